@@ -2,30 +2,38 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include "net/base/ip_endpoint.h"
 #include "net/base/net_errors.h"
-#include "net/dns/host_resolver_proc.h"
-#include "net/quic/address_utils.h"
-#include "net/quic/quic_chromium_packet_writer.h"
 #include "net/quic/raw_quic/raw_quic.h"
 #include "net/quic/raw_quic/raw_quic_context.h"
-#include "net/socket/udp_client_socket.h"
-#include "net/third_party/quiche/src/quic/core/quic_utils.h"
-#include "net/third_party/quiche/src/quic/core/quic_versions.h"
-#include "url/gurl.h"
+#include "net/quic/raw_quic/raw_quic_server.h"
+#include "net/quic/raw_quic/raw_quic_session_pool.h"
 
 namespace net {
 
 namespace {
-const int32_t kQuicSocketReceiveBufferSize = 1024 * 1024;  // 1MB
-const int32_t kMaxIdleNetworkTimeout = 30;
-const int32_t kDefaultIdleNetworkTimeout = 30;
-const int32_t kSetMaxTimeBeforeCryptoHandshake = 10;
-const int32_t kSetMaxIdleTimeBeforeCryptoHandshake = 5;
 const int32_t kMinSendBufferSize = 8 * 1024;
 const int32_t kMinRecvBufferSize = 8 * 1024;
 const int32_t kDefaultSendBufferSize = 512 * 1024;
 const int32_t kDefaultRecvBufferSize = 512 * 1024;
 const int32_t kReadOnceSize = 32 * 1024;
+const uint32_t kCoalesceBufferSize = 16 * 1024;
+const uint32_t kMaxCoalesceDelayUs = 200 * 1000;
+const uint32_t kDefaultBandwidthChangePercent = 20;
+const uint32_t kDefaultRttChangePercent = 20;
+const uint32_t kDefaultQueueDelayChangePercent = 50;
+const uint32_t kDefaultBandwidthReportIntervalMs = 50;
+// Changes of values below these are noise, not worth a report.
+const int64_t kMinRttChangeBaseUs = 1000;
+const int64_t kMinQueueDelayChangeBaseUs = 10 * 1000;
+
+bool IsChanged(int64_t value, int64_t reported, int64_t base, uint32_t percent) {
+  if (percent == 0) {
+    return false;
+  }
+  int64_t diff = value > reported ? value - reported : reported - value;
+  return diff > 0 && diff * 100 >= std::max(reported, base) * percent;
+}
 }  // namespace
 
 ///////////////////////////////////RawQuicStreamVisitor///////////////////////////////////////
@@ -33,6 +41,16 @@ RawQuicStreamVisitor::RawQuicStreamVisitor(DataDelegate* data_delegate) {
   data_delegate_ = data_delegate;
 }
 
+RawQuicStreamVisitor::~RawQuicStreamVisitor() {
+  if (data_delegate_) {
+    data_delegate_->OnStreamDestroyed();
+  }
+}
+
+void RawQuicStreamVisitor::Detach() {
+  data_delegate_ = nullptr;
+}
+
 void RawQuicStreamVisitor::OnCanRead() {
   if (data_delegate_) {
     data_delegate_->OnCanRead();
@@ -55,13 +73,25 @@ void RawQuicStreamVisitor::OnCanWrite() {
 RawQuic::RawQuic(RawQuicCallbacks callback, void* opaque, bool verify)
     : callback_(callback),
       opaque_(opaque),
+      shutdown_callback_(nullptr),
+      closed_callback_(nullptr),
+      migrate_callback_(nullptr),
+      bandwidth_callback_(nullptr),
       verify_(verify),
       status_(RAW_QUIC_STATUS_IDLE),
+      shutting_down_(false),
+      write_closed_(false),
       send_buffer_size_(kDefaultSendBufferSize),
       recv_buffer_size_(kDefaultRecvBufferSize),
-      temp_read_buffer_(new uint8_t[kReadOnceSize]),
+      temp_read_buffer_(GetBufferPool()->Allocate(kReadOnceSize)),
       read_istream_(&read_buffer_),
-      read_ostream_(&read_buffer_) {}
+      read_ostream_(&read_buffer_) {
+  bandwidth_thresholds_.bandwidth_percent = kDefaultBandwidthChangePercent;
+  bandwidth_thresholds_.rtt_percent = kDefaultRttChangePercent;
+  bandwidth_thresholds_.queue_delay_percent = kDefaultQueueDelayChangePercent;
+  bandwidth_thresholds_.min_interval_ms = kDefaultBandwidthReportIntervalMs;
+  memset(&reported_bandwidth_info_, 0, sizeof(reported_bandwidth_info_));
+}
 
 RawQuic::~RawQuic() {}
 
@@ -113,6 +143,30 @@ int32_t RawQuic::Connect(const char* host,
   return ret;
 }
 
+void RawQuic::Accept(RawQuicServerSession* server_session,
+                     quic::QuicTransportStream* stream) {
+  host_.clear();
+  port_ = 0;
+  context_ = server_session->context();
+  path_ = server_session->path();
+  fin_pending_ = false;
+  fin_sent_ = false;
+  write_closed_.store(false);
+  {
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    fin_received_ = false;
+  }
+  server_session_ = server_session;
+  session_ = server_session;
+  server_session->AddUser(this);
+
+  AttachStream(stream);
+  status_.store(RAW_QUIC_STATUS_CONNECTED);
+
+  // Data may have arrived before the handle, read it once the app has it.
+  PostCommand(RAW_QUIC_COMMAND_READ, nullptr, 0);
+}
+
 void RawQuic::Close() {
   IntPromisePtr promise(new IntPromise);
 
@@ -123,6 +177,112 @@ void RawQuic::Close() {
   future.get();
 }
 
+void RawQuic::CloseAsync() {
+  GetContext()->Post(
+      base::Bind(&RawQuic::DoCloseAsync, base::Unretained(this)));
+}
+
+int32_t RawQuic::Shutdown(int32_t linger_ms) {
+  int32_t status = status_.load();
+  if (status != RAW_QUIC_STATUS_CONNECTED || shutting_down_.exchange(true)) {
+    return RAW_QUIC_ERROR_CODE_INVALID_STATE;
+  }
+  write_closed_.store(true);
+
+  {
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    corked_ = false;
+    PostPendingWrite();
+  }
+
+  GetContext()->Post(base::Bind(&RawQuic::DoShutdown, base::Unretained(this),
+                                std::max<int32_t>(linger_ms, 0)));
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RawQuic::ShutdownWrite() {
+  int32_t status = status_.load();
+  if (status != RAW_QUIC_STATUS_CONNECTED || write_closed_.exchange(true)) {
+    return RAW_QUIC_ERROR_CODE_INVALID_STATE;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(write_mutex_);
+    corked_ = false;
+    PostPendingWrite();
+  }
+
+  GetContext()->Post(
+      base::Bind(&RawQuic::DoShutdownWrite, base::Unretained(this)));
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RawQuic::Migrate(const char* local_ip, int32_t timeout) {
+  int32_t ret = RAW_QUIC_ERROR_CODE_SUCCESS;
+  do {
+    int32_t status = status_.load();
+    if (status != RAW_QUIC_STATUS_CONNECTED) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    IntPromisePtr promise;
+    if (timeout != 0) {
+      promise.reset(new IntPromise);
+    }
+
+    GetContext()->Post(base::Bind(
+        &RawQuic::DoMigrate, base::Unretained(this),
+        local_ip == NULL ? "" : std::string(local_ip), promise));
+
+    if (promise == NULL) {
+      break;
+    }
+
+    IntFuture future = promise->get_future();
+    if (timeout < 0) {
+      ret = future.get();
+      break;
+    }
+
+    std::future_status wait_ret = future.wait_until(
+        std::chrono::system_clock::now() + std::chrono::milliseconds(timeout));
+    if (wait_ret == std::future_status::ready) {
+      ret = future.get();
+      break;
+    }
+
+    ret = RAW_QUIC_ERROR_CODE_TIMEOUT;
+  } while (0);
+  return ret;
+}
+
+int32_t RawQuic::EnableMultipath(const RawQuicMultipathConfig* config) {
+  int32_t ret = RAW_QUIC_ERROR_CODE_SUCCESS;
+  do {
+    if (config == nullptr || config->local_ip == nullptr) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+
+    int32_t status = status_.load();
+    if (status != RAW_QUIC_STATUS_CONNECTED) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    IntPromisePtr promise(new IntPromise);
+    GetContext()->Post(base::Bind(
+        &RawQuic::DoEnableMultipath, base::Unretained(this),
+        std::string(config->local_ip), config->scheduler,
+        config->primary_delay_ms, config->secondary_delay_ms, promise));
+
+    IntFuture future = promise->get_future();
+    ret = future.get();
+  } while (0);
+  return ret;
+}
+
 int32_t RawQuic::Write(uint8_t* data, uint32_t size) {
   int32_t ret = RAW_QUIC_ERROR_CODE_SUCCESS;
   do {
@@ -132,17 +292,24 @@ int32_t RawQuic::Write(uint8_t* data, uint32_t size) {
     }
 
     int32_t status = status_.load();
-    if (status != RAW_QUIC_STATUS_CONNECTED) {
+    if (status != RAW_QUIC_STATUS_CONNECTED || write_closed_.load()) {
       ret = RAW_QUIC_ERROR_CODE_INVALID_STATE;
       break;
     }
 
-    std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
+    {
+      std::unique_lock<std::mutex> lock(write_mutex_);
+      if (corked_ || coalesce_delay_us_ > 0) {
+        ret = WriteCoalesced(data, size);
+        break;
+      }
+    }
+
+    RawQuicBufferPtr buffer(GetBufferPool()->Allocate(size));
     memcpy(buffer.get(), data, size);
     ret = size;
 
-    GetContext()->Post(base::Bind(&RawQuic::DoWrite, base::Unretained(this),
-                                  buffer.release(), size));
+    PostWrite(std::move(buffer), size, GetTimeUs());
   } while (0);
   return ret;
 }
@@ -162,12 +329,23 @@ int32_t RawQuic::Read(uint8_t* data, uint32_t size, int32_t timeout) {
     }
 
     std::unique_lock<std::mutex> lock(read_mutex_);
+    if (peeking_) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
     bool wait = true;
-    while (read_buffer_.size() == 0) {
-      // Try filling read buffer once, worker thread will gain
-      // lock after current thread called wait or run out.
-      GetContext()->Post(
-          base::Bind(&RawQuic::OnCanRead, base::Unretained(this)));
+    while (read_buffer_.size() == 0 && !fin_received_) {
+      // Try filling read buffer once. PostCommand waits for room in the
+      // command ring, which the IO thread frees, and it may be waiting for
+      // read_mutex_ in OnCanRead, so post unlocked.
+      lock.unlock();
+      PostCommand(RAW_QUIC_COMMAND_READ, nullptr, 0);
+      lock.lock();
+      if (read_buffer_.size() > 0 || fin_received_) {
+        break;
+      }
+
       if (timeout > 0) {
         read_cond_.wait_until(lock, std::chrono::system_clock::now() +
                                         std::chrono::milliseconds(timeout));
@@ -180,27 +358,125 @@ int32_t RawQuic::Read(uint8_t* data, uint32_t size, int32_t timeout) {
       }
     }
 
+    // Peek may have pinned the buffer while unlocked.
+    if (peeking_) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
     uint32_t read_len = std::min<uint32_t>(size, read_buffer_.size());
     if (read_len == 0) {
-      ret = wait ? RAW_QUIC_ERROR_CODE_TIMEOUT : RAW_QUIC_ERROR_CODE_EAGAIN;
+      if (fin_received_) {
+        ret = RAW_QUIC_ERROR_CODE_STREAM_FIN;
+      } else {
+        ret = wait ? RAW_QUIC_ERROR_CODE_TIMEOUT : RAW_QUIC_ERROR_CODE_EAGAIN;
+      }
       break;
     }
 
     read_istream_.read((char*)data, read_len);
+    OnReadBufferConsumed(read_len);
     ret = read_len;
   } while (0);
 
   return ret;
 }
 
+int32_t RawQuic::Peek(const RawQuicIovec** regions, int* count) {
+  int32_t ret = RAW_QUIC_ERROR_CODE_SUCCESS;
+  bool post_read = false;
+  do {
+    if (regions == nullptr || count == nullptr) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+
+    *regions = nullptr;
+    *count = 0;
+
+    int32_t status = status_.load();
+    if (status != RAW_QUIC_STATUS_CONNECTED) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    if (read_buffer_.size() == 0) {
+      if (fin_received_) {
+        ret = RAW_QUIC_ERROR_CODE_STREAM_FIN;
+        break;
+      }
+      // Posted once read_mutex_ is released, see Read.
+      post_read = true;
+      ret = RAW_QUIC_ERROR_CODE_EAGAIN;
+      break;
+    }
+
+    // Pin the read buffer, FillReadBuffer may move or reallocate it.
+    peeking_ = true;
+
+    int32_t region_count = 0;
+    uint32_t total = 0;
+    boost::asio::streambuf::const_buffers_type buffers = read_buffer_.data();
+    for (auto it = buffers.begin();
+         it != buffers.end() && region_count < kMaxPeekRegions; ++it) {
+      boost::asio::const_buffer buffer(*it);
+      uint32_t len = (uint32_t)boost::asio::buffer_size(buffer);
+      if (len == 0) {
+        continue;
+      }
+      peek_regions_[region_count].base =
+          boost::asio::buffer_cast<const uint8_t*>(buffer);
+      peek_regions_[region_count].len = len;
+      total += len;
+      ++region_count;
+    }
+
+    *regions = peek_regions_;
+    *count = region_count;
+    ret = total;
+  } while (0);
+
+  if (post_read) {
+    PostCommand(RAW_QUIC_COMMAND_READ, nullptr, 0);
+  }
+  return ret;
+}
+
+int32_t RawQuic::Consume(uint32_t size) {
+  int32_t ret = RAW_QUIC_ERROR_CODE_SUCCESS;
+  bool post_read = false;
+  do {
+    std::unique_lock<std::mutex> lock(read_mutex_);
+    if (!peeking_) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    uint32_t consume_len = std::min<uint32_t>(size, read_buffer_.size());
+    read_buffer_.consume(consume_len);
+    OnReadBufferConsumed(consume_len);
+    peeking_ = false;
+    ret = consume_len;
+
+    // Refill what was held back in the stream while pinned, posted once
+    // read_mutex_ is released, see Read.
+    post_read = true;
+  } while (0);
+
+  if (post_read) {
+    PostCommand(RAW_QUIC_COMMAND_READ, nullptr, 0);
+  }
+  return ret;
+}
+
 int32_t RawQuic::GetRecvBufferDataSize() {
   std::unique_lock<std::mutex> lock(read_mutex_);
   return (int32_t)read_buffer_.size();
 }
 
 void RawQuic::SetSendBufferSize(uint32_t size) {
-  GetContext()->Post(
-      base::Bind(&RawQuic::DoSetSendBufferSize, base::Unretained(this), size));
+  PostCommand(RAW_QUIC_COMMAND_SET_SEND_BUFFER_SIZE, nullptr, size);
 }
 
 uint32_t RawQuic::GetSendBufferSize() {
@@ -208,8 +484,72 @@ uint32_t RawQuic::GetSendBufferSize() {
 }
 
 void RawQuic::SetRecvBufferSize(uint32_t size) {
-  GetContext()->Post(
-      base::Bind(&RawQuic::DoSetRecvBufferSize, base::Unretained(this), size));
+  PostCommand(RAW_QUIC_COMMAND_SET_RECV_BUFFER_SIZE, nullptr, size);
+}
+
+int32_t RawQuic::GetStats(RawQuicStats* out) {
+  if (out == nullptr) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  // Only copies on IO thread, the caller waits rather than the IO thread.
+  // Callbacks already run there, a posted task would wait for them.
+  IntPromisePtr promise(new IntPromise);
+  RawQuicContext* context = GetContext();
+  if (context->BelongsToCurrentThread()) {
+    DoGetStats(out, promise);
+  } else {
+    context->Post(base::Bind(&RawQuic::DoGetStats, base::Unretained(this),
+                             out, promise));
+  }
+
+  IntFuture future = promise->get_future();
+  return future.get();
+}
+
+void RawQuic::SetBandwidthThresholds(
+    const RawQuicBandwidthThresholds& thresholds) {
+  GetContext()->Post(base::Bind(&RawQuic::DoSetBandwidthThresholds,
+                                base::Unretained(this), thresholds));
+}
+
+void RawQuic::GetLatencyStats(RawQuicLatencyStats* out, bool reset) {
+  latency_histograms_.Snapshot(out, reset);
+}
+
+void RawQuic::Cork() {
+  std::unique_lock<std::mutex> lock(write_mutex_);
+  corked_ = true;
+}
+
+void RawQuic::Uncork() {
+  std::unique_lock<std::mutex> lock(write_mutex_);
+  corked_ = false;
+  PostPendingWrite();
+}
+
+void RawQuic::SetCoalesceDelay(uint32_t delay_us) {
+  std::unique_lock<std::mutex> lock(write_mutex_);
+  coalesce_delay_us_ = std::min<uint32_t>(delay_us, kMaxCoalesceDelayUs);
+  if (coalesce_delay_us_ == 0 && !corked_) {
+    PostPendingWrite();
+  }
+}
+
+void RawQuic::SetShutdownCallback(ShutdownCallback callback) {
+  shutdown_callback_.store(callback);
+}
+
+void RawQuic::SetClosedCallback(ClosedCallback callback) {
+  closed_callback_.store(callback);
+}
+
+void RawQuic::SetMigrateCallback(MigrateCallback callback) {
+  migrate_callback_.store(callback);
+}
+
+void RawQuic::SetBandwidthCallback(BandwidthCallback callback) {
+  bandwidth_callback_.store(callback);
 }
 
 void RawQuic::DoConnect(const std::string& host,
@@ -221,55 +561,61 @@ void RawQuic::DoConnect(const std::string& host,
     host_ = host;
     port_ = port;
     path_ = path;
-    std::string url = base::StringPrintf(
-        "quic-transport://%s:%d/%s", host_.c_str(), (int)port, path_.c_str());
-    url_ = GURL(url);
-    status_.store(RAW_QUIC_STATUS_CONNECTING);
-
-    net::AddressList address_list;
-    ret = Resolve(host_, &address_list);
-    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
-      break;
+    fin_pending_ = false;
+    fin_sent_ = false;
+    write_closed_.store(false);
+    {
+      std::unique_lock<std::mutex> lock(read_mutex_);
+      fin_received_ = false;
     }
+    status_.store(RAW_QUIC_STATUS_CONNECTING);
+    connect_promise_ = promise;
 
-    if (address_list.empty()) {
-      ret.error = RAW_QUIC_ERROR_CODE_RESOLVE_FAILED;
-      break;
+    // Adopt a pooled or preconnected session to the same origin if any.
+    RawQuicSessionKey key = {host_, port_, path_, verify_};
+    RawQuicSessionPool* pool = GetContext()->GetSessionPool();
+    RawQuicPooledSession* pooled_session = pool->Find(key);
+    if (pooled_session == nullptr) {
+      ret = pool->Create(key, &pooled_session);
+      if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+        break;
+      }
     }
 
-    net::IPEndPoint endpoint = *address_list.begin();
-    net::IPAddress addr = endpoint.address();
-    net::IPEndPoint dest(addr, port);
-
-    ret = CreateSession(dest);
-    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
-      break;
+    AttachSession(pooled_session);
+    pooled_session->Connect();
+    if (session_ != nullptr && pooled_session_->session()->IsSessionReady()) {
+      OnSessionReady();
     }
   } while (0);
 
   if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
     status_.store(RAW_QUIC_STATUS_IDLE);
+    connect_promise_ = nullptr;
     if (promise != nullptr) {
       promise->set_value(ret.error);
     } else if (callback_.connect_callback != nullptr) {
       callback_.connect_callback(this, &ret, opaque_);
     }
-  } else {
-    connect_promise_ = promise;
   }
 }
 
 void RawQuic::DoClose(IntPromisePtr promise) {
-  if (session_ != nullptr) {
-    quic::QuicConnection* connection = session_->connection();
-    if (connection != nullptr) {
-      status_.store(RAW_QUIC_STATUS_CLOSING);
-      connection->CloseConnection(
-          quic::QUIC_NO_ERROR, "Client shutdown.",
-          quic::ConnectionCloseBehavior::SEND_CONNECTION_CLOSE_PACKET);
-    }
-    session_ = nullptr;
+  // Run commands still queued for this handle before it goes away.
+  GetContext()->DrainCommands();
+
+  if (flush_alarm_ != nullptr) {
+    flush_alarm_->Cancel();
+    flush_alarm_.reset();
+  }
+
+  if (shutdown_alarm_ != nullptr) {
+    shutdown_alarm_->Cancel();
+    shutdown_alarm_.reset();
   }
+  shutting_down_.store(false);
+
+  CloseSession("Client shutdown.");
 
   status_.store(RAW_QUIC_STATUS_CLOSED);
   if (promise != nullptr) {
@@ -277,25 +623,336 @@ void RawQuic::DoClose(IntPromisePtr promise) {
   }
 }
 
-void RawQuic::DoWrite(uint8_t* data, uint32_t size) {
+void RawQuic::DoCloseAsync() {
+  DoClose(nullptr);
+
+  // Session not kept by pool is deleted by a task posted in DoClose,
+  // finish after it.
+  GetContext()->Post(
+      base::Bind(&RawQuic::OnCloseAsyncDone, base::Unretained(this)));
+}
+
+void RawQuic::OnCloseAsyncDone() {
+  ClosedCallback closed_callback = closed_callback_.load();
+  if (closed_callback != nullptr) {
+    closed_callback(this, opaque_);
+  }
+  delete this;
+}
+
+void RawQuic::DoShutdownWrite() {
+  // Flush commands still queued, writes must go out before FIN.
+  GetContext()->DrainCommands();
+
+  if (stream_ == nullptr) {
+    return;
+  }
+
+  fin_pending_ = true;
+  FlushWriteBuffer();
+}
+
+void RawQuic::DoMigrate(const std::string& local_ip, IntPromisePtr promise) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  do {
+    if (pooled_session_ == nullptr || stream_ == nullptr ||
+        migrate_promise_ != nullptr) {
+      ret.error = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    // Without local ip, rebind to a new port on the default interface.
+    net::IPEndPoint local_address;
+    if (!local_ip.empty()) {
+      net::IPAddress address;
+      if (!address.AssignFromIPLiteral(local_ip)) {
+        ret.error = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+        break;
+      }
+      local_address = net::IPEndPoint(address, 0);
+    }
+
+    migrate_promise_ = promise;
+    ret = pooled_session_->Migrate(
+        this, local_ip.empty() ? nullptr : &local_address);
+    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      migrate_promise_ = nullptr;
+    }
+  } while (0);
+
+  if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    MigrateCallback migrate_callback = migrate_callback_.load();
+    if (promise != nullptr) {
+      promise->set_value(ret.error);
+    } else if (migrate_callback != nullptr) {
+      migrate_callback(this, &ret, opaque_);
+    }
+  }
+}
+
+void RawQuic::OnMigrated(RawQuicError* error) {
+  MigrateCallback migrate_callback = migrate_callback_.load();
+  if (migrate_promise_ != nullptr) {
+    migrate_promise_->set_value(error->error);
+    migrate_promise_ = nullptr;
+  } else if (migrate_callback != nullptr) {
+    migrate_callback(this, error, opaque_);
+  }
+}
+
+void RawQuic::DoEnableMultipath(const std::string& local_ip,
+                                RawQuicMultipathScheduler scheduler,
+                                uint32_t primary_delay_ms,
+                                uint32_t secondary_delay_ms,
+                                IntPromisePtr promise) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  do {
+    if (pooled_session_ == nullptr || migrate_promise_ != nullptr) {
+      ret.error = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    net::IPAddress address;
+    if (!address.AssignFromIPLiteral(local_ip)) {
+      ret.error = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+
+    ret = pooled_session_->EnableMultipath(net::IPEndPoint(address, 0),
+                                           scheduler, primary_delay_ms,
+                                           secondary_delay_ms);
+  } while (0);
+
+  promise->set_value(ret.error);
+}
+
+void RawQuic::DoShutdown(int32_t linger_ms) {
+  // Flush commands still queued, writes must go out before FIN.
+  GetContext()->DrainCommands();
+
+  if (!shutting_down_.load()) {
+    return;
+  }
+
+  if (session_ == nullptr || stream_ == nullptr) {
+    RawQuicError ret = {RAW_QUIC_ERROR_CODE_INVALID_STATE, 0, 0};
+    FinishShutdown(&ret);
+    return;
+  }
+
+  fin_pending_ = true;
+  shutdown_deadline_ = GetContext()->GetQuicClock()->ApproximateNow() +
+                       quic::QuicTime::Delta::FromMilliseconds(linger_ms);
+  FlushWriteBuffer();
+
+  if (shutdown_alarm_ == nullptr) {
+    shutdown_alarm_.reset(GetContext()->GetQuicAlarmFactory()->CreateAlarm(
+        new AlarmDelegate(this, &RawQuic::CheckShutdown)));
+  }
+  CheckShutdown();
+}
+
+void RawQuic::CheckShutdown() {
+  if (!shutting_down_.load()) {
+    return;
+  }
+
+  // Stream is only deleted after both sides closed and all data acked.
+  quic::QuicTime now = GetContext()->GetQuicClock()->ApproximateNow();
+  if (stream_ == nullptr ||
+      (fin_sent_ && !stream_->IsWaitingForAcks())) {
+    RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+    FinishShutdown(&ret);
+  } else if (now >= shutdown_deadline_) {
+    RawQuicError ret = {RAW_QUIC_ERROR_CODE_TIMEOUT, 0, 0};
+    FinishShutdown(&ret);
+  } else {
+    // OnStreamFrameAcked checks again on every ack, the alarm only waits
+    // for the linger deadline.
+    shutdown_alarm_->Update(shutdown_deadline_, quic::QuicTime::Delta::Zero());
+  }
+}
+
+void RawQuic::FinishShutdown(RawQuicError* error) {
+  if (shutdown_alarm_ != nullptr) {
+    shutdown_alarm_->Cancel();
+  }
+
+  shutting_down_.store(false);
+  fin_pending_ = false;
+  CloseSession("Client shutdown.");
+  status_.store(RAW_QUIC_STATUS_CLOSED);
+
+  ShutdownCallback shutdown_callback = shutdown_callback_.load();
+  if (shutdown_callback != nullptr) {
+    shutdown_callback(this, error, opaque_);
+  }
+}
+
+void RawQuic::CloseSession(const std::string& details) {
+  if (pooled_session_ != nullptr) {
+    status_.store(RAW_QUIC_STATUS_CLOSING);
+    // Pool resets the stream if the connection is kept for other handles,
+    // otherwise closes the connection and deletes the session later.
+    RawQuicPooledSession* pooled_session = pooled_session_;
+    quic::QuicTransportStream* stream = stream_;
+    DetachSession();
+    pooled_session->RemoveUser(this, stream, details);
+  } else if (server_session_ != nullptr) {
+    status_.store(RAW_QUIC_STATUS_CLOSING);
+    RawQuicServerSession* server_session = server_session_;
+    quic::QuicTransportStream* stream = stream_;
+    DetachSession();
+    server_session->RemoveUser(this, stream);
+  }
+  stream_ = nullptr;
+}
+
+void RawQuic::AttachSession(RawQuicPooledSession* pooled_session) {
+  pooled_session_ = pooled_session;
+  session_ = pooled_session->session();
+  pooled_session->AddUser(this);
+}
+
+void RawQuic::DetachSession() {
+  // Migration result of a session left is never reported.
+  if (migrate_promise_ != nullptr) {
+    migrate_promise_->set_value(RAW_QUIC_ERROR_CODE_INVALID_STATE);
+    migrate_promise_ = nullptr;
+  }
+
+  if (stream_visitor_ != nullptr) {
+    stream_visitor_->Detach();
+    stream_visitor_ = nullptr;
+  }
+  stream_ = nullptr;
+  session_ = nullptr;
+  pooled_session_ = nullptr;
+  server_session_ = nullptr;
+}
+
+void RawQuic::AttachStream(quic::QuicTransportStream* stream) {
+  stream_ = stream;
+  stream_write_offset_ = 0;
+  unacked_writes_.clear();
+
+  std::unique_ptr<RawQuicStreamVisitor> stream_visitor =
+      std::make_unique<RawQuicStreamVisitor>(this);
+  stream_visitor_ = stream_visitor.get();
+  stream_->set_visitor(std::move(stream_visitor));
+}
+
+quic::QuicTime RawQuic::GetLastPacketReceiptTime() {
+  if (pooled_session_ != nullptr) {
+    return pooled_session_->session()->last_packet_receipt_time();
+  }
+  if (server_session_ != nullptr) {
+    return server_session_->last_packet_receipt_time();
+  }
+  return quic::QuicTime::Zero();
+}
+
+void RawQuic::DoWrite(uint8_t* data, uint32_t size, int64_t time_us) {
+  // Buffer was allocated from the pool by the caller thread.
+  RawQuicBufferPtr buffer(data);
   if (buffered_write_data_size_ + size >= send_buffer_size_) {
     LOG(ERROR) << "Send buffer overflow.";
     if (callback_.error_callback != nullptr) {
       RawQuicError ret = {RAW_QUIC_ERROR_CODE_BUFFER_OVERFLOWED, 0, 0};
       callback_.error_callback(this, &ret, opaque_);
     }
-    if (data != nullptr) {
-      delete [] data;
-    }
     return;
   }
 
-  write_queue_.emplace((char*)data, size, true);
+  write_queue_.emplace(std::move(buffer), size, time_us);
   buffered_write_data_size_ += size;
 
   if (stream_ != nullptr && stream_->visitor() != nullptr) {
     stream_->visitor()->OnCanWrite();
   }
+
+  // Queue delay grows with writes as well as with acks.
+  if (bandwidth_callback_.load() != nullptr) {
+    MaybeReportBandwidth(GetContext()->GetQuicClock()->ApproximateNow());
+  }
+}
+
+// Called with write_mutex_ held.
+int32_t RawQuic::WriteCoalesced(uint8_t* data, uint32_t size) {
+  if (pending_write_size_ + size > kCoalesceBufferSize) {
+    PostPendingWrite();
+  }
+
+  // Too large to coalesce, bypass the pending buffer.
+  if (size >= kCoalesceBufferSize) {
+    RawQuicBufferPtr buffer(GetBufferPool()->Allocate(size));
+    memcpy(buffer.get(), data, size);
+    PostWrite(std::move(buffer), size, GetTimeUs());
+    return size;
+  }
+
+  if (pending_write_ == nullptr) {
+    pending_write_.reset(GetBufferPool()->Allocate(kCoalesceBufferSize));
+  }
+  // Latency of coalesced data counts from its oldest write.
+  if (pending_write_size_ == 0) {
+    pending_write_time_us_ = GetTimeUs();
+  }
+  memcpy(pending_write_.get() + pending_write_size_, data, size);
+  pending_write_size_ += size;
+
+  if (!corked_ && !flush_scheduled_) {
+    flush_scheduled_ = true;
+    GetContext()->Post(base::Bind(&RawQuic::DoScheduleFlush,
+                                  base::Unretained(this), coalesce_delay_us_));
+  }
+  return size;
+}
+
+// Called with write_mutex_ held.
+void RawQuic::PostPendingWrite() {
+  if (pending_write_size_ == 0) {
+    return;
+  }
+
+  PostWrite(std::move(pending_write_), pending_write_size_,
+            pending_write_time_us_);
+  pending_write_size_ = 0;
+}
+
+void RawQuic::PostWrite(RawQuicBufferPtr buffer,
+                        uint32_t size,
+                        int64_t time_us) {
+  RawQuicCommand command = {this, RAW_QUIC_COMMAND_WRITE, buffer.release(),
+                            size, time_us};
+  GetContext()->PostCommand(command);
+}
+
+void RawQuic::PostCommand(int32_t type, uint8_t* data, uint32_t size) {
+  RawQuicCommand command = {this, type, data, size, 0};
+  GetContext()->PostCommand(command);
+}
+
+void RawQuic::DoScheduleFlush(uint32_t delay_us) {
+  if (flush_alarm_ == nullptr) {
+    flush_alarm_.reset(GetContext()->GetQuicAlarmFactory()->CreateAlarm(
+        new AlarmDelegate(this, &RawQuic::DoFlushPendingWrite)));
+  }
+
+  if (!flush_alarm_->IsSet()) {
+    flush_alarm_->Set(GetContext()->GetQuicClock()->ApproximateNow() +
+                      quic::QuicTime::Delta::FromMicroseconds(delay_us));
+  }
+}
+
+void RawQuic::DoFlushPendingWrite() {
+  std::unique_lock<std::mutex> lock(write_mutex_);
+  flush_scheduled_ = false;
+  if (!corked_) {
+    // Post rather than write directly, so it is queued after any write
+    // already posted by the caller thread.
+    PostPendingWrite();
+  }
 }
 
 void RawQuic::DoSetSendBufferSize(uint32_t size) {
@@ -312,153 +969,211 @@ void RawQuic::DoSetRecvBufferSize(uint32_t size) {
   recv_buffer_size_ = size;
 }
 
-RawQuicContext* RawQuic::GetContext() {
-  return RawQuicContext::GetInstance();
-}
+void RawQuic::DoGetStats(RawQuicStats* out, IntPromisePtr promise) {
+  memset(out, 0, sizeof(RawQuicStats));
+  out->send_buffer_bytes = buffered_write_data_size_;
+  out->send_buffer_size = send_buffer_size_;
+  out->recv_buffer_bytes = calling_can_read_ ? (int32_t)read_buffer_.size()
+                                             : GetRecvBufferDataSize();
+  out->recv_buffer_size = recv_buffer_size_;
 
-RawQuicError RawQuic::Resolve(const std::string& host,
-                              net::AddressList* addrlist) {
-  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
-  int32_t os_error = 0;
-  ret.net_error = net::SystemHostResolverCall(
-      host, net::ADDRESS_FAMILY_UNSPECIFIED, 0, addrlist, &os_error);
-  if (ret.net_error != net::OK || os_error != 0) {
-    ret.error = RAW_QUIC_ERROR_CODE_RESOLVE_FAILED;
-    LOG(ERROR) << "Resolve " << host << " failed, error:" << os_error;
+  if (session_ == nullptr) {
+    promise->set_value(RAW_QUIC_ERROR_CODE_INVALID_STATE);
+    return;
   }
-  return ret;
+
+  quic::QuicConnection* connection = session_->connection();
+  const quic::QuicConnectionStats& stats = connection->GetStats();
+  out->packets_sent = stats.packets_sent;
+  out->bytes_sent = stats.bytes_sent;
+  out->packets_received = stats.packets_received;
+  out->bytes_received = stats.bytes_received;
+  out->packets_lost = stats.packets_lost;
+  out->packets_retransmitted = stats.packets_retransmitted;
+  out->bytes_retransmitted = stats.bytes_retransmitted;
+
+  const quic::QuicSentPacketManager& sent_packet_manager =
+      connection->sent_packet_manager();
+  const quic::RttStats* rtt_stats = sent_packet_manager.GetRttStats();
+  out->min_rtt_us = rtt_stats->min_rtt().ToMicroseconds();
+  out->smoothed_rtt_us = rtt_stats->smoothed_rtt().ToMicroseconds();
+  out->latest_rtt_us = rtt_stats->latest_rtt().ToMicroseconds();
+
+  quic::QuicByteCount bytes_in_flight = sent_packet_manager.GetBytesInFlight();
+  out->bandwidth_estimate_bps =
+      sent_packet_manager.BandwidthEstimate().ToBitsPerSecond();
+  out->pacing_rate_bps = sent_packet_manager.GetSendAlgorithm()
+                             ->PacingRate(bytes_in_flight)
+                             .ToBitsPerSecond();
+  out->cwnd_bytes = sent_packet_manager.GetCongestionWindowInBytes();
+  out->bytes_in_flight = bytes_in_flight;
+
+  promise->set_value(RAW_QUIC_ERROR_CODE_SUCCESS);
 }
 
-RawQuicError RawQuic::CreateSession(const net::IPEndPoint& dest) {
-  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+void RawQuic::DoSetBandwidthThresholds(RawQuicBandwidthThresholds thresholds) {
+  bandwidth_thresholds_ = thresholds;
+}
 
-  auto socket = std::unique_ptr<net::DatagramClientSocket>(
-      new net::UDPClientSocket(net::DatagramSocket::DEFAULT_BIND,
-                               GetContext()->GetNetLogWithSource()->net_log(),
-                               GetContext()->GetNetLogWithSource()->source()));
-  ret = ConfigureSocket(socket.get(), dest);
-  if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
-    return ret;
+void RawQuic::OnCongestionChange(quic::QuicTime now) {
+  if (bandwidth_callback_.load() != nullptr) {
+    MaybeReportBandwidth(now);
   }
+}
 
-  auto connection = CreateConnection(socket.get(), dest);
+void RawQuic::MaybeReportBandwidth(quic::QuicTime now) {
+  if (session_ == nullptr || stream_ == nullptr) {
+    return;
+  }
 
-  auto crypto_config = std::make_unique<quic::QuicCryptoClientConfig>(
-      GetContext()->CreateProofVerifier(host_, verify_));
+  if (last_bandwidth_report_time_.IsInitialized() &&
+      now - last_bandwidth_report_time_ <
+          quic::QuicTime::Delta::FromMilliseconds(
+              bandwidth_thresholds_.min_interval_ms)) {
+    return;
+  }
 
-  std::string url = std::string("https://") + host_;
-  GURL origin_url(url);
-  url::Origin origin = url::Origin::Create(origin_url);
+  const quic::QuicSentPacketManager& sent_packet_manager =
+      session_->connection()->sent_packet_manager();
+  const quic::RttStats* rtt_stats = sent_packet_manager.GetRttStats();
+  quic::QuicBandwidth bandwidth = sent_packet_manager.BandwidthEstimate();
+
+  RawQuicBandwidthInfo info;
+  info.bandwidth_estimate_bps = bandwidth.ToBitsPerSecond();
+  info.smoothed_rtt_us = rtt_stats->smoothed_rtt().ToMicroseconds();
+  info.min_rtt_us = rtt_stats->min_rtt().ToMicroseconds();
+  info.send_buffer_bytes = buffered_write_data_size_;
+  info.queue_delay_us =
+      bandwidth.IsZero()
+          ? 0
+          : bandwidth.TransferTime(buffered_write_data_size_).ToMicroseconds();
+
+  if (!IsChanged(info.bandwidth_estimate_bps,
+                 reported_bandwidth_info_.bandwidth_estimate_bps, 0,
+                 bandwidth_thresholds_.bandwidth_percent) &&
+      !IsChanged(info.smoothed_rtt_us, reported_bandwidth_info_.smoothed_rtt_us,
+                 kMinRttChangeBaseUs, bandwidth_thresholds_.rtt_percent) &&
+      !IsChanged(info.queue_delay_us, reported_bandwidth_info_.queue_delay_us,
+                 kMinQueueDelayChangeBaseUs,
+                 bandwidth_thresholds_.queue_delay_percent)) {
+    return;
+  }
 
-  session_ = std::make_unique<RawQuicSession>(
-      std::move(connection), std::move(socket), GetContext()->GetQuicClock(),
-      this, DefaultQuicConfig(), GetVersions(), url_, std::move(crypto_config),
-      origin, this);
-  session_->Initialize();
-  session_->CryptoConnect();
+  BandwidthCallback bandwidth_callback = bandwidth_callback_.load();
+  if (bandwidth_callback == nullptr) {
+    return;
+  }
 
-  return ret;
+  last_bandwidth_report_time_ = now;
+  reported_bandwidth_info_ = info;
+  bandwidth_callback(this, &info, opaque_);
 }
 
-RawQuicError RawQuic::ConfigureSocket(DatagramClientSocket* socket,
-                                      const net::IPEndPoint& dest) {
-  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
-  do {
-    if (socket == nullptr) {
-      ret.error = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
-      break;
-    }
-
-    socket->UseNonBlockingIO();
+void RawQuic::OnStreamFrameAcked(const quic::QuicStreamFrame& frame,
+                                 quic::QuicTime now) {
+  if (stream_ == nullptr || frame.stream_id != stream_->id()) {
+    return;
+  }
 
-    ret.net_error = socket->Connect(dest);
-    if (ret.net_error != net::OK) {
-      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
-      break;
-    }
+  // Acks may come out of order, a write counts as acked once the frame
+  // holding its last byte is, which may be a little early.
+  uint64_t acked_offset = frame.offset + frame.data_length;
+  int64_t now_us = (now - quic::QuicTime::Zero()).ToMicroseconds();
+  while (!unacked_writes_.empty() &&
+         unacked_writes_.front().first <= acked_offset) {
+    RecordLatency(RawQuicLatencyHistograms::ACK,
+                  now_us - unacked_writes_.front().second);
+    unacked_writes_.pop_front();
+  }
 
-    ret.net_error = socket->SetReceiveBufferSize(kQuicSocketReceiveBufferSize);
-    if (ret.net_error != net::OK) {
-      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
-      break;
-    }
+  // Shutdown is done once the FIN and all data before it are acked. It
+  // finishes from the alarm, the session iterates its users here and
+  // FinishShutdown removes this one.
+  if (shutting_down_.load() && fin_sent_ && !stream_->IsWaitingForAcks() &&
+      shutdown_alarm_ != nullptr) {
+    shutdown_alarm_->Update(now, quic::QuicTime::Delta::Zero());
+  }
+}
 
-    ret.net_error = socket->SetDoNotFragment();
-    // SetDoNotFragment is not implemented on all platforms, so ignore errors.
-    if (ret.net_error != net::OK && ret.net_error != net::ERR_NOT_IMPLEMENTED) {
-      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
-      break;
+void RawQuic::OnReadBufferConsumed(uint32_t size) {
+  read_buffer_consumed_ += size;
+  int64_t now_us = 0;
+  while (!read_buffer_arrivals_.empty() &&
+         read_buffer_arrivals_.front().first <= read_buffer_consumed_) {
+    if (now_us == 0) {
+      now_us = GetTimeUs();
     }
-
-    // Set a buffer large enough to contain the initial CWND's worth of packet
-    // to work around the problem with CHLO packets being sent out with the
-    // wrong encryption level, when the send buffer is full.
-    ret.net_error =
-        socket->SetSendBufferSize(quic::kMaxOutgoingPacketSize * 20);
-    if (ret.net_error != net::OK) {
-      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
-      break;
-    }
-  } while (0);
-
-  return ret;
+    RecordLatency(RawQuicLatencyHistograms::RECV_QUEUE,
+                  now_us - read_buffer_arrivals_.front().second);
+    read_buffer_arrivals_.pop_front();
+  }
 }
 
-std::unique_ptr<quic::QuicConnection> RawQuic::CreateConnection(
-    DatagramClientSocket* socket,
-    const net::IPEndPoint& dest) {
-  quic::QuicConnectionId connection_id =
-      quic::QuicUtils::CreateRandomConnectionId(GetContext()->GetQuicRandom());
-
-  net::QuicChromiumPacketWriter* writer =
-      new net::QuicChromiumPacketWriter(socket, GetContext()->GetTaskRunner());
-
-  auto connection = std::make_unique<quic::QuicConnection>(
-      connection_id, net::ToQuicSocketAddress(dest),
-      GetContext()->GetQuicConnectionHelper(),
-      GetContext()->GetQuicAlarmFactory(), writer, true /* owns_writer */,
-      quic::Perspective::IS_CLIENT, GetVersions());
+void RawQuic::RecordLatency(RawQuicLatencyHistograms::Stage stage,
+                            int64_t value_us) {
+  latency_histograms_.Record(stage, value_us);
+  // Global stats cover handles of every IO thread.
+  RawQuicContext::GetInstance()->GetLatencyHistograms()->Record(stage,
+                                                                value_us);
+}
 
-  return connection;
+int64_t RawQuic::GetTimeUs() {
+  // Clock is thread safe, caller threads stamp with it too.
+  return (GetContext()->GetQuicClock()->Now() - quic::QuicTime::Zero())
+      .ToMicroseconds();
 }
 
-quic::ParsedQuicVersionVector RawQuic::GetVersions() {
-  quic::ParsedQuicVersionVector versions;
-  versions.emplace_back(quic::PROTOCOL_TLS1_3, quic::QUIC_VERSION_99);
-  return versions;
+RawQuicContext* RawQuic::GetContext() {
+  return context_ != nullptr ? context_ : RawQuicContext::GetInstance();
 }
 
-quic::QuicConfig RawQuic::DefaultQuicConfig() {
-  quic::QuicConfig config;
-  config.SetIdleNetworkTimeout(
-      quic::QuicTime::Delta::FromSeconds(kMaxIdleNetworkTimeout),
-      quic::QuicTime::Delta::FromSeconds(kDefaultIdleNetworkTimeout));
-  config.set_max_time_before_crypto_handshake(
-      quic::QuicTime::Delta::FromSeconds(kSetMaxTimeBeforeCryptoHandshake));
-  config.set_max_idle_time_before_crypto_handshake(
-      quic::QuicTime::Delta::FromSeconds(kSetMaxIdleTimeBeforeCryptoHandshake));
-  return config;
+RawQuicBufferPool* RawQuic::GetBufferPool() {
+  return RawQuicBufferPool::GetInstance();
 }
 
 void RawQuic::FlushWriteBuffer() {
+  if (session_ == nullptr) {
+    return;
+  }
+
+  // Bundle all queued writes into as few packets as possible.
+  quic::QuicConnection::ScopedPacketFlusher flusher(session_->connection());
+  int64_t now_us = 0;
   while (can_write_) {
     if (write_queue_.empty() || stream_ == nullptr) {
       break;
     }
 
-    quic::QuicData& data = write_queue_.front();
+    RawQuicBuffer& data = write_queue_.front();
     if (!stream_->Write(quiche::QuicheStringPiece(data.data(), data.length()))) {
       can_write_ = false;
       break;
     }
 
+    if (now_us == 0) {
+      now_us = GetTimeUs();
+    }
+    if (data.time_us() != 0) {
+      RecordLatency(RawQuicLatencyHistograms::SEND_QUEUE,
+                    now_us - data.time_us());
+    }
+    stream_write_offset_ += data.length();
+    unacked_writes_.emplace_back(stream_write_offset_, now_us);
+
     buffered_write_data_size_ -= data.length();
     write_queue_.pop();
   }
+
+  // Not gated on can_write_, which is only set by OnCanWrite, a handle
+  // that never wrote must still finish. Stream refuses while blocked.
+  if (fin_pending_ && !fin_sent_ && write_queue_.empty() &&
+      stream_ != nullptr) {
+    fin_sent_ = stream_->SendFin();
+  }
 }
 
 void RawQuic::FillReadBuffer() {
-  while (read_buffer_.size() < recv_buffer_size_) {
+  while (!peeking_ && read_buffer_.size() < recv_buffer_size_) {
     if (stream_ == nullptr) {
       break;
     }
@@ -470,10 +1185,29 @@ void RawQuic::FillReadBuffer() {
     }
 
     read_ostream_.write((const char*)temp_read_buffer_.get(), read_len);
+
+    // Data came in no later than the last packet, merge chunks of it.
+    quic::QuicTime receipt_time = GetLastPacketReceiptTime();
+    int64_t arrival_us = receipt_time.IsInitialized()
+                             ? (receipt_time - quic::QuicTime::Zero())
+                                   .ToMicroseconds()
+                             : GetTimeUs();
+    read_buffer_offset_ += read_len;
+    if (!read_buffer_arrivals_.empty() &&
+        read_buffer_arrivals_.back().second == arrival_us) {
+      read_buffer_arrivals_.back().first = read_buffer_offset_;
+    } else {
+      read_buffer_arrivals_.emplace_back(read_buffer_offset_, arrival_us);
+    }
   }
 }
 
 void RawQuic::ReportError(RawQuicError* error) {
+  if (shutting_down_.load()) {
+    FinishShutdown(error);
+    return;
+  }
+
   int32_t status = status_.load();
   if (status == RAW_QUIC_STATUS_CONNECTED) {
     if (callback_.error_callback != nullptr) {
@@ -498,12 +1232,22 @@ void RawQuic::OnClosed(RawQuicError* error) {
 }
 
 void RawQuic::OnSessionReady() {
-  status_.store(RAW_QUIC_STATUS_CONNECTED);
+  if (stream_ != nullptr) {
+    return;
+  }
 
-  std::unique_ptr<quic::QuicTransportStream::Visitor> stream_visitor =
-      std::make_unique<RawQuicStreamVisitor>(this);
-  stream_ = session_->OpenOutgoingBidirectionalStream();
-  stream_->set_visitor(std::move(stream_visitor));
+  quic::QuicTransportStream* stream =
+      pooled_session_->session()->OpenOutgoingBidirectionalStream();
+  if (stream == nullptr) {
+    RawQuicError ret = {RAW_QUIC_ERROR_CODE_QUIC_ERROR, 0,
+                        quic::QUIC_TOO_MANY_OPEN_STREAMS};
+    CloseSession("Too many streams.");
+    OnClosed(&ret);
+    return;
+  }
+
+  AttachStream(stream);
+  status_.store(RAW_QUIC_STATUS_CONNECTED);
 
   if (connect_promise_ != nullptr) {
     connect_promise_->set_value(RAW_QUIC_ERROR_CODE_SUCCESS);
@@ -553,16 +1297,13 @@ void RawQuic::OnWriteBlocked(quic::QuicBlockedWriterInterface* blocked_writer) {
 }
 
 void RawQuic::OnRstStreamReceived(const quic::QuicRstStreamFrame& frame) {
-  if (session_ != nullptr) {
-    quic::QuicConnection* connection = session_->connection();
-    if (connection != nullptr) {
-      connection->CloseConnection(
-          quic::QUIC_NO_ERROR, "Stream reset.",
-          quic::ConnectionCloseBehavior::SEND_CONNECTION_CLOSE_PACKET);
-    }
-    session_ = nullptr;
+  // Session may carry streams of other handles.
+  if (stream_ == nullptr || frame.stream_id != stream_->id()) {
+    return;
   }
 
+  CloseSession("Stream reset.");
+
   RawQuicError ret = {RAW_QUIC_ERROR_CODE_STREAM_RESET, 0, 0};
   OnClosed(&ret);
 }
@@ -573,28 +1314,35 @@ void RawQuic::OnStopSendingReceived(const quic::QuicStopSendingFrame& frame) {
 
 void RawQuic::OnCanRead() {
   std::unique_lock<std::mutex> lock(read_mutex_);
+  // Stream may report fin from inside Read, lock is held already.
+  filling_read_buffer_ = true;
   FillReadBuffer();
-  if (read_buffer_.size() > 0) {
+  filling_read_buffer_ = false;
+  if (read_buffer_.size() > 0 || fin_received_) {
     read_cond_.notify_all();
     if (callback_.can_read_callback != nullptr) {
+      calling_can_read_ = true;
       callback_.can_read_callback(this, read_buffer_.size(), opaque_);
+      calling_can_read_ = false;
     }
   }
 }
 
 void RawQuic::OnFinRead() {
-  if (session_ != nullptr) {
-    quic::QuicConnection* connection = session_->connection();
-    if (connection != nullptr) {
-      connection->CloseConnection(
-          quic::QUIC_NO_ERROR, "Stream fin.",
-          quic::ConnectionCloseBehavior::SEND_CONNECTION_CLOSE_PACKET);
-    }
-    session_ = nullptr;
+  // Peer finished sending, keep connection for our own writes.
+  if (filling_read_buffer_) {
+    fin_received_ = true;
+    return;
   }
 
-  RawQuicError ret = {RAW_QUIC_ERROR_CODE_STREAM_FIN, 0, 0};
-  OnClosed(&ret);
+  std::unique_lock<std::mutex> lock(read_mutex_);
+  fin_received_ = true;
+  read_cond_.notify_all();
+  if (callback_.can_read_callback != nullptr) {
+    calling_can_read_ = true;
+    callback_.can_read_callback(this, read_buffer_.size(), opaque_);
+    calling_can_read_ = false;
+  }
 }
 
 void RawQuic::OnCanWrite() {
@@ -602,4 +1350,28 @@ void RawQuic::OnCanWrite() {
   FlushWriteBuffer();
 }
 
+void RawQuic::OnStreamDestroyed() {
+  stream_ = nullptr;
+  stream_visitor_ = nullptr;
+}
+
+void RawQuic::OnCommand(const RawQuicCommand& command) {
+  switch (command.type) {
+    case RAW_QUIC_COMMAND_WRITE:
+      DoWrite(command.data, command.size, command.time_us);
+      break;
+    case RAW_QUIC_COMMAND_READ:
+      OnCanRead();
+      break;
+    case RAW_QUIC_COMMAND_SET_SEND_BUFFER_SIZE:
+      DoSetSendBufferSize(command.size);
+      break;
+    case RAW_QUIC_COMMAND_SET_RECV_BUFFER_SIZE:
+      DoSetRecvBufferSize(command.size);
+      break;
+    default:
+      break;
+  }
+}
+
 }  // namespace net
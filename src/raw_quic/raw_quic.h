@@ -5,14 +5,18 @@
 #ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_H_
 #define NET_QUIC_RAW_QUIC_RAW_QUIC_H_
 
+#include <deque>
 #include <future>
 #include <memory>
 #include <mutex>
 
-#include "net/base/address_list.h"
+#include "net/quic/raw_quic/raw_quic_buffer_pool.h"
+#include "net/quic/raw_quic/raw_quic_command_queue.h"
 #include "net/quic/raw_quic/raw_quic_define.h"
+#include "net/quic/raw_quic/raw_quic_histogram.h"
 #include "net/quic/raw_quic/raw_quic_session.h"
 #include "net/quic/raw_quic/streambuf/streambuf.hpp"
+#include "net/third_party/quiche/src/quic/core/quic_alarm.h"
 #include "net/third_party/quiche/src/quic/core/quic_connection.h"
 #include "net/third_party/quiche/src/quic/core/quic_packets.h"
 #include "net/third_party/quiche/src/quic/core/quic_server_id.h"
@@ -21,6 +25,11 @@
 namespace net {
 
 class RawQuicContext;
+class RawQuicPooledSession;
+class RawQuicServerSession;
+
+// Max regions exposed by Peek, a ring buffer has at most two.
+const int32_t kMaxPeekRegions = 2;
 
 typedef enum RawQuicStatus {
   RAW_QUIC_STATUS_IDLE = 0,
@@ -44,9 +53,12 @@ class RawQuicStreamVisitor : public quic::QuicTransportStream::Visitor {
     virtual void OnCanRead() = 0;
     virtual void OnFinRead() = 0;
     virtual void OnCanWrite() = 0;
+    virtual void OnStreamDestroyed() = 0;
   };
 
   RawQuicStreamVisitor(DataDelegate* data_delegate);
+  ~RawQuicStreamVisitor() override;
+  void Detach();
   void OnCanRead() override;
   void OnFinRead() override;
   void OnCanWrite() override;
@@ -58,7 +70,8 @@ class RawQuicStreamVisitor : public quic::QuicTransportStream::Visitor {
 /////////////////////////////////////RawQuic/////////////////////////////////////
 class RawQuic : public quic::QuicTransportClientSession::ClientVisitor,
                 public quic::QuicSession::Visitor,
-                public net::RawQuicStreamVisitor::DataDelegate {
+                public net::RawQuicStreamVisitor::DataDelegate,
+                public net::RawQuicCommandHandler {
  public:
   RawQuic(RawQuicCallbacks callback, void* opaque, bool verify);
   ~RawQuic() override;
@@ -69,12 +82,30 @@ class RawQuic : public quic::QuicTransportClientSession::ClientVisitor,
                   const char* path,
                   int32_t timeout);
 
+  // Takes stream accepted by a listener, IO thread only.
+  void Accept(RawQuicServerSession* server_session,
+              quic::QuicTransportStream* stream);
+
   void Close();
 
+  void CloseAsync();
+
+  int32_t Shutdown(int32_t linger_ms);
+
+  int32_t ShutdownWrite();
+
+  int32_t Migrate(const char* local_ip, int32_t timeout);
+
+  int32_t EnableMultipath(const RawQuicMultipathConfig* config);
+
   int32_t Write(uint8_t* data, uint32_t size);
 
   int32_t Read(uint8_t* data, uint32_t size, int32_t timeout);
 
+  int32_t Peek(const RawQuicIovec** regions, int* count);
+
+  int32_t Consume(uint32_t size);
+
   int32_t GetRecvBufferDataSize();
 
   void SetSendBufferSize(uint32_t size);
@@ -83,6 +114,27 @@ class RawQuic : public quic::QuicTransportClientSession::ClientVisitor,
 
   void SetRecvBufferSize(uint32_t size);
 
+  int32_t GetStats(RawQuicStats* out);
+
+  void SetBandwidthThresholds(const RawQuicBandwidthThresholds& thresholds);
+
+  void GetLatencyStats(RawQuicLatencyStats* out, bool reset);
+
+  void Cork();
+
+  void Uncork();
+
+  void SetCoalesceDelay(uint32_t delay_us);
+
+  // Any thread, events reported after it use the new callback.
+  void SetShutdownCallback(ShutdownCallback callback);
+
+  void SetClosedCallback(ClosedCallback callback);
+
+  void SetMigrateCallback(MigrateCallback callback);
+
+  void SetBandwidthCallback(BandwidthCallback callback);
+
  protected:
   void DoConnect(const std::string& host,
                  uint16_t port,
@@ -91,28 +143,81 @@ class RawQuic : public quic::QuicTransportClientSession::ClientVisitor,
 
   void DoClose(IntPromisePtr promise);
 
-  void DoWrite(uint8_t* data, uint32_t size);
+  void DoCloseAsync();
+
+  void OnCloseAsyncDone();
+
+  void DoShutdown(int32_t linger_ms);
+
+  void DoShutdownWrite();
+
+  void DoMigrate(const std::string& local_ip, IntPromisePtr promise);
+
+  void OnMigrated(RawQuicError* error);
+
+  void DoEnableMultipath(const std::string& local_ip,
+                         RawQuicMultipathScheduler scheduler,
+                         uint32_t primary_delay_ms,
+                         uint32_t secondary_delay_ms,
+                         IntPromisePtr promise);
+
+  void CheckShutdown();
+
+  void FinishShutdown(RawQuicError* error);
+
+  void CloseSession(const std::string& details);
+
+  void AttachSession(RawQuicPooledSession* pooled_session);
+
+  void DetachSession();
+
+  void AttachStream(quic::QuicTransportStream* stream);
+
+  quic::QuicTime GetLastPacketReceiptTime();
+
+  void DoWrite(uint8_t* data, uint32_t size, int64_t time_us);
+
+  int32_t WriteCoalesced(uint8_t* data, uint32_t size);
+
+  void PostPendingWrite();
+
+  void PostWrite(RawQuicBufferPtr buffer, uint32_t size, int64_t time_us);
+
+  void PostCommand(int32_t type, uint8_t* data, uint32_t size);
+
+  void DoScheduleFlush(uint32_t delay_us);
+
+  void DoFlushPendingWrite();
 
   void DoSetSendBufferSize(uint32_t size);
 
   void DoSetRecvBufferSize(uint32_t size);
 
-  RawQuicContext* GetContext();
+  void DoGetStats(RawQuicStats* out, IntPromisePtr promise);
 
-  RawQuicError Resolve(const std::string& host, net::AddressList* addrlist);
+  void DoSetBandwidthThresholds(RawQuicBandwidthThresholds thresholds);
 
-  RawQuicError CreateSession(const net::IPEndPoint& dest);
+  void OnCongestionChange(quic::QuicTime now);
 
-  RawQuicError ConfigureSocket(DatagramClientSocket* socket,
-                               const net::IPEndPoint& dest);
+  // Reports to the bandwidth callback if a threshold is crossed since last
+  // report.
+  void MaybeReportBandwidth(quic::QuicTime now);
 
-  std::unique_ptr<quic::QuicConnection> CreateConnection(
-      DatagramClientSocket* socket,
-      const net::IPEndPoint& dest);
+  void OnStreamFrameAcked(const quic::QuicStreamFrame& frame,
+                          quic::QuicTime now);
 
-  quic::ParsedQuicVersionVector GetVersions();
+  // Called with read_mutex_ held after size bytes left the read buffer.
+  void OnReadBufferConsumed(uint32_t size);
 
-  quic::QuicConfig DefaultQuicConfig();
+  void RecordLatency(RawQuicLatencyHistograms::Stage stage, int64_t value_us);
+
+  int64_t GetTimeUs();
+
+  // Context of the IO thread the handle lives on, the instance unless
+  // accepted by a listener worker.
+  RawQuicContext* GetContext();
+
+  RawQuicBufferPool* GetBufferPool();
 
   void FlushWriteBuffer();
 
@@ -155,41 +260,116 @@ class RawQuic : public quic::QuicTransportClientSession::ClientVisitor,
 
   void OnCanWrite() override;
 
+  void OnStreamDestroyed() override;
+
+  // net::RawQuicCommandHandler
+  void OnCommand(const RawQuicCommand& command) override;
+
  private:
+  friend class RawQuicPooledSession;
+  friend class RawQuicServerSession;
+
+  class AlarmDelegate : public quic::QuicAlarm::Delegate {
+   public:
+    typedef void (RawQuic::*Method)();
+    AlarmDelegate(RawQuic* raw_quic, Method method)
+        : raw_quic_(raw_quic), method_(method) {}
+    void OnAlarm() override { (raw_quic_->*method_)(); }
+
+   private:
+    RawQuic* raw_quic_ = nullptr;
+    Method method_ = nullptr;
+  };
+
   // Application callback.
   RawQuicCallbacks callback_;
   void* opaque_ = nullptr;
+  // Set one by one, RawQuicCallbacks keeps the layout apps were built with.
+  std::atomic<ShutdownCallback> shutdown_callback_;
+  std::atomic<ClosedCallback> closed_callback_;
+  std::atomic<MigrateCallback> migrate_callback_;
+  std::atomic<BandwidthCallback> bandwidth_callback_;
 
   // Status.
   bool verify_ = true;
   bool can_write_ = false;
   std::atomic<int32_t> status_;
   IntPromisePtr connect_promise_;
+  IntPromisePtr migrate_promise_;
+
+  // Set once accepted on a listener worker, never changes after.
+  RawQuicContext* context_ = nullptr;
 
   // Endpoint.
   std::string host_;
   uint16_t port_ = 0;
   std::string path_;
-  GURL url_;
 
-  // QUIC.
-  std::unique_ptr<quic::QuicTransportClientSession> session_;
+  // QUIC, session may be shared with other handles through pool, or be
+  // accepted by a listener, session_ is the one of either.
+  RawQuicPooledSession* pooled_session_ = nullptr;
+  RawQuicServerSession* server_session_ = nullptr;
+  quic::QuicSession* session_ = nullptr;
   // Stream owned by QuicSession, only one supported now.
   quic::QuicTransportStream* stream_ = nullptr;
+  // Owned by stream, tells when stream_ is deleted.
+  RawQuicStreamVisitor* stream_visitor_ = nullptr;
 
   // Send buffer.
   uint32_t send_buffer_size_ = 0;
   uint32_t buffered_write_data_size_ = 0;
-  std::queue<quic::QuicData> write_queue_;
+  std::queue<RawQuicBuffer> write_queue_;
+
+  // Coalescing of small writes, filled by caller thread.
+  std::mutex write_mutex_;
+  bool corked_ = false;
+  bool flush_scheduled_ = false;
+  uint32_t coalesce_delay_us_ = 0;
+  RawQuicBufferPtr pending_write_;
+  uint32_t pending_write_size_ = 0;
+  int64_t pending_write_time_us_ = 0;
+  std::unique_ptr<quic::QuicAlarm> flush_alarm_;
+
+  // Graceful shutdown, write FIN after write queue flushed.
+  std::atomic<bool> shutting_down_;
+  std::atomic<bool> write_closed_;
+  bool fin_pending_ = false;
+  bool fin_sent_ = false;
+  quic::QuicTime shutdown_deadline_ = quic::QuicTime::Zero();
+  std::unique_ptr<quic::QuicAlarm> shutdown_alarm_;
+
+  // Bandwidth change notification, values of last report.
+  RawQuicBandwidthThresholds bandwidth_thresholds_;
+  quic::QuicTime last_bandwidth_report_time_ = quic::QuicTime::Zero();
+  RawQuicBandwidthInfo reported_bandwidth_info_;
+
+  // Latency, written stream offsets wait for ack and read buffer offsets
+  // wait for the app, each with the time it entered the stage.
+  RawQuicLatencyHistograms latency_histograms_;
+  uint64_t stream_write_offset_ = 0;
+  std::deque<std::pair<uint64_t, int64_t>> unacked_writes_;
+  uint64_t read_buffer_offset_ = 0;
+  uint64_t read_buffer_consumed_ = 0;
+  std::deque<std::pair<uint64_t, int64_t>> read_buffer_arrivals_;
 
   // Recv buffer.
   uint32_t recv_buffer_size_ = 0;
   std::mutex read_mutex_;
   std::condition_variable read_cond_;
   boost::asio::streambuf read_buffer_;
-  std::unique_ptr<uint8_t[]> temp_read_buffer_;
+  RawQuicBufferPtr temp_read_buffer_;
   std::istream read_istream_;
   std::ostream read_ostream_;
+
+  // Zero-copy read, read buffer is pinned between Peek and Consume.
+  bool peeking_ = false;
+
+  // Peer sent FIN and all stream data is in read buffer.
+  bool fin_received_ = false;
+  bool filling_read_buffer_ = false;
+  // can_read_callback runs with read_mutex_ held, IO thread only.
+  bool calling_can_read_ = false;
+  RawQuicIovec peek_regions_[kMaxPeekRegions];
 };
 
 }  // namespace net
@@ -0,0 +1,276 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_admission.h"
+
+#include <algorithm>
+
+#include "net/third_party/quiche/src/quic/core/quic_constants.h"
+#include "net/third_party/quiche/src/quic/core/quic_data_reader.h"
+#include "third_party/boringssl/src/include/openssl/aead.h"
+#include "third_party/boringssl/src/include/openssl/digest.h"
+#include "third_party/boringssl/src/include/openssl/hmac.h"
+#include "third_party/boringssl/src/include/openssl/mem.h"
+
+namespace net {
+
+namespace {
+// Header form and fixed bit, then the long packet type.
+const uint8_t kLongHeaderBits = 0xC0;
+const uint8_t kLongPacketTypeMask = 0x30;
+const uint8_t kInitialPacketType = 0x00;
+const uint8_t kRetryPacketType = 0x30;
+
+// Retry integrity key and nonce of draft-25, which QUIC_VERSION_99 speaks.
+const uint8_t kRetryIntegrityKey[] = {0x4d, 0x32, 0xec, 0xdb, 0x2a, 0x21,
+                                      0x33, 0xc8, 0x41, 0xe4, 0x04, 0x3d,
+                                      0xf2, 0x7d, 0x44, 0x30};
+const uint8_t kRetryIntegrityNonce[] = {0x4d, 0x16, 0x11, 0xd0, 0x55, 0x13,
+                                        0xa5, 0x52, 0xc5, 0x87, 0xd5, 0x75};
+const size_t kRetryIntegrityTagSize = 16;
+
+const size_t kTokenMacSize = 16;
+// Client comes back within a round trip, a lost Initial costs a PTO more.
+const int64_t kTokenLifetimeUs = 10 * 1000 * 1000;
+const size_t kMaxOriginalConnectionIds = 1024;
+
+const uint32_t kDefaultHandshakesPerSecond = 1000;
+const uint32_t kDefaultHandshakeBurst = 1000;
+
+void AppendUInt64(uint64_t value, std::string* out) {
+  for (int i = 7; i >= 0; --i) {
+    out->push_back((char)(value >> (i * 8)));
+  }
+}
+
+void AppendConnectionId(const quic::QuicConnectionId& connection_id,
+                        std::string* out) {
+  out->push_back((char)connection_id.length());
+  out->append(connection_id.data(), connection_id.length());
+}
+
+int64_t ToMicroseconds(quic::QuicTime time) {
+  return (time - quic::QuicTime::Zero()).ToMicroseconds();
+}
+}  // namespace
+
+//////////////////////////////RawQuicAdmissionController//////////////////////////////
+RawQuicAdmissionController::RawQuicAdmissionController(
+    const std::string& secret)
+    : secret_(secret) {
+  RawQuicHandshakeLimit limit;
+  limit.handshakes_per_second = kDefaultHandshakesPerSecond;
+  limit.burst = kDefaultHandshakeBurst;
+  limit.retry = true;
+  SetLimit(limit);
+}
+
+RawQuicAdmissionController::~RawQuicAdmissionController() {}
+
+void RawQuicAdmissionController::SetLimit(const RawQuicHandshakeLimit& limit) {
+  limit_ = limit;
+  tokens_ = limit.burst;
+  last_refill_ = quic::QuicTime::Zero();
+}
+
+bool RawQuicAdmissionController::ParseInitialPacket(
+    const char* data,
+    size_t length,
+    RawQuicInitialPacket* packet) {
+  quic::QuicDataReader reader(data, length);
+  uint8_t first_byte = 0;
+  if (!reader.ReadUInt8(&first_byte) ||
+      (first_byte & kLongHeaderBits) != kLongHeaderBits ||
+      (first_byte & kLongPacketTypeMask) != kInitialPacketType) {
+    return false;
+  }
+
+  // Version 0 is version negotiation.
+  uint64_t token_length = 0;
+  if (!reader.ReadUInt32(&packet->version_label) ||
+      packet->version_label == 0 ||
+      !reader.ReadLengthPrefixedConnectionId(
+          &packet->destination_connection_id) ||
+      !reader.ReadLengthPrefixedConnectionId(&packet->source_connection_id) ||
+      !reader.ReadVarInt62(&token_length) ||
+      !reader.ReadStringPiece(&packet->token, (size_t)token_length)) {
+    return false;
+  }
+
+  // Clients pick at least 8 bytes, the first one steers the connection.
+  return packet->destination_connection_id.length() >=
+         quic::kQuicDefaultConnectionIdLength;
+}
+
+RawQuicAdmissionController::Decision RawQuicAdmissionController::Admit(
+    const RawQuicInitialPacket& packet,
+    const net::IPAddress& client_ip,
+    quic::QuicTime now) {
+  // Only Retry hands out tokens. One that doesn't validate was issued to
+  // another address or too long ago, the handshake can't complete anyway.
+  quic::QuicConnectionId original;
+  bool validated = false;
+  if (!packet.token.empty()) {
+    if (!ValidateToken(packet, client_ip, now, &original)) {
+      return DROP;
+    }
+    validated = true;
+  }
+
+  if (limit_.handshakes_per_second > 0) {
+    Refill(now);
+    if (!validated && limit_.retry && tokens_ * 2 < limit_.burst) {
+      return RETRY;
+    }
+
+    // Client retransmits its Initial, by then the bucket has refilled.
+    if (tokens_ < 1) {
+      return DROP;
+    }
+    tokens_ -= 1;
+  }
+
+  if (validated) {
+    AddOriginalConnectionId(packet.destination_connection_id, original, now);
+  }
+  return ADMIT;
+}
+
+bool RawQuicAdmissionController::BuildRetryPacket(
+    const RawQuicInitialPacket& packet,
+    const net::IPAddress& client_ip,
+    const quic::QuicConnectionId& new_connection_id,
+    quic::QuicTime now,
+    std::string* retry) const {
+  // Issue time and the original destination connection id, signed with the
+  // id the client must come back with and its address.
+  std::string token;
+  AppendUInt64((uint64_t)ToMicroseconds(now), &token);
+  AppendConnectionId(packet.destination_connection_id, &token);
+  token.append(Sign(token, new_connection_id, client_ip));
+
+  retry->clear();
+  retry->push_back((char)(kLongHeaderBits | kRetryPacketType));
+  for (int i = 3; i >= 0; --i) {
+    retry->push_back((char)(packet.version_label >> (i * 8)));
+  }
+  AppendConnectionId(packet.source_connection_id, retry);
+  AppendConnectionId(new_connection_id, retry);
+  retry->append(token);
+
+  // Integrity tag is the AEAD of nothing, over the original destination
+  // connection id followed by the packet.
+  std::string pseudo_packet;
+  AppendConnectionId(packet.destination_connection_id, &pseudo_packet);
+  pseudo_packet.append(*retry);
+
+  bssl::ScopedEVP_AEAD_CTX aead;
+  uint8_t tag[kRetryIntegrityTagSize];
+  size_t tag_length = 0;
+  if (!EVP_AEAD_CTX_init(aead.get(), EVP_aead_aes_128_gcm(),
+                         kRetryIntegrityKey, sizeof(kRetryIntegrityKey),
+                         kRetryIntegrityTagSize, nullptr) ||
+      !EVP_AEAD_CTX_seal(aead.get(), tag, &tag_length, sizeof(tag),
+                         kRetryIntegrityNonce, sizeof(kRetryIntegrityNonce),
+                         nullptr, 0, (const uint8_t*)pseudo_packet.data(),
+                         pseudo_packet.size())) {
+    return false;
+  }
+  retry->append((const char*)tag, tag_length);
+  return true;
+}
+
+bool RawQuicAdmissionController::TakeOriginalConnectionId(
+    const quic::QuicConnectionId& connection_id,
+    quic::QuicConnectionId* original) {
+  auto it = original_connection_ids_.find(connection_id);
+  if (it == original_connection_ids_.end()) {
+    return false;
+  }
+
+  *original = it->second.first;
+  original_connection_ids_.erase(it);
+  return true;
+}
+
+bool RawQuicAdmissionController::ValidateToken(
+    const RawQuicInitialPacket& packet,
+    const net::IPAddress& client_ip,
+    quic::QuicTime now,
+    quic::QuicConnectionId* original) const {
+  quic::QuicDataReader reader(packet.token.data(), packet.token.size());
+  uint64_t issued_us = 0;
+  if (!reader.ReadUInt64(&issued_us) ||
+      !reader.ReadLengthPrefixedConnectionId(original) ||
+      reader.BytesRemaining() != kTokenMacSize) {
+    return false;
+  }
+
+  int64_t now_us = ToMicroseconds(now);
+  if ((int64_t)issued_us > now_us ||
+      now_us - (int64_t)issued_us > kTokenLifetimeUs) {
+    return false;
+  }
+
+  size_t payload_size = packet.token.size() - kTokenMacSize;
+  std::string mac =
+      Sign(std::string(packet.token.data(), payload_size),
+           packet.destination_connection_id, client_ip);
+  return CRYPTO_memcmp(mac.data(), packet.token.data() + payload_size,
+                       kTokenMacSize) == 0;
+}
+
+std::string RawQuicAdmissionController::Sign(
+    const std::string& payload,
+    const quic::QuicConnectionId& connection_id,
+    const net::IPAddress& client_ip) const {
+  std::string data = payload;
+  AppendConnectionId(connection_id, &data);
+  data.append((const char*)client_ip.bytes().data(), client_ip.size());
+
+  uint8_t mac[EVP_MAX_MD_SIZE];
+  unsigned int mac_length = 0;
+  HMAC(EVP_sha256(), secret_.data(), secret_.size(),
+       (const uint8_t*)data.data(), data.size(), mac, &mac_length);
+  return std::string((const char*)mac, kTokenMacSize);
+}
+
+void RawQuicAdmissionController::Refill(quic::QuicTime now) {
+  // Starts full, the first refill only clamps.
+  double elapsed_seconds = (now - last_refill_).ToMicroseconds() / 1e6;
+  tokens_ = std::min<double>(
+      limit_.burst, tokens_ + elapsed_seconds * limit_.handshakes_per_second);
+  last_refill_ = now;
+}
+
+void RawQuicAdmissionController::AddOriginalConnectionId(
+    const quic::QuicConnectionId& connection_id,
+    const quic::QuicConnectionId& original,
+    quic::QuicTime now) {
+  // Sessions are created right away unless the dispatcher buffered the
+  // CHLO, entries left behind are of clients that gave up. Expired first,
+  // else the oldest.
+  if (original_connection_ids_.size() >= kMaxOriginalConnectionIds &&
+      original_connection_ids_.count(connection_id) == 0) {
+    for (auto it = original_connection_ids_.begin();
+         it != original_connection_ids_.end();) {
+      if (ToMicroseconds(now) - ToMicroseconds(it->second.second) >
+          kTokenLifetimeUs) {
+        it = original_connection_ids_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (original_connection_ids_.size() >= kMaxOriginalConnectionIds) {
+      original_connection_ids_.erase(std::min_element(
+          original_connection_ids_.begin(), original_connection_ids_.end(),
+          [](const auto& a, const auto& b) {
+            return a.second.second < b.second.second;
+          }));
+    }
+  }
+  original_connection_ids_[connection_id] = std::make_pair(original, now);
+}
+
+}  // namespace net
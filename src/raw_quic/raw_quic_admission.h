@@ -0,0 +1,102 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_ADMISSION_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_ADMISSION_H_
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "net/base/ip_address.h"
+#include "net/quic/raw_quic/raw_quic_define.h"
+#include "net/third_party/quiche/src/common/platform/api/quiche_string_piece.h"
+#include "net/third_party/quiche/src/quic/core/quic_connection_id.h"
+#include "net/third_party/quiche/src/quic/core/quic_time.h"
+#include "net/third_party/quiche/src/quic/core/quic_versions.h"
+
+namespace net {
+
+// Long header Initial packet of a client, token points into the packet.
+struct RawQuicInitialPacket {
+  quic::QuicVersionLabel version_label = 0;
+  quic::QuicConnectionId destination_connection_id;
+  quic::QuicConnectionId source_connection_id;
+  quiche::QuicheStringPiece token;
+};
+
+//////////////////////////////RawQuicAdmissionController//////////////////////////////
+// Decides which new connections of a listener worker get a handshake, on its
+// IO thread. A token bucket refilled at handshakes_per_second bounds the
+// handshakes started. Once it's below half full, clients without a token get
+// a stateless Retry first, which costs one packet and no state, and a
+// spoofed flood never comes back with the token. Packets of established
+// connections never come here.
+class RawQuicAdmissionController {
+ public:
+  enum Decision { ADMIT, RETRY, DROP };
+
+  // secret signs Retry tokens, the same for every worker of a listener.
+  explicit RawQuicAdmissionController(const std::string& secret);
+  ~RawQuicAdmissionController();
+
+  // Bucket starts full.
+  void SetLimit(const RawQuicHandshakeLimit& limit);
+
+  // Returns false unless data is a client Initial, version not checked.
+  static bool ParseInitialPacket(const char* data,
+                                 size_t length,
+                                 RawQuicInitialPacket* packet);
+
+  // Initial packet of a connection the dispatcher doesn't know yet.
+  Decision Admit(const RawQuicInitialPacket& packet,
+                 const net::IPAddress& client_ip,
+                 quic::QuicTime now);
+
+  // Retry asking the client to come back with new_connection_id and a token
+  // bound to its address.
+  bool BuildRetryPacket(const RawQuicInitialPacket& packet,
+                        const net::IPAddress& client_ip,
+                        const quic::QuicConnectionId& new_connection_id,
+                        quic::QuicTime now,
+                        std::string* retry) const;
+
+  // Destination connection id of the Initial that was retried, the session
+  // created for connection_id must send it in its transport parameters.
+  bool TakeOriginalConnectionId(const quic::QuicConnectionId& connection_id,
+                                quic::QuicConnectionId* original);
+
+ protected:
+  // Sets original if token was issued to client_ip for packet.
+  bool ValidateToken(const RawQuicInitialPacket& packet,
+                     const net::IPAddress& client_ip,
+                     quic::QuicTime now,
+                     quic::QuicConnectionId* original) const;
+
+  std::string Sign(const std::string& payload,
+                   const quic::QuicConnectionId& connection_id,
+                   const net::IPAddress& client_ip) const;
+
+  void Refill(quic::QuicTime now);
+
+  void AddOriginalConnectionId(const quic::QuicConnectionId& connection_id,
+                               const quic::QuicConnectionId& original,
+                               quic::QuicTime now);
+
+ private:
+  std::string secret_;
+  RawQuicHandshakeLimit limit_;
+  double tokens_ = 0;
+  quic::QuicTime last_refill_ = quic::QuicTime::Zero();
+
+  // Admitted after Retry, until the dispatcher creates the session.
+  std::unordered_map<quic::QuicConnectionId,
+                     std::pair<quic::QuicConnectionId, quic::QuicTime>,
+                     quic::QuicConnectionIdHash>
+      original_connection_ids_;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_ADMISSION_H_
@@ -1,6 +1,8 @@
 #include "net/quic/raw_quic/raw_quic_api.h"
 
 #include "net/quic/raw_quic/raw_quic.h"
+#include "net/quic/raw_quic/raw_quic_context.h"
+#include "net/quic/raw_quic/raw_quic_server.h"
 
 RawQuicHandle RAW_QUIC_CALL RawQuicOpen(RawQuicCallbacks callback,
                                         void* opaque,
@@ -9,6 +11,50 @@ RawQuicHandle RAW_QUIC_CALL RawQuicOpen(RawQuicCallbacks callback,
   return (RawQuicHandle)raw_quic;
 }
 
+int32_t RAW_QUIC_CALL RawQuicSetShutdownCallback(RawQuicHandle handle,
+                                                 ShutdownCallback callback) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->SetShutdownCallback(callback);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicSetClosedCallback(RawQuicHandle handle,
+                                               ClosedCallback callback) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->SetClosedCallback(callback);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicSetMigrateCallback(RawQuicHandle handle,
+                                                MigrateCallback callback) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->SetMigrateCallback(callback);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicSetBandwidthCallback(RawQuicHandle handle,
+                                                  BandwidthCallback callback) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->SetBandwidthCallback(callback);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
 int32_t RAW_QUIC_CALL RawQuicClose(RawQuicHandle handle) {
   if (handle == 0) {
     return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
@@ -21,6 +67,36 @@ int32_t RAW_QUIC_CALL RawQuicClose(RawQuicHandle handle) {
   return RAW_QUIC_ERROR_CODE_SUCCESS;
 }
 
+int32_t RAW_QUIC_CALL RawQuicCloseAsync(RawQuicHandle handle) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  // Handle is deleted on IO thread.
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->CloseAsync();
+
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicShutdownWrite(RawQuicHandle handle) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  return raw_quic->ShutdownWrite();
+}
+
+int32_t RAW_QUIC_CALL RawQuicShutdown(RawQuicHandle handle, int32_t linger_ms) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  return raw_quic->Shutdown(linger_ms);
+}
+
 int32_t RAW_QUIC_CALL RawQuicConnect(RawQuicHandle handle,
                                      const char* host,
                                      uint16_t port,
@@ -34,6 +110,28 @@ int32_t RAW_QUIC_CALL RawQuicConnect(RawQuicHandle handle,
   return raw_quic->Connect(host, port, path, timeout);
 }
 
+int32_t RAW_QUIC_CALL RawQuicMigrate(RawQuicHandle handle,
+                                     const char* local_ip,
+                                     int32_t timeout) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  return raw_quic->Migrate(local_ip, timeout);
+}
+
+int32_t RAW_QUIC_CALL
+RawQuicEnableMultipath(RawQuicHandle handle,
+                       const RawQuicMultipathConfig* config) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  return raw_quic->EnableMultipath(config);
+}
+
 int32_t RAW_QUIC_CALL RawQuicSend(RawQuicHandle handle,
                                   uint8_t* data,
                                   uint32_t size) {
@@ -57,6 +155,26 @@ int32_t RAW_QUIC_CALL RawQuicRecv(RawQuicHandle handle,
   return raw_quic->Read(data, size, timeout);
 }
 
+int32_t RAW_QUIC_CALL RawQuicRecvPeek(RawQuicHandle handle,
+                                      const RawQuicIovec** regions,
+                                      int* count) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  return raw_quic->Peek(regions, count);
+}
+
+int32_t RAW_QUIC_CALL RawQuicRecvConsume(RawQuicHandle handle, uint32_t n) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  return raw_quic->Consume(n);
+}
+
 int32_t RAW_QUIC_CALL RawQuicGetRecvBufferDataSize(RawQuicHandle handle) {
   if (handle == 0) {
     return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
@@ -75,6 +193,16 @@ void RawQuicSetSendBufferSize(RawQuicHandle handle, uint32_t size) {
   raw_quic->SetSendBufferSize(size);
 }
 
+void RAW_QUIC_CALL RawQuicSetRecvBufferSize(RawQuicHandle handle,
+                                           uint32_t size) {
+  if (handle == 0) {
+    return;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->SetRecvBufferSize(size);
+}
+
 uint32_t RAW_QUIC_CALL RawQuicGetSendBufferSize(RawQuicHandle handle) {
   if (handle == 0) {
     return 0;
@@ -83,3 +211,172 @@ uint32_t RAW_QUIC_CALL RawQuicGetSendBufferSize(RawQuicHandle handle) {
   net::RawQuic* raw_quic = (net::RawQuic*)handle;
   return raw_quic->GetSendBufferSize();
 }
+
+int32_t RAW_QUIC_CALL RawQuicGetStats(RawQuicHandle handle,
+                                      RawQuicStats* out) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  return raw_quic->GetStats(out);
+}
+
+int32_t RAW_QUIC_CALL RawQuicGetLatencyStats(RawQuicHandle handle,
+                                             RawQuicLatencyStats* out,
+                                             bool reset) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  if (out == NULL) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->GetLatencyStats(out, reset);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicGetGlobalLatencyStats(RawQuicLatencyStats* out,
+                                                   bool reset) {
+  if (out == NULL) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  net::RawQuicContext::GetInstance()->GetLatencyHistograms()->Snapshot(out,
+                                                                      reset);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL
+RawQuicSetBandwidthThresholds(RawQuicHandle handle,
+                              const RawQuicBandwidthThresholds* thresholds) {
+  if (handle == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  if (thresholds == NULL) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->SetBandwidthThresholds(*thresholds);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+void RAW_QUIC_CALL RawQuicCork(RawQuicHandle handle) {
+  if (handle == 0) {
+    return;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->Cork();
+}
+
+void RAW_QUIC_CALL RawQuicUncork(RawQuicHandle handle) {
+  if (handle == 0) {
+    return;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->Uncork();
+}
+
+void RAW_QUIC_CALL RawQuicSetCoalesceDelay(RawQuicHandle handle,
+                                           uint32_t delay_us) {
+  if (handle == 0) {
+    return;
+  }
+
+  net::RawQuic* raw_quic = (net::RawQuic*)handle;
+  raw_quic->SetCoalesceDelay(delay_us);
+}
+
+void RAW_QUIC_CALL RawQuicSetPoolIdleTimeout(uint32_t idle_ms) {
+  net::RawQuicContext::GetInstance()->SetPoolIdleTimeout(idle_ms);
+}
+
+void RAW_QUIC_CALL RawQuicSetQlogDir(const char* dir) {
+  net::RawQuicContext::GetInstance()->SetQlogDir(dir == NULL ? "" : dir);
+}
+
+int32_t RAW_QUIC_CALL RawQuicPreconnect(const char* host,
+                                        uint16_t port,
+                                        const char* path,
+                                        bool verify) {
+  if (host == NULL) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  net::RawQuicContext::GetInstance()->Preconnect(
+      host, port, path == NULL ? "" : path, verify);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicListen(const char* ip,
+                                    uint16_t port,
+                                    const char* cert_path,
+                                    const char* key_path,
+                                    uint32_t threads,
+                                    AcceptCallback accept_callback,
+                                    RawQuicCallbacks callback,
+                                    void* opaque,
+                                    RawQuicListenerHandle* listener) {
+  if (accept_callback == NULL || listener == NULL) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  net::RawQuicServer* server =
+      new net::RawQuicServer(accept_callback, callback, opaque);
+  int32_t ret = server->Listen(ip, port, cert_path, key_path, threads);
+  if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    delete server;
+    return ret;
+  }
+
+  *listener = (RawQuicListenerHandle)server;
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicStopListen(RawQuicListenerHandle listener) {
+  if (listener == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  net::RawQuicServer* server = (net::RawQuicServer*)listener;
+  server->Stop();
+  delete server;
+
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL RawQuicGetListenerStats(RawQuicListenerHandle listener,
+                                              RawQuicListenerStats* stats) {
+  if (listener == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  if (stats == NULL) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  net::RawQuicServer* server = (net::RawQuicServer*)listener;
+  server->GetStats(stats);
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+int32_t RAW_QUIC_CALL
+RawQuicSetHandshakeLimit(RawQuicListenerHandle listener,
+                         const RawQuicHandshakeLimit* limit) {
+  if (listener == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_HANDLE;
+  }
+
+  if (limit == NULL) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  net::RawQuicServer* server = (net::RawQuicServer*)listener;
+  return server->SetHandshakeLimit(*limit);
+}
@@ -1,6 +1,6 @@
 /**
  *  @file        raw_quic_api.h
- *  @brief       RawQuic apiļ.
+ *  @brief       RawQuic api声明文件.
  *  @author      sonysuqin
  *  @copyright   sonysuqin
  *  @version     1.0.1
@@ -16,33 +16,104 @@ extern "C" {
 #endif
 
 /**
- *  @brief  һRawQuic.
- *  @param  callback        첽ص.
- *  @param  opaque          ϲ㴫ݵĲڻصΪش.
- *  @param  verify          ǷУ֤.
- *  @return RawQuic.
+ *  @brief  创建一个RawQuic句柄.
+ *  @param  callback        异步回调.
+ *  @param  opaque          上层传递的参数，将在回调中作为参数回传.
+ *  @param  verify          是否校验证书.
+ *  @return RawQuic句柄.
  */
 RAW_QUIC_API RawQuicHandle RAW_QUIC_CALL RawQuicOpen(RawQuicCallbacks callback,
                                                      void* opaque,
                                                      bool verify);
 
 /**
- *  @brief  رһRawQuic.
- *  @param  handle          RawQuic.
- *  @return .
+ *  @brief  设置优雅关闭完成回调.
+ *  @param  handle          RawQuic句柄.
+ *  @param  callback        回调，NULL为不回调.
+ *  @note   可在任意线程调用，之后发生的事件使用新的回调，下同.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicSetShutdownCallback(RawQuicHandle handle, ShutdownCallback callback);
+
+/**
+ *  @brief  设置异步关闭完成回调.
+ *  @param  handle          RawQuic句柄.
+ *  @param  callback        回调，NULL为不回调.
+ *  @note   须在RawQuicCloseAsync之前设置.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicSetClosedCallback(RawQuicHandle handle, ClosedCallback callback);
+
+/**
+ *  @brief  设置连接迁移结果回调.
+ *  @param  handle          RawQuic句柄.
+ *  @param  callback        回调，NULL为不回调.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicSetMigrateCallback(RawQuicHandle handle, MigrateCallback callback);
+
+/**
+ *  @brief  设置带宽变化回调.
+ *  @param  handle          RawQuic句柄.
+ *  @param  callback        回调，NULL为不回调.
+ *  @note   阈值由RawQuicSetBandwidthThresholds设置.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicSetBandwidthCallback(RawQuicHandle handle, BandwidthCallback callback);
+
+/**
+ *  @brief  关闭一个RawQuic句柄.
+ *  @param  handle          RawQuic句柄.
+ *  @return 错误码.
  */
 RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicClose(RawQuicHandle handle);
 
 /**
- *  @brief  ʹRawQuicһ.
- *  @param  handle          RawQuic.
- *  @param  host            עQUICܣԱ֤.
- *  @param  port            ˶˿.
- *  @param  port            ·.
- *  @param  timeout         ʱʱ䣬ms.
- *  @note   timeout0ʱΪֱͬӳɹʧܡ߳ʱ
- *          timeoutΪ0ʱΪ첽connect_callbackص.
- *  @return .
+ *  @brief  关闭RawQuic连接的发送方向(半关闭).
+ *  @param  handle          RawQuic句柄.
+ *  @note   异步方法，先发送完发送缓冲区中的数据再发送FIN，连接保持，
+ *          之后仍可继续接收对端数据，但不能再发送.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicShutdownWrite(RawQuicHandle handle);
+
+/**
+ *  @brief  异步关闭一个RawQuic句柄.
+ *  @param  handle          RawQuic句柄.
+ *  @note   立即返回，不等待网络线程. 连接关闭后在网络线程上回调
+ *          RawQuicSetClosedCallback设置的回调并释放句柄，之后不能再使用该句柄.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicCloseAsync(RawQuicHandle handle);
+
+/**
+ *  @brief  优雅关闭一个RawQuic连接.
+ *  @param  handle          RawQuic句柄.
+ *  @param  linger_ms       逗留时间，ms.
+ *  @note   异步方法，先发送完发送缓冲区中的数据并发送FIN，再等待数据全部
+ *          被对端确认或者逗留超时后关闭连接，结果由RawQuicSetShutdownCallback
+ *          设置的回调通知.
+ *          期间仍可接收数据，但不能再发送. linger_ms为0时发送FIN后立即关闭.
+ *          完成后仍须调用RawQuicClose释放句柄.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicShutdown(RawQuicHandle handle,
+                                                   int32_t linger_ms);
+
+/**
+ *  @brief  使用RawQuic句柄连接一个服务.
+ *  @param  handle          RawQuic句柄.
+ *  @param  host            服务端域名，注意QUIC必须加密，所以必须有域名及证书.
+ *  @param  port            服务端端口.
+ *  @param  port            服务端路径.
+ *  @param  timeout         超时时间，ms.
+ *  @note   timeout非0时，为同步方法，会阻塞直到连接成功、失败、或者超时，
+ *          当timeout为0时，为异步方法，connect_callback将被回调.
+ *  @return 错误码.
  */
 RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicConnect(RawQuicHandle handle,
                                                   const char* host,
@@ -51,56 +122,283 @@ RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicConnect(RawQuicHandle handle,
                                                   int32_t timeout);
 
 /**
- *  @brief  ʹRawQuicһ.
- *  @param  handle          RawQuic.
- *  @param  data            ݻַ.
- *  @param  size            ݳ.
- *  @note   ֻǷŵͻ.
- *  @return ͵ֽߴ.
+ *  @brief  将RawQuic连接迁移到新的本地地址.
+ *  @param  handle          RawQuic句柄.
+ *  @param  local_ip        新的本地IP地址，NULL时在默认网卡上使用新端口.
+ *  @param  timeout         超时时间，ms.
+ *  @note   用于网络切换，如Wi-Fi切换到蜂窝网络. 先在新路径上探测，对端响应
+ *          后再切换，流及缓冲区中的数据不受影响，探测失败时连接保持在原路径.
+ *          timeout非0时为同步方法，为0时为异步方法，结果由
+ *          RawQuicSetMigrateCallback设置的回调通知.
+ *          开启连接池时共享同一连接的句柄一起迁移.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicMigrate(RawQuicHandle handle,
+                                                  const char* local_ip,
+                                                  int32_t timeout);
+
+/**
+ *  @brief  开启多路径(实验性).
+ *  @param  handle          RawQuic句柄.
+ *  @param  config          多路径配置.
+ *  @note   同步方法，连接成功后调用. 在config->local_ip上增加一条路径，与
+ *          当前路径同时使用，按调度策略分配发送的包. 对端看到的是地址不断
+ *          变化的单一路径，没有按路径的拥塞控制，MIN_RTT在RTT最小的路径
+ *          阻塞时才使用其它路径. 与RawQuicMigrate互斥，开启后不能关闭.
+ *          模拟时延用于在本机两个回环地址上测试.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicEnableMultipath(RawQuicHandle handle,
+                       const RawQuicMultipathConfig* config);
+
+/**
+ *  @brief  使用RawQuic句柄发送一段数据.
+ *  @param  handle          RawQuic句柄.
+ *  @param  data            数据缓存地址.
+ *  @param  size            数据长度.
+ *  @note   只是放到发送缓冲区.
+ *  @return 发送的字节数或者错误码.
  */
 RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicSend(RawQuicHandle handle,
                                                uint8_t* data,
                                                uint32_t size);
 
 /**
- *  @brief  ʹRawQuicһ.
- *  @param  handle          RawQuic.
- *  @param  data            ݻַ.
- *  @param  size            ݻ泤.
- *  @param  timeout         ʱʱ䣬ms.
- *  @note   timeout0ʱȴֱݡʧܡ߳ʱ,
- *          timeoutΪ0ʱֻǳԼջǷݣ
- *          򷵻ݣ򷵻EAGAIN. can_read_callback
- *          ص֪ͨݿɶ(Ե).
- *  @return յֽߴ.
+ *  @brief  使用RawQuic句柄接收一段数据.
+ *  @param  handle          RawQuic句柄.
+ *  @param  data            数据缓存地址.
+ *  @param  size            数据缓存长度.
+ *  @param  timeout         超时时间，ms.
+ *  @note   timeout非0时，将等待直到有数据、失败、或者超时,
+ *          timeout为0时，只是尝试检查接收缓冲区是否有数据，
+ *          有则返回数据，否则返回EAGAIN. can_read_callback
+ *          回调将会通知有数据可读(边缘触发).
+ *          对端发送FIN后，读完数据返回STREAM_FIN，连接不会被关闭.
+ *  @return 接收的字节数或者错误码.
  */
 RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicRecv(RawQuicHandle handle,
                                                uint8_t* data,
                                                uint32_t size,
                                                int32_t timeout);
 
+/**
+ *  @brief  零拷贝查看接收缓冲区中的数据.
+ *  @param  handle          RawQuic句柄.
+ *  @param  regions         输出接收缓冲区的数据区域数组，由句柄持有.
+ *  @param  count           输出数据区域个数，最多2个.
+ *  @note   非阻塞方法，返回的区域在调用RawQuicRecvConsume之前一直有效,
+ *          期间接收缓冲区不会再被填充，也不能调用RawQuicRecv.
+ *  @return 可查看的字节数或者错误码，无数据时返回EAGAIN.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicRecvPeek(RawQuicHandle handle,
+                                                   const RawQuicIovec** regions,
+                                                   int* count);
+
+/**
+ *  @brief  消费接收缓冲区头部的数据，并结束RawQuicRecvPeek.
+ *  @param  handle          RawQuic句柄.
+ *  @param  n               消费的字节数，超过可读长度时全部消费.
+ *  @note   n为0时只结束RawQuicRecvPeek，之前返回的区域随即失效.
+ *  @return 消费的字节数或者错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicRecvConsume(RawQuicHandle handle,
+                                                      uint32_t n);
 
 /**
- *  @brief  ȡջݳ.
- *  @param  handle          RawQuic.
- *  @return ջݳ.
+ *  @brief  获取接收缓冲区的数据长度.
+ *  @param  handle          RawQuic句柄.
+ *  @return 接收缓冲区的数据长度.
  */
 RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicGetRecvBufferDataSize(RawQuicHandle handle);
 
 /**
- *  @brief  ÷ͻС.
- *  @param  handle          RawQuic.
- *  @param  size            С.
+ *  @brief  设置发送缓冲区大小.
+ *  @param  handle          RawQuic句柄.
+ *  @param  size            缓冲区大小.
  */
 RAW_QUIC_API void RawQuicSetSendBufferSize(RawQuicHandle handle, uint32_t size);
 
 /**
- *  @brief  ȡͻĴС.
- *  @param  handle          RawQuic.
- *  @return ͻĴС.
+ *  @brief  获取发送缓冲区的大小.
+ *  @param  handle          RawQuic句柄.
+ *  @return 发送缓冲区的大小.
  */
 RAW_QUIC_API uint32_t RAW_QUIC_CALL RawQuicGetSendBufferSize(RawQuicHandle handle);
 
+/**
+ *  @brief  设置接收缓冲区大小.
+ *  @param  handle          RawQuic句柄.
+ *  @param  size            缓冲区大小，默认512KB.
+ *  @note   接收缓冲区满时数据留在QUIC流中，由流控限制对端发送.
+ */
+RAW_QUIC_API void RAW_QUIC_CALL RawQuicSetRecvBufferSize(RawQuicHandle handle,
+                                                        uint32_t size);
+
+/**
+ *  @brief  获取连接统计.
+ *  @param  handle          RawQuic句柄.
+ *  @param  out             统计输出.
+ *  @note   在网络线程上取快照，只拷贝数据，不会长时间阻塞网络线程. 可在
+ *          任意线程调用，在回调中调用时直接取快照.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicGetStats(RawQuicHandle handle,
+                                                   RawQuicStats* out);
+
+/**
+ *  @brief  获取连接的时延分布.
+ *  @param  handle          RawQuic句柄.
+ *  @param  out             时延分布输出.
+ *  @param  reset           取完后是否清零.
+ *  @note   不经过网络线程，可在任意线程及回调中调用.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicGetLatencyStats(RawQuicHandle handle,
+                       RawQuicLatencyStats* out,
+                       bool reset);
+
+/**
+ *  @brief  获取本进程所有连接合计的时延分布.
+ *  @param  out             时延分布输出.
+ *  @param  reset           取完后是否清零.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicGetGlobalLatencyStats(RawQuicLatencyStats* out, bool reset);
+
+/**
+ *  @brief  设置带宽变化回调的阈值.
+ *  @param  handle          RawQuic句柄.
+ *  @param  thresholds      阈值.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicSetBandwidthThresholds(RawQuicHandle handle,
+                              const RawQuicBandwidthThresholds* thresholds);
+
+/**
+ *  @brief  塞住发送，之后的小数据合并到同一块缓存，直到RawQuicUncork.
+ *  @param  handle          RawQuic句柄.
+ *  @note   合并缓存满16KB时仍然会发送.
+ */
+RAW_QUIC_API void RAW_QUIC_CALL RawQuicCork(RawQuicHandle handle);
+
+/**
+ *  @brief  解除塞住，立即发送已合并的数据.
+ *  @param  handle          RawQuic句柄.
+ */
+RAW_QUIC_API void RAW_QUIC_CALL RawQuicUncork(RawQuicHandle handle);
+
+/**
+ *  @brief  设置自动合并发送的延迟(类似Nagle).
+ *  @param  handle          RawQuic句柄.
+ *  @param  delay_us        合并延迟，us，0为关闭(默认)，最大200ms.
+ *  @note   开启后，小数据先合并到缓存，最多等待delay_us后统一发送.
+ */
+RAW_QUIC_API void RAW_QUIC_CALL RawQuicSetCoalesceDelay(RawQuicHandle handle,
+                                                        uint32_t delay_us);
+
+/**
+ *  @brief  设置连接池空闲超时，开启连接复用.
+ *  @param  idle_ms         空闲超时，ms，0为关闭连接池(默认).
+ *  @note   开启后，host、port、path及verify相同的句柄共享同一个QUIC连接，
+ *          每个句柄使用连接上的一个独立流，已建立的连接上RawQuicConnect
+ *          无需握手. 连接在最后一个句柄关闭后保留idle_ms，注意超过QUIC
+ *          空闲超时(30s)无数据时连接仍会被关闭.
+ */
+RAW_QUIC_API void RAW_QUIC_CALL RawQuicSetPoolIdleTimeout(uint32_t idle_ms);
+
+/**
+ *  @brief  开启qlog跟踪，用于离线分析拥塞及丢包.
+ *  @param  dir             输出目录，NULL或空串为关闭(默认).
+ *  @note   只对之后新建的连接生效，每个连接写一个<连接ID>.qlog文件，
+ *          格式为qlog draft-02 JSON-SEQ，可用qvis等工具打开. 文件在后台
+ *          线程写入，不阻塞网络线程.
+ */
+RAW_QUIC_API void RAW_QUIC_CALL RawQuicSetQlogDir(const char* dir);
+
+/**
+ *  @brief  预连接一个服务.
+ *  @param  host            服务端域名.
+ *  @param  port            服务端端口.
+ *  @param  path            服务端路径.
+ *  @param  verify          是否校验证书，须与之后RawQuicOpen的verify一致.
+ *  @note   异步方法，立即返回. 在网络线程上解析域名并完成握手，连接保留
+ *          在上下文中，之后相同host、port、path及verify的RawQuicConnect
+ *          直接使用该连接，无需再握手. 未使用的预连接最多保留8个，超出时
+ *          关闭最久未使用的连接，注意超过QUIC空闲超时(30s)仍会被关闭.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL RawQuicPreconnect(const char* host,
+                                                     uint16_t port,
+                                                     const char* path,
+                                                     bool verify);
+
+/**
+ *  @brief  在本地端口上监听QuicTransport连接.
+ *  @param  ip              本地地址，NULL或空串为所有地址.
+ *  @param  port            本地端口.
+ *  @param  cert_path       证书文件路径(PEM).
+ *  @param  key_path        私钥文件路径(PKCS#8 DER).
+ *  @param  threads         网络线程数，0或1时在RawQuic网络线程上监听.
+ *  @param  accept_callback 接受新流回调.
+ *  @param  callback        接受的句柄使用的异步回调.
+ *  @param  opaque          上层传递的参数，将在回调中作为参数回传.
+ *  @param  listener        返回的监听句柄.
+ *  @note   同步方法. 客户端在连接上打开的每个双向流都作为一个新的RawQuic
+ *          句柄由accept_callback回调，之后与RawQuicConnect得到的句柄用法
+ *          相同. threads大于1时(仅Linux及Android)每个线程使用独立的
+ *          SO_REUSEPORT套接字，按目的连接ID分配连接，客户端地址变化后
+ *          连接仍由同一线程处理，accept_callback可能在多个线程上同时回调.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicListen(const char* ip,
+              uint16_t port,
+              const char* cert_path,
+              const char* key_path,
+              uint32_t threads,
+              AcceptCallback accept_callback,
+              RawQuicCallbacks callback,
+              void* opaque,
+              RawQuicListenerHandle* listener);
+
+/**
+ *  @brief  停止监听并释放监听句柄.
+ *  @param  listener        RawQuic监听句柄.
+ *  @note   同步方法，关闭所有已接受的连接，已接受的句柄收到错误回调，
+ *          仍须调用RawQuicClose释放.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicStopListen(RawQuicListenerHandle listener);
+
+/**
+ *  @brief  获取监听统计.
+ *  @param  listener        RawQuic监听句柄.
+ *  @param  stats           返回的统计.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicGetListenerStats(RawQuicListenerHandle listener,
+                        RawQuicListenerStats* stats);
+
+/**
+ *  @brief  设置新连接握手限速.
+ *  @param  listener        RawQuic监听句柄.
+ *  @param  limit           限速.
+ *  @note   同步方法. 网络线程先处理已有连接的包再处理新连接，已有连接不受
+ *          影响. 可开始的握手数不足burst一半时，limit->retry为true(默认)则先
+ *          回复Retry，客户端带令牌重发Initial验证地址后才开始握手. 握手数
+ *          用尽时丢弃Initial包，由客户端重传.
+ *  @return 错误码.
+ */
+RAW_QUIC_API int32_t RAW_QUIC_CALL
+RawQuicSetHandshakeLimit(RawQuicListenerHandle listener,
+                         const RawQuicHandshakeLimit* limit);
+
 #ifdef __cplusplus
 }
 #endif
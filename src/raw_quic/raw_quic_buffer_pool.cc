@@ -0,0 +1,155 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_buffer_pool.h"
+
+#include <algorithm>
+
+#include "base/no_destructor.h"
+
+namespace net {
+
+namespace {
+// Keep the data 16 bytes aligned.
+const uint32_t kBlockHeaderSize = 16;
+const uint32_t kLargeSizeClass = kBufferSizeClassCount;
+const uint32_t kMaxCachedBytesPerClass = 4 * 1024 * 1024;  // 4MB
+const uint32_t kMinCachedBlocksPerClass = 8;
+}  // namespace
+
+RawQuicBufferPool::ThreadCache::~ThreadCache() {
+  RawQuicBufferPool* pool = RawQuicBufferPool::GetInstance();
+  for (uint32_t i = 0; i < kBufferSizeClassCount; ++i) {
+    while (heads[i] != nullptr) {
+      Block* block = heads[i];
+      heads[i] = block->next;
+      pool->PushFree(block);
+    }
+  }
+}
+
+RawQuicBufferPool::RawQuicBufferPool() {
+  static_assert(sizeof(Block) <= kBlockHeaderSize, "Block header too large.");
+  for (uint32_t i = 0; i < kBufferSizeClassCount; ++i) {
+    free_lists_[i].store(nullptr);
+    free_counts_[i].store(0);
+  }
+}
+
+RawQuicBufferPool::~RawQuicBufferPool() {
+  for (uint32_t i = 0; i < kBufferSizeClassCount; ++i) {
+    Block* block = free_lists_[i].exchange(nullptr);
+    while (block != nullptr) {
+      Block* next = block->next;
+      delete[](uint8_t*) block;
+      block = next;
+    }
+  }
+}
+
+RawQuicBufferPool* RawQuicBufferPool::GetInstance() {
+  static base::NoDestructor<RawQuicBufferPool> instance;
+  return instance.get();
+}
+
+uint8_t* RawQuicBufferPool::Allocate(uint32_t size) {
+  int32_t size_class = GetSizeClass(size);
+  if (size_class < 0) {
+    Block* block = (Block*)new uint8_t[kBlockHeaderSize + size];
+    block->next = nullptr;
+    block->size_class = kLargeSizeClass;
+    return ToBuffer(block);
+  }
+
+  ThreadCache* cache = GetThreadCache();
+  if (cache->heads[size_class] == nullptr) {
+    cache->heads[size_class] = TakeFree(size_class);
+  }
+
+  Block* block = cache->heads[size_class];
+  if (block != nullptr) {
+    cache->heads[size_class] = block->next;
+  } else {
+    uint32_t class_size = 1 << (size_class + kMinBufferSizeClassShift);
+    block = (Block*)new uint8_t[kBlockHeaderSize + class_size];
+    block->size_class = size_class;
+  }
+
+  block->next = nullptr;
+  return ToBuffer(block);
+}
+
+void RawQuicBufferPool::Free(uint8_t* buffer) {
+  if (buffer == nullptr) {
+    return;
+  }
+
+  Block* block = ToBlock(buffer);
+  if (block->size_class == kLargeSizeClass) {
+    delete[](uint8_t*) block;
+    return;
+  }
+
+  PushFree(block);
+}
+
+RawQuicBufferPool::ThreadCache* RawQuicBufferPool::GetThreadCache() {
+  static thread_local ThreadCache cache;
+  return &cache;
+}
+
+int32_t RawQuicBufferPool::GetSizeClass(uint32_t size) {
+  for (uint32_t shift = kMinBufferSizeClassShift;
+       shift <= kMaxBufferSizeClassShift; ++shift) {
+    if (size <= (1u << shift)) {
+      return shift - kMinBufferSizeClassShift;
+    }
+  }
+  return -1;
+}
+
+RawQuicBufferPool::Block* RawQuicBufferPool::ToBlock(uint8_t* buffer) {
+  return (Block*)(buffer - kBlockHeaderSize);
+}
+
+uint8_t* RawQuicBufferPool::ToBuffer(Block* block) {
+  return (uint8_t*)block + kBlockHeaderSize;
+}
+
+void RawQuicBufferPool::PushFree(Block* block) {
+  uint32_t size_class = block->size_class;
+  uint32_t class_size = 1 << (size_class + kMinBufferSizeClassShift);
+  uint32_t max_count = std::max<uint32_t>(
+      kMaxCachedBytesPerClass / class_size, kMinCachedBlocksPerClass);
+  if (free_counts_[size_class].fetch_add(1, std::memory_order_relaxed) >=
+      max_count) {
+    free_counts_[size_class].fetch_sub(1, std::memory_order_relaxed);
+    delete[](uint8_t*) block;
+    return;
+  }
+
+  // Only pushes race here, pops take the whole list, so no ABA.
+  Block* head = free_lists_[size_class].load(std::memory_order_relaxed);
+  do {
+    block->next = head;
+  } while (!free_lists_[size_class].compare_exchange_weak(
+      head, block, std::memory_order_release, std::memory_order_relaxed));
+}
+
+RawQuicBufferPool::Block* RawQuicBufferPool::TakeFree(uint32_t size_class) {
+  Block* head =
+      free_lists_[size_class].exchange(nullptr, std::memory_order_acquire);
+  uint32_t count = 0;
+  for (Block* block = head; block != nullptr; block = block->next) {
+    ++count;
+  }
+  free_counts_[size_class].fetch_sub(count, std::memory_order_relaxed);
+  return head;
+}
+
+void RawQuicBufferDeleter::operator()(uint8_t* buffer) const {
+  RawQuicBufferPool::GetInstance()->Free(buffer);
+}
+
+}  // namespace net
@@ -0,0 +1,94 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_BUFFER_POOL_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_BUFFER_POOL_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace net {
+
+// Size classes are powers of two from 256B to 64KB.
+const uint32_t kMinBufferSizeClassShift = 8;
+const uint32_t kMaxBufferSizeClassShift = 16;
+const uint32_t kBufferSizeClassCount =
+    kMaxBufferSizeClassShift - kMinBufferSizeClassShift + 1;
+
+/////////////////////////////////RawQuicBufferPool/////////////////////////////////
+// Size-class buffer pool shared by all connections of the process.
+// Buffers are usually allocated on caller threads and freed on the IO
+// thread, so frees are pushed onto a lock-free list per size class and
+// allocating threads grab the whole list into a thread-local cache at once,
+// which keeps the hot path free of locks and ABA issues.
+class RawQuicBufferPool {
+ public:
+  RawQuicBufferPool();
+  virtual ~RawQuicBufferPool();
+  static RawQuicBufferPool* GetInstance();
+
+ public:
+  uint8_t* Allocate(uint32_t size);
+
+  void Free(uint8_t* buffer);
+
+ protected:
+  struct Block {
+    Block* next;
+    uint32_t size_class;
+  };
+
+  struct ThreadCache {
+    ~ThreadCache();
+    Block* heads[kBufferSizeClassCount] = {};
+  };
+
+  static ThreadCache* GetThreadCache();
+
+  static int32_t GetSizeClass(uint32_t size);
+
+  static Block* ToBlock(uint8_t* buffer);
+
+  static uint8_t* ToBuffer(Block* block);
+
+  void PushFree(Block* block);
+
+  Block* TakeFree(uint32_t size_class);
+
+ protected:
+  std::atomic<Block*> free_lists_[kBufferSizeClassCount];
+  std::atomic<uint32_t> free_counts_[kBufferSizeClassCount];
+};
+
+struct RawQuicBufferDeleter {
+  void operator()(uint8_t* buffer) const;
+};
+
+typedef std::unique_ptr<uint8_t[], RawQuicBufferDeleter> RawQuicBufferPtr;
+
+///////////////////////////////////RawQuicBuffer///////////////////////////////////
+// Pooled data chunk queued for writing.
+class RawQuicBuffer {
+ public:
+  RawQuicBuffer(RawQuicBufferPtr buffer, uint32_t size, int64_t time_us = 0)
+      : buffer_(std::move(buffer)), size_(size), time_us_(time_us) {}
+
+  const char* data() const { return (const char*)buffer_.get(); }
+
+  uint32_t length() const { return size_; }
+
+  // When the caller handed the data over.
+  int64_t time_us() const { return time_us_; }
+
+ private:
+  RawQuicBufferPtr buffer_;
+  uint32_t size_ = 0;
+  int64_t time_us_ = 0;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_BUFFER_POOL_H_
@@ -0,0 +1,123 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_COMMAND_QUEUE_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_COMMAND_QUEUE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace net {
+
+typedef enum RawQuicCommandType {
+  RAW_QUIC_COMMAND_WRITE = 0,
+  RAW_QUIC_COMMAND_READ,
+  RAW_QUIC_COMMAND_SET_SEND_BUFFER_SIZE,
+  RAW_QUIC_COMMAND_SET_RECV_BUFFER_SIZE,
+  RAW_QUIC_COMMAND_COUNT
+} RawQuicCommandType;
+
+class RawQuicCommandHandler;
+
+// Hot path operation posted from caller threads to the IO thread.
+struct RawQuicCommand {
+  RawQuicCommandHandler* handler;
+  int32_t type;
+  uint8_t* data;
+  uint32_t size;
+  // Caller side time in us, for latency accounting.
+  int64_t time_us;
+};
+
+class RawQuicCommandHandler {
+ public:
+  virtual ~RawQuicCommandHandler() {}
+  virtual void OnCommand(const RawQuicCommand& command) = 0;
+};
+
+//////////////////////////////////RawQuicMpscRing//////////////////////////////////
+// Bounded lock-free ring, any thread may push, only one thread may pop.
+// Each cell carries a sequence number telling whether it is free for the
+// producer at the same position or filled for the consumer, so producers
+// only contend on one atomic increment.
+template <typename T>
+class RawQuicMpscRing {
+ public:
+  // Capacity must be power of 2.
+  explicit RawQuicMpscRing(uint32_t capacity)
+      : cells_(new Cell[capacity]), mask_(capacity - 1) {
+    for (uint32_t i = 0; i < capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    enqueue_pos_.store(0, std::memory_order_relaxed);
+  }
+
+  RawQuicMpscRing(const RawQuicMpscRing&) = delete;
+  RawQuicMpscRing& operator=(const RawQuicMpscRing&) = delete;
+
+  // Returns false if ring is full.
+  bool Push(const T& value) {
+    Cell* cell = nullptr;
+    uint64_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+      int64_t diff = (int64_t)sequence - (int64_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->value = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer thread only.
+  bool Pop(T* value) {
+    Cell* cell = &cells_[dequeue_pos_ & mask_];
+    uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if (sequence != dequeue_pos_ + 1) {
+      return false;
+    }
+
+    *value = cell->value;
+    cell->sequence.store(dequeue_pos_ + mask_ + 1, std::memory_order_release);
+    ++dequeue_pos_;
+    return true;
+  }
+
+  // Consumer thread only.
+  bool Empty() {
+    Cell* cell = &cells_[dequeue_pos_ & mask_];
+    return cell->sequence.load(std::memory_order_acquire) != dequeue_pos_ + 1;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<uint64_t> sequence;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  uint64_t mask_ = 0;
+  // Keep producer and consumer positions on different cache lines.
+  alignas(64) std::atomic<uint64_t> enqueue_pos_;
+  alignas(64) uint64_t dequeue_pos_ = 0;
+};
+
+typedef RawQuicMpscRing<RawQuicCommand> RawQuicCommandQueue;
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_COMMAND_QUEUE_H_
@@ -3,33 +3,52 @@
 // found in the LICENSE file.
 #include "net/quic/raw_quic/raw_quic_context.h"
 
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "base/no_destructor.h"
+#include "base/strings/string_number_conversions.h"
+
 #include "net/quic/platform/impl/quic_chromium_clock.h"
 #include "net/quic/quic_chromium_alarm_factory.h"
 #include "net/quic/quic_chromium_connection_helper.h"
 #include "net/quic/quic_chromium_packet_reader.h"
 #include "net/quic/quic_chromium_packet_writer.h"
-#include "net/third_party/quiche/src/quic/platform/api/quic_default_proof_providers.h"
+#include "net/quic/raw_quic/raw_quic_proof_verifier.h"
+#include "net/quic/raw_quic/raw_quic_qlog.h"
+#include "net/quic/raw_quic/raw_quic_session_pool.h"
 #include "net/third_party/quiche/src/quic/platform/api/quic_flags.h"
 #include "net/third_party/quiche/src/quic/platform/api/quic_system_event_loop.h"
 #include "net/third_party/quiche/src/quic/tools/fake_proof_verifier.h"
 
 namespace net {
 
-RawQuicContext::RawQuicContext() : event_loop_("RawQuic") {
+namespace {
+const uint32_t kCommandQueueCapacity = 16 * 1024;
+const uint32_t kMaxCommandsPerDrain = 256;
+}  // namespace
+
+RawQuicContext::RawQuicContext()
+    : event_loop_(std::make_unique<QuicSystemEventLoop>("RawQuic")),
+      command_queue_(kCommandQueueCapacity),
+      session_pool_(std::make_unique<RawQuicSessionPool>()),
+      drain_scheduled_(false) {
 #if defined(OS_WIN)
   WSADATA wsaData;
   WSAStartup(MAKEWORD(2, 2), &wsaData);
 #endif
 
-  if (thread_ == nullptr) {
-    thread_ = std::make_unique<base::Thread>("RawQuic");
-    base::Thread::Options thread_options(base::MessagePumpType::IO, 0);
-    thread_->StartWithOptions(thread_options);
-  }
+  StartThread("RawQuic");
+}
 
-  if (task_runner_ == nullptr && thread_ != nullptr) {
-    task_runner_ = thread_->task_runner();
-  }
+RawQuicContext::RawQuicContext(const std::string& thread_name)
+    : command_queue_(kCommandQueueCapacity),
+      session_pool_(std::make_unique<RawQuicSessionPool>()),
+      drain_scheduled_(false) {
+  // Event loop is once per process, the instance sets it up.
+  GetInstance();
+  StartThread(thread_name);
 }
 
 RawQuicContext::~RawQuicContext() {
@@ -43,17 +62,92 @@ RawQuicContext::~RawQuicContext() {
   }
 }
 
+void RawQuicContext::StartThread(const std::string& thread_name) {
+  if (thread_ == nullptr) {
+    thread_ = std::make_unique<base::Thread>(thread_name);
+    base::Thread::Options thread_options(base::MessagePumpType::IO, 0);
+    thread_->StartWithOptions(thread_options);
+  }
+
+  if (task_runner_ == nullptr && thread_ != nullptr) {
+    task_runner_ = thread_->task_runner();
+  }
+}
+
 RawQuicContext* RawQuicContext::GetInstance() {
   static base::NoDestructor<RawQuicContext> instance;
   return instance.get();
 }
 
+// static
+RawQuicContext* RawQuicContext::GetWorkerInstance(uint32_t index) {
+  static base::NoDestructor<std::mutex> mutex;
+  static base::NoDestructor<std::vector<std::unique_ptr<RawQuicContext>>>
+      workers;
+  std::unique_lock<std::mutex> lock(*mutex);
+  while (workers->size() <= index) {
+    workers->push_back(std::make_unique<RawQuicContext>(
+        "RawQuicWorker" + base::NumberToString(workers->size())));
+  }
+  return (*workers)[index].get();
+}
+
 void RawQuicContext::Post(base::OnceClosure task) {
   if (task_runner_ != nullptr) {
     task_runner_->PostTask(FROM_HERE, std::move(task));
   }
 }
 
+bool RawQuicContext::BelongsToCurrentThread() {
+  return task_runner_ != nullptr && task_runner_->BelongsToCurrentThread();
+}
+
+void RawQuicContext::PostCommand(const RawQuicCommand& command) {
+  while (!command_queue_.Push(command)) {
+    // Ring is full, drain it inline on IO thread to keep commands in order,
+    // otherwise wait for IO thread to make room.
+    if (BelongsToCurrentThread()) {
+      DrainCommands();
+    } else {
+      std::this_thread::yield();
+    }
+  }
+
+  // Wake up IO thread only once until it drains the ring.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!drain_scheduled_.exchange(true)) {
+    Post(base::Bind(&RawQuicContext::DoDrainCommands, base::Unretained(this)));
+  }
+}
+
+void RawQuicContext::DrainCommands() {
+  RawQuicCommand command;
+  while (command_queue_.Pop(&command)) {
+    command.handler->OnCommand(command);
+  }
+}
+
+void RawQuicContext::DoDrainCommands() {
+  RawQuicCommand command;
+  uint32_t count = 0;
+  while (count < kMaxCommandsPerDrain && command_queue_.Pop(&command)) {
+    command.handler->OnCommand(command);
+    ++count;
+  }
+
+  // Yield to other tasks, such as packet reading, between batches.
+  if (count == kMaxCommandsPerDrain) {
+    Post(base::Bind(&RawQuicContext::DoDrainCommands, base::Unretained(this)));
+    return;
+  }
+
+  drain_scheduled_.store(false);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!command_queue_.Empty() && !drain_scheduled_.exchange(true)) {
+    Post(base::Bind(&RawQuicContext::DoDrainCommands, base::Unretained(this)));
+  }
+}
+
 base::SingleThreadTaskRunner* RawQuicContext::GetTaskRunner() {
   return task_runner_.get();
 }
@@ -86,13 +180,46 @@ net::NetLogWithSource* RawQuicContext::GetNetLogWithSource() {
   return &net_log_;
 }
 
+RawQuicSessionPool* RawQuicContext::GetSessionPool() {
+  return session_pool_.get();
+}
+
+RawQuicLatencyHistograms* RawQuicContext::GetLatencyHistograms() {
+  return &latency_histograms_;
+}
+
+void RawQuicContext::SetPoolIdleTimeout(uint32_t idle_ms) {
+  Post(base::Bind(&RawQuicSessionPool::SetIdleTimeout,
+                  base::Unretained(session_pool_.get()), idle_ms));
+}
+
+void RawQuicContext::SetQlogDir(const std::string& dir) {
+  Post(base::Bind(&RawQuicSessionPool::SetQlogDir,
+                  base::Unretained(session_pool_.get()), dir));
+}
+
+RawQuicQlogWriter* RawQuicContext::GetQlogWriter() {
+  if (qlog_writer_ == nullptr) {
+    qlog_writer_ = std::make_unique<RawQuicQlogWriter>();
+  }
+  return qlog_writer_.get();
+}
+
+void RawQuicContext::Preconnect(const std::string& host,
+                                uint16_t port,
+                                const std::string& path,
+                                bool verify) {
+  RawQuicSessionKey key = {host, port, path, verify};
+  Post(base::Bind(&RawQuicSessionPool::Preconnect,
+                  base::Unretained(session_pool_.get()), key));
+}
+
 std::unique_ptr<quic::ProofVerifier> RawQuicContext::CreateProofVerifier(
-    const std::string& host,
     bool verify) {
   if (!verify) {
     return std::make_unique<quic::FakeProofVerifier>();
   } else {
-    return quic::CreateDefaultProofVerifier(host);
+    return std::make_unique<RawQuicProofVerifier>();
   }
 }
 
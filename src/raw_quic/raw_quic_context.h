@@ -5,12 +5,16 @@
 #ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_CONTEXT_H_
 #define NET_QUIC_RAW_QUIC_RAW_QUIC_CONTEXT_H_
 
+#include <atomic>
 #include <memory>
+#include <string>
 
 #include "base/callback_forward.h"
 #include "base/single_thread_task_runner.h"
 #include "base/threading/thread.h"
 #include "net/log/net_log_with_source.h"
+#include "net/quic/raw_quic/raw_quic_command_queue.h"
+#include "net/quic/raw_quic/raw_quic_histogram.h"
 #include "net/third_party/quiche/src/quic/core/crypto/proof_verifier.h"
 #include "net/third_party/quiche/src/quic/core/crypto/quic_random.h"
 #include "net/third_party/quiche/src/quic/core/quic_alarm_factory.h"
@@ -20,15 +24,32 @@
 
 namespace net {
 
+class RawQuicQlogWriter;
+class RawQuicSessionPool;
+
 class RawQuicContext {
  public:
   RawQuicContext();
+  // Extra IO thread, process wide state such as the event loop and global
+  // latency stats stays with the instance.
+  explicit RawQuicContext(const std::string& thread_name);
   virtual ~RawQuicContext();
   static RawQuicContext* GetInstance();
 
+  // Extra IO threads of listener workers, created on first use and kept
+  // like the instance, handles accepted on them may outlive the listener.
+  static RawQuicContext* GetWorkerInstance(uint32_t index);
+
  public:
   void Post(base::OnceClosure task);
 
+  // True on the IO thread, sync methods called there must not wait for it.
+  bool BelongsToCurrentThread();
+
+  void PostCommand(const RawQuicCommand& command);
+
+  void DrainCommands();
+
   base::SingleThreadTaskRunner* GetTaskRunner();
 
   quic::QuicAlarmFactory* GetQuicAlarmFactory();
@@ -41,9 +62,30 @@ class RawQuicContext {
 
   net::NetLogWithSource* GetNetLogWithSource();
 
-  std::unique_ptr<quic::ProofVerifier> CreateProofVerifier(
-      const std::string& host,
-      bool verify = true);
+  RawQuicSessionPool* GetSessionPool();
+
+  RawQuicLatencyHistograms* GetLatencyHistograms();
+
+  void SetPoolIdleTimeout(uint32_t idle_ms);
+
+  void SetQlogDir(const std::string& dir);
+
+  // Created on first use, IO thread only.
+  RawQuicQlogWriter* GetQlogWriter();
+
+  void Preconnect(const std::string& host,
+                  uint16_t port,
+                  const std::string& path,
+                  bool verify);
+
+  // With verify, chains are checked once per host and cached process wide,
+  // see RawQuicProofVerifier.
+  std::unique_ptr<quic::ProofVerifier> CreateProofVerifier(bool verify);
+
+ protected:
+  void StartThread(const std::string& thread_name);
+
+  void DoDrainCommands();
 
  protected:
   std::unique_ptr<base::Thread> thread_;
@@ -51,7 +93,12 @@ class RawQuicContext {
   std::unique_ptr<quic::QuicAlarmFactory> alarm_factory_;
   std::unique_ptr<quic::QuicConnectionHelperInterface> helper_;
   net::NetLogWithSource net_log_;
-  QuicSystemEventLoop event_loop_;
+  std::unique_ptr<QuicSystemEventLoop> event_loop_;
+  RawQuicCommandQueue command_queue_;
+  std::unique_ptr<RawQuicSessionPool> session_pool_;
+  RawQuicLatencyHistograms latency_histograms_;
+  std::unique_ptr<RawQuicQlogWriter> qlog_writer_;
+  std::atomic<bool> drain_scheduled_;
 };
 
 }  // namespace net
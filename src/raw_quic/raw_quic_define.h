@@ -1,6 +1,6 @@
 /**
  *  @file        raw_quic_define.h
- *  @brief       RawQuic apiݽṹļ.
+ *  @brief       RawQuic api数据结构声明文件.
  *  @author      sonysuqin
  *  @copyright   sonysuqin
  *  @version     1.0.1
@@ -31,75 +31,230 @@
 #define RAW_QUIC_CALLBACK
 #endif
 
-/// Ҫ֧C99.
+/// 需要支持C99.
 #include <stdint.h>
 #include <stdbool.h>
 
-/// .
+/// 错误码.
 typedef enum RawQuicErrorCode {
-  RAW_QUIC_ERROR_CODE_SUCCESS               = 0,    //!< ɹ.
-  RAW_QUIC_ERROR_CODE_INVALID_PARAM         = -1,   //!< Ƿ.
-  RAW_QUIC_ERROR_CODE_INVALID_STATE         = -2,   //!< Ƿ״̬.
-  RAW_QUIC_ERROR_CODE_NULL_POINTER          = -3,   //!< ָ.
-  RAW_QUIC_ERROR_CODE_SOCKET_ERROR          = -4,   //!< Socket.
-  RAW_QUIC_ERROR_CODE_RESOLVE_FAILED        = -5,   //!< ʧ.
-  RAW_QUIC_ERROR_CODE_BUFFER_OVERFLOWED     = -6,   //!< .
-  RAW_QUIC_ERROR_CODE_STREAM_FIN            = -7,   //!< .
-  RAW_QUIC_ERROR_CODE_STREAM_RESET          = -8,   //!< .
-  RAW_QUIC_ERROR_CODE_NET_ERROR             = -9,   //!< .
-  RAW_QUIC_ERROR_CODE_QUIC_ERROR            = -10,  //!< QUIC.
-  RAW_QUIC_ERROR_CODE_TIMEOUT               = -11,  //!< ʱ.
-  RAW_QUIC_ERROR_CODE_UNKNOWN               = -12,  //!< δ֪.
-  RAW_QUIC_ERROR_CODE_INVALID_HANDLE        = -13,  //!< Ƿ.
+  RAW_QUIC_ERROR_CODE_SUCCESS               = 0,    //!< 成功.
+  RAW_QUIC_ERROR_CODE_INVALID_PARAM         = -1,   //!< 非法参数.
+  RAW_QUIC_ERROR_CODE_INVALID_STATE         = -2,   //!< 非法状态.
+  RAW_QUIC_ERROR_CODE_NULL_POINTER          = -3,   //!< 空指针.
+  RAW_QUIC_ERROR_CODE_SOCKET_ERROR          = -4,   //!< Socket错误.
+  RAW_QUIC_ERROR_CODE_RESOLVE_FAILED        = -5,   //!< 解析失败.
+  RAW_QUIC_ERROR_CODE_BUFFER_OVERFLOWED     = -6,   //!< 缓冲区溢出.
+  RAW_QUIC_ERROR_CODE_STREAM_FIN            = -7,   //!< 流被结束.
+  RAW_QUIC_ERROR_CODE_STREAM_RESET          = -8,   //!< 流被重置.
+  RAW_QUIC_ERROR_CODE_NET_ERROR             = -9,   //!< 网络错误.
+  RAW_QUIC_ERROR_CODE_QUIC_ERROR            = -10,  //!< QUIC错误.
+  RAW_QUIC_ERROR_CODE_TIMEOUT               = -11,  //!< 超时.
+  RAW_QUIC_ERROR_CODE_UNKNOWN               = -12,  //!< 未知错误.
+  RAW_QUIC_ERROR_CODE_INVALID_HANDLE        = -13,  //!< 非法句柄.
   RAW_QUIC_ERROR_CODE_EAGAIN                = -14,  //!< EAGAIN.
   RAW_QUIC_ERROR_CODE_COUNT
 } RawQuicErrorCode;
 
-/// ṹ.
+/// 错误结构.
 typedef struct RawQuicError {
-  RawQuicErrorCode error;   //!< RawQuicErrorCode.
-  int32_t net_error;        //!< .
-  int32_t quic_error;       //!< QUIC.
+  RawQuicErrorCode error;   //!< RawQuicErrorCode错误码.
+  int32_t net_error;        //!< 网络错误码.
+  int32_t quic_error;       //!< QUIC错误码.
 } RawQuicError;
 
-/// RawQuic.
+/// RawQuic句柄类型.
 typedef void* RawQuicHandle;
 
+/// RawQuic监听句柄类型.
+typedef void* RawQuicListenerHandle;
+
+/// 接收缓冲区数据区域.
+typedef struct RawQuicIovec {
+  const uint8_t* base;      //!< 区域起始地址.
+  uint32_t len;             //!< 区域长度.
+} RawQuicIovec;
+
+/// 连接统计，共享连接时连接相关字段为整个连接的统计.
+typedef struct RawQuicStats {
+  int64_t min_rtt_us;               //!< 最小RTT，us.
+  int64_t smoothed_rtt_us;          //!< 平滑RTT，us.
+  int64_t latest_rtt_us;            //!< 最近一次RTT，us.
+  uint64_t bandwidth_estimate_bps;  //!< 带宽估计，bit/s.
+  uint64_t pacing_rate_bps;         //!< 发送速率，bit/s.
+  uint64_t cwnd_bytes;              //!< 拥塞窗口，字节.
+  uint64_t bytes_in_flight;         //!< 已发送未确认，字节.
+  uint64_t packets_sent;            //!< 发送包数.
+  uint64_t bytes_sent;              //!< 发送字节数.
+  uint64_t packets_received;        //!< 接收包数.
+  uint64_t bytes_received;          //!< 接收字节数.
+  uint64_t packets_lost;            //!< 丢包数.
+  uint64_t packets_retransmitted;   //!< 重传包数.
+  uint64_t bytes_retransmitted;     //!< 重传字节数.
+  uint32_t send_buffer_bytes;       //!< 发送缓冲区中待发送数据，字节.
+  uint32_t send_buffer_size;        //!< 发送缓冲区大小，字节.
+  uint32_t recv_buffer_bytes;       //!< 接收缓冲区中未读数据，字节.
+  uint32_t recv_buffer_size;        //!< 接收缓冲区大小，字节.
+} RawQuicStats;
+
+/// 监听统计，所有网络线程合计.
+typedef struct RawQuicListenerStats {
+  uint32_t threads;                 //!< 网络线程数.
+  uint64_t packets_received;        //!< 接收包数.
+  uint64_t packets_forwarded;       //!< 由其他线程收到后转交的包数.
+  uint64_t handshakes_accepted;     //!< 准许开始握手的新连接数.
+  uint64_t handshakes_retried;      //!< 回复Retry要求验证地址的新连接数.
+  uint64_t handshakes_validated;    //!< 带Retry令牌重发Initial，准许握手的新连接数.
+  uint64_t handshakes_dropped;      //!< 超出限速而丢弃的新连接包数.
+} RawQuicListenerStats;
+
+/// 新连接握手限速，每个网络线程独立计算.
+typedef struct RawQuicHandshakeLimit {
+  uint32_t handshakes_per_second;   //!< 每秒可开始的握手数，0为不限，默认1000.
+  uint32_t burst;                   //!< 可累积的握手数，默认1000.
+  bool retry;                       //!< 累积不足一半时先用Retry验证客户端地址，默认true.
+} RawQuicHandshakeLimit;
+
+/// 时延分布，us.
+typedef struct RawQuicLatencySummary {
+  uint64_t count;           //!< 样本数.
+  int64_t min_us;           //!< 最小值.
+  int64_t max_us;           //!< 最大值.
+  int64_t mean_us;          //!< 平均值.
+  int64_t p50_us;           //!< 50分位.
+  int64_t p90_us;           //!< 90分位.
+  int64_t p99_us;           //!< 99分位.
+  int64_t p999_us;          //!< 99.9分位.
+} RawQuicLatencySummary;
+
+/// 各阶段时延，分位值误差不超过1/16.
+typedef struct RawQuicLatencyStats {
+  RawQuicLatencySummary send_queue;   //!< RawQuicSend到写入QUIC流.
+  RawQuicLatencySummary ack;          //!< 写入QUIC流到对端确认.
+  RawQuicLatencySummary recv_queue;   //!< 收到数据包到RawQuicRecv/RawQuicConsume取走.
+} RawQuicLatencyStats;
+
+/// 带宽变化通知阈值，变化百分比为0时不通知该项.
+typedef struct RawQuicBandwidthThresholds {
+  uint32_t bandwidth_percent;       //!< 带宽估计相对变化，%，默认20.
+  uint32_t rtt_percent;             //!< 平滑RTT相对变化，%，默认20.
+  uint32_t queue_delay_percent;     //!< 发送队列时延相对变化，%，默认50.
+  uint32_t min_interval_ms;         //!< 两次通知的最小间隔，ms，默认50.
+} RawQuicBandwidthThresholds;
+
+/// 带宽变化信息.
+typedef struct RawQuicBandwidthInfo {
+  uint64_t bandwidth_estimate_bps;  //!< 带宽估计，bit/s.
+  int64_t smoothed_rtt_us;          //!< 平滑RTT，us.
+  int64_t min_rtt_us;               //!< 最小RTT，us.
+  uint32_t send_buffer_bytes;       //!< 发送缓冲区中待发送数据，字节.
+  int64_t queue_delay_us;           //!< 按带宽估计发完发送缓冲区的时间，us.
+} RawQuicBandwidthInfo;
+
+/// 多路径调度策略.
+typedef enum RawQuicMultipathScheduler {
+  RAW_QUIC_MULTIPATH_SCHEDULER_MIN_RTT      = 0,    //!< 优先RTT最小的路径.
+  RAW_QUIC_MULTIPATH_SCHEDULER_REDUNDANT    = 1,    //!< 每个包在所有路径上发送.
+} RawQuicMultipathScheduler;
+
+/// 多路径配置(实验性).
+typedef struct RawQuicMultipathConfig {
+  const char* local_ip;                 //!< 第二条路径的本地IP地址.
+  RawQuicMultipathScheduler scheduler;  //!< 调度策略.
+  uint32_t primary_delay_ms;            //!< 主路径模拟发送时延，ms，测试用，0为不模拟.
+  uint32_t secondary_delay_ms;          //!< 第二条路径模拟发送时延，ms，测试用，0为不模拟.
+} RawQuicMultipathConfig;
+
 /**
- *  @brief  ӽصֻtimeoutΪ0Żص.
- *  @param  handle      RawQuic.
- *  @param  error       ṹ.
- *  @param  opaque      ͸.
+ *  @brief  连接结果回调，只有在timeout为0才回调.
+ *  @param  handle      RawQuic句柄.
+ *  @param  error       错误结构.
+ *  @param  opaque      透传参数.
  */
 typedef void(RAW_QUIC_CALLBACK* ConnectCallback)(RawQuicHandle handle,
                                                  RawQuicError* error,
                                                  void* opaque);
 
 /**
- *  @brief  صʱص.
- *  @param  handle      RawQuic.
- *  @param  error       ṹ.
- *  @param  opaque      ͸.
+ *  @brief  错误回调，发生错误时回调.
+ *  @param  handle      RawQuic句柄.
+ *  @param  error       错误结构.
+ *  @param  opaque      透传参数.
  */
 typedef void(RAW_QUIC_CALLBACK* ErrorCallback)(RawQuicHandle handle,
                                                RawQuicError* error,
                                                void* opaque);
 
 /**
- *  @brief  ɶص.
- *  @param  handle      RawQuic.
- *  @param  size        ɶݳ.
- *  @param  opaque      ͸.
+ *  @brief  可读回调.
+ *  @param  handle      RawQuic句柄.
+ *  @param  size        可读数据长度，对端结束流且数据已读完时为0.
+ *  @param  opaque      透传参数.
  */
 typedef void(RAW_QUIC_CALLBACK* CanReadCallback)(RawQuicHandle handle,
                                                  uint32_t size,
                                                  void* opaque);
 
-/// RawQuicصṹ.
+/**
+ *  @brief  优雅关闭完成回调.
+ *  @param  handle      RawQuic句柄.
+ *  @param  error       错误结构，数据全部被确认时为SUCCESS，逗留超时为TIMEOUT.
+ *  @param  opaque      透传参数.
+ */
+typedef void(RAW_QUIC_CALLBACK* ShutdownCallback)(RawQuicHandle handle,
+                                                  RawQuicError* error,
+                                                  void* opaque);
+
+/**
+ *  @brief  异步关闭完成回调，回调返回后句柄被释放.
+ *  @param  handle      RawQuic句柄.
+ *  @param  opaque      透传参数.
+ */
+typedef void(RAW_QUIC_CALLBACK* ClosedCallback)(RawQuicHandle handle,
+                                                void* opaque);
+
+/**
+ *  @brief  连接迁移结果回调，只有在timeout为0才回调.
+ *  @param  handle      RawQuic句柄.
+ *  @param  error       错误结构，新路径未响应时为TIMEOUT.
+ *  @param  opaque      透传参数.
+ */
+typedef void(RAW_QUIC_CALLBACK* MigrateCallback)(RawQuicHandle handle,
+                                                 RawQuicError* error,
+                                                 void* opaque);
+
+/**
+ *  @brief  带宽变化回调，在网络线程上回调.
+ *  @param  handle      RawQuic句柄.
+ *  @param  info        当前带宽信息.
+ *  @param  opaque      透传参数.
+ *  @note   带宽估计、平滑RTT或发送队列时延相对上次通知的变化超过阈值时
+ *          回调，两次回调的间隔不小于min_interval_ms.
+ */
+typedef void(RAW_QUIC_CALLBACK* BandwidthCallback)(
+    RawQuicHandle handle,
+    const RawQuicBandwidthInfo* info,
+    void* opaque);
+
+/// RawQuic回调结构，未使用的回调须置为NULL. 按值传递，布局与1.0.1相同，
+/// 之后新增的回调通过RawQuicSetXXXCallback单独设置.
 typedef struct RawQuicCallbacks {
-  ConnectCallback connect_callback;     //!< ӽص.
-  ErrorCallback error_callback;         //!< ص.
-  CanReadCallback can_read_callback;    //!< ɶص.
+  ConnectCallback connect_callback;     //!< 连接结果回调.
+  ErrorCallback error_callback;         //!< 错误回调.
+  CanReadCallback can_read_callback;    //!< 可读回调.
 } RawQuicCallbacks;
 
+/**
+ *  @brief  接受新流回调，在网络线程上回调.
+ *  @param  listener    RawQuic监听句柄.
+ *  @param  handle      新流的RawQuic句柄，已连接，可直接收发.
+ *  @param  path        客户端连接时的路径，不含开头的'/'.
+ *  @param  opaque      透传参数.
+ *  @note   handle使用监听时的回调及透传参数，须由上层调用RawQuicClose或
+ *          RawQuicCloseAsync释放. 回调中不能调用RawQuicClose.
+ */
+typedef void(RAW_QUIC_CALLBACK* AcceptCallback)(RawQuicListenerHandle listener,
+                                                RawQuicHandle handle,
+                                                const char* path,
+                                                void* opaque);
+
 #endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_DEFINE_H_
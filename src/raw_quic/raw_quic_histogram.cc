@@ -0,0 +1,144 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_histogram.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace net {
+
+namespace {
+const int64_t kMaxTrackableValue = (int64_t(1) << kHistogramMaxValueBits) - 1;
+
+// Percentiles in 1/10 permille, to keep 99.9 exact.
+const uint64_t kPercentileScale = 10000;
+
+uint32_t HighestBit(uint64_t value) {
+  uint32_t bit = 0;
+  while (value >>= 1) {
+    ++bit;
+  }
+  return bit;
+}
+}  // namespace
+
+//////////////////////////////////RawQuicHistogram//////////////////////////////////
+RawQuicHistogram::RawQuicHistogram()
+    : sum_(0),
+      min_(std::numeric_limits<int64_t>::max()),
+      max_(0) {
+  for (uint32_t i = 0; i < kHistogramBucketCount; ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+RawQuicHistogram::~RawQuicHistogram() {}
+
+void RawQuicHistogram::Record(int64_t value_us) {
+  value_us = std::min(std::max<int64_t>(value_us, 0), kMaxTrackableValue);
+  buckets_[GetBucketIndex(value_us)].fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value_us, std::memory_order_relaxed);
+
+  int64_t min = min_.load(std::memory_order_relaxed);
+  while (value_us < min &&
+         !min_.compare_exchange_weak(min, value_us,
+                                     std::memory_order_relaxed)) {
+  }
+  int64_t max = max_.load(std::memory_order_relaxed);
+  while (value_us > max &&
+         !max_.compare_exchange_weak(max, value_us,
+                                     std::memory_order_relaxed)) {
+  }
+}
+
+void RawQuicHistogram::Snapshot(RawQuicLatencySummary* out, bool reset) {
+  memset(out, 0, sizeof(RawQuicLatencySummary));
+
+  uint64_t counts[kHistogramBucketCount];
+  uint64_t total = 0;
+  for (uint32_t i = 0; i < kHistogramBucketCount; ++i) {
+    counts[i] = reset ? buckets_[i].exchange(0, std::memory_order_relaxed)
+                      : buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+
+  int64_t sum = reset ? sum_.exchange(0, std::memory_order_relaxed)
+                      : sum_.load(std::memory_order_relaxed);
+  int64_t min = reset ? min_.exchange(std::numeric_limits<int64_t>::max(),
+                                      std::memory_order_relaxed)
+                      : min_.load(std::memory_order_relaxed);
+  int64_t max = reset ? max_.exchange(0, std::memory_order_relaxed)
+                      : max_.load(std::memory_order_relaxed);
+  if (total == 0) {
+    return;
+  }
+
+  out->count = total;
+  out->min_us = min;
+  out->max_us = max;
+  out->mean_us = sum / (int64_t)total;
+
+  struct {
+    uint64_t percentile;
+    int64_t* value;
+  } targets[] = {{5000, &out->p50_us},
+                 {9000, &out->p90_us},
+                 {9900, &out->p99_us},
+                 {9990, &out->p999_us}};
+
+  uint64_t seen = 0;
+  size_t target = 0;
+  for (uint32_t i = 0;
+       i < kHistogramBucketCount && target < sizeof(targets) / sizeof(targets[0]);
+       ++i) {
+    seen += counts[i];
+    while (target < sizeof(targets) / sizeof(targets[0]) &&
+           seen * kPercentileScale >= total * targets[target].percentile) {
+      // Upper bound of the bucket, but never beyond what was recorded.
+      *targets[target].value = std::min(GetBucketUpperBound(i), max);
+      ++target;
+    }
+  }
+}
+
+uint32_t RawQuicHistogram::GetBucketIndex(int64_t value_us) {
+  if (value_us < kHistogramSubBucketCount) {
+    return (uint32_t)value_us;
+  }
+
+  uint32_t shift = HighestBit(value_us) - kHistogramSubBucketBits;
+  uint32_t sub_bucket =
+      (uint32_t)(value_us >> shift) & (kHistogramSubBucketCount - 1);
+  return (shift + 1) * kHistogramSubBucketCount + sub_bucket;
+}
+
+int64_t RawQuicHistogram::GetBucketUpperBound(uint32_t index) {
+  if (index < kHistogramSubBucketCount) {
+    return index;
+  }
+
+  uint32_t shift = index / kHistogramSubBucketCount - 1;
+  int64_t sub_bucket = index % kHistogramSubBucketCount;
+  return ((kHistogramSubBucketCount + sub_bucket + 1) << shift) - 1;
+}
+
+//////////////////////////////RawQuicLatencyHistograms//////////////////////////////
+RawQuicLatencyHistograms::RawQuicLatencyHistograms() {}
+
+RawQuicLatencyHistograms::~RawQuicLatencyHistograms() {}
+
+void RawQuicLatencyHistograms::Record(Stage stage, int64_t value_us) {
+  histograms_[stage].Record(value_us);
+}
+
+void RawQuicLatencyHistograms::Snapshot(RawQuicLatencyStats* out, bool reset) {
+  histograms_[SEND_QUEUE].Snapshot(&out->send_queue, reset);
+  histograms_[ACK].Snapshot(&out->ack, reset);
+  histograms_[RECV_QUEUE].Snapshot(&out->recv_queue, reset);
+}
+
+}  // namespace net
@@ -0,0 +1,85 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_HISTOGRAM_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include "net/quic/raw_quic/raw_quic_define.h"
+
+namespace net {
+
+// Log-linear buckets, 16 linear sub-buckets per power of two, so a bucket
+// is at most 1/16 of its value wide. Values from 2^31us on share the last
+// bucket.
+const uint32_t kHistogramSubBucketBits = 4;
+const uint32_t kHistogramSubBucketCount = 1 << kHistogramSubBucketBits;
+const uint32_t kHistogramMaxValueBits = 31;
+const uint32_t kHistogramBucketCount =
+    (kHistogramMaxValueBits - kHistogramSubBucketBits + 1) *
+    kHistogramSubBucketCount;
+
+//////////////////////////////////RawQuicHistogram//////////////////////////////////
+// HDR style latency histogram in microseconds. Recording is a few relaxed
+// atomic adds, so any thread may record while another snapshots.
+class RawQuicHistogram {
+ public:
+  RawQuicHistogram();
+  ~RawQuicHistogram();
+
+  RawQuicHistogram(const RawQuicHistogram&) = delete;
+  RawQuicHistogram& operator=(const RawQuicHistogram&) = delete;
+
+ public:
+  void Record(int64_t value_us);
+
+  // Reset takes the counts away bucket by bucket, a value recorded at the
+  // same time lands in either this snapshot or the next one.
+  void Snapshot(RawQuicLatencySummary* out, bool reset);
+
+  static uint32_t GetBucketIndex(int64_t value_us);
+
+  // Highest value counted by bucket at index.
+  static int64_t GetBucketUpperBound(uint32_t index);
+
+ protected:
+  std::atomic<uint64_t> buckets_[kHistogramBucketCount];
+  std::atomic<int64_t> sum_;
+  std::atomic<int64_t> min_;
+  std::atomic<int64_t> max_;
+};
+
+//////////////////////////////RawQuicLatencyHistograms//////////////////////////////
+// Latency of each stage data goes through, kept per connection and summed
+// up per context.
+class RawQuicLatencyHistograms {
+ public:
+  enum Stage {
+    // RawQuicSend until written into the QUIC stream.
+    SEND_QUEUE = 0,
+    // Written into the QUIC stream until acked by peer.
+    ACK,
+    // Packet arrival until taken by RawQuicRecv or RawQuicConsume.
+    RECV_QUEUE,
+    STAGE_COUNT
+  };
+
+  RawQuicLatencyHistograms();
+  ~RawQuicLatencyHistograms();
+
+ public:
+  void Record(Stage stage, int64_t value_us);
+
+  void Snapshot(RawQuicLatencyStats* out, bool reset);
+
+ protected:
+  RawQuicHistogram histograms_[STAGE_COUNT];
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_HISTOGRAM_H_
@@ -0,0 +1,214 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_multipath_writer.h"
+
+#include <algorithm>
+
+#include "base/bind.h"
+#include "base/location.h"
+
+namespace net {
+
+/////////////////////////////////////RawQuicPathWriter/////////////////////////////////////
+RawQuicPathWriter::RawQuicPathWriter(DatagramClientSocket* socket,
+                                     base::SingleThreadTaskRunner* task_runner,
+                                     uint32_t delay_ms)
+    : writer_(socket, task_runner),
+      task_runner_(task_runner),
+      delay_ms_(delay_ms) {}
+
+RawQuicPathWriter::~RawQuicPathWriter() {}
+
+quic::WriteResult RawQuicPathWriter::WritePacket(
+    const char* buffer,
+    size_t buf_len,
+    const quic::QuicIpAddress& self_address,
+    const quic::QuicSocketAddress& peer_address,
+    quic::PerPacketOptions* options) {
+  if (delay_ms_ == 0) {
+    return writer_.WritePacket(buffer, buf_len, self_address, peer_address,
+                               options);
+  }
+
+  // Delayed packet is reported written, a blocked socket drops it later
+  // as the network would.
+  task_runner_->PostDelayedTask(
+      FROM_HERE,
+      base::BindOnce(&RawQuicPathWriter::DoDelayedWrite,
+                     weak_factory_.GetWeakPtr(), std::string(buffer, buf_len),
+                     self_address, peer_address),
+      base::TimeDelta::FromMilliseconds(delay_ms_));
+  return quic::WriteResult(quic::WRITE_STATUS_OK, buf_len);
+}
+
+void RawQuicPathWriter::DoDelayedWrite(
+    const std::string& packet,
+    const quic::QuicIpAddress& self_address,
+    const quic::QuicSocketAddress& peer_address) {
+  if (writer_.IsWriteBlocked()) {
+    return;
+  }
+  writer_.WritePacket(packet.data(), packet.size(), self_address,
+                      peer_address, nullptr);
+}
+
+bool RawQuicPathWriter::IsWriteBlocked() const {
+  return writer_.IsWriteBlocked();
+}
+
+void RawQuicPathWriter::SetWritable() {
+  writer_.SetWritable();
+}
+
+quic::QuicByteCount RawQuicPathWriter::GetMaxPacketSize(
+    const quic::QuicSocketAddress& peer_address) const {
+  return writer_.GetMaxPacketSize(peer_address);
+}
+
+bool RawQuicPathWriter::SupportsReleaseTime() const {
+  return false;
+}
+
+bool RawQuicPathWriter::IsBatchMode() const {
+  return false;
+}
+
+char* RawQuicPathWriter::GetNextWriteLocation(
+    const quic::QuicIpAddress& self_address,
+    const quic::QuicSocketAddress& peer_address) {
+  return nullptr;
+}
+
+quic::WriteResult RawQuicPathWriter::Flush() {
+  return quic::WriteResult(quic::WRITE_STATUS_OK, 0);
+}
+
+///////////////////////////////////RawQuicMultipathWriter///////////////////////////////////
+RawQuicMultipathWriter::RawQuicMultipathWriter(
+    RawQuicMultipathScheduler scheduler)
+    : scheduler_(scheduler) {}
+
+RawQuicMultipathWriter::~RawQuicMultipathWriter() {}
+
+size_t RawQuicMultipathWriter::AddPath(
+    std::unique_ptr<RawQuicPathWriter> writer) {
+  Path path;
+  path.writer = std::move(writer);
+  paths_.push_back(std::move(path));
+  return paths_.size() - 1;
+}
+
+size_t RawQuicMultipathWriter::GetPathCount() const {
+  return paths_.size();
+}
+
+RawQuicPathWriter* RawQuicMultipathWriter::GetPathWriter(size_t index) {
+  return index < paths_.size() ? paths_[index].writer.get() : nullptr;
+}
+
+void RawQuicMultipathWriter::OnPathRttSample(size_t index,
+                                             quic::QuicTime::Delta rtt) {
+  if (index >= paths_.size()) {
+    return;
+  }
+
+  // Same smoothing as RttStats.
+  Path& path = paths_[index];
+  if (path.srtt.IsZero()) {
+    path.srtt = rtt;
+  } else {
+    path.srtt = path.srtt * 0.875 + rtt * 0.125;
+  }
+}
+
+quic::WriteResult RawQuicMultipathWriter::WritePacket(
+    const char* buffer,
+    size_t buf_len,
+    const quic::QuicIpAddress& self_address,
+    const quic::QuicSocketAddress& peer_address,
+    quic::PerPacketOptions* options) {
+  if (scheduler_ == RAW_QUIC_MULTIPATH_SCHEDULER_REDUNDANT) {
+    // Copies of a packet share its number, peer drops the later ones.
+    quic::WriteResult result(quic::WRITE_STATUS_BLOCKED, 0);
+    for (Path& path : paths_) {
+      if (path.writer->IsWriteBlocked()) {
+        continue;
+      }
+      quic::WriteResult path_result = path.writer->WritePacket(
+          buffer, buf_len, self_address, peer_address, options);
+      if (result.status != quic::WRITE_STATUS_OK) {
+        result = path_result;
+      }
+    }
+    return result;
+  }
+
+  RawQuicPathWriter* writer = SelectPath();
+  if (writer == nullptr) {
+    return quic::WriteResult(quic::WRITE_STATUS_BLOCKED, 0);
+  }
+  return writer->WritePacket(buffer, buf_len, self_address, peer_address,
+                             options);
+}
+
+RawQuicPathWriter* RawQuicMultipathWriter::SelectPath() {
+  Path* selected = nullptr;
+  for (Path& path : paths_) {
+    if (path.writer->IsWriteBlocked()) {
+      continue;
+    }
+    if (selected == nullptr ||
+        (!path.srtt.IsZero() &&
+         (selected->srtt.IsZero() || path.srtt < selected->srtt))) {
+      selected = &path;
+    }
+  }
+  return selected != nullptr ? selected->writer.get() : nullptr;
+}
+
+bool RawQuicMultipathWriter::IsWriteBlocked() const {
+  for (const Path& path : paths_) {
+    if (!path.writer->IsWriteBlocked()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void RawQuicMultipathWriter::SetWritable() {
+  for (Path& path : paths_) {
+    path.writer->SetWritable();
+  }
+}
+
+quic::QuicByteCount RawQuicMultipathWriter::GetMaxPacketSize(
+    const quic::QuicSocketAddress& peer_address) const {
+  quic::QuicByteCount max_packet_size = quic::kMaxOutgoingPacketSize;
+  for (const Path& path : paths_) {
+    max_packet_size = std::min(max_packet_size,
+                               path.writer->GetMaxPacketSize(peer_address));
+  }
+  return max_packet_size;
+}
+
+bool RawQuicMultipathWriter::SupportsReleaseTime() const {
+  return false;
+}
+
+bool RawQuicMultipathWriter::IsBatchMode() const {
+  return false;
+}
+
+char* RawQuicMultipathWriter::GetNextWriteLocation(
+    const quic::QuicIpAddress& self_address,
+    const quic::QuicSocketAddress& peer_address) {
+  return nullptr;
+}
+
+quic::WriteResult RawQuicMultipathWriter::Flush() {
+  return quic::WriteResult(quic::WRITE_STATUS_OK, 0);
+}
+
+}  // namespace net
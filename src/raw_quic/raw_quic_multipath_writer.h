@@ -0,0 +1,113 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_MULTIPATH_WRITER_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_MULTIPATH_WRITER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/memory/weak_ptr.h"
+#include "base/single_thread_task_runner.h"
+#include "net/quic/quic_chromium_packet_writer.h"
+#include "net/quic/raw_quic/raw_quic_define.h"
+#include "net/socket/datagram_client_socket.h"
+#include "net/third_party/quiche/src/quic/core/quic_packet_writer.h"
+#include "net/third_party/quiche/src/quic/core/quic_time.h"
+
+namespace net {
+
+/////////////////////////////////////RawQuicPathWriter/////////////////////////////////////
+// Writer of one path, with optional simulated one way delay for testing
+// without netem.
+class RawQuicPathWriter : public quic::QuicPacketWriter {
+ public:
+  RawQuicPathWriter(DatagramClientSocket* socket,
+                    base::SingleThreadTaskRunner* task_runner,
+                    uint32_t delay_ms);
+  ~RawQuicPathWriter() override;
+
+  // quic::QuicPacketWriter
+  quic::WriteResult WritePacket(const char* buffer,
+                                size_t buf_len,
+                                const quic::QuicIpAddress& self_address,
+                                const quic::QuicSocketAddress& peer_address,
+                                quic::PerPacketOptions* options) override;
+  bool IsWriteBlocked() const override;
+  void SetWritable() override;
+  quic::QuicByteCount GetMaxPacketSize(
+      const quic::QuicSocketAddress& peer_address) const override;
+  bool SupportsReleaseTime() const override;
+  bool IsBatchMode() const override;
+  char* GetNextWriteLocation(
+      const quic::QuicIpAddress& self_address,
+      const quic::QuicSocketAddress& peer_address) override;
+  quic::WriteResult Flush() override;
+
+ protected:
+  void DoDelayedWrite(const std::string& packet,
+                      const quic::QuicIpAddress& self_address,
+                      const quic::QuicSocketAddress& peer_address);
+
+ protected:
+  QuicChromiumPacketWriter writer_;
+  base::SingleThreadTaskRunner* task_runner_ = nullptr;
+  uint32_t delay_ms_ = 0;
+  base::WeakPtrFactory<RawQuicPathWriter> weak_factory_{this};
+};
+
+///////////////////////////////////RawQuicMultipathWriter///////////////////////////////////
+// Schedules the packets of one connection across the sockets of several
+// local interfaces. The peer sees a single path whose address changes,
+// there is no per path packet number space or congestion control.
+class RawQuicMultipathWriter : public quic::QuicPacketWriter {
+ public:
+  explicit RawQuicMultipathWriter(RawQuicMultipathScheduler scheduler);
+  ~RawQuicMultipathWriter() override;
+
+ public:
+  // Returns index of the path.
+  size_t AddPath(std::unique_ptr<RawQuicPathWriter> writer);
+
+  size_t GetPathCount() const;
+
+  RawQuicPathWriter* GetPathWriter(size_t index);
+
+  void OnPathRttSample(size_t index, quic::QuicTime::Delta rtt);
+
+  // quic::QuicPacketWriter
+  quic::WriteResult WritePacket(const char* buffer,
+                                size_t buf_len,
+                                const quic::QuicIpAddress& self_address,
+                                const quic::QuicSocketAddress& peer_address,
+                                quic::PerPacketOptions* options) override;
+  bool IsWriteBlocked() const override;
+  void SetWritable() override;
+  quic::QuicByteCount GetMaxPacketSize(
+      const quic::QuicSocketAddress& peer_address) const override;
+  bool SupportsReleaseTime() const override;
+  bool IsBatchMode() const override;
+  char* GetNextWriteLocation(
+      const quic::QuicIpAddress& self_address,
+      const quic::QuicSocketAddress& peer_address) override;
+  quic::WriteResult Flush() override;
+
+ protected:
+  // Unblocked path of lowest RTT, paths not measured yet come last.
+  RawQuicPathWriter* SelectPath();
+
+ protected:
+  struct Path {
+    std::unique_ptr<RawQuicPathWriter> writer;
+    quic::QuicTime::Delta srtt = quic::QuicTime::Delta::Zero();
+  };
+
+  RawQuicMultipathScheduler scheduler_;
+  std::vector<Path> paths_;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_MULTIPATH_WRITER_H_
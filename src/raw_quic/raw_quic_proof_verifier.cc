@@ -0,0 +1,239 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_proof_verifier.h"
+
+#include <algorithm>
+
+#include "base/no_destructor.h"
+#include "base/time/default_clock.h"
+#include "net/cert/x509_certificate.h"
+#include "net/log/net_log_with_source.h"
+#include "net/quic/crypto/proof_verifier_chromium.h"
+#include "net/third_party/quiche/src/quic/platform/api/quic_default_proof_providers.h"
+#include "third_party/boringssl/src/include/openssl/sha.h"
+
+namespace net {
+
+////////////////////////////////////RawQuicCertCache////////////////////////////////////
+RawQuicCertCache::RawQuicCertCache()
+    : clock_(base::DefaultClock::GetInstance()) {}
+
+RawQuicCertCache::~RawQuicCertCache() {}
+
+RawQuicCertCache* RawQuicCertCache::GetInstance() {
+  static base::NoDestructor<RawQuicCertCache> instance;
+  return instance.get();
+}
+
+// static
+std::string RawQuicCertCache::Key(const std::string& hostname,
+                                  const std::vector<std::string>& certs) {
+  // Lengths go in too, no two lists hash the same bytes.
+  SHA256_CTX sha256;
+  SHA256_Init(&sha256);
+  uint64_t length = hostname.size();
+  SHA256_Update(&sha256, &length, sizeof(length));
+  SHA256_Update(&sha256, hostname.data(), hostname.size());
+  for (const std::string& cert : certs) {
+    length = cert.size();
+    SHA256_Update(&sha256, &length, sizeof(length));
+    SHA256_Update(&sha256, cert.data(), cert.size());
+  }
+
+  uint8_t digest[SHA256_DIGEST_LENGTH];
+  SHA256_Final(digest, &sha256);
+  return std::string((const char*)digest, sizeof(digest));
+}
+
+bool RawQuicCertCache::Lookup(const std::string& key) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return false;
+  }
+
+  if (it->second <= clock_->Now()) {
+    entries_.erase(it);
+    return false;
+  }
+  return true;
+}
+
+void RawQuicCertCache::Insert(const std::string& key,
+                              const std::string& leaf) {
+  scoped_refptr<X509Certificate> cert =
+      X509Certificate::CreateFromBytes(leaf.data(), leaf.size());
+  if (cert == nullptr) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  base::Time now = clock_->Now();
+  base::Time expiry = std::min(
+      cert->valid_expiry(),
+      now + base::TimeDelta::FromMinutes(kVerifiedChainLifetimeMinutes));
+
+  if (entries_.size() >= kMaxVerifiedChains && entries_.count(key) == 0) {
+    // Expired first, else the one expiring soonest.
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      if (it->second <= now) {
+        it = entries_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (entries_.size() >= kMaxVerifiedChains) {
+      entries_.erase(std::min_element(
+          entries_.begin(), entries_.end(),
+          [](const std::pair<const std::string, base::Time>& a,
+             const std::pair<const std::string, base::Time>& b) {
+            return a.second < b.second;
+          }));
+    }
+  }
+  entries_[key] = expiry;
+}
+
+void RawQuicCertCache::SetClockForTesting(base::Clock* clock) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  clock_ = clock != nullptr ? clock : base::DefaultClock::GetInstance();
+}
+
+//////////////////////////////////RawQuicProofVerifier//////////////////////////////////
+RawQuicProofVerifier::VerifyCallback::VerifyCallback(
+    RawQuicProofVerifier* owner,
+    const std::string& hostname,
+    const std::string& key,
+    const std::string& leaf,
+    std::unique_ptr<quic::ProofVerifierCallback> callback)
+    : owner_(owner),
+      hostname_(hostname),
+      key_(key),
+      leaf_(leaf),
+      callback_(std::move(callback)) {}
+
+RawQuicProofVerifier::VerifyCallback::~VerifyCallback() {}
+
+void RawQuicProofVerifier::VerifyCallback::Run(
+    bool ok,
+    const std::string& error_details,
+    std::unique_ptr<quic::ProofVerifyDetails>* details) {
+  if (ok && !key_.empty()) {
+    owner_->cache_->Insert(key_, leaf_);
+  }
+  owner_->OnVerifyDone(hostname_);
+  callback_->Run(ok, error_details, details);
+}
+
+RawQuicProofVerifier::RawQuicProofVerifier()
+    : RawQuicProofVerifier(RawQuicCertCache::GetInstance()) {}
+
+RawQuicProofVerifier::RawQuicProofVerifier(RawQuicCertCache* cache)
+    : cache_(cache),
+      verifiers_(base::MRUCache<std::string, HostVerifier>::NO_AUTO_EVICT) {}
+
+RawQuicProofVerifier::~RawQuicProofVerifier() {}
+
+quic::QuicAsyncStatus RawQuicProofVerifier::VerifyProof(
+    const std::string& hostname,
+    const uint16_t port,
+    const std::string& server_config,
+    quic::QuicTransportVersion transport_version,
+    quiche::QuicheStringPiece chlo_hash,
+    const std::vector<std::string>& certs,
+    const std::string& cert_sct,
+    const std::string& signature,
+    const quic::ProofVerifyContext* context,
+    std::string* error_details,
+    std::unique_ptr<quic::ProofVerifyDetails>* details,
+    std::unique_ptr<quic::ProofVerifierCallback> callback) {
+  // QUIC crypto handshakes only, every version used is TLS.
+  HostVerifier* host = GetVerifier(hostname);
+  quic::QuicAsyncStatus status = host->verifier->VerifyProof(
+      hostname, port, server_config, transport_version, chlo_hash, certs,
+      cert_sct, signature, context, error_details, details,
+      std::make_unique<VerifyCallback>(this, hostname, std::string(),
+                                       std::string(), std::move(callback)));
+  if (status == quic::QUIC_PENDING) {
+    ++host->pending;
+  }
+  return status;
+}
+
+quic::QuicAsyncStatus RawQuicProofVerifier::VerifyCertChain(
+    const std::string& hostname,
+    const std::vector<std::string>& certs,
+    const std::string& ocsp_response,
+    const std::string& cert_sct,
+    const quic::ProofVerifyContext* context,
+    std::string* error_details,
+    std::unique_ptr<quic::ProofVerifyDetails>* details,
+    std::unique_ptr<quic::ProofVerifierCallback> callback) {
+  // Empty chains fail in the default verifier, they aren't cached.
+  std::string key;
+  std::string leaf;
+  if (!certs.empty()) {
+    key = RawQuicCertCache::Key(hostname, certs);
+    leaf = certs[0];
+    if (cache_->Lookup(key)) {
+      return quic::QUIC_SUCCESS;
+    }
+  }
+
+  HostVerifier* host = GetVerifier(hostname);
+  quic::QuicAsyncStatus status = host->verifier->VerifyCertChain(
+      hostname, certs, ocsp_response, cert_sct, context, error_details,
+      details,
+      std::make_unique<VerifyCallback>(this, hostname, key, leaf,
+                                       std::move(callback)));
+  if (status == quic::QUIC_PENDING) {
+    ++host->pending;
+  } else if (status == quic::QUIC_SUCCESS && !key.empty()) {
+    cache_->Insert(key, leaf);
+  }
+  return status;
+}
+
+std::unique_ptr<quic::ProofVerifyContext>
+RawQuicProofVerifier::CreateDefaultContext() {
+  // Same as the default verifiers, which are ProofVerifierChromium.
+  return std::make_unique<ProofVerifyContextChromium>(0, NetLogWithSource());
+}
+
+std::unique_ptr<quic::ProofVerifier> RawQuicProofVerifier::CreateVerifier(
+    const std::string& hostname) {
+  return quic::CreateDefaultProofVerifier(hostname);
+}
+
+RawQuicProofVerifier::HostVerifier* RawQuicProofVerifier::GetVerifier(
+    const std::string& hostname) {
+  auto it = verifiers_.Get(hostname);
+  if (it != verifiers_.end()) {
+    return &it->second;
+  }
+
+  // Jobs in flight hold callbacks of sessions, their verifier must stay.
+  for (auto rit = verifiers_.rbegin();
+       rit != verifiers_.rend() && verifiers_.size() >= kMaxHostVerifiers;) {
+    if (rit->second.pending == 0) {
+      rit = verifiers_.Erase(rit);
+    } else {
+      ++rit;
+    }
+  }
+
+  HostVerifier host;
+  host.verifier = CreateVerifier(hostname);
+  return &verifiers_.Put(hostname, std::move(host))->second;
+}
+
+void RawQuicProofVerifier::OnVerifyDone(const std::string& hostname) {
+  auto it = verifiers_.Peek(hostname);
+  if (it != verifiers_.end() && it->second.pending > 0) {
+    --it->second.pending;
+  }
+}
+
+}  // namespace net
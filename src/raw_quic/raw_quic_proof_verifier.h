@@ -0,0 +1,144 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_PROOF_VERIFIER_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_PROOF_VERIFIER_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "base/containers/mru_cache.h"
+#include "base/time/clock.h"
+#include "base/time/time.h"
+#include "net/third_party/quiche/src/quic/core/crypto/proof_verifier.h"
+
+namespace net {
+
+// Bounds how late a revocation or root store change is noticed.
+const int64_t kVerifiedChainLifetimeMinutes = 30;
+const size_t kMaxVerifiedChains = 256;
+// Hosts a context keeps a verifier for, the cache outlives those dropped.
+const size_t kMaxHostVerifiers = 64;
+
+////////////////////////////////////RawQuicCertCache////////////////////////////////////
+// Certificate chains verified for a host, process wide and thread safe, so
+// sessions of every context skip X.509 path validation on reconnect. TLS
+// still checks the server holds the key of the leaf in every handshake.
+class RawQuicCertCache {
+ public:
+  RawQuicCertCache();
+  ~RawQuicCertCache();
+  static RawQuicCertCache* GetInstance();
+
+  // SHA-256 over hostname and the DER certificates of the chain.
+  static std::string Key(const std::string& hostname,
+                         const std::vector<std::string>& certs);
+
+  // True if the chain of key was verified and neither it nor the leaf
+  // expired since.
+  bool Lookup(const std::string& key);
+
+  // Chain of key verified just now, leaf is its first certificate.
+  void Insert(const std::string& key, const std::string& leaf);
+
+  // Clock is not owned, NULL restores the default clock.
+  void SetClockForTesting(base::Clock* clock);
+
+ private:
+  std::mutex mutex_;
+  base::Clock* clock_;
+  // Key to expiry.
+  std::map<std::string, base::Time> entries_;
+};
+
+//////////////////////////////////RawQuicProofVerifier//////////////////////////////////
+// Verifier of the crypto config shared by all sessions of a context. Chains
+// found in RawQuicCertCache are accepted at once, others go to the default
+// verifier of their host, which trusts unknown roots for that host only.
+// IO thread only, as the config.
+class RawQuicProofVerifier : public quic::ProofVerifier {
+ public:
+  RawQuicProofVerifier();
+  // Chains are cached in cache instead of the process wide one.
+  explicit RawQuicProofVerifier(RawQuicCertCache* cache);
+  ~RawQuicProofVerifier() override;
+
+  // quic::ProofVerifier
+  quic::QuicAsyncStatus VerifyProof(
+      const std::string& hostname,
+      const uint16_t port,
+      const std::string& server_config,
+      quic::QuicTransportVersion transport_version,
+      quiche::QuicheStringPiece chlo_hash,
+      const std::vector<std::string>& certs,
+      const std::string& cert_sct,
+      const std::string& signature,
+      const quic::ProofVerifyContext* context,
+      std::string* error_details,
+      std::unique_ptr<quic::ProofVerifyDetails>* details,
+      std::unique_ptr<quic::ProofVerifierCallback> callback) override;
+
+  quic::QuicAsyncStatus VerifyCertChain(
+      const std::string& hostname,
+      const std::vector<std::string>& certs,
+      const std::string& ocsp_response,
+      const std::string& cert_sct,
+      const quic::ProofVerifyContext* context,
+      std::string* error_details,
+      std::unique_ptr<quic::ProofVerifyDetails>* details,
+      std::unique_ptr<quic::ProofVerifierCallback> callback) override;
+
+  std::unique_ptr<quic::ProofVerifyContext> CreateDefaultContext() override;
+
+ protected:
+  // Default verifier of hostname.
+  virtual std::unique_ptr<quic::ProofVerifier> CreateVerifier(
+      const std::string& hostname);
+
+ private:
+  struct HostVerifier {
+    std::unique_ptr<quic::ProofVerifier> verifier;
+    // Verifications in flight, their jobs are owned by verifier.
+    int32_t pending = 0;
+  };
+
+  // Caches the chain once verification completes, if key isn't empty.
+  class VerifyCallback : public quic::ProofVerifierCallback {
+   public:
+    VerifyCallback(RawQuicProofVerifier* owner,
+                   const std::string& hostname,
+                   const std::string& key,
+                   const std::string& leaf,
+                   std::unique_ptr<quic::ProofVerifierCallback> callback);
+    ~VerifyCallback() override;
+
+    void Run(bool ok,
+             const std::string& error_details,
+             std::unique_ptr<quic::ProofVerifyDetails>* details) override;
+
+   private:
+    RawQuicProofVerifier* owner_;
+    std::string hostname_;
+    std::string key_;
+    std::string leaf_;
+    std::unique_ptr<quic::ProofVerifierCallback> callback_;
+  };
+
+  // Created on first use. Past kMaxHostVerifiers the least recently used
+  // one with nothing in flight is dropped.
+  HostVerifier* GetVerifier(const std::string& hostname);
+
+  // Pending verification of hostname completed.
+  void OnVerifyDone(const std::string& hostname);
+
+  RawQuicCertCache* cache_;
+  base::MRUCache<std::string, HostVerifier> verifiers_;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_PROOF_VERIFIER_H_
@@ -0,0 +1,344 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_qlog.h"
+
+#include "base/bind.h"
+#include "base/files/file_util.h"
+#include "base/json/string_escape.h"
+#include "base/location.h"
+#include "base/logging.h"
+#include "base/strings/stringprintf.h"
+#include "base/time/time.h"
+
+namespace net {
+
+namespace {
+// Buffered events are handed to the writer past this size or once a second.
+const size_t kQlogFlushSize = 64 * 1024;
+const int64_t kQlogFlushIntervalMs = 1000;
+
+// JSON-SEQ record separator.
+const char kRecordSeparator = '\x1e';
+
+const char* GetPacketType(quic::EncryptionLevel level) {
+  switch (level) {
+    case quic::ENCRYPTION_INITIAL:
+      return "initial";
+    case quic::ENCRYPTION_HANDSHAKE:
+      return "handshake";
+    case quic::ENCRYPTION_ZERO_RTT:
+      return "0RTT";
+    case quic::ENCRYPTION_FORWARD_SECURE:
+      return "1RTT";
+    default:
+      return "unknown";
+  }
+}
+
+const char* GetPacketType(const quic::QuicPacketHeader& header) {
+  if (header.form != quic::IETF_QUIC_LONG_HEADER_PACKET) {
+    return "1RTT";
+  }
+
+  switch (header.long_packet_type) {
+    case quic::INITIAL:
+      return "initial";
+    case quic::HANDSHAKE:
+      return "handshake";
+    case quic::ZERO_RTT_PROTECTED:
+      return "0RTT";
+    case quic::RETRY:
+      return "retry";
+    case quic::VERSION_NEGOTIATION:
+      return "version_negotiation";
+    default:
+      return "unknown";
+  }
+}
+
+std::string FormatStreamFrame(const quic::QuicStreamFrame& frame) {
+  return base::StringPrintf(
+      "{\"frame_type\":\"stream\",\"stream_id\":%u,\"offset\":%llu,"
+      "\"length\":%u,\"fin\":%s}",
+      (uint32_t)frame.stream_id, (unsigned long long)frame.offset,
+      (uint32_t)frame.data_length, frame.fin ? "true" : "false");
+}
+
+std::string FormatFrame(const quic::QuicFrame& frame) {
+  switch (frame.type) {
+    case quic::STREAM_FRAME:
+      return FormatStreamFrame(frame.stream_frame);
+    case quic::CRYPTO_FRAME:
+      return base::StringPrintf(
+          "{\"frame_type\":\"crypto\",\"offset\":%llu,\"length\":%u}",
+          (unsigned long long)frame.crypto_frame->offset,
+          (uint32_t)frame.crypto_frame->data_length);
+    case quic::PING_FRAME:
+      return "{\"frame_type\":\"ping\"}";
+    case quic::RST_STREAM_FRAME:
+      return "{\"frame_type\":\"reset_stream\"}";
+    case quic::CONNECTION_CLOSE_FRAME:
+      return "{\"frame_type\":\"connection_close\"}";
+    case quic::WINDOW_UPDATE_FRAME:
+      return "{\"frame_type\":\"max_data\"}";
+    case quic::BLOCKED_FRAME:
+      return "{\"frame_type\":\"data_blocked\"}";
+    case quic::MAX_STREAMS_FRAME:
+      return "{\"frame_type\":\"max_streams\"}";
+    case quic::NEW_CONNECTION_ID_FRAME:
+      return "{\"frame_type\":\"new_connection_id\"}";
+    case quic::PATH_CHALLENGE_FRAME:
+      return "{\"frame_type\":\"path_challenge\"}";
+    case quic::PATH_RESPONSE_FRAME:
+      return "{\"frame_type\":\"path_response\"}";
+    default:
+      return "{\"frame_type\":\"unknown\"}";
+  }
+}
+}  // namespace
+
+/////////////////////////////////////RawQuicQlogWriter/////////////////////////////////////
+struct RawQuicQlogWriter::File {
+  base::FilePath path;
+  FILE* file = nullptr;
+};
+
+RawQuicQlogWriter::RawQuicQlogWriter()
+    : thread_(std::make_unique<base::Thread>("RawQuicQlog")) {
+  thread_->Start();
+}
+
+RawQuicQlogWriter::~RawQuicQlogWriter() {
+  while (!files_.empty()) {
+    Close(files_.begin()->first);
+  }
+  // Runs the pending writes before joining.
+  thread_->Stop();
+}
+
+int32_t RawQuicQlogWriter::Open(const base::FilePath& path) {
+  File* file = new File;
+  file->path = path;
+  int32_t id = ++next_id_;
+  files_[id] = file;
+  thread_->task_runner()->PostTask(
+      FROM_HERE, base::BindOnce(&RawQuicQlogWriter::DoOpen, file));
+  return id;
+}
+
+void RawQuicQlogWriter::Append(int32_t id, std::string data) {
+  auto it = files_.find(id);
+  if (it == files_.end() || data.empty()) {
+    return;
+  }
+
+  thread_->task_runner()->PostTask(
+      FROM_HERE, base::BindOnce(&RawQuicQlogWriter::DoAppend, it->second,
+                                std::move(data)));
+}
+
+void RawQuicQlogWriter::Close(int32_t id) {
+  auto it = files_.find(id);
+  if (it == files_.end()) {
+    return;
+  }
+
+  // File is deleted by the last task posted for it.
+  thread_->task_runner()->PostTask(
+      FROM_HERE, base::BindOnce(&RawQuicQlogWriter::DoClose, it->second));
+  files_.erase(it);
+}
+
+void RawQuicQlogWriter::DoOpen(File* file) {
+  file->file = base::OpenFile(file->path, "wb");
+  if (file->file == nullptr) {
+    LOG(ERROR) << "Open qlog file " << file->path.value() << " failed.";
+  }
+}
+
+void RawQuicQlogWriter::DoAppend(File* file, const std::string& data) {
+  if (file->file == nullptr) {
+    return;
+  }
+
+  if (fwrite(data.data(), 1, data.size(), file->file) != data.size()) {
+    LOG(ERROR) << "Write qlog file " << file->path.value() << " failed.";
+    base::CloseFile(file->file);
+    file->file = nullptr;
+  }
+}
+
+void RawQuicQlogWriter::DoClose(File* file) {
+  if (file->file != nullptr) {
+    base::CloseFile(file->file);
+  }
+  delete file;
+}
+
+/////////////////////////////////////RawQuicQlogTracer/////////////////////////////////////
+RawQuicQlogTracer::RawQuicQlogTracer(RawQuicQlogWriter* writer,
+                                     const base::FilePath& path,
+                                     const quic::QuicConnection* connection,
+                                     const quic::QuicClock* clock,
+                                     quic::QuicAlarmFactory* alarm_factory)
+    : writer_(writer),
+      file_id_(writer->Open(path)),
+      connection_(connection),
+      clock_(clock),
+      start_time_(clock->Now()),
+      flush_alarm_(alarm_factory->CreateAlarm(new AlarmDelegate(this))) {
+  WriteHeader();
+  flush_alarm_->Set(start_time_ +
+                    quic::QuicTime::Delta::FromMilliseconds(kQlogFlushIntervalMs));
+}
+
+RawQuicQlogTracer::~RawQuicQlogTracer() {
+  flush_alarm_->Cancel();
+  Flush();
+  writer_->Close(file_id_);
+}
+
+void RawQuicQlogTracer::OnPacketSent(
+    const quic::SerializedPacket& serialized_packet,
+    quic::TransmissionType transmission_type,
+    quic::QuicTime sent_time) {
+  std::string frames;
+  if (serialized_packet.has_ack) {
+    frames += "{\"frame_type\":\"ack\"}";
+  }
+  for (const quic::QuicFrame& frame : serialized_packet.retransmittable_frames) {
+    if (!frames.empty()) {
+      frames += ",";
+    }
+    frames += FormatFrame(frame);
+  }
+
+  std::string data = base::StringPrintf(
+      "{\"header\":{\"packet_type\":\"%s\",\"packet_number\":%llu},"
+      "\"raw\":{\"length\":%u},\"frames\":[%s]",
+      GetPacketType(serialized_packet.encryption_level),
+      (unsigned long long)serialized_packet.packet_number.ToUint64(),
+      (uint32_t)serialized_packet.encrypted_length, frames.c_str());
+  if (transmission_type != quic::NOT_RETRANSMISSION) {
+    base::StringAppendF(
+        &data, ",\"trigger\":\"%s\"",
+        quic::TransmissionTypeToString(transmission_type).c_str());
+  }
+  data += "}";
+  AppendEvent(sent_time, "transport:packet_sent", data);
+}
+
+void RawQuicQlogTracer::OnPacketLoss(quic::QuicPacketNumber lost_packet_number,
+                                     quic::TransmissionType transmission_type,
+                                     quic::QuicTime detection_time) {
+  AppendEvent(detection_time, "recovery:packet_lost",
+              base::StringPrintf(
+                  "{\"header\":{\"packet_number\":%llu},\"trigger\":\"%s\"}",
+                  (unsigned long long)lost_packet_number.ToUint64(),
+                  quic::TransmissionTypeToString(transmission_type).c_str()));
+}
+
+void RawQuicQlogTracer::OnPacketReceived(
+    const quic::QuicSocketAddress& self_address,
+    const quic::QuicSocketAddress& peer_address,
+    const quic::QuicEncryptedPacket& packet) {
+  received_packet_length_ = packet.length();
+}
+
+void RawQuicQlogTracer::OnPacketHeader(const quic::QuicPacketHeader& header) {
+  unsigned long long packet_number =
+      header.packet_number.IsInitialized() ? header.packet_number.ToUint64()
+                                           : 0;
+  AppendEvent(clock_->ApproximateNow(), "transport:packet_received",
+              base::StringPrintf("{\"header\":{\"packet_type\":\"%s\","
+                                 "\"packet_number\":%llu},"
+                                 "\"raw\":{\"length\":%u}}",
+                                 GetPacketType(header), packet_number,
+                                 (uint32_t)received_packet_length_));
+}
+
+void RawQuicQlogTracer::OnStreamFrame(const quic::QuicStreamFrame& frame) {
+  AppendEvent(clock_->ApproximateNow(), "transport:frames_processed",
+              "{\"frames\":[" + FormatStreamFrame(frame) + "]}");
+}
+
+void RawQuicQlogTracer::OnRttChanged(quic::QuicTime::Delta rtt) const {
+  // Sampled after every ack that updates RTT, congestion state with it.
+  const quic::QuicSentPacketManager& sent_packet_manager =
+      connection_->sent_packet_manager();
+  const quic::RttStats* rtt_stats = sent_packet_manager.GetRttStats();
+  quic::QuicByteCount bytes_in_flight = sent_packet_manager.GetBytesInFlight();
+  AppendEvent(
+      clock_->ApproximateNow(), "recovery:metrics_updated",
+      base::StringPrintf(
+          "{\"min_rtt\":%.3f,\"smoothed_rtt\":%.3f,\"latest_rtt\":%.3f,"
+          "\"congestion_window\":%llu,\"bytes_in_flight\":%llu,"
+          "\"pacing_rate\":%llu}",
+          rtt_stats->min_rtt().ToMicroseconds() / 1000.0,
+          rtt_stats->smoothed_rtt().ToMicroseconds() / 1000.0,
+          rtt.ToMicroseconds() / 1000.0,
+          (unsigned long long)sent_packet_manager.GetCongestionWindowInBytes(),
+          (unsigned long long)bytes_in_flight,
+          (unsigned long long)sent_packet_manager.GetSendAlgorithm()
+              ->PacingRate(bytes_in_flight)
+              .ToBitsPerSecond()));
+}
+
+void RawQuicQlogTracer::OnConnectionClosed(
+    const quic::QuicConnectionCloseFrame& frame,
+    quic::ConnectionCloseSource source) {
+  std::string reason;
+  base::EscapeJSONString(frame.error_details, true, &reason);
+  AppendEvent(clock_->ApproximateNow(), "connectivity:connection_state_updated",
+              base::StringPrintf(
+                  "{\"new\":\"closed\",\"trigger\":\"%s\","
+                  "\"error_code\":%d,\"reason\":%s}",
+                  source == quic::ConnectionCloseSource::FROM_PEER ? "remote"
+                                                                   : "local",
+                  (int)frame.quic_error_code, reason.c_str()));
+  Flush();
+}
+
+void RawQuicQlogTracer::WriteHeader() {
+  buffer_ += kRecordSeparator;
+  base::StringAppendF(
+      &buffer_,
+      "{\"qlog_version\":\"draft-02\",\"qlog_format\":\"JSON-SEQ\","
+      "\"title\":\"rawquic\",\"trace\":{\"vantage_point\":{\"type\":"
+      "\"client\"},\"common_fields\":{\"ODCID\":\"%s\",\"time_format\":"
+      "\"relative\",\"reference_time\":%.3f}}}\n",
+      connection_->connection_id().ToString().c_str(),
+      base::Time::Now().ToJsTime());
+}
+
+void RawQuicQlogTracer::AppendEvent(quic::QuicTime time,
+                                    const char* name,
+                                    const std::string& data) const {
+  buffer_ += kRecordSeparator;
+  base::StringAppendF(&buffer_, "{\"time\":%.3f,\"name\":\"%s\",\"data\":%s}\n",
+                      (time - start_time_).ToMicroseconds() / 1000.0, name,
+                      data.c_str());
+  if (buffer_.size() >= kQlogFlushSize) {
+    Flush();
+  }
+}
+
+void RawQuicQlogTracer::OnFlushAlarm() {
+  Flush();
+  flush_alarm_->Set(clock_->ApproximateNow() +
+                    quic::QuicTime::Delta::FromMilliseconds(kQlogFlushIntervalMs));
+}
+
+void RawQuicQlogTracer::Flush() const {
+  if (buffer_.empty()) {
+    return;
+  }
+
+  std::string data;
+  data.swap(buffer_);
+  writer_->Append(file_id_, std::move(data));
+}
+
+}  // namespace net
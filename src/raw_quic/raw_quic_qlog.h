@@ -0,0 +1,124 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_QLOG_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_QLOG_H_
+
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "base/files/file_path.h"
+#include "base/threading/thread.h"
+#include "net/third_party/quiche/src/quic/core/quic_alarm.h"
+#include "net/third_party/quiche/src/quic/core/quic_alarm_factory.h"
+#include "net/third_party/quiche/src/quic/core/quic_connection.h"
+
+namespace net {
+
+/////////////////////////////////////RawQuicQlogWriter/////////////////////////////////////
+// Writes trace files on a background thread, so disk never stalls the IO
+// thread. Tasks of one file run in order on the same thread.
+class RawQuicQlogWriter {
+ public:
+  RawQuicQlogWriter();
+  ~RawQuicQlogWriter();
+
+ public:
+  // Returns file id used by Append and Close.
+  int32_t Open(const base::FilePath& path);
+
+  void Append(int32_t id, std::string data);
+
+  void Close(int32_t id);
+
+ protected:
+  struct File;
+
+  static void DoOpen(File* file);
+
+  static void DoAppend(File* file, const std::string& data);
+
+  static void DoClose(File* file);
+
+ protected:
+  std::unique_ptr<base::Thread> thread_;
+  int32_t next_id_ = 0;
+  std::map<int32_t, File*> files_;
+};
+
+/////////////////////////////////////RawQuicQlogTracer/////////////////////////////////////
+// qlog (draft-02, JSON-SEQ) trace of one connection. Events are formatted
+// on the IO thread into a buffer handed to the writer in chunks.
+class RawQuicQlogTracer : public quic::QuicConnectionDebugVisitor {
+ public:
+  RawQuicQlogTracer(RawQuicQlogWriter* writer,
+                    const base::FilePath& path,
+                    const quic::QuicConnection* connection,
+                    const quic::QuicClock* clock,
+                    quic::QuicAlarmFactory* alarm_factory);
+  ~RawQuicQlogTracer() override;
+
+  // quic::QuicConnectionDebugVisitor
+  void OnPacketSent(const quic::SerializedPacket& serialized_packet,
+                    quic::TransmissionType transmission_type,
+                    quic::QuicTime sent_time) override;
+
+  void OnPacketLoss(quic::QuicPacketNumber lost_packet_number,
+                    quic::TransmissionType transmission_type,
+                    quic::QuicTime detection_time) override;
+
+  void OnPacketReceived(const quic::QuicSocketAddress& self_address,
+                        const quic::QuicSocketAddress& peer_address,
+                        const quic::QuicEncryptedPacket& packet) override;
+
+  void OnPacketHeader(const quic::QuicPacketHeader& header) override;
+
+  void OnStreamFrame(const quic::QuicStreamFrame& frame) override;
+
+  void OnRttChanged(quic::QuicTime::Delta rtt) const override;
+
+  void OnConnectionClosed(const quic::QuicConnectionCloseFrame& frame,
+                          quic::ConnectionCloseSource source) override;
+
+ protected:
+  void WriteHeader();
+
+  void AppendEvent(quic::QuicTime time,
+                   const char* name,
+                   const std::string& data) const;
+
+  void OnFlushAlarm();
+
+  void Flush() const;
+
+ protected:
+  class AlarmDelegate : public quic::QuicAlarm::Delegate {
+   public:
+    explicit AlarmDelegate(RawQuicQlogTracer* tracer) : tracer_(tracer) {}
+    void OnAlarm() override { tracer_->OnFlushAlarm(); }
+
+   private:
+    RawQuicQlogTracer* tracer_ = nullptr;
+  };
+
+  RawQuicQlogWriter* writer_ = nullptr;
+  int32_t file_id_ = 0;
+  const quic::QuicConnection* connection_ = nullptr;
+  const quic::QuicClock* clock_ = nullptr;
+  quic::QuicTime start_time_ = quic::QuicTime::Zero();
+  std::unique_ptr<quic::QuicAlarm> flush_alarm_;
+
+  // Some events come through const methods of the visitor.
+  mutable std::string buffer_;
+
+  // Length of the packet whose header is parsed next.
+  size_t received_packet_length_ = 0;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_QLOG_H_
@@ -0,0 +1,892 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_server.h"
+
+#include <string.h>
+
+#include "base/bind.h"
+#include "base/files/file_path.h"
+#include "build/build_config.h"
+#include "net/base/net_errors.h"
+#include "net/quic/address_utils.h"
+#include "net/quic/crypto/proof_source_chromium.h"
+#include "net/quic/quic_chromium_alarm_factory.h"
+#include "net/quic/quic_chromium_connection_helper.h"
+#include "net/quic/raw_quic/raw_quic_context.h"
+#include "net/quic/raw_quic/raw_quic_session_pool.h"
+#include "net/third_party/quiche/src/quic/core/quic_connection.h"
+#include "net/third_party/quiche/src/quic/core/quic_utils.h"
+#include "net/tools/quic/quic_simple_server_session_helper.h"
+#include "url/gurl.h"
+#include "url/origin.h"
+
+namespace net {
+
+namespace {
+const char kSourceAddressTokenSecret[] = "raw_quic";
+const size_t kMaxReadsPerEvent = 32;
+const size_t kMaxNewConnectionsPerEvent = 32;
+const int32_t kReadBufferSize = 2 * quic::kMaxIncomingPacketSize;
+const int32_t kQuicSocketReceiveBufferSize = 1024 * 1024;  // 1MB
+const uint32_t kMaxListenThreads = 64;
+const size_t kMaxPendingConnections = 256;
+const size_t kRetrySecretSize = 32;
+}  // namespace
+
+//////////////////////////////////RawQuicServerSession//////////////////////////////////
+RawQuicServerSession::RawQuicServerSession(
+    std::unique_ptr<quic::QuicConnection> connection,
+    RawQuicServerWorker* worker,
+    QuicSession::Visitor* owner,
+    const quic::QuicConfig& config,
+    const quic::ParsedQuicVersionVector& supported_versions,
+    const quic::QuicCryptoServerConfig* crypto_config,
+    quic::QuicCompressedCertsCache* compressed_certs_cache)
+    : QuicTransportServerSession(connection.get(),
+                                 owner,
+                                 config,
+                                 supported_versions,
+                                 crypto_config,
+                                 compressed_certs_cache,
+                                 this),
+      worker_(worker),
+      connection_(std::move(connection)) {}
+
+RawQuicServerSession::~RawQuicServerSession() {
+  if (ready_alarm_ != nullptr) {
+    ready_alarm_->Cancel();
+  }
+  DetachUsers();
+}
+
+const std::string& RawQuicServerSession::path() const {
+  return path_;
+}
+
+RawQuicContext* RawQuicServerSession::context() {
+  return worker_->context();
+}
+
+quic::QuicTime RawQuicServerSession::last_packet_receipt_time() const {
+  return worker_->last_packet_receipt_time();
+}
+
+void RawQuicServerSession::AddUser(RawQuic* user) {
+  users_.insert(user);
+}
+
+void RawQuicServerSession::RemoveUser(RawQuic* user,
+                                      quic::QuicTransportStream* stream) {
+  users_.erase(user);
+  if (!connection()->connected()) {
+    return;
+  }
+
+  if (stream != nullptr && !IsClosedStream(stream->id())) {
+    stream->Reset(quic::QUIC_STREAM_CANCELLED);
+  }
+}
+
+void RawQuicServerSession::OnClosed(
+    quic::QuicConnectionId server_connection_id,
+    quic::QuicErrorCode error,
+    const std::string& error_details,
+    quic::ConnectionCloseSource source) {
+  if (ready_alarm_ != nullptr) {
+    ready_alarm_->Cancel();
+  }
+  pending_streams_.clear();
+
+  std::vector<RawQuic*> users(users_.begin(), users_.end());
+  for (RawQuic* user : users) {
+    if (users_.count(user) > 0) {
+      user->OnConnectionClosed(server_connection_id, error, error_details,
+                               source);
+    }
+  }
+
+  DetachUsers();
+}
+
+void RawQuicServerSession::OnIncomingDataStream(
+    quic::QuicTransportStream* stream) {
+  if (IsSessionReady()) {
+    worker_->server()->Accept(this, stream);
+    return;
+  }
+
+  // Client indication not processed yet, the stream can't be read.
+  pending_streams_.emplace_back(stream->id(), stream);
+}
+
+bool RawQuicServerSession::CheckOrigin(url::Origin origin) {
+  // Clients are not browsers, any origin is fine.
+  return true;
+}
+
+bool RawQuicServerSession::ProcessPath(const GURL& url) {
+  path_ = url.PathForRequest();
+  if (!path_.empty() && path_[0] == '/') {
+    path_.erase(0, 1);
+  }
+
+  // Session becomes ready after this returns, accept streams after it.
+  if (!pending_streams_.empty()) {
+    RawQuicContext* context = worker_->context();
+    if (ready_alarm_ == nullptr) {
+      ready_alarm_.reset(context->GetQuicAlarmFactory()->CreateAlarm(
+          new AlarmDelegate(this, &RawQuicServerSession::OnReadyAlarm)));
+    }
+    ready_alarm_->Update(context->GetQuicClock()->ApproximateNow(),
+                         quic::QuicTime::Delta::Zero());
+  }
+  return true;
+}
+
+void RawQuicServerSession::OnRstStream(const quic::QuicRstStreamFrame& frame) {
+  // Users must see the reset before the stream is closed by it.
+  std::vector<RawQuic*> users(users_.begin(), users_.end());
+  for (RawQuic* user : users) {
+    if (users_.count(user) > 0) {
+      user->OnRstStreamReceived(frame);
+    }
+  }
+
+  QuicTransportServerSession::OnRstStream(frame);
+}
+
+void RawQuicServerSession::OnCongestionWindowChange(quic::QuicTime now) {
+  QuicTransportServerSession::OnCongestionWindowChange(now);
+
+  std::vector<RawQuic*> users(users_.begin(), users_.end());
+  for (RawQuic* user : users) {
+    if (users_.count(user) > 0) {
+      user->OnCongestionChange(now);
+    }
+  }
+}
+
+bool RawQuicServerSession::OnFrameAcked(const quic::QuicFrame& frame,
+                                        quic::QuicTime::Delta ack_delay_time,
+                                        quic::QuicTime receive_timestamp) {
+  bool new_data_acked = QuicTransportServerSession::OnFrameAcked(
+      frame, ack_delay_time, receive_timestamp);
+  if (new_data_acked && frame.type == quic::STREAM_FRAME) {
+    // Hot path, users only look at their own stream and never leave here.
+    quic::QuicTime now = worker_->context()->GetQuicClock()->ApproximateNow();
+    for (RawQuic* user : users_) {
+      user->OnStreamFrameAcked(frame.stream_frame, now);
+    }
+  }
+  return new_data_acked;
+}
+
+void RawQuicServerSession::OnReadyAlarm() {
+  std::vector<std::pair<quic::QuicStreamId, quic::QuicTransportStream*>>
+      streams;
+  streams.swap(pending_streams_);
+  if (!IsSessionReady()) {
+    return;
+  }
+
+  for (const auto& stream : streams) {
+    if (!IsClosedStream(stream.first)) {
+      worker_->server()->Accept(this, stream.second);
+    }
+  }
+}
+
+void RawQuicServerSession::DetachUsers() {
+  std::set<RawQuic*> users;
+  users.swap(users_);
+  for (RawQuic* user : users) {
+    user->DetachSession();
+  }
+}
+
+/////////////////////////////////RawQuicServerDispatcher/////////////////////////////////
+RawQuicServerDispatcher::RawQuicServerDispatcher(
+    RawQuicServerWorker* worker,
+    const quic::QuicConfig* config,
+    const quic::QuicCryptoServerConfig* crypto_config,
+    quic::QuicVersionManager* version_manager,
+    std::unique_ptr<quic::QuicConnectionHelperInterface> helper,
+    std::unique_ptr<quic::QuicCryptoServerStream::Helper> session_helper,
+    std::unique_ptr<quic::QuicAlarmFactory> alarm_factory)
+    : QuicDispatcher(config,
+                     crypto_config,
+                     version_manager,
+                     std::move(helper),
+                     std::move(session_helper),
+                     std::move(alarm_factory),
+                     quic::kQuicDefaultConnectionIdLength),
+      worker_(worker) {}
+
+RawQuicServerDispatcher::~RawQuicServerDispatcher() {}
+
+bool RawQuicServerDispatcher::HasSession(
+    const quic::QuicConnectionId& server_connection_id) const {
+  if (sessions_.count(server_connection_id) > 0) {
+    return true;
+  }
+
+  // Initial retransmitted with the id the client picked.
+  return server_connection_id.length() !=
+             quic::kQuicDefaultConnectionIdLength &&
+         sessions_.count(ReplaceConnectionId(server_connection_id)) > 0;
+}
+
+// static
+quic::QuicConnectionId RawQuicServerDispatcher::ReplaceConnectionId(
+    const quic::QuicConnectionId& connection_id) {
+  quic::QuicConnectionId replacement =
+      quic::QuicUtils::CreateReplacementConnectionId(connection_id);
+  // Short header packets must steer where the Initials did.
+  if (!connection_id.IsEmpty()) {
+    replacement.mutable_data()[0] = connection_id.data()[0];
+  }
+  return replacement;
+}
+
+void RawQuicServerDispatcher::OnConnectionClosed(
+    quic::QuicConnectionId server_connection_id,
+    quic::QuicErrorCode error,
+    const std::string& error_details,
+    quic::ConnectionCloseSource source) {
+  auto it = sessions_.find(server_connection_id);
+  if (it != sessions_.end()) {
+    RawQuicServerSession* session = it->second;
+    sessions_.erase(it);
+    session->OnClosed(server_connection_id, error, error_details, source);
+  }
+
+  // Session is deleted later by base.
+  QuicDispatcher::OnConnectionClosed(server_connection_id, error,
+                                     error_details, source);
+}
+
+std::unique_ptr<quic::QuicSession> RawQuicServerDispatcher::CreateQuicSession(
+    quic::QuicConnectionId server_connection_id,
+    const quic::QuicSocketAddress& peer_address,
+    quiche::QuicheStringPiece alpn,
+    const quic::ParsedQuicVersion& version) {
+  auto connection = std::make_unique<quic::QuicConnection>(
+      server_connection_id, peer_address, helper(), alarm_factory(), writer(),
+      false /* owns_writer */, quic::Perspective::IS_SERVER,
+      quic::ParsedQuicVersionVector{version});
+
+  // Client checks it was retried by the server it handshakes with.
+  quic::QuicConfig session_config = config();
+  quic::QuicConnectionId original_connection_id;
+  if (worker_->admission()->TakeOriginalConnectionId(server_connection_id,
+                                                     &original_connection_id)) {
+    session_config.SetOriginalConnectionIdToSend(original_connection_id);
+  }
+
+  auto session = std::make_unique<RawQuicServerSession>(
+      std::move(connection), worker_, this, session_config,
+      GetSupportedVersions(), crypto_config(), compressed_certs_cache());
+  session->Initialize();
+  sessions_[server_connection_id] = session.get();
+  return session;
+}
+
+quic::QuicConnectionId RawQuicServerDispatcher::GenerateNewServerConnectionId(
+    quic::ParsedQuicVersion version,
+    quic::QuicConnectionId connection_id) const {
+  return ReplaceConnectionId(connection_id);
+}
+
+//////////////////////////////RawQuicServerPacketWriter//////////////////////////////
+RawQuicServerPacketWriter::RawQuicServerPacketWriter(
+    RawQuicUDPServerSocket* socket,
+    quic::QuicDispatcher* dispatcher)
+    : socket_(socket), dispatcher_(dispatcher), weak_factory_(this) {}
+
+RawQuicServerPacketWriter::~RawQuicServerPacketWriter() {}
+
+quic::WriteResult RawQuicServerPacketWriter::WritePacket(
+    const char* buffer,
+    size_t buf_len,
+    const quic::QuicIpAddress& self_address,
+    const quic::QuicSocketAddress& peer_address,
+    quic::PerPacketOptions* options) {
+  scoped_refptr<net::StringIOBuffer> buf =
+      base::MakeRefCounted<net::StringIOBuffer>(std::string(buffer, buf_len));
+  int rv = socket_->SendTo(
+      buf.get(), (int)buf_len, net::ToIPEndPoint(peer_address),
+      base::BindOnce(&RawQuicServerPacketWriter::OnWriteComplete,
+                     weak_factory_.GetWeakPtr()));
+
+  quic::WriteStatus status = quic::WRITE_STATUS_OK;
+  if (rv < 0) {
+    if (rv != net::ERR_IO_PENDING) {
+      status = quic::WRITE_STATUS_ERROR;
+    } else {
+      // Socket keeps the buffer, dispatcher waits for OnCanWrite.
+      status = quic::WRITE_STATUS_BLOCKED_DATA_BUFFERED;
+      write_blocked_ = true;
+    }
+  }
+  return quic::WriteResult(status, rv);
+}
+
+bool RawQuicServerPacketWriter::IsWriteBlocked() const {
+  return write_blocked_;
+}
+
+void RawQuicServerPacketWriter::SetWritable() {
+  write_blocked_ = false;
+}
+
+quic::QuicByteCount RawQuicServerPacketWriter::GetMaxPacketSize(
+    const quic::QuicSocketAddress& peer_address) const {
+  return quic::kMaxOutgoingPacketSize;
+}
+
+bool RawQuicServerPacketWriter::SupportsReleaseTime() const {
+  return false;
+}
+
+bool RawQuicServerPacketWriter::IsBatchMode() const {
+  return false;
+}
+
+char* RawQuicServerPacketWriter::GetNextWriteLocation(
+    const quic::QuicIpAddress& self_address,
+    const quic::QuicSocketAddress& peer_address) {
+  return nullptr;
+}
+
+quic::WriteResult RawQuicServerPacketWriter::Flush() {
+  return quic::WriteResult(quic::WRITE_STATUS_OK, 0);
+}
+
+void RawQuicServerPacketWriter::OnWriteComplete(int result) {
+  write_blocked_ = false;
+  dispatcher_->OnCanWrite();
+}
+
+//////////////////////////////////RawQuicServerWorker//////////////////////////////////
+RawQuicServerWorker::RawQuicServerWorker(RawQuicServer* server,
+                                         RawQuicContext* context)
+    : server_(server),
+      context_(context),
+      config_(RawQuicSessionPool::DefaultQuicConfig()),
+      version_manager_(RawQuicSessionPool::GetVersions()),
+      admission_(server->retry_secret()),
+      packets_received_(0),
+      packets_forwarded_(0),
+      handshakes_accepted_(0),
+      handshakes_retried_(0),
+      handshakes_validated_(0),
+      handshakes_dropped_(0),
+      weak_factory_(this) {}
+
+RawQuicServerWorker::~RawQuicServerWorker() {}
+
+RawQuicContext* RawQuicServerWorker::context() {
+  return context_;
+}
+
+RawQuicServer* RawQuicServerWorker::server() {
+  return server_;
+}
+
+RawQuicAdmissionController* RawQuicServerWorker::admission() {
+  return &admission_;
+}
+
+void RawQuicServerWorker::SetHandshakeLimit(
+    const RawQuicHandshakeLimit& limit) {
+  IntPromisePtr promise(new IntPromise);
+  context_->Post(base::Bind(&RawQuicServerWorker::DoSetHandshakeLimit,
+                            base::Unretained(this), limit, promise));
+
+  IntFuture future = promise->get_future();
+  future.get();
+}
+
+uint16_t RawQuicServerWorker::port() const {
+  return server_address_.port();
+}
+
+int32_t RawQuicServerWorker::Listen(
+    const net::IPEndPoint& address,
+    bool share_port,
+    bool steer,
+    const quic::QuicCryptoServerConfig* crypto_config) {
+  IntPromisePtr promise(new IntPromise);
+  context_->Post(base::Bind(&RawQuicServerWorker::DoListen,
+                            base::Unretained(this), address, share_port, steer,
+                            crypto_config, promise));
+
+  IntFuture future = promise->get_future();
+  return future.get();
+}
+
+void RawQuicServerWorker::Start() {
+  context_->Post(
+      base::BindOnce(&RawQuicServerWorker::ReadPackets, weak_this_));
+}
+
+void RawQuicServerWorker::Stop() {
+  IntPromisePtr promise(new IntPromise);
+  context_->Post(base::Bind(&RawQuicServerWorker::DoStop,
+                            base::Unretained(this), promise));
+
+  IntFuture future = promise->get_future();
+  future.get();
+}
+
+void RawQuicServerWorker::PostPacket(
+    const net::IPEndPoint& client_address,
+    std::unique_ptr<quic::QuicReceivedPacket> packet) {
+  context_->Post(base::BindOnce(&RawQuicServerWorker::ProcessForwardedPacket,
+                                weak_this_, client_address,
+                                std::move(packet)));
+}
+
+quic::QuicTime RawQuicServerWorker::last_packet_receipt_time() const {
+  return last_packet_receipt_time_;
+}
+
+uint64_t RawQuicServerWorker::packets_received() const {
+  return packets_received_.load(std::memory_order_relaxed);
+}
+
+uint64_t RawQuicServerWorker::packets_forwarded() const {
+  return packets_forwarded_.load(std::memory_order_relaxed);
+}
+
+uint64_t RawQuicServerWorker::handshakes_accepted() const {
+  return handshakes_accepted_.load(std::memory_order_relaxed);
+}
+
+uint64_t RawQuicServerWorker::handshakes_retried() const {
+  return handshakes_retried_.load(std::memory_order_relaxed);
+}
+
+uint64_t RawQuicServerWorker::handshakes_validated() const {
+  return handshakes_validated_.load(std::memory_order_relaxed);
+}
+
+uint64_t RawQuicServerWorker::handshakes_dropped() const {
+  return handshakes_dropped_.load(std::memory_order_relaxed);
+}
+
+void RawQuicServerWorker::DoListen(
+    const net::IPEndPoint& address,
+    bool share_port,
+    bool steer,
+    const quic::QuicCryptoServerConfig* crypto_config,
+    IntPromisePtr promise) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  do {
+    net::NetLogWithSource* net_log = context_->GetNetLogWithSource();
+    socket_ = std::make_unique<RawQuicUDPServerSocket>(net_log->net_log(),
+                                                       net_log->source());
+    ret.net_error = socket_->Listen(address, share_port);
+    if (ret.net_error != net::OK) {
+      LOG(ERROR) << "Listen on " << address.ToString()
+                 << " failed, error:" << ret.net_error;
+      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+      break;
+    }
+
+    ret.net_error = socket_->SetReceiveBufferSize(kQuicSocketReceiveBufferSize);
+    if (ret.net_error == net::OK) {
+      ret.net_error = socket_->GetLocalAddress(&server_address_);
+    }
+    if (ret.net_error != net::OK) {
+      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+      break;
+    }
+
+    // Last socket of the group attaches the program for all of them. The
+    // kernel can't steer without it, ProcessReadPacket forwards instead.
+    if (steer) {
+      int rv = socket_->SetSteering(server_->worker_count());
+      if (rv != net::OK) {
+        LOG(ERROR) << "Attach steering program failed, error:" << rv
+                   << ", packets are forwarded between threads.";
+      }
+    }
+
+    dispatcher_ = std::make_unique<RawQuicServerDispatcher>(
+        this, &config_, crypto_config, &version_manager_,
+        std::make_unique<net::QuicChromiumConnectionHelper>(
+            context_->GetQuicClock(), context_->GetQuicRandom()),
+        std::make_unique<net::QuicSimpleServerSessionHelper>(
+            context_->GetQuicRandom()),
+        std::make_unique<net::QuicChromiumAlarmFactory>(
+            context_->GetTaskRunner(), context_->GetQuicClock()));
+    // Writer is owned by dispatcher.
+    writer_ = new RawQuicServerPacketWriter(socket_.get(), dispatcher_.get());
+    dispatcher_->InitializeWithWriter(writer_);
+
+    read_buffer_ = base::MakeRefCounted<net::IOBufferWithSize>(kReadBufferSize);
+    weak_this_ = weak_factory_.GetWeakPtr();
+  } while (0);
+
+  if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    writer_ = nullptr;
+    dispatcher_.reset();
+    socket_.reset();
+  }
+  promise->set_value(ret.error);
+}
+
+void RawQuicServerWorker::DoStop(IntPromisePtr promise) {
+  // Pending reads, posted ReadPackets and packets forwarded by other
+  // workers never run after this.
+  weak_factory_.InvalidateWeakPtrs();
+
+  if (dispatcher_ != nullptr) {
+    // Handles learn it through error_callback.
+    dispatcher_->Shutdown();
+    writer_ = nullptr;
+    dispatcher_.reset();
+  }
+  socket_.reset();
+  read_buffer_ = nullptr;
+  pending_connections_.clear();
+  promise->set_value(0);
+}
+
+void RawQuicServerWorker::DoSetHandshakeLimit(
+    const RawQuicHandshakeLimit& limit,
+    IntPromisePtr promise) {
+  admission_.SetLimit(limit);
+  promise->set_value(0);
+}
+
+void RawQuicServerWorker::ReadPackets() {
+  dispatcher_->ProcessBufferedChlos(kMaxNewConnectionsPerEvent);
+
+  bool read_pending = false;
+  for (size_t i = 0; i < kMaxReadsPerEvent; ++i) {
+    int result = socket_->RecvFrom(
+        read_buffer_.get(), read_buffer_->size(), &client_address_,
+        base::BindOnce(&RawQuicServerWorker::OnReadComplete,
+                       weak_factory_.GetWeakPtr()));
+    if (result == net::ERR_IO_PENDING) {
+      read_pending = true;
+      break;
+    }
+
+    if (!ProcessReadPacket(result)) {
+      return;
+    }
+  }
+
+  // Established connections of the batch were served first.
+  ProcessPendingConnections();
+  if (read_pending) {
+    return;
+  }
+
+  // Yield to other tasks, such as commands of handles, between batches.
+  context_->Post(base::BindOnce(&RawQuicServerWorker::ReadPackets,
+                                weak_factory_.GetWeakPtr()));
+}
+
+void RawQuicServerWorker::OnReadComplete(int result) {
+  if (ProcessReadPacket(result)) {
+    ReadPackets();
+  }
+}
+
+bool RawQuicServerWorker::ProcessReadPacket(int result) {
+  if (result == 0) {
+    result = net::ERR_CONNECTION_CLOSED;
+  }
+
+  if (result < 0) {
+    LOG(ERROR) << "Read packet failed, error:" << result
+               << ", stop listening.";
+    return false;
+  }
+
+  packets_received_.fetch_add(1, std::memory_order_relaxed);
+  quic::QuicTime now = context_->GetQuicClock()->Now();
+  quic::QuicReceivedPacket packet(read_buffer_->data(), result, now,
+                                  false /* owns_buffer */);
+
+  // Kernel steered it elsewhere, as without the program or after the
+  // client address changed, hand it to the worker owning the connection.
+  RawQuicServerWorker* owner = server_->GetWorker(read_buffer_->data(), result);
+  if (owner != this) {
+    packets_forwarded_.fetch_add(1, std::memory_order_relaxed);
+    owner->PostPacket(client_address_, packet.Clone());
+    return true;
+  }
+
+  // Handshakes would starve established connections in a reconnect storm,
+  // they wait for the end of the batch.
+  if (IsNewConnection(read_buffer_->data(), result)) {
+    if (pending_connections_.size() >= kMaxPendingConnections) {
+      handshakes_dropped_.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    pending_connections_.push_back({client_address_, packet.Clone()});
+    return true;
+  }
+
+  ProcessPacket(client_address_, packet);
+  return true;
+}
+
+void RawQuicServerWorker::ProcessPacket(
+    const net::IPEndPoint& client_address,
+    const quic::QuicReceivedPacket& packet) {
+  last_packet_receipt_time_ = packet.receipt_time();
+  dispatcher_->ProcessPacket(net::ToQuicSocketAddress(server_address_),
+                             net::ToQuicSocketAddress(client_address), packet);
+}
+
+void RawQuicServerWorker::ProcessForwardedPacket(
+    const net::IPEndPoint& client_address,
+    std::unique_ptr<quic::QuicReceivedPacket> packet) {
+  if (IsNewConnection(packet->data(), packet->length())) {
+    ProcessNewConnection(client_address, *packet);
+    return;
+  }
+
+  ProcessPacket(client_address, *packet);
+}
+
+bool RawQuicServerWorker::IsNewConnection(const char* data, size_t length) {
+  RawQuicInitialPacket initial;
+  if (!RawQuicAdmissionController::ParseInitialPacket(data, length,
+                                                      &initial) ||
+      dispatcher_->HasSession(initial.destination_connection_id)) {
+    return false;
+  }
+
+  // Dispatcher answers other versions with version negotiation.
+  for (const quic::ParsedQuicVersion& version :
+       version_manager_.GetSupportedVersions()) {
+    if (quic::CreateQuicVersionLabel(version) == initial.version_label) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RawQuicServerWorker::ProcessNewConnection(
+    const net::IPEndPoint& client_address,
+    const quic::QuicReceivedPacket& packet) {
+  RawQuicInitialPacket initial;
+  if (!RawQuicAdmissionController::ParseInitialPacket(
+          packet.data(), packet.length(), &initial)) {
+    return;
+  }
+
+  // Retransmission of an Initial admitted earlier in the batch.
+  if (dispatcher_->HasSession(initial.destination_connection_id)) {
+    ProcessPacket(client_address, packet);
+    return;
+  }
+
+  quic::QuicTime now = context_->GetQuicClock()->Now();
+  switch (admission_.Admit(initial, client_address.address(), now)) {
+    case RawQuicAdmissionController::ADMIT:
+      // Tokens that don't validate are dropped, the client took the Retry.
+      if (!initial.token.empty()) {
+        handshakes_validated_.fetch_add(1, std::memory_order_relaxed);
+      }
+      handshakes_accepted_.fetch_add(1, std::memory_order_relaxed);
+      ProcessPacket(client_address, packet);
+      break;
+    case RawQuicAdmissionController::RETRY:
+      SendRetry(client_address, initial, now);
+      break;
+    case RawQuicAdmissionController::DROP:
+      handshakes_dropped_.fetch_add(1, std::memory_order_relaxed);
+      break;
+  }
+}
+
+void RawQuicServerWorker::ProcessPendingConnections() {
+  std::deque<PendingConnection> pending;
+  pending.swap(pending_connections_);
+  for (const PendingConnection& connection : pending) {
+    ProcessNewConnection(connection.client_address, *connection.packet);
+  }
+}
+
+void RawQuicServerWorker::SendRetry(const net::IPEndPoint& client_address,
+                                    const RawQuicInitialPacket& initial,
+                                    quic::QuicTime now) {
+  // Keeps the first byte, the connection stays on this worker.
+  char id[quic::kQuicDefaultConnectionIdLength];
+  context_->GetQuicRandom()->RandBytes(id, sizeof(id));
+  id[0] = initial.destination_connection_id.data()[0];
+  quic::QuicConnectionId new_connection_id(id, sizeof(id));
+
+  std::string retry;
+  if (writer_->IsWriteBlocked() ||
+      !admission_.BuildRetryPacket(initial, client_address.address(),
+                                   new_connection_id, now, &retry)) {
+    handshakes_dropped_.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  writer_->WritePacket(retry.data(), retry.size(),
+                       net::ToQuicSocketAddress(server_address_).host(),
+                       net::ToQuicSocketAddress(client_address), nullptr);
+  handshakes_retried_.fetch_add(1, std::memory_order_relaxed);
+}
+
+//////////////////////////////////////RawQuicServer//////////////////////////////////////
+RawQuicServer::RawQuicServer(AcceptCallback accept_callback,
+                             RawQuicCallbacks callback,
+                             void* opaque)
+    : accept_callback_(accept_callback), callback_(callback), opaque_(opaque) {}
+
+RawQuicServer::~RawQuicServer() {}
+
+int32_t RawQuicServer::Listen(const char* ip,
+                              uint16_t port,
+                              const char* cert_path,
+                              const char* key_path,
+                              uint32_t threads) {
+  int32_t ret = RAW_QUIC_ERROR_CODE_SUCCESS;
+  do {
+    if (cert_path == nullptr || key_path == nullptr ||
+        threads > kMaxListenThreads) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+
+#if !defined(OS_LINUX) && !defined(OS_ANDROID)
+    // Without SO_REUSEPORT balancing, one socket would get every packet.
+    if (threads > 1) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+#endif
+
+    // Without ip, listen on all interfaces, v4 mapped included.
+    net::IPAddress address = net::IPAddress::IPv6AllZeros();
+    if (ip != nullptr && ip[0] != '\0' && !address.AssignFromIPLiteral(ip)) {
+      ret = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+
+    auto proof_source = std::make_unique<net::ProofSourceChromium>();
+    if (!proof_source->Initialize(base::FilePath::FromUTF8Unsafe(cert_path),
+                                  base::FilePath::FromUTF8Unsafe(key_path),
+                                  base::FilePath())) {
+      LOG(ERROR) << "Load certificate " << cert_path << " failed.";
+      ret = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+
+    RawQuicContext* context = RawQuicContext::GetInstance();
+    crypto_config_ = std::make_unique<quic::QuicCryptoServerConfig>(
+        kSourceAddressTokenSecret, context->GetQuicRandom(),
+        std::move(proof_source), quic::KeyExchangeSource::Default());
+
+    // Tokens of a listener are only good for it, and only while it runs.
+    retry_secret_.resize(kRetrySecretSize);
+    context->GetQuicRandom()->RandBytes(&retry_secret_[0],
+                                        retry_secret_.size());
+
+    // A single worker runs on the RawQuic IO thread, as handles do.
+    bool share_port = threads > 1;
+    uint32_t count = share_port ? threads : 1;
+    for (uint32_t i = 0; i < count; ++i) {
+      workers_.push_back(std::make_unique<RawQuicServerWorker>(
+          this, share_port ? RawQuicContext::GetWorkerInstance(i) : context));
+    }
+
+    // Sockets join the port group in worker order, the steering program
+    // returns the same indexes.
+    net::IPEndPoint endpoint(address, port);
+    for (uint32_t i = 0; i < count && ret == RAW_QUIC_ERROR_CODE_SUCCESS;
+         ++i) {
+      ret = workers_[i]->Listen(endpoint, share_port,
+                                share_port && i + 1 == count,
+                                crypto_config_.get());
+      if (i == 0 && ret == RAW_QUIC_ERROR_CODE_SUCCESS && port == 0) {
+        // Others must join the port the first one was given.
+        endpoint = net::IPEndPoint(address, workers_[0]->port());
+      }
+    }
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      break;
+    }
+
+    // Workers forward packets to each other, all must be listening.
+    for (auto& worker : workers_) {
+      worker->Start();
+    }
+  } while (0);
+
+  if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    Stop();
+  }
+  return ret;
+}
+
+void RawQuicServer::Stop() {
+  // None reads or forwards after all stopped, then they can go.
+  for (auto& worker : workers_) {
+    worker->Stop();
+  }
+  workers_.clear();
+  crypto_config_.reset();
+}
+
+void RawQuicServer::GetStats(RawQuicListenerStats* stats) {
+  memset(stats, 0, sizeof(RawQuicListenerStats));
+  stats->threads = (uint32_t)workers_.size();
+  for (auto& worker : workers_) {
+    stats->packets_received += worker->packets_received();
+    stats->packets_forwarded += worker->packets_forwarded();
+    stats->handshakes_accepted += worker->handshakes_accepted();
+    stats->handshakes_retried += worker->handshakes_retried();
+    stats->handshakes_validated += worker->handshakes_validated();
+    stats->handshakes_dropped += worker->handshakes_dropped();
+  }
+}
+
+int32_t RawQuicServer::SetHandshakeLimit(const RawQuicHandshakeLimit& limit) {
+  if (limit.handshakes_per_second > 0 && limit.burst == 0) {
+    return RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+  }
+
+  for (auto& worker : workers_) {
+    worker->SetHandshakeLimit(limit);
+  }
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+void RawQuicServer::Accept(RawQuicServerSession* session,
+                           quic::QuicTransportStream* stream) {
+  // Server never verifies, the flag only matters to Connect.
+  RawQuic* raw_quic = new RawQuic(callback_, opaque_, false);
+  raw_quic->Accept(session, stream);
+  accept_callback_(this, raw_quic, session->path().c_str(), opaque_);
+}
+
+uint32_t RawQuicServer::worker_count() const {
+  return (uint32_t)workers_.size();
+}
+
+const std::string& RawQuicServer::retry_secret() const {
+  return retry_secret_;
+}
+
+RawQuicServerWorker* RawQuicServer::GetWorker(const char* data,
+                                              size_t length) {
+  return workers_[RawQuicUDPServerSocket::SteeringIndex(
+                      data, length, (uint32_t)workers_.size())]
+      .get();
+}
+
+}  // namespace net
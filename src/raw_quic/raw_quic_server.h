@@ -0,0 +1,398 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_SERVER_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_SERVER_H_
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/memory/weak_ptr.h"
+#include "net/base/io_buffer.h"
+#include "net/base/ip_endpoint.h"
+#include "net/quic/raw_quic/raw_quic.h"
+#include "net/quic/raw_quic/raw_quic_admission.h"
+#include "net/quic/raw_quic/raw_quic_define.h"
+#include "net/quic/raw_quic/raw_quic_udp_socket.h"
+#include "net/third_party/quiche/src/quic/core/crypto/quic_crypto_server_config.h"
+#include "net/third_party/quiche/src/quic/core/quic_alarm.h"
+#include "net/third_party/quiche/src/quic/core/quic_config.h"
+#include "net/third_party/quiche/src/quic/core/quic_dispatcher.h"
+#include "net/third_party/quiche/src/quic/core/quic_packet_writer.h"
+#include "net/third_party/quiche/src/quic/core/quic_packets.h"
+#include "net/third_party/quiche/src/quic/core/quic_version_manager.h"
+#include "net/third_party/quiche/src/quic/quic_transport/quic_transport_server_session.h"
+#include "net/third_party/quiche/src/quic/quic_transport/quic_transport_stream.h"
+
+namespace net {
+
+class RawQuicContext;
+class RawQuicServer;
+class RawQuicServerWorker;
+
+//////////////////////////////////RawQuicServerSession//////////////////////////////////
+// Accepted QuicTransport connection, every incoming bidirectional stream on
+// it becomes a RawQuic handle. Session events are forwarded to all handles
+// attached, as RawQuicPooledSession does on client side.
+class RawQuicServerSession
+    : public quic::QuicTransportServerSession,
+      public quic::QuicTransportServerSession::ServerVisitor {
+ public:
+  RawQuicServerSession(std::unique_ptr<quic::QuicConnection> connection,
+                       RawQuicServerWorker* worker,
+                       QuicSession::Visitor* owner,
+                       const quic::QuicConfig& config,
+                       const quic::ParsedQuicVersionVector& supported_versions,
+                       const quic::QuicCryptoServerConfig* crypto_config,
+                       quic::QuicCompressedCertsCache* compressed_certs_cache);
+  ~RawQuicServerSession() override;
+
+  // Path of the client indication, without the leading '/'.
+  const std::string& path() const;
+
+  // Context of the worker the session runs on.
+  RawQuicContext* context();
+
+  // Receipt time of the packet the worker processed last, data read from
+  // streams arrived no later than this.
+  quic::QuicTime last_packet_receipt_time() const;
+
+  void AddUser(RawQuic* user);
+
+  // Stream of user is reset if still open, the connection is kept until
+  // the client closes it or it idles out.
+  void RemoveUser(RawQuic* user, quic::QuicTransportStream* stream);
+
+  // Called by dispatcher before the session is closed.
+  void OnClosed(quic::QuicConnectionId server_connection_id,
+                quic::QuicErrorCode error,
+                const std::string& error_details,
+                quic::ConnectionCloseSource source);
+
+  // quic::QuicTransportServerSession
+  void OnIncomingDataStream(quic::QuicTransportStream* stream) override;
+
+  // quic::QuicTransportServerSession::ServerVisitor
+  bool CheckOrigin(url::Origin origin) override;
+
+  bool ProcessPath(const GURL& url) override;
+
+  // quic::QuicSession
+  void OnRstStream(const quic::QuicRstStreamFrame& frame) override;
+
+  void OnCongestionWindowChange(quic::QuicTime now) override;
+
+  bool OnFrameAcked(const quic::QuicFrame& frame,
+                    quic::QuicTime::Delta ack_delay_time,
+                    quic::QuicTime receive_timestamp) override;
+
+ protected:
+  // Streams opened before the client indication are accepted once ready.
+  void OnReadyAlarm();
+
+  void DetachUsers();
+
+ private:
+  class AlarmDelegate : public quic::QuicAlarm::Delegate {
+   public:
+    typedef void (RawQuicServerSession::*Method)();
+    AlarmDelegate(RawQuicServerSession* session, Method method)
+        : session_(session), method_(method) {}
+    void OnAlarm() override { (session_->*method_)(); }
+
+   private:
+    RawQuicServerSession* session_ = nullptr;
+    Method method_ = nullptr;
+  };
+
+  RawQuicServerWorker* worker_ = nullptr;
+  std::unique_ptr<quic::QuicConnection> connection_;
+  std::string path_;
+  std::set<RawQuic*> users_;
+  // Id with stream, the stream is only touched while id is not closed.
+  std::vector<std::pair<quic::QuicStreamId, quic::QuicTransportStream*>>
+      pending_streams_;
+  std::unique_ptr<quic::QuicAlarm> ready_alarm_;
+};
+
+/////////////////////////////////RawQuicServerDispatcher/////////////////////////////////
+// Connection ids of clients that aren't kQuicDefaultConnectionIdLength long
+// are replaced by one keeping their first byte, which steers the connection
+// to its worker.
+class RawQuicServerDispatcher : public quic::QuicDispatcher {
+ public:
+  RawQuicServerDispatcher(
+      RawQuicServerWorker* worker,
+      const quic::QuicConfig* config,
+      const quic::QuicCryptoServerConfig* crypto_config,
+      quic::QuicVersionManager* version_manager,
+      std::unique_ptr<quic::QuicConnectionHelperInterface> helper,
+      std::unique_ptr<quic::QuicCryptoServerStream::Helper> session_helper,
+      std::unique_ptr<quic::QuicAlarmFactory> alarm_factory);
+  ~RawQuicServerDispatcher() override;
+
+  // Also true for the id the client picked if the session has its
+  // replacement.
+  bool HasSession(const quic::QuicConnectionId& server_connection_id) const;
+
+  // Same for every Initial of a connection, retransmissions included.
+  static quic::QuicConnectionId ReplaceConnectionId(
+      const quic::QuicConnectionId& connection_id);
+
+  // quic::QuicSession::Visitor
+  void OnConnectionClosed(quic::QuicConnectionId server_connection_id,
+                          quic::QuicErrorCode error,
+                          const std::string& error_details,
+                          quic::ConnectionCloseSource source) override;
+
+ protected:
+  // quic::QuicDispatcher
+  std::unique_ptr<quic::QuicSession> CreateQuicSession(
+      quic::QuicConnectionId server_connection_id,
+      const quic::QuicSocketAddress& peer_address,
+      quiche::QuicheStringPiece alpn,
+      const quic::ParsedQuicVersion& version) override;
+
+  quic::QuicConnectionId GenerateNewServerConnectionId(
+      quic::ParsedQuicVersion version,
+      quic::QuicConnectionId connection_id) const override;
+
+ private:
+  RawQuicServerWorker* worker_ = nullptr;
+  // Sessions still connected, owned by base.
+  std::unordered_map<quic::QuicConnectionId,
+                     RawQuicServerSession*,
+                     quic::QuicConnectionIdHash>
+      sessions_;
+};
+
+//////////////////////////////RawQuicServerPacketWriter//////////////////////////////
+// Same as QuicSimpleServerPacketWriter, over the socket of a worker.
+class RawQuicServerPacketWriter : public quic::QuicPacketWriter {
+ public:
+  RawQuicServerPacketWriter(RawQuicUDPServerSocket* socket,
+                            quic::QuicDispatcher* dispatcher);
+  ~RawQuicServerPacketWriter() override;
+
+  // quic::QuicPacketWriter
+  quic::WriteResult WritePacket(const char* buffer,
+                                size_t buf_len,
+                                const quic::QuicIpAddress& self_address,
+                                const quic::QuicSocketAddress& peer_address,
+                                quic::PerPacketOptions* options) override;
+  bool IsWriteBlocked() const override;
+  void SetWritable() override;
+  quic::QuicByteCount GetMaxPacketSize(
+      const quic::QuicSocketAddress& peer_address) const override;
+  bool SupportsReleaseTime() const override;
+  bool IsBatchMode() const override;
+  char* GetNextWriteLocation(
+      const quic::QuicIpAddress& self_address,
+      const quic::QuicSocketAddress& peer_address) override;
+  quic::WriteResult Flush() override;
+
+ protected:
+  void OnWriteComplete(int result);
+
+ private:
+  RawQuicUDPServerSocket* socket_ = nullptr;
+  quic::QuicDispatcher* dispatcher_ = nullptr;
+  bool write_blocked_ = false;
+
+  base::WeakPtrFactory<RawQuicServerPacketWriter> weak_factory_;
+};
+
+//////////////////////////////////RawQuicServerWorker//////////////////////////////////
+// Socket, dispatcher and packet loop of one IO thread, same as
+// quic_transport_simple_server. With several workers, each one has its own
+// IO thread and SO_REUSEPORT socket, and a connection lives on the worker
+// its connection id steers to, see RawQuicUDPServerSocket::SteeringIndex.
+// New connections go through the worker's RawQuicAdmissionController after
+// the packets of established ones read in the same batch.
+class RawQuicServerWorker {
+ public:
+  RawQuicServerWorker(RawQuicServer* server, RawQuicContext* context);
+  virtual ~RawQuicServerWorker();
+
+ public:
+  RawQuicContext* context();
+
+  // Sync, reading starts with Start.
+  int32_t Listen(const net::IPEndPoint& address,
+                 bool share_port,
+                 bool steer,
+                 const quic::QuicCryptoServerConfig* crypto_config);
+
+  void Start();
+
+  // Sync, closes every connection of the worker.
+  void Stop();
+
+  // Any thread, packet of a connection of this worker read by another one.
+  void PostPacket(const net::IPEndPoint& client_address,
+                  std::unique_ptr<quic::QuicReceivedPacket> packet);
+
+  RawQuicServer* server();
+
+  // IO thread only.
+  RawQuicAdmissionController* admission();
+
+  // Sync.
+  void SetHandshakeLimit(const RawQuicHandshakeLimit& limit);
+
+  // Local port once listening.
+  uint16_t port() const;
+
+  // IO thread only.
+  quic::QuicTime last_packet_receipt_time() const;
+
+  uint64_t packets_received() const;
+
+  uint64_t packets_forwarded() const;
+
+  uint64_t handshakes_accepted() const;
+
+  uint64_t handshakes_retried() const;
+
+  uint64_t handshakes_validated() const;
+
+  uint64_t handshakes_dropped() const;
+
+ protected:
+  void DoListen(const net::IPEndPoint& address,
+                bool share_port,
+                bool steer,
+                const quic::QuicCryptoServerConfig* crypto_config,
+                IntPromisePtr promise);
+
+  void DoStop(IntPromisePtr promise);
+
+  void DoSetHandshakeLimit(const RawQuicHandshakeLimit& limit,
+                           IntPromisePtr promise);
+
+  void ReadPackets();
+
+  void OnReadComplete(int result);
+
+  // Returns false if reading stopped.
+  bool ProcessReadPacket(int result);
+
+  void ProcessPacket(const net::IPEndPoint& client_address,
+                     const quic::QuicReceivedPacket& packet);
+
+  void ProcessForwardedPacket(const net::IPEndPoint& client_address,
+                              std::unique_ptr<quic::QuicReceivedPacket> packet);
+
+  // Client Initial of a connection the dispatcher doesn't know.
+  bool IsNewConnection(const char* data, size_t length);
+
+  // Admits, retries or drops.
+  void ProcessNewConnection(const net::IPEndPoint& client_address,
+                            const quic::QuicReceivedPacket& packet);
+
+  void ProcessPendingConnections();
+
+  void SendRetry(const net::IPEndPoint& client_address,
+                 const RawQuicInitialPacket& initial,
+                 quic::QuicTime now);
+
+ private:
+  struct PendingConnection {
+    net::IPEndPoint client_address;
+    std::unique_ptr<quic::QuicReceivedPacket> packet;
+  };
+
+  RawQuicServer* server_ = nullptr;
+  RawQuicContext* context_ = nullptr;
+
+  quic::QuicConfig config_;
+  quic::QuicVersionManager version_manager_;
+  std::unique_ptr<RawQuicServerDispatcher> dispatcher_;
+  std::unique_ptr<RawQuicUDPServerSocket> socket_;
+  // Owned by dispatcher_, Retry packets are written with it too.
+  RawQuicServerPacketWriter* writer_ = nullptr;
+  net::IPEndPoint server_address_;
+
+  RawQuicAdmissionController admission_;
+  // New connections of the read batch, processed after the packets of
+  // established ones.
+  std::deque<PendingConnection> pending_connections_;
+
+  // Result of the potentially asynchronous read.
+  scoped_refptr<net::IOBufferWithSize> read_buffer_;
+  net::IPEndPoint client_address_;
+  quic::QuicTime last_packet_receipt_time_ = quic::QuicTime::Zero();
+
+  std::atomic<uint64_t> packets_received_;
+  std::atomic<uint64_t> packets_forwarded_;
+  std::atomic<uint64_t> handshakes_accepted_;
+  std::atomic<uint64_t> handshakes_retried_;
+  std::atomic<uint64_t> handshakes_validated_;
+  std::atomic<uint64_t> handshakes_dropped_;
+
+  // Taken on IO thread by DoListen, copies post packets from other workers.
+  // Reads and posted tasks hold weak pointers, Stop invalidates them.
+  base::WeakPtr<RawQuicServerWorker> weak_this_;
+  base::WeakPtrFactory<RawQuicServerWorker> weak_factory_;
+};
+
+//////////////////////////////////////RawQuicServer//////////////////////////////////////
+// QuicTransport listener on one or more IO threads. Streams accepted are
+// handed to the app as RawQuic handles opened with the listener's
+// callbacks and opaque.
+class RawQuicServer {
+ public:
+  RawQuicServer(AcceptCallback accept_callback,
+                RawQuicCallbacks callback,
+                void* opaque);
+  virtual ~RawQuicServer();
+
+ public:
+  // threads 0 or 1 listens on the RawQuic IO thread, more start a worker
+  // IO thread each, sharing the port.
+  int32_t Listen(const char* ip,
+                 uint16_t port,
+                 const char* cert_path,
+                 const char* key_path,
+                 uint32_t threads);
+
+  // Closes every connection accepted, handles stay valid until closed.
+  void Stop();
+
+  void GetStats(RawQuicListenerStats* stats);
+
+  int32_t SetHandshakeLimit(const RawQuicHandshakeLimit& limit);
+
+  // Worker threads, creates the handle of stream and reports it.
+  void Accept(RawQuicServerSession* session,
+              quic::QuicTransportStream* stream);
+
+  uint32_t worker_count() const;
+
+  // Signs Retry tokens, any worker validates those of the others.
+  const std::string& retry_secret() const;
+
+  // Worker a packet belongs to, any thread while listening.
+  RawQuicServerWorker* GetWorker(const char* data, size_t length);
+
+ private:
+  AcceptCallback accept_callback_ = nullptr;
+  RawQuicCallbacks callback_;
+  void* opaque_ = nullptr;
+
+  // Shared by workers, thread safe once created.
+  std::unique_ptr<quic::QuicCryptoServerConfig> crypto_config_;
+  std::string retry_secret_;
+  std::vector<std::unique_ptr<RawQuicServerWorker>> workers_;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_SERVER_H_
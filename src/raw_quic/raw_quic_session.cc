@@ -2,11 +2,22 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
-#include "net/base/net_errors.h"
 #include "net/quic/raw_quic/raw_quic_session.h"
 
+#include <algorithm>
+
+#include "net/base/net_errors.h"
+#include "net/quic/address_utils.h"
+#include "net/quic/raw_quic/raw_quic_context.h"
+
 namespace net {
 
+namespace {
+const int64_t kMinProbingTimeoutMs = 100;
+const int32_t kMaxProbingRetries = 4;
+const int64_t kPathProbeIntervalMs = 500;
+}  // namespace
+
 RawQuicSession::RawQuicSession(
     std::unique_ptr<quic::QuicConnection> connection,
     std::unique_ptr<net::DatagramClientSocket> socket,
@@ -15,7 +26,7 @@ RawQuicSession::RawQuicSession(
     const quic::QuicConfig& config,
     const quic::ParsedQuicVersionVector& supported_versions,
     const GURL& url,
-    std::unique_ptr<quic::QuicCryptoClientConfig> crypto_config,
+    quic::QuicCryptoClientConfig* crypto_config,
     url::Origin origin,
     QuicTransportClientSession::ClientVisitor* visitor)
     : QuicTransportClientSession(connection.get(),
@@ -23,19 +34,244 @@ RawQuicSession::RawQuicSession(
                                  config,
                                  supported_versions,
                                  url,
-                                 crypto_config.get(),
+                                 crypto_config,
                                  origin,
                                  visitor),
+      clock_(clock),
       socket_(std::move(socket)),
-      connection_(std::move(connection)),
-      crypto_config_ (std::move(crypto_config)) {
-  CreatePacketReader(socket_.get(), clock);
+      connection_(std::move(connection)) {
+  if (socket_ != nullptr) {
+    packet_reader_ = CreatePacketReader(socket_.get());
+  }
+}
+
+RawQuicSession::~RawQuicSession() {
+  if (probing_alarm_ != nullptr) {
+    probing_alarm_->Cancel();
+  }
+
+  if (path_probe_alarm_ != nullptr) {
+    path_probe_alarm_->Cancel();
+  }
+}
+
+RawQuicErrorCode RawQuicSession::StartMigration(
+    std::unique_ptr<net::DatagramClientSocket> socket,
+    MigrationDelegate* delegate) {
+  if (!IsSessionReady() || !connection()->connected() || socket_ == nullptr ||
+      probing_socket_ != nullptr || multipath_writer_ != nullptr) {
+    return RAW_QUIC_ERROR_CODE_INVALID_STATE;
+  }
+
+  IPEndPoint self_address;
+  if (socket->GetLocalAddress(&self_address) != net::OK) {
+    return RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+  }
+
+  probing_socket_ = std::move(socket);
+  probing_self_address_ = ToQuicSocketAddress(self_address);
+  probing_writer_ = std::make_unique<net::QuicChromiumPacketWriter>(
+      probing_socket_.get(),
+      RawQuicContext::GetInstance()->GetTaskRunner());
+  probing_reader_ = CreatePacketReader(probing_socket_.get());
+  probing_retries_ = 0;
+  probe_validated_ = false;
+  migration_delegate_ = delegate;
+
+  if (probing_alarm_ == nullptr) {
+    probing_alarm_.reset(
+        RawQuicContext::GetInstance()->GetQuicAlarmFactory()->CreateAlarm(
+            new AlarmDelegate(this, &RawQuicSession::OnProbingAlarm)));
+  }
+
+  SendProbe();
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
 }
 
-RawQuicSession::~RawQuicSession() {}
+RawQuicErrorCode RawQuicSession::EnableMultipath(
+    std::unique_ptr<net::DatagramClientSocket> socket,
+    RawQuicMultipathScheduler scheduler,
+    uint32_t primary_delay_ms,
+    uint32_t secondary_delay_ms) {
+  if (!IsSessionReady() || !connection()->connected() || socket_ == nullptr ||
+      probing_socket_ != nullptr || multipath_writer_ != nullptr) {
+    return RAW_QUIC_ERROR_CODE_INVALID_STATE;
+  }
+
+  IPEndPoint primary_address;
+  IPEndPoint secondary_address;
+  if (socket_->GetLocalAddress(&primary_address) != net::OK ||
+      socket->GetLocalAddress(&secondary_address) != net::OK) {
+    return RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+  }
+
+  base::SingleThreadTaskRunner* task_runner =
+      RawQuicContext::GetInstance()->GetTaskRunner();
+  auto writer = std::make_unique<RawQuicMultipathWriter>(scheduler);
+  writer->AddPath(std::make_unique<RawQuicPathWriter>(
+      socket_.get(), task_runner, primary_delay_ms));
+  writer->AddPath(std::make_unique<RawQuicPathWriter>(
+      socket.get(), task_runner, secondary_delay_ms));
+  path_addresses_.push_back(ToQuicSocketAddress(primary_address));
+  path_addresses_.push_back(ToQuicSocketAddress(secondary_address));
+
+  multipath_socket_ = std::move(socket);
+  multipath_reader_ = CreatePacketReader(multipath_socket_.get());
+  multipath_writer_ = writer.get();
+  // Old writer is deleted by connection.
+  connection()->SetQuicPacketWriter(writer.release(), true /* owns_writer */);
+
+  path_probe_alarm_.reset(
+      RawQuicContext::GetInstance()->GetQuicAlarmFactory()->CreateAlarm(
+          new AlarmDelegate(this, &RawQuicSession::ProbeNextPath)));
+  ProbeNextPath();
+  return RAW_QUIC_ERROR_CODE_SUCCESS;
+}
+
+void RawQuicSession::ProbeNextPath() {
+  if (!connection()->connected()) {
+    return;
+  }
+
+  probing_path_ = (probing_path_ + 1) % multipath_writer_->GetPathCount();
+  path_probe_sent_time_ = clock_->ApproximateNow();
+  connection()->SendConnectivityProbingPacket(
+      multipath_writer_->GetPathWriter(probing_path_),
+      connection()->peer_address());
+  path_probe_alarm_->Set(
+      path_probe_sent_time_ +
+      quic::QuicTime::Delta::FromMilliseconds(kPathProbeIntervalMs));
+}
+
+void RawQuicSession::set_transport_observer(TransportObserver* observer) {
+  transport_observer_ = observer;
+}
+
+void RawQuicSession::SetDebugVisitor(
+    std::unique_ptr<quic::QuicConnectionDebugVisitor> debug_visitor) {
+  connection_->set_debug_visitor(debug_visitor.get());
+  debug_visitor_ = std::move(debug_visitor);
+}
+
+quic::QuicTime RawQuicSession::last_packet_receipt_time() const {
+  return last_packet_receipt_time_;
+}
+
+bool RawQuicSession::OnFrameAcked(const quic::QuicFrame& frame,
+                                  quic::QuicTime::Delta ack_delay_time,
+                                  quic::QuicTime receive_timestamp) {
+  bool new_data_acked = QuicTransportClientSession::OnFrameAcked(
+      frame, ack_delay_time, receive_timestamp);
+  if (new_data_acked && frame.type == quic::STREAM_FRAME &&
+      transport_observer_ != nullptr) {
+    transport_observer_->OnStreamFrameAcked(frame.stream_frame,
+                                            clock_->ApproximateNow());
+  }
+  return new_data_acked;
+}
+
+void RawQuicSession::OnCongestionWindowChange(quic::QuicTime now) {
+  QuicTransportClientSession::OnCongestionWindowChange(now);
+  if (transport_observer_ != nullptr) {
+    transport_observer_->OnCongestionChange(now);
+  }
+}
+
+void RawQuicSession::OnPacketReceived(
+    const quic::QuicSocketAddress& self_address,
+    const quic::QuicSocketAddress& peer_address,
+    bool is_connectivity_probe) {
+  QuicTransportClientSession::OnPacketReceived(self_address, peer_address,
+                                               is_connectivity_probe);
+  if (is_connectivity_probe && multipath_writer_ != nullptr &&
+      path_probe_sent_time_.IsInitialized() &&
+      self_address == path_addresses_[probing_path_]) {
+    multipath_writer_->OnPathRttSample(
+        probing_path_, clock_->ApproximateNow() - path_probe_sent_time_);
+    path_probe_sent_time_ = quic::QuicTime::Zero();
+    return;
+  }
+
+  if (!is_connectivity_probe || probing_socket_ == nullptr ||
+      self_address != probing_self_address_) {
+    return;
+  }
+
+  // Called from inside ProcessUdpPacket, switch writer after it returns.
+  probe_validated_ = true;
+  probing_alarm_->Update(clock_->ApproximateNow(),
+                         quic::QuicTime::Delta::Zero());
+}
+
+void RawQuicSession::SendProbe() {
+  // Back off from twice the RTT, as in Chromium connection migration.
+  quic::QuicTime::Delta timeout = std::max(
+      connection()->sent_packet_manager().GetRttStats()->smoothed_rtt() * 2,
+      quic::QuicTime::Delta::FromMilliseconds(kMinProbingTimeoutMs));
+  timeout = timeout * (1 << probing_retries_);
+
+  connection()->SendConnectivityProbingPacket(probing_writer_.get(),
+                                              connection()->peer_address());
+  probing_alarm_->Set(clock_->ApproximateNow() + timeout);
+}
+
+void RawQuicSession::OnProbingAlarm() {
+  if (probing_socket_ == nullptr) {
+    return;
+  }
+
+  if (probe_validated_) {
+    RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+    FinishMigration(&ret);
+  } else if (++probing_retries_ > kMaxProbingRetries) {
+    RawQuicError ret = {RAW_QUIC_ERROR_CODE_TIMEOUT, 0, 0};
+    FinishMigration(&ret);
+  } else {
+    SendProbe();
+  }
+}
+
+void RawQuicSession::FinishMigration(RawQuicError* error) {
+  std::unique_ptr<net::QuicChromiumPacketReader> old_reader;
+  std::unique_ptr<net::DatagramClientSocket> old_socket;
+  if (error->error == RAW_QUIC_ERROR_CODE_SUCCESS) {
+    old_reader = std::move(packet_reader_);
+    old_socket = std::move(socket_);
+    packet_reader_ = std::move(probing_reader_);
+    socket_ = std::move(probing_socket_);
+    connection()->SetSelfAddress(probing_self_address_);
+    // Old writer is deleted by connection.
+    connection()->SetQuicPacketWriter(probing_writer_.release(),
+                                      true /* owns_writer */);
+    // Tell peer the new path at once rather than at the next write.
+    SendPing();
+    connection()->WriteIfNotBlocked();
+  } else {
+    old_reader = std::move(probing_reader_);
+    old_socket = std::move(probing_socket_);
+    probing_writer_.reset();
+  }
+
+  // Reader reads the socket, delete it first.
+  old_reader.reset();
+  old_socket->Close();
+  old_socket.reset();
+
+  probe_validated_ = false;
+  MigrationDelegate* delegate = migration_delegate_;
+  migration_delegate_ = nullptr;
+  if (delegate != nullptr) {
+    delegate->OnMigrationDone(error);
+  }
+}
 
 void RawQuicSession::OnReadError(int result,
                                  const DatagramClientSocket* socket) {
+  // Probing or extra path failing is not fatal.
+  if (socket != socket_.get()) {
+    return;
+  }
+
   quic::QuicConnection* connection = QuicSession::connection();
   if (connection != nullptr) {
     connection->CloseConnection(quic::QUIC_PACKET_READ_ERROR,
@@ -49,20 +285,22 @@ bool RawQuicSession::OnPacket(const quic::QuicReceivedPacket& packet,
                               const quic::QuicSocketAddress& peer_address) {
   quic::QuicConnection* connection = QuicSession::connection();
   if (connection != nullptr) {
+    last_packet_receipt_time_ = packet.receipt_time();
     connection->ProcessUdpPacket(local_address, peer_address, packet);
     return connection->connected();
   }
   return false;
 }
 
-void RawQuicSession::CreatePacketReader(net::DatagramClientSocket* socket,
-                                        quic::QuicClock* clock) {
-  packet_reader_.reset(new net::QuicChromiumPacketReader(
-      socket, clock, this, net::kQuicYieldAfterPacketsRead,
+std::unique_ptr<net::QuicChromiumPacketReader>
+RawQuicSession::CreatePacketReader(net::DatagramClientSocket* socket) {
+  auto packet_reader = std::make_unique<net::QuicChromiumPacketReader>(
+      socket, clock_, this, net::kQuicYieldAfterPacketsRead,
       quic::QuicTime::Delta::FromMilliseconds(
           net::kQuicYieldAfterDurationMilliseconds),
-      net::NetLogWithSource()));
-  packet_reader_->StartReading();
+      net::NetLogWithSource());
+  packet_reader->StartReading();
+  return packet_reader;
 }
 
 }  // namespace net
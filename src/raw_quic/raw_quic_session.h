@@ -5,9 +5,14 @@
 #ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_SESSION_H_
 #define NET_QUIC_RAW_QUIC_RAW_QUIC_SESSION_H_
 
+#include <vector>
 
 #include "net/quic/quic_chromium_packet_reader.h"
+#include "net/quic/quic_chromium_packet_writer.h"
+#include "net/quic/raw_quic/raw_quic_define.h"
+#include "net/quic/raw_quic/raw_quic_multipath_writer.h"
 #include "net/socket/datagram_client_socket.h"
+#include "net/third_party/quiche/src/quic/core/quic_alarm.h"
 #include "net/third_party/quiche/src/quic/core/crypto/quic_crypto_client_config.h"
 #include "net/third_party/quiche/src/quic/quic_transport/quic_transport_client_session.h"
 
@@ -16,6 +21,25 @@ namespace net {
 class RawQuicSession : public quic::QuicTransportClientSession,
                        public net::QuicChromiumPacketReader::Visitor {
  public:
+  class MigrationDelegate {
+   public:
+    virtual ~MigrationDelegate() {}
+    virtual void OnMigrationDone(RawQuicError* error) = 0;
+  };
+
+  class TransportObserver {
+   public:
+    virtual ~TransportObserver() {}
+    // Acks, losses or RTT samples changed the congestion controller.
+    virtual void OnCongestionChange(quic::QuicTime now) = 0;
+    // Stream data of frame was acked by peer.
+    virtual void OnStreamFrameAcked(const quic::QuicStreamFrame& frame,
+                                    quic::QuicTime now) = 0;
+  };
+
+  // socket may be null if the caller feeds packets through OnPacket itself,
+  // such as a simulated network. Migration and multipath need a socket.
+  // crypto_config is shared with other sessions and must outlive this one.
   RawQuicSession(std::unique_ptr<quic::QuicConnection> connection,
                  std::unique_ptr<net::DatagramClientSocket> socket,
                  quic::QuicClock* clock,
@@ -23,11 +47,46 @@ class RawQuicSession : public quic::QuicTransportClientSession,
                  const quic::QuicConfig& config,
                  const quic::ParsedQuicVersionVector& supported_versions,
                  const GURL& url,
-                 std::unique_ptr<quic::QuicCryptoClientConfig> crypto_config,
+                 quic::QuicCryptoClientConfig* crypto_config,
                  url::Origin origin,
                  QuicTransportClientSession::ClientVisitor* visitor);
   ~RawQuicSession() override;
 
+  // Probes the path over socket, moves the connection onto it once the
+  // peer answered. Result is reported to delegate unless failed at once.
+  RawQuicErrorCode StartMigration(
+      std::unique_ptr<net::DatagramClientSocket> socket,
+      MigrationDelegate* delegate);
+
+  // Experimental, adds a path over socket and schedules packets across
+  // both paths from now on. Exclusive with migration.
+  RawQuicErrorCode EnableMultipath(
+      std::unique_ptr<net::DatagramClientSocket> socket,
+      RawQuicMultipathScheduler scheduler,
+      uint32_t primary_delay_ms,
+      uint32_t secondary_delay_ms);
+
+  void set_transport_observer(TransportObserver* observer);
+
+  // Attaches debug_visitor, such as a qlog tracer, to the connection.
+  void SetDebugVisitor(
+      std::unique_ptr<quic::QuicConnectionDebugVisitor> debug_visitor);
+
+  // Receipt time of the packet processed last, data read from streams
+  // arrived no later than this.
+  quic::QuicTime last_packet_receipt_time() const;
+
+  // quic::QuicSession
+  void OnCongestionWindowChange(quic::QuicTime now) override;
+
+  bool OnFrameAcked(const quic::QuicFrame& frame,
+                    quic::QuicTime::Delta ack_delay_time,
+                    quic::QuicTime receive_timestamp) override;
+
+  void OnPacketReceived(const quic::QuicSocketAddress& self_address,
+                        const quic::QuicSocketAddress& peer_address,
+                        bool is_connectivity_probe) override;
+
     // net::QuicChromiumPacketReader::Visitor
   void OnReadError(int result, const DatagramClientSocket* socket) override;
 
@@ -36,14 +95,58 @@ class RawQuicSession : public quic::QuicTransportClientSession,
                 const quic::QuicSocketAddress& peer_address) override;
 
  protected:
-  void CreatePacketReader(net::DatagramClientSocket* socket,
-                          quic::QuicClock* clock);
+  std::unique_ptr<net::QuicChromiumPacketReader> CreatePacketReader(
+      net::DatagramClientSocket* socket);
+
+  void SendProbe();
+
+  void OnProbingAlarm();
+
+  void FinishMigration(RawQuicError* error);
+
+  // Probes one path at a time, peer answers the latest challenge only.
+  void ProbeNextPath();
 
  protected:
+  class AlarmDelegate : public quic::QuicAlarm::Delegate {
+   public:
+    typedef void (RawQuicSession::*Method)();
+    AlarmDelegate(RawQuicSession* session, Method method)
+        : session_(session), method_(method) {}
+    void OnAlarm() override { (session_->*method_)(); }
+
+   private:
+    RawQuicSession* session_ = nullptr;
+    Method method_ = nullptr;
+  };
+
+  quic::QuicClock* clock_ = nullptr;
+  TransportObserver* transport_observer_ = nullptr;
+  quic::QuicTime last_packet_receipt_time_ = quic::QuicTime::Zero();
+  // Declared before connection_ so it outlives the connection using it.
+  std::unique_ptr<quic::QuicConnectionDebugVisitor> debug_visitor_;
   std::unique_ptr<net::DatagramClientSocket> socket_;
   std::unique_ptr<quic::QuicConnection> connection_;
-  std::unique_ptr<quic::QuicCryptoClientConfig> crypto_config_;
   std::unique_ptr<net::QuicChromiumPacketReader> packet_reader_;
+
+  // Path being probed for migration, replaces the ones above on success.
+  std::unique_ptr<net::DatagramClientSocket> probing_socket_;
+  std::unique_ptr<net::QuicChromiumPacketWriter> probing_writer_;
+  std::unique_ptr<net::QuicChromiumPacketReader> probing_reader_;
+  std::unique_ptr<quic::QuicAlarm> probing_alarm_;
+  quic::QuicSocketAddress probing_self_address_;
+  int32_t probing_retries_ = 0;
+  bool probe_validated_ = false;
+  MigrationDelegate* migration_delegate_ = nullptr;
+
+  // Multipath, writer is owned by connection.
+  std::unique_ptr<net::DatagramClientSocket> multipath_socket_;
+  std::unique_ptr<net::QuicChromiumPacketReader> multipath_reader_;
+  RawQuicMultipathWriter* multipath_writer_ = nullptr;
+  std::unique_ptr<quic::QuicAlarm> path_probe_alarm_;
+  std::vector<quic::QuicSocketAddress> path_addresses_;
+  size_t probing_path_ = 0;
+  quic::QuicTime path_probe_sent_time_ = quic::QuicTime::Zero();
 };
 
 }  // namespace net
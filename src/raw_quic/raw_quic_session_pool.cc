@@ -0,0 +1,581 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_session_pool.h"
+
+#include <atomic>
+#include <tuple>
+#include <vector>
+
+#include "base/strings/stringprintf.h"
+#include "net/base/net_errors.h"
+#include "net/dns/host_resolver_proc.h"
+#include "net/quic/address_utils.h"
+#include "net/quic/quic_chromium_packet_writer.h"
+#include "net/quic/raw_quic/raw_quic.h"
+#include "net/quic/raw_quic/raw_quic_context.h"
+#include "net/quic/raw_quic/raw_quic_qlog.h"
+#include "net/quic/raw_quic/raw_quic_udp_socket.h"
+#include "net/socket/udp_client_socket.h"
+#include "net/third_party/quiche/src/quic/core/quic_utils.h"
+#include "net/third_party/quiche/src/quic/core/quic_versions.h"
+#include "url/gurl.h"
+
+namespace net {
+
+namespace {
+const int32_t kQuicSocketReceiveBufferSize = 1024 * 1024;  // 1MB
+const int32_t kMaxIdleNetworkTimeout = 30;
+const int32_t kDefaultIdleNetworkTimeout = 30;
+const int32_t kSetMaxTimeBeforeCryptoHandshake = 10;
+const int32_t kSetMaxIdleTimeBeforeCryptoHandshake = 5;
+const size_t kMaxParkedSessions = 8;
+
+std::atomic<uint8_t> g_connection_id_length(0);
+}  // namespace
+
+bool RawQuicSessionKey::operator<(const RawQuicSessionKey& other) const {
+  return std::tie(host, port, path, verify) <
+         std::tie(other.host, other.port, other.path, other.verify);
+}
+
+//////////////////////////////////RawQuicPooledSession//////////////////////////////////
+RawQuicPooledSession::RawQuicPooledSession(RawQuicSessionPool* pool,
+                                           const RawQuicSessionKey& key)
+    : pool_(pool), key_(key) {}
+
+RawQuicPooledSession::~RawQuicPooledSession() {
+  if (idle_alarm_ != nullptr) {
+    idle_alarm_->Cancel();
+  }
+}
+
+void RawQuicPooledSession::SetSession(std::unique_ptr<RawQuicSession> session) {
+  session_ = std::move(session);
+  session_->set_transport_observer(this);
+}
+
+RawQuicSession* RawQuicPooledSession::session() {
+  return session_.get();
+}
+
+const RawQuicSessionKey& RawQuicPooledSession::key() const {
+  return key_;
+}
+
+bool RawQuicPooledSession::CanAddUser() {
+  if (session_ == nullptr || !session_->connection()->connected()) {
+    return false;
+  }
+
+  // Streams of handles joining a handshaking session are opened when ready.
+  return !session_->IsSessionReady() ||
+         session_->CanOpenNextOutgoingBidirectionalStream();
+}
+
+bool RawQuicPooledSession::IsParked() const {
+  return users_.empty();
+}
+
+void RawQuicPooledSession::Connect() {
+  if (connecting_ || session_ == nullptr) {
+    return;
+  }
+
+  connecting_ = true;
+  session_->Initialize();
+  session_->CryptoConnect();
+}
+
+void RawQuicPooledSession::Close(const std::string& details) {
+  if (session_ == nullptr) {
+    return;
+  }
+
+  // Reports OnConnectionClosed, which removes this from pool.
+  quic::QuicConnection* connection = session_->connection();
+  if (connection != nullptr && connection->connected()) {
+    connection->CloseConnection(
+        quic::QUIC_NO_ERROR, details,
+        quic::ConnectionCloseBehavior::SEND_CONNECTION_CLOSE_PACKET);
+  }
+}
+
+void RawQuicPooledSession::AddUser(RawQuic* user) {
+  if (idle_alarm_ != nullptr) {
+    idle_alarm_->Cancel();
+  }
+  if (users_.empty()) {
+    pool_->Unpark(this);
+  }
+  users_.insert(user);
+}
+
+void RawQuicPooledSession::RemoveUser(RawQuic* user,
+                                      quic::QuicTransportStream* stream,
+                                      const std::string& details) {
+  users_.erase(user);
+  if (migrating_user_ == user) {
+    migrating_user_ = nullptr;
+  }
+  if (session_ == nullptr) {
+    return;
+  }
+
+  quic::QuicConnection* connection = session_->connection();
+  if (connection == nullptr || !connection->connected()) {
+    return;
+  }
+
+  uint32_t idle_timeout = pool_->GetIdleTimeout();
+  if (!users_.empty() || (idle_timeout > 0 && session_->IsSessionReady())) {
+    if (stream != nullptr && !session_->IsClosedStream(stream->id())) {
+      stream->Reset(quic::QUIC_STREAM_CANCELLED);
+    }
+  } else {
+    Close(details);
+    return;
+  }
+
+  if (users_.empty()) {
+    if (idle_alarm_ == nullptr) {
+      idle_alarm_.reset(
+          RawQuicContext::GetInstance()->GetQuicAlarmFactory()->CreateAlarm(
+              new IdleAlarmDelegate(this)));
+    }
+    idle_alarm_->Update(
+        RawQuicContext::GetInstance()->GetQuicClock()->ApproximateNow() +
+            quic::QuicTime::Delta::FromMilliseconds(idle_timeout),
+        quic::QuicTime::Delta::Zero());
+    pool_->Park(this);
+  }
+}
+
+RawQuicError RawQuicPooledSession::Migrate(
+    RawQuic* user,
+    const net::IPEndPoint* local_address) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  do {
+    if (session_ == nullptr || migrating_user_ != nullptr) {
+      ret.error = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    std::unique_ptr<DatagramClientSocket> socket;
+    ret = pool_->CreateSocket(
+        ToIPEndPoint(session_->connection()->peer_address()), local_address,
+        &socket);
+    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      break;
+    }
+
+    ret.error = session_->StartMigration(std::move(socket), this);
+    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      break;
+    }
+
+    migrating_user_ = user;
+  } while (0);
+
+  return ret;
+}
+
+RawQuicError RawQuicPooledSession::EnableMultipath(
+    const net::IPEndPoint& local_address,
+    RawQuicMultipathScheduler scheduler,
+    uint32_t primary_delay_ms,
+    uint32_t secondary_delay_ms) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  do {
+    if (session_ == nullptr || migrating_user_ != nullptr) {
+      ret.error = RAW_QUIC_ERROR_CODE_INVALID_STATE;
+      break;
+    }
+
+    std::unique_ptr<DatagramClientSocket> socket;
+    ret = pool_->CreateSocket(
+        ToIPEndPoint(session_->connection()->peer_address()), &local_address,
+        &socket);
+    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      break;
+    }
+
+    ret.error = session_->EnableMultipath(std::move(socket), scheduler,
+                                          primary_delay_ms,
+                                          secondary_delay_ms);
+  } while (0);
+
+  return ret;
+}
+
+void RawQuicPooledSession::OnMigrationDone(RawQuicError* error) {
+  RawQuic* user = migrating_user_;
+  migrating_user_ = nullptr;
+  if (user != nullptr) {
+    user->OnMigrated(error);
+  }
+}
+
+void RawQuicPooledSession::OnIdleTimeout() {
+  if (users_.empty()) {
+    Close("Pooled session idle.");
+  }
+}
+
+void RawQuicPooledSession::DetachUsers() {
+  std::set<RawQuic*> users;
+  users.swap(users_);
+  for (RawQuic* user : users) {
+    user->DetachSession();
+  }
+}
+
+void RawQuicPooledSession::OnSessionReady() {
+  // Users may leave in callbacks, iterate over a copy.
+  std::vector<RawQuic*> users(users_.begin(), users_.end());
+  for (RawQuic* user : users) {
+    if (users_.count(user) > 0) {
+      user->OnSessionReady();
+    }
+  }
+}
+
+void RawQuicPooledSession::OnIncomingBidirectionalStreamAvailable() {
+  // TBD
+}
+
+void RawQuicPooledSession::OnIncomingUnidirectionalStreamAvailable() {
+  // TBD
+}
+
+void RawQuicPooledSession::OnDatagramReceived(
+    quiche::QuicheStringPiece datagram) {}
+
+void RawQuicPooledSession::OnCanCreateNewOutgoingBidirectionalStream() {}
+
+void RawQuicPooledSession::OnCanCreateNewOutgoingUnidirectionalStream() {}
+
+void RawQuicPooledSession::OnConnectionClosed(
+    quic::QuicConnectionId server_connection_id,
+    quic::QuicErrorCode error,
+    const std::string& error_details,
+    quic::ConnectionCloseSource source) {
+  std::vector<RawQuic*> users(users_.begin(), users_.end());
+  for (RawQuic* user : users) {
+    if (users_.count(user) > 0) {
+      user->OnConnectionClosed(server_connection_id, error, error_details,
+                               source);
+    }
+  }
+
+  DetachUsers();
+  pool_->OnSessionClosed(this);
+}
+
+void RawQuicPooledSession::OnWriteBlocked(
+    quic::QuicBlockedWriterInterface* blocked_writer) {
+  for (RawQuic* user : users_) {
+    user->OnWriteBlocked(blocked_writer);
+  }
+}
+
+void RawQuicPooledSession::OnCongestionChange(quic::QuicTime now) {
+  std::vector<RawQuic*> users(users_.begin(), users_.end());
+  for (RawQuic* user : users) {
+    if (users_.count(user) > 0) {
+      user->OnCongestionChange(now);
+    }
+  }
+}
+
+void RawQuicPooledSession::OnStreamFrameAcked(
+    const quic::QuicStreamFrame& frame,
+    quic::QuicTime now) {
+  // Hot path, users only look at their own stream and never leave here.
+  for (RawQuic* user : users_) {
+    user->OnStreamFrameAcked(frame, now);
+  }
+}
+
+void RawQuicPooledSession::OnRstStreamReceived(
+    const quic::QuicRstStreamFrame& frame) {
+  std::vector<RawQuic*> users(users_.begin(), users_.end());
+  for (RawQuic* user : users) {
+    if (users_.count(user) > 0) {
+      user->OnRstStreamReceived(frame);
+    }
+  }
+}
+
+void RawQuicPooledSession::OnStopSendingReceived(
+    const quic::QuicStopSendingFrame& frame) {
+  // TBD
+}
+
+///////////////////////////////////RawQuicSessionPool///////////////////////////////////
+RawQuicSessionPool::RawQuicSessionPool() {}
+
+RawQuicSessionPool::~RawQuicSessionPool() {}
+
+void RawQuicSessionPool::SetIdleTimeout(uint32_t idle_ms) {
+  idle_timeout_ms_ = idle_ms;
+}
+
+uint32_t RawQuicSessionPool::GetIdleTimeout() {
+  return idle_timeout_ms_;
+}
+
+void RawQuicSessionPool::SetQlogDir(const std::string& dir) {
+  qlog_dir_ = dir;
+}
+
+RawQuicPooledSession* RawQuicSessionPool::Find(const RawQuicSessionKey& key) {
+  auto range = sessions_.equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    RawQuicPooledSession* session = it->second.get();
+    // Sessions in use are only shared with pooling on.
+    if ((session->IsParked() || idle_timeout_ms_ > 0) &&
+        session->CanAddUser()) {
+      return session;
+    }
+  }
+  return nullptr;
+}
+
+RawQuicError RawQuicSessionPool::Create(const RawQuicSessionKey& key,
+                                        RawQuicPooledSession** session) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  do {
+    net::AddressList address_list;
+    ret = Resolve(key.host, &address_list);
+    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      break;
+    }
+
+    if (address_list.empty()) {
+      ret.error = RAW_QUIC_ERROR_CODE_RESOLVE_FAILED;
+      break;
+    }
+
+    net::IPEndPoint endpoint = *address_list.begin();
+    net::IPAddress addr = endpoint.address();
+    net::IPEndPoint dest(addr, key.port);
+
+    std::unique_ptr<DatagramClientSocket> socket;
+    ret = CreateSocket(dest, nullptr, &socket);
+    if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      break;
+    }
+
+    auto connection = CreateConnection(socket.get(), dest);
+
+    RawQuicContext* context = RawQuicContext::GetInstance();
+    GURL url(base::StringPrintf("quic-transport://%s:%d/%s", key.host.c_str(),
+                                (int)key.port, key.path.c_str()));
+    url::Origin origin =
+        url::Origin::Create(GURL(std::string("https://") + key.host));
+
+    auto it = sessions_.emplace(
+        key, std::make_unique<RawQuicPooledSession>(this, key));
+    RawQuicPooledSession* pooled_session = it->second.get();
+    pooled_session->SetSession(std::make_unique<RawQuicSession>(
+        std::move(connection), std::move(socket), context->GetQuicClock(),
+        pooled_session, DefaultQuicConfig(), GetVersions(), url,
+        GetCryptoConfig(key.verify), origin, pooled_session));
+
+    if (!qlog_dir_.empty()) {
+      quic::QuicConnection* quic_connection =
+          pooled_session->session()->connection();
+      base::FilePath path =
+          base::FilePath::FromUTF8Unsafe(qlog_dir_).AppendASCII(
+              quic_connection->connection_id().ToString() + ".qlog");
+      pooled_session->session()->SetDebugVisitor(
+          std::make_unique<RawQuicQlogTracer>(
+              context->GetQlogWriter(), path, quic_connection,
+              context->GetQuicClock(), context->GetQuicAlarmFactory()));
+    }
+    *session = pooled_session;
+  } while (0);
+
+  return ret;
+}
+
+void RawQuicSessionPool::Preconnect(const RawQuicSessionKey& key) {
+  if (Find(key) != nullptr) {
+    return;
+  }
+
+  RawQuicPooledSession* session = nullptr;
+  RawQuicError ret = Create(key, &session);
+  if (ret.error != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    LOG(ERROR) << "Preconnect " << key.host << " failed, error:" << ret.error;
+    return;
+  }
+
+  Park(session);
+  session->Connect();
+}
+
+void RawQuicSessionPool::Park(RawQuicPooledSession* session) {
+  parked_sessions_.remove(session);
+  parked_sessions_.push_front(session);
+
+  while (parked_sessions_.size() > kMaxParkedSessions) {
+    RawQuicPooledSession* evicted = parked_sessions_.back();
+    parked_sessions_.pop_back();
+    evicted->Close("Parked session evicted.");
+  }
+}
+
+void RawQuicSessionPool::Unpark(RawQuicPooledSession* session) {
+  parked_sessions_.remove(session);
+}
+
+void RawQuicSessionPool::OnSessionClosed(RawQuicPooledSession* session) {
+  Unpark(session);
+  auto range = sessions_.equal_range(session->key());
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second.get() == session) {
+      // Called back from inside the session, delete it later.
+      RawQuicContext::GetInstance()->GetTaskRunner()->DeleteSoon(
+          FROM_HERE, it->second.release());
+      sessions_.erase(it);
+      break;
+    }
+  }
+}
+
+RawQuicError RawQuicSessionPool::CreateSocket(
+    const net::IPEndPoint& dest,
+    const net::IPEndPoint* local_address,
+    std::unique_ptr<DatagramClientSocket>* socket) {
+  net::NetLogWithSource* net_log =
+      RawQuicContext::GetInstance()->GetNetLogWithSource();
+  if (local_address != nullptr) {
+    socket->reset(new RawQuicUDPSocket(*local_address, net_log->net_log(),
+                                       net_log->source()));
+  } else {
+    socket->reset(new net::UDPClientSocket(net::DatagramSocket::DEFAULT_BIND,
+                                           net_log->net_log(),
+                                           net_log->source()));
+  }
+  return ConfigureSocket(socket->get(), dest);
+}
+
+RawQuicError RawQuicSessionPool::Resolve(const std::string& host,
+                                         net::AddressList* addrlist) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  int32_t os_error = 0;
+  ret.net_error = net::SystemHostResolverCall(
+      host, net::ADDRESS_FAMILY_UNSPECIFIED, 0, addrlist, &os_error);
+  if (ret.net_error != net::OK || os_error != 0) {
+    ret.error = RAW_QUIC_ERROR_CODE_RESOLVE_FAILED;
+    LOG(ERROR) << "Resolve " << host << " failed, error:" << os_error;
+  }
+  return ret;
+}
+
+RawQuicError RawQuicSessionPool::ConfigureSocket(
+    DatagramClientSocket* socket,
+    const net::IPEndPoint& dest) {
+  RawQuicError ret = {RAW_QUIC_ERROR_CODE_SUCCESS, 0, 0};
+  do {
+    if (socket == nullptr) {
+      ret.error = RAW_QUIC_ERROR_CODE_INVALID_PARAM;
+      break;
+    }
+
+    socket->UseNonBlockingIO();
+
+    ret.net_error = socket->Connect(dest);
+    if (ret.net_error != net::OK) {
+      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+      break;
+    }
+
+    ret.net_error = socket->SetReceiveBufferSize(kQuicSocketReceiveBufferSize);
+    if (ret.net_error != net::OK) {
+      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+      break;
+    }
+
+    ret.net_error = socket->SetDoNotFragment();
+    // SetDoNotFragment is not implemented on all platforms, so ignore errors.
+    if (ret.net_error != net::OK && ret.net_error != net::ERR_NOT_IMPLEMENTED) {
+      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+      break;
+    }
+
+    // Set a buffer large enough to contain the initial CWND's worth of packet
+    // to work around the problem with CHLO packets being sent out with the
+    // wrong encryption level, when the send buffer is full.
+    ret.net_error =
+        socket->SetSendBufferSize(quic::kMaxOutgoingPacketSize * 20);
+    if (ret.net_error != net::OK) {
+      ret.error = RAW_QUIC_ERROR_CODE_SOCKET_ERROR;
+      break;
+    }
+  } while (0);
+
+  return ret;
+}
+
+std::unique_ptr<quic::QuicConnection> RawQuicSessionPool::CreateConnection(
+    DatagramClientSocket* socket,
+    const net::IPEndPoint& dest) {
+  RawQuicContext* context = RawQuicContext::GetInstance();
+  uint8_t length = g_connection_id_length.load(std::memory_order_relaxed);
+  quic::QuicConnectionId connection_id =
+      length == 0
+          ? quic::QuicUtils::CreateRandomConnectionId(context->GetQuicRandom())
+          : quic::QuicUtils::CreateRandomConnectionId(
+                length, context->GetQuicRandom());
+
+  net::QuicChromiumPacketWriter* writer =
+      new net::QuicChromiumPacketWriter(socket, context->GetTaskRunner());
+
+  auto connection = std::make_unique<quic::QuicConnection>(
+      connection_id, net::ToQuicSocketAddress(dest),
+      context->GetQuicConnectionHelper(), context->GetQuicAlarmFactory(),
+      writer, true /* owns_writer */, quic::Perspective::IS_CLIENT,
+      GetVersions());
+
+  return connection;
+}
+
+quic::ParsedQuicVersionVector RawQuicSessionPool::GetVersions() {
+  quic::ParsedQuicVersionVector versions;
+  versions.emplace_back(quic::PROTOCOL_TLS1_3, quic::QUIC_VERSION_99);
+  return versions;
+}
+
+quic::QuicConfig RawQuicSessionPool::DefaultQuicConfig() {
+  quic::QuicConfig config;
+  config.SetIdleNetworkTimeout(
+      quic::QuicTime::Delta::FromSeconds(kMaxIdleNetworkTimeout),
+      quic::QuicTime::Delta::FromSeconds(kDefaultIdleNetworkTimeout));
+  config.set_max_time_before_crypto_handshake(
+      quic::QuicTime::Delta::FromSeconds(kSetMaxTimeBeforeCryptoHandshake));
+  config.set_max_idle_time_before_crypto_handshake(
+      quic::QuicTime::Delta::FromSeconds(kSetMaxIdleTimeBeforeCryptoHandshake));
+  return config;
+}
+
+// static
+void RawQuicSessionPool::SetConnectionIdLengthForTesting(uint8_t length) {
+  g_connection_id_length.store(length, std::memory_order_relaxed);
+}
+
+quic::QuicCryptoClientConfig* RawQuicSessionPool::GetCryptoConfig(
+    bool verify) {
+  std::unique_ptr<quic::QuicCryptoClientConfig>& crypto_config =
+      crypto_configs_[verify ? 1 : 0];
+  if (crypto_config == nullptr) {
+    crypto_config = std::make_unique<quic::QuicCryptoClientConfig>(
+        RawQuicContext::GetInstance()->CreateProofVerifier(verify));
+  }
+  return crypto_config.get();
+}
+
+}  // namespace net
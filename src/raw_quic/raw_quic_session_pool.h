@@ -0,0 +1,222 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_SESSION_POOL_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_SESSION_POOL_H_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+
+#include "net/base/address_list.h"
+#include "net/quic/raw_quic/raw_quic_define.h"
+#include "net/quic/raw_quic/raw_quic_session.h"
+#include "net/third_party/quiche/src/quic/core/quic_alarm.h"
+#include "net/third_party/quiche/src/quic/quic_transport/quic_transport_stream.h"
+
+namespace net {
+
+class RawQuic;
+class RawQuicSessionPool;
+
+struct RawQuicSessionKey {
+  std::string host;
+  uint16_t port = 0;
+  std::string path;
+  bool verify = true;
+
+  bool operator<(const RawQuicSessionKey& other) const;
+};
+
+//////////////////////////////////RawQuicPooledSession//////////////////////////////////
+// QuicTransport connection shared by RawQuic handles of the same origin and
+// path, each handle owns one bidirectional stream on it. Session events are
+// forwarded to all handles attached.
+class RawQuicPooledSession
+    : public quic::QuicTransportClientSession::ClientVisitor,
+      public quic::QuicSession::Visitor,
+      public RawQuicSession::MigrationDelegate,
+      public RawQuicSession::TransportObserver {
+ public:
+  RawQuicPooledSession(RawQuicSessionPool* pool, const RawQuicSessionKey& key);
+  ~RawQuicPooledSession() override;
+
+ public:
+  void SetSession(std::unique_ptr<RawQuicSession> session);
+
+  RawQuicSession* session();
+
+  const RawQuicSessionKey& key() const;
+
+  bool CanAddUser();
+
+  // Parked session has no handle, kept by pool idle timeout or preconnect.
+  bool IsParked() const;
+
+  // Starts handshake, once.
+  void Connect();
+
+  void Close(const std::string& details);
+
+  void AddUser(RawQuic* user);
+
+  // Stream of user is reset if the connection is kept, otherwise the
+  // connection is closed with details.
+  void RemoveUser(RawQuic* user,
+                  quic::QuicTransportStream* stream,
+                  const std::string& details);
+
+  // Moves the connection, with streams of all users, to a new socket bound
+  // to local_address if given. Result goes to user unless failed at once.
+  RawQuicError Migrate(RawQuic* user, const net::IPEndPoint* local_address);
+
+  // Experimental, adds a path over a socket bound to local_address.
+  RawQuicError EnableMultipath(const net::IPEndPoint& local_address,
+                               RawQuicMultipathScheduler scheduler,
+                               uint32_t primary_delay_ms,
+                               uint32_t secondary_delay_ms);
+
+ protected:
+  void OnIdleTimeout();
+
+  void DetachUsers();
+
+  // quic::QuicTransportClientSession::ClientVisitor
+  void OnSessionReady() override;
+
+  void OnIncomingBidirectionalStreamAvailable() override;
+
+  void OnIncomingUnidirectionalStreamAvailable() override;
+
+  void OnDatagramReceived(quiche::QuicheStringPiece datagram) override;
+
+  void OnCanCreateNewOutgoingBidirectionalStream() override;
+
+  void OnCanCreateNewOutgoingUnidirectionalStream() override;
+
+  // quic::QuicSession::Visitor
+  void OnConnectionClosed(quic::QuicConnectionId server_connection_id,
+                          quic::QuicErrorCode error,
+                          const std::string& error_details,
+                          quic::ConnectionCloseSource source) override;
+
+  void OnWriteBlocked(
+      quic::QuicBlockedWriterInterface* blocked_writer) override;
+
+  void OnRstStreamReceived(const quic::QuicRstStreamFrame& frame) override;
+
+  void OnStopSendingReceived(const quic::QuicStopSendingFrame& frame) override;
+
+  // RawQuicSession::MigrationDelegate
+  void OnMigrationDone(RawQuicError* error) override;
+
+  // RawQuicSession::TransportObserver
+  void OnCongestionChange(quic::QuicTime now) override;
+
+  void OnStreamFrameAcked(const quic::QuicStreamFrame& frame,
+                          quic::QuicTime now) override;
+
+ private:
+  class IdleAlarmDelegate : public quic::QuicAlarm::Delegate {
+   public:
+    explicit IdleAlarmDelegate(RawQuicPooledSession* session)
+        : session_(session) {}
+    void OnAlarm() override { session_->OnIdleTimeout(); }
+
+   private:
+    RawQuicPooledSession* session_ = nullptr;
+  };
+
+  RawQuicSessionPool* pool_ = nullptr;
+  RawQuicSessionKey key_;
+  std::unique_ptr<RawQuicSession> session_;
+  bool connecting_ = false;
+  std::set<RawQuic*> users_;
+  RawQuic* migrating_user_ = nullptr;
+  std::unique_ptr<quic::QuicAlarm> idle_alarm_;
+};
+
+///////////////////////////////////RawQuicSessionPool///////////////////////////////////
+// Sessions of the context, IO thread only. With idle timeout 0 a session
+// is closed as soon as its last handle leaves, as without pooling.
+class RawQuicSessionPool {
+ public:
+  RawQuicSessionPool();
+  virtual ~RawQuicSessionPool();
+
+ public:
+  void SetIdleTimeout(uint32_t idle_ms);
+
+  uint32_t GetIdleTimeout();
+
+  // Sessions created from now on write a qlog trace into dir, empty dir
+  // turns tracing off.
+  void SetQlogDir(const std::string& dir);
+
+  // Parked session, or with pooling on any connected session, with room
+  // for a new stream, or nullptr.
+  RawQuicPooledSession* Find(const RawQuicSessionKey& key);
+
+  // Resolves host and creates a session, handshake is not started.
+  RawQuicError Create(const RawQuicSessionKey& key,
+                      RawQuicPooledSession** session);
+
+  // Handshakes a parked session unless one can be adopted already.
+  void Preconnect(const RawQuicSessionKey& key);
+
+  // Least recently parked session is closed beyond kMaxParkedSessions.
+  void Park(RawQuicPooledSession* session);
+
+  void Unpark(RawQuicPooledSession* session);
+
+  void OnSessionClosed(RawQuicPooledSession* session);
+
+  // Connected UDP socket, bound to local_address if not null.
+  RawQuicError CreateSocket(const net::IPEndPoint& dest,
+                            const net::IPEndPoint* local_address,
+                            std::unique_ptr<DatagramClientSocket>* socket);
+
+  // Versions and config of every session, also used by the simulator
+  // benchmark to talk the same way.
+  static quic::ParsedQuicVersionVector GetVersions();
+
+  static quic::QuicConfig DefaultQuicConfig();
+
+  // Connections created after this pick ids of length, 0 restores the
+  // default. Lets tests check servers replacing them, any thread.
+  static void SetConnectionIdLengthForTesting(uint8_t length);
+
+  // Shared by every session of the context with the same verify flag, so
+  // server configs and verified chains carry over to the next connection.
+  quic::QuicCryptoClientConfig* GetCryptoConfig(bool verify);
+
+ protected:
+  RawQuicError Resolve(const std::string& host, net::AddressList* addrlist);
+
+  RawQuicError ConfigureSocket(DatagramClientSocket* socket,
+                               const net::IPEndPoint& dest);
+
+  std::unique_ptr<quic::QuicConnection> CreateConnection(
+      DatagramClientSocket* socket,
+      const net::IPEndPoint& dest);
+
+ protected:
+  typedef std::multimap<RawQuicSessionKey,
+                        std::unique_ptr<RawQuicPooledSession>>
+      SessionMap;
+
+  // Declared before sessions_ so it outlives the sessions using it.
+  std::unique_ptr<quic::QuicCryptoClientConfig> crypto_configs_[2];
+  SessionMap sessions_;
+  // Most recently parked first.
+  std::list<RawQuicPooledSession*> parked_sessions_;
+  uint32_t idle_timeout_ms_ = 0;
+  std::string qlog_dir_;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_SESSION_POOL_H_
@@ -0,0 +1,297 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net/quic/raw_quic/raw_quic_udp_socket.h"
+
+#include "build/build_config.h"
+#include "net/base/address_family.h"
+#include "net/base/net_errors.h"
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+#include <errno.h>
+#include <linux/filter.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+#endif
+
+namespace net {
+
+RawQuicUDPSocket::RawQuicUDPSocket(const IPEndPoint& local_address,
+                                   net::NetLog* net_log,
+                                   const net::NetLogSource& source)
+    : local_address_(local_address),
+      socket_(DatagramSocket::DEFAULT_BIND, net_log, source) {}
+
+RawQuicUDPSocket::~RawQuicUDPSocket() {}
+
+int RawQuicUDPSocket::Connect(const IPEndPoint& address) {
+  if (local_address_.GetFamily() != address.GetFamily()) {
+    return ERR_ADDRESS_INVALID;
+  }
+
+  int rv = socket_.Open(address.GetFamily());
+  if (rv != OK) {
+    return rv;
+  }
+
+  rv = socket_.Bind(local_address_);
+  if (rv != OK) {
+    return rv;
+  }
+
+  return socket_.Connect(address);
+}
+
+int RawQuicUDPSocket::ConnectUsingNetwork(
+    NetworkChangeNotifier::NetworkHandle network,
+    const IPEndPoint& address) {
+  return ERR_NOT_IMPLEMENTED;
+}
+
+int RawQuicUDPSocket::ConnectUsingDefaultNetwork(const IPEndPoint& address) {
+  return ERR_NOT_IMPLEMENTED;
+}
+
+NetworkChangeNotifier::NetworkHandle RawQuicUDPSocket::GetBoundNetwork()
+    const {
+  return NetworkChangeNotifier::kInvalidNetworkHandle;
+}
+
+void RawQuicUDPSocket::ApplySocketTag(const SocketTag& tag) {
+  socket_.ApplySocketTag(tag);
+}
+
+int RawQuicUDPSocket::Read(IOBuffer* buf,
+                           int buf_len,
+                           CompletionOnceCallback callback) {
+  return socket_.Read(buf, buf_len, std::move(callback));
+}
+
+int RawQuicUDPSocket::Write(
+    IOBuffer* buf,
+    int buf_len,
+    CompletionOnceCallback callback,
+    const NetworkTrafficAnnotationTag& traffic_annotation) {
+  return socket_.Write(buf, buf_len, std::move(callback), traffic_annotation);
+}
+
+int RawQuicUDPSocket::WriteAsync(
+    DatagramBuffers buffers,
+    CompletionOnceCallback callback,
+    const NetworkTrafficAnnotationTag& traffic_annotation) {
+  return socket_.WriteAsync(std::move(buffers), std::move(callback),
+                            traffic_annotation);
+}
+
+int RawQuicUDPSocket::WriteAsync(
+    const char* buffer,
+    size_t buf_len,
+    CompletionOnceCallback callback,
+    const NetworkTrafficAnnotationTag& traffic_annotation) {
+  return socket_.WriteAsync(buffer, buf_len, std::move(callback),
+                            traffic_annotation);
+}
+
+DatagramBuffers RawQuicUDPSocket::GetUnwrittenBuffers() {
+  return socket_.GetUnwrittenBuffers();
+}
+
+void RawQuicUDPSocket::Close() {
+  socket_.Close();
+}
+
+int RawQuicUDPSocket::GetPeerAddress(IPEndPoint* address) const {
+  return socket_.GetPeerAddress(address);
+}
+
+int RawQuicUDPSocket::GetLocalAddress(IPEndPoint* address) const {
+  return socket_.GetLocalAddress(address);
+}
+
+void RawQuicUDPSocket::UseNonBlockingIO() {
+#if defined(OS_WIN)
+  socket_.UseNonBlockingIO();
+#endif
+}
+
+int RawQuicUDPSocket::SetReceiveBufferSize(int32_t size) {
+  return socket_.SetReceiveBufferSize(size);
+}
+
+int RawQuicUDPSocket::SetSendBufferSize(int32_t size) {
+  return socket_.SetSendBufferSize(size);
+}
+
+int RawQuicUDPSocket::SetDoNotFragment() {
+  return socket_.SetDoNotFragment();
+}
+
+void RawQuicUDPSocket::SetMsgConfirm(bool confirm) {
+  socket_.SetMsgConfirm(confirm);
+}
+
+const NetLogWithSource& RawQuicUDPSocket::NetLog() const {
+  return socket_.NetLog();
+}
+
+void RawQuicUDPSocket::EnableRecvOptimization() {
+#if defined(OS_POSIX)
+  socket_.enable_experimental_recv_optimization();
+#endif
+}
+
+void RawQuicUDPSocket::SetWriteAsyncEnabled(bool enabled) {
+  socket_.SetWriteAsyncEnabled(enabled);
+}
+
+bool RawQuicUDPSocket::WriteAsyncEnabled() {
+  return socket_.WriteAsyncEnabled();
+}
+
+void RawQuicUDPSocket::SetMaxPacketSize(size_t max_packet_size) {
+  socket_.SetMaxPacketSize(max_packet_size);
+}
+
+void RawQuicUDPSocket::SetWriteMultiCoreEnabled(bool enabled) {
+  socket_.SetWriteMultiCoreEnabled(enabled);
+}
+
+void RawQuicUDPSocket::SetSendmmsgEnabled(bool enabled) {
+  socket_.SetSendmmsgEnabled(enabled);
+}
+
+void RawQuicUDPSocket::SetWriteBatchingActive(bool active) {
+  socket_.SetWriteBatchingActive(active);
+}
+
+int RawQuicUDPSocket::SetMulticastInterface(uint32_t interface_index) {
+  return socket_.SetMulticastInterface(interface_index);
+}
+
+RawQuicUDPServerSocket::RawQuicUDPServerSocket(net::NetLog* net_log,
+                                               const net::NetLogSource& source)
+    : socket_(DatagramSocket::DEFAULT_BIND, net_log, source) {}
+
+RawQuicUDPServerSocket::~RawQuicUDPServerSocket() {}
+
+int RawQuicUDPServerSocket::Listen(const IPEndPoint& address,
+                                   bool share_port) {
+  if (!share_port) {
+    int rv = socket_.Open(address.GetFamily());
+    if (rv != OK) {
+      return rv;
+    }
+    return socket_.Bind(address);
+  }
+
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+  // SO_REUSEPORT must be set before bind, UDPSocket opens and binds at once.
+  SocketDescriptor socket = CreatePlatformSocket(
+      ConvertAddressFamily(address.GetFamily()), SOCK_DGRAM, IPPROTO_UDP);
+  if (socket == kInvalidSocket) {
+    return MapSystemError(errno);
+  }
+
+  int value = 1;
+  if (setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(value)) !=
+      0) {
+    int rv = MapSystemError(errno);
+    close(socket);
+    return rv;
+  }
+
+  int rv = socket_.AdoptOpenedSocket(address.GetFamily(), socket);
+  if (rv != OK) {
+    return rv;
+  }
+  socket_descriptor_ = socket;
+  return socket_.Bind(address);
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+int RawQuicUDPServerSocket::SetSteering(uint32_t socket_count) {
+#if defined(OS_LINUX) || defined(OS_ANDROID)
+  if (socket_descriptor_ == kInvalidSocket || socket_count == 0) {
+    return ERR_INVALID_ARGUMENT;
+  }
+
+  // Same as SteeringIndex, loads beyond the packet return socket 0.
+  struct sock_filter code[] = {
+      // A = first byte, long header if 0x80 is set.
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+      BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x80, 0, 2),
+      // Long header, destination connection id follows version and length.
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 6),
+      BPF_JUMP(BPF_JMP | BPF_JA, 1, 0, 0),
+      // Short header, destination connection id follows first byte.
+      BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 1),
+      BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, socket_count),
+      BPF_STMT(BPF_RET | BPF_A, 0),
+  };
+  struct sock_fprog program = {
+      (unsigned short)(sizeof(code) / sizeof(code[0])), code};
+  if (setsockopt(socket_descriptor_, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                 &program, sizeof(program)) != 0) {
+    return MapSystemError(errno);
+  }
+  return OK;
+#else
+  return ERR_NOT_IMPLEMENTED;
+#endif
+}
+
+// static
+uint32_t RawQuicUDPServerSocket::SteeringIndex(const char* data,
+                                               size_t length,
+                                               uint32_t socket_count) {
+  if (socket_count <= 1 || length == 0) {
+    return 0;
+  }
+
+  size_t offset = (data[0] & 0x80) != 0 ? 6 : 1;
+  if (length <= offset) {
+    return 0;
+  }
+  return (uint8_t)data[offset] % socket_count;
+}
+
+int RawQuicUDPServerSocket::RecvFrom(IOBuffer* buf,
+                                     int buf_len,
+                                     IPEndPoint* address,
+                                     CompletionOnceCallback callback) {
+  return socket_.RecvFrom(buf, buf_len, address, std::move(callback));
+}
+
+int RawQuicUDPServerSocket::SendTo(IOBuffer* buf,
+                                   int buf_len,
+                                   const IPEndPoint& address,
+                                   CompletionOnceCallback callback) {
+  return socket_.SendTo(buf, buf_len, address, std::move(callback));
+}
+
+int RawQuicUDPServerSocket::SetReceiveBufferSize(int32_t size) {
+  return socket_.SetReceiveBufferSize(size);
+}
+
+int RawQuicUDPServerSocket::SetSendBufferSize(int32_t size) {
+  return socket_.SetSendBufferSize(size);
+}
+
+int RawQuicUDPServerSocket::GetLocalAddress(IPEndPoint* address) const {
+  return socket_.GetLocalAddress(address);
+}
+
+void RawQuicUDPServerSocket::Close() {
+  socket_.Close();
+  socket_descriptor_ = kInvalidSocket;
+}
+
+}  // namespace net
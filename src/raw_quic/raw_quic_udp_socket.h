@@ -0,0 +1,115 @@
+// Copyright 2013 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef NET_QUIC_RAW_QUIC_RAW_QUIC_UDP_SOCKET_H_
+#define NET_QUIC_RAW_QUIC_RAW_QUIC_UDP_SOCKET_H_
+
+#include "net/base/completion_once_callback.h"
+#include "net/base/io_buffer.h"
+#include "net/base/ip_endpoint.h"
+#include "net/socket/datagram_client_socket.h"
+#include "net/socket/socket_descriptor.h"
+#include "net/socket/udp_socket.h"
+
+namespace net {
+
+// Same as UDPClientSocket, but binds to a local address before connect, so
+// a connection can be moved to a given interface.
+class RawQuicUDPSocket : public DatagramClientSocket {
+ public:
+  RawQuicUDPSocket(const IPEndPoint& local_address,
+                   net::NetLog* net_log,
+                   const net::NetLogSource& source);
+  ~RawQuicUDPSocket() override;
+
+  // DatagramClientSocket
+  int Connect(const IPEndPoint& address) override;
+  int ConnectUsingNetwork(NetworkChangeNotifier::NetworkHandle network,
+                          const IPEndPoint& address) override;
+  int ConnectUsingDefaultNetwork(const IPEndPoint& address) override;
+  NetworkChangeNotifier::NetworkHandle GetBoundNetwork() const override;
+  void ApplySocketTag(const SocketTag& tag) override;
+  int Read(IOBuffer* buf,
+           int buf_len,
+           CompletionOnceCallback callback) override;
+  int Write(IOBuffer* buf,
+            int buf_len,
+            CompletionOnceCallback callback,
+            const NetworkTrafficAnnotationTag& traffic_annotation) override;
+  int WriteAsync(DatagramBuffers buffers,
+                 CompletionOnceCallback callback,
+                 const NetworkTrafficAnnotationTag& traffic_annotation) override;
+  int WriteAsync(const char* buffer,
+                 size_t buf_len,
+                 CompletionOnceCallback callback,
+                 const NetworkTrafficAnnotationTag& traffic_annotation) override;
+  DatagramBuffers GetUnwrittenBuffers() override;
+  void Close() override;
+  int GetPeerAddress(IPEndPoint* address) const override;
+  int GetLocalAddress(IPEndPoint* address) const override;
+  void UseNonBlockingIO() override;
+  int SetReceiveBufferSize(int32_t size) override;
+  int SetSendBufferSize(int32_t size) override;
+  int SetDoNotFragment() override;
+  void SetMsgConfirm(bool confirm) override;
+  const NetLogWithSource& NetLog() const override;
+  void EnableRecvOptimization() override;
+  void SetWriteAsyncEnabled(bool enabled) override;
+  bool WriteAsyncEnabled() override;
+  void SetMaxPacketSize(size_t max_packet_size) override;
+  void SetWriteMultiCoreEnabled(bool enabled) override;
+  void SetSendmmsgEnabled(bool enabled) override;
+  void SetWriteBatchingActive(bool active) override;
+  int SetMulticastInterface(uint32_t interface_index) override;
+
+ private:
+  IPEndPoint local_address_;
+  UDPSocket socket_;
+};
+
+// Same as UDPServerSocket, but sockets of several listener workers can
+// share a port. Kernel balances the group by 4-tuple unless a steering
+// program is attached.
+class RawQuicUDPServerSocket {
+ public:
+  RawQuicUDPServerSocket(net::NetLog* net_log, const net::NetLogSource& source);
+  ~RawQuicUDPServerSocket();
+
+  // share_port sets SO_REUSEPORT before bind, Linux and Android only.
+  int Listen(const IPEndPoint& address, bool share_port);
+
+  // Steers packets of the port group by SteeringIndex with a classic BPF
+  // program, sockets are indexed in the order they were bound. Linux 4.5+.
+  int SetSteering(uint32_t socket_count);
+
+  // Index in a group of socket_count for a QUIC packet, taken from the
+  // first byte of its destination connection id. It stays the same for
+  // every packet of a connection, even after the client address changes,
+  // as long as ids the server picks keep the first byte of the client's.
+  static uint32_t SteeringIndex(const char* data,
+                                size_t length,
+                                uint32_t socket_count);
+
+  int RecvFrom(IOBuffer* buf,
+               int buf_len,
+               IPEndPoint* address,
+               CompletionOnceCallback callback);
+  int SendTo(IOBuffer* buf,
+             int buf_len,
+             const IPEndPoint& address,
+             CompletionOnceCallback callback);
+  int SetReceiveBufferSize(int32_t size);
+  int SetSendBufferSize(int32_t size);
+  int GetLocalAddress(IPEndPoint* address) const;
+  void Close();
+
+ private:
+  UDPSocket socket_;
+  // Owned by socket_, kept for options UDPSocket has no setter of.
+  SocketDescriptor socket_descriptor_ = kInvalidSocket;
+};
+
+}  // namespace net
+
+#endif  // NET_QUIC_RAW_QUIC_RAW_QUIC_UDP_SOCKET_H_
@@ -0,0 +1,292 @@
+// Throughput benchmark of librawquic against a local server.
+//
+//   rawquic_bench [--workloads=upload,download,echo] [--sizes=64,1K,16K,256K,1M]
+//                 [--send-buffers=512K,4M] [--recv-buffers=512K]
+//                 [--connections=1,4] [--coalesce-us=0] [--seconds=3]
+//                 [--host=127.0.0.1 --port=20557] [--json=result.json]
+//
+// Without --host, rawquic_test_server is started as a child process.
+// Workloads, each connection driven by its own thread:
+//   upload    Bulk send to /discard, counted once drained from the send
+//             buffer.
+//   download  Bulk echo from /echo with a window of half the buffers,
+//             counted as received. The test server has no source mode.
+//   echo      One message in flight per connection, messages/s is the
+//             round trip rate.
+// Every case reports MB/s, messages/s, packets sent per message, and the
+// CPU time of the process and of the IO thread (Linux only) per second.
+// Upload paces on RawQuicGetStats, its polls/s are reported as they cost
+// IO thread time too.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raw_quic_api.h"
+#include "raw_quic_bench_util.h"
+#include "raw_quic_test_server.h"
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t kRecvChunkSize = 64 * 1024;
+const int kDrainTimeoutSeconds = 10;
+
+struct Case {
+  std::string workload;
+  uint32_t message_size;
+  uint32_t send_buffer_size;
+  uint32_t recv_buffer_size;
+  uint32_t connections;
+  uint32_t coalesce_us;
+  int seconds;
+};
+
+struct Result {
+  uint64_t bytes = 0;
+  uint64_t messages = 0;
+  uint64_t packets_sent = 0;
+  bool failed = false;
+};
+
+void RunUpload(RawQuicHandle handle, const Case& c, Result* result) {
+  std::vector<uint8_t> message(c.message_size, 'u');
+  Clock::time_point end = Clock::now() + std::chrono::seconds(c.seconds);
+  uint32_t pacing_limit = c.send_buffer_size / 2;
+  uint32_t sent_since_check = 0;
+  while (Clock::now() < end) {
+    if (sent_since_check + c.message_size > pacing_limit / 2) {
+      if (!bench::WaitSendBuffer(handle, pacing_limit - c.message_size,
+                                 end + std::chrono::seconds(
+                                           kDrainTimeoutSeconds))) {
+        result->failed = true;
+        return;
+      }
+      sent_since_check = 0;
+    }
+
+    if (RawQuicSend(handle, message.data(), c.message_size) < 0) {
+      result->failed = true;
+      return;
+    }
+    sent_since_check += c.message_size;
+    result->bytes += c.message_size;
+    ++result->messages;
+  }
+
+  // Counted as delivered once out of the send buffer.
+  result->failed = !bench::WaitSendBuffer(
+      handle, 0, Clock::now() + std::chrono::seconds(kDrainTimeoutSeconds));
+}
+
+void RunDownload(RawQuicHandle handle, const Case& c, Result* result) {
+  std::vector<uint8_t> message(c.message_size, 'd');
+  std::vector<uint8_t> buffer(kRecvChunkSize);
+  uint64_t window =
+      std::max<uint64_t>(std::min(c.send_buffer_size, c.recv_buffer_size) / 2,
+                         c.message_size);
+  uint64_t sent = 0;
+  Clock::time_point end = Clock::now() + std::chrono::seconds(c.seconds);
+  while (Clock::now() < end) {
+    if (sent + c.message_size - result->bytes <= window) {
+      if (RawQuicSend(handle, message.data(), c.message_size) < 0) {
+        result->failed = true;
+        return;
+      }
+      sent += c.message_size;
+      continue;
+    }
+
+    int32_t ret = RawQuicRecv(handle, buffer.data(), kRecvChunkSize, 100);
+    if (ret < 0 && ret != RAW_QUIC_ERROR_CODE_TIMEOUT) {
+      result->failed = true;
+      return;
+    }
+    result->bytes += ret > 0 ? ret : 0;
+  }
+  result->messages = result->bytes / c.message_size;
+}
+
+void RunEcho(RawQuicHandle handle, const Case& c, Result* result) {
+  std::vector<uint8_t> message(c.message_size, 'e');
+  std::vector<uint8_t> buffer(kRecvChunkSize);
+  Clock::time_point end = Clock::now() + std::chrono::seconds(c.seconds);
+  while (Clock::now() < end) {
+    if (RawQuicSend(handle, message.data(), c.message_size) < 0) {
+      result->failed = true;
+      return;
+    }
+
+    uint32_t received = 0;
+    while (received < c.message_size) {
+      int32_t ret = RawQuicRecv(handle, buffer.data(), kRecvChunkSize, 5000);
+      if (ret < 0) {
+        result->failed = true;
+        return;
+      }
+      received += ret;
+    }
+    result->bytes += c.message_size;
+    ++result->messages;
+  }
+}
+
+bool RunCase(const char* host,
+             uint16_t port,
+             const Case& c,
+             bench::Report* report) {
+  const char* path = c.workload == "upload" ? "discard" : "echo";
+  std::vector<RawQuicHandle> handles;
+  for (uint32_t i = 0; i < c.connections; ++i) {
+    RawQuicHandle handle = bench::OpenConnected(
+        host, port, path, c.send_buffer_size, c.recv_buffer_size);
+    if (handle == 0) {
+      break;
+    }
+    RawQuicSetCoalesceDelay(handle, c.coalesce_us);
+    handles.push_back(handle);
+  }
+
+  std::vector<Result> results(handles.size());
+  std::vector<uint64_t> packets_before(handles.size());
+  for (size_t i = 0; i < handles.size(); ++i) {
+    RawQuicStats stats;
+    RawQuicGetStats(handles[i], &stats);
+    packets_before[i] = stats.packets_sent;
+  }
+
+  double process_cpu = bench::GetProcessCpuMs();
+  double io_cpu = bench::GetIoThreadCpuMs();
+  uint64_t polls = bench::StatsPolls().load();
+  Clock::time_point start = Clock::now();
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < handles.size(); ++i) {
+    threads.emplace_back([&c, &handles, &results, i] {
+      if (c.workload == "upload") {
+        RunUpload(handles[i], c, &results[i]);
+      } else if (c.workload == "download") {
+        RunDownload(handles[i], c, &results[i]);
+      } else {
+        RunEcho(handles[i], c, &results[i]);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  double elapsed = bench::ElapsedSeconds(start);
+  process_cpu = bench::GetProcessCpuMs() - process_cpu;
+  double io_cpu_end = bench::GetIoThreadCpuMs();
+  io_cpu = io_cpu < 0 || io_cpu_end < 0 ? -1 : io_cpu_end - io_cpu;
+  polls = bench::StatsPolls().load() - polls;
+
+  Result total;
+  total.failed = handles.size() != c.connections;
+  for (size_t i = 0; i < handles.size(); ++i) {
+    RawQuicStats stats;
+    RawQuicGetStats(handles[i], &stats);
+    total.bytes += results[i].bytes;
+    total.messages += results[i].messages;
+    total.packets_sent += stats.packets_sent - packets_before[i];
+    total.failed = total.failed || results[i].failed;
+    RawQuicClose(handles[i]);
+  }
+
+  double mbps = total.bytes / elapsed / (1024 * 1024);
+  fprintf(stderr,
+          "%-8s size %-8u sndbuf %-8u rcvbuf %-8u conns %-4u coalesce %-5u "
+          "%10.2f MB/s %12.0f msg/s %s\n",
+          c.workload.c_str(), c.message_size, c.send_buffer_size,
+          c.recv_buffer_size, c.connections, c.coalesce_us, mbps,
+          total.messages / elapsed, total.failed ? "FAILED" : "");
+
+  report->BeginResult();
+  report->Add("workload", c.workload);
+  report->Add("message_size", (uint64_t)c.message_size);
+  report->Add("send_buffer_size", (uint64_t)c.send_buffer_size);
+  report->Add("recv_buffer_size", (uint64_t)c.recv_buffer_size);
+  report->Add("connections", (uint64_t)c.connections);
+  report->Add("coalesce_us", (uint64_t)c.coalesce_us);
+  report->Add("seconds", elapsed);
+  report->Add("bytes", total.bytes);
+  report->Add("messages", total.messages);
+  report->Add("mb_per_second", mbps);
+  report->Add("messages_per_second", total.messages / elapsed);
+  report->Add("packets_per_message",
+              total.messages > 0 ? (double)total.packets_sent / total.messages
+                                 : 0.0);
+  report->Add("process_cpu_ms_per_second", process_cpu / elapsed);
+  report->Add("io_thread_cpu_ms_per_second",
+              io_cpu < 0 ? -1.0 : io_cpu / elapsed);
+  report->Add("stats_polls_per_second", polls / elapsed);
+  report->Add("failed", (uint64_t)(total.failed ? 1 : 0));
+  report->EndResult();
+  return !total.failed;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> workloads = bench::ParseNames(
+      bench::GetFlag(argc, argv, "workloads", "upload,download,echo"));
+  std::vector<uint32_t> sizes = bench::ParseSizes(
+      bench::GetFlag(argc, argv, "sizes", "64,1K,16K,256K,1M"));
+  std::vector<uint32_t> send_buffers =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "send-buffers", "512K,4M"));
+  std::vector<uint32_t> recv_buffers =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "recv-buffers", "512K"));
+  std::vector<uint32_t> connections =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "connections", "1,4"));
+  std::vector<uint32_t> coalesce =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "coalesce-us", "0"));
+  if (coalesce.empty()) {
+    coalesce.push_back(0);
+  }
+  int seconds = atoi(bench::GetFlag(argc, argv, "seconds", "3"));
+  const char* host = bench::GetFlag(argc, argv, "host", nullptr);
+  uint16_t port = (uint16_t)atoi(bench::GetFlag(argc, argv, "port", "20557"));
+  const char* json = bench::GetFlag(argc, argv, "json", "");
+
+  RawQuicTestServer server;
+  if (host == nullptr) {
+    if (!server.Start(argv[0], port)) {
+      return 1;
+    }
+    host = server.host();
+  }
+
+  bench::Report report("rawquic_bench");
+  bool passed = true;
+  for (const std::string& workload : workloads) {
+    for (uint32_t size : sizes) {
+      for (uint32_t send_buffer : send_buffers) {
+        for (uint32_t recv_buffer : recv_buffers) {
+          for (uint32_t count : connections) {
+            for (uint32_t coalesce_us : coalesce) {
+              // Message must fit the pacing window of the send buffer.
+              if (size > send_buffer / 4) {
+                continue;
+              }
+              Case c = {workload, size,        send_buffer, recv_buffer,
+                        count,    coalesce_us, seconds};
+              passed = RunCase(host, port, c, &report) && passed;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  server.Stop();
+  if (!report.Write(json)) {
+    return 1;
+  }
+  return passed ? 0 : 1;
+}
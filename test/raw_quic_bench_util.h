@@ -0,0 +1,357 @@
+// Helpers shared by the rawquic benchmarks: flags, CPU time, memory, send
+// pacing and JSON output. Human readable lines go to stderr, so stdout only
+// carries the JSON when no --json file is given.
+
+#ifndef RAW_QUIC_BENCH_UTIL_H_
+#define RAW_QUIC_BENCH_UTIL_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include "raw_quic_api.h"
+
+namespace bench {
+
+// Value of --name=value, or default_value.
+inline const char* GetFlag(int argc,
+                           char** argv,
+                           const char* name,
+                           const char* default_value) {
+  size_t len = strlen(name);
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--", 2) == 0 && strncmp(argv[i] + 2, name, len) == 0 &&
+        argv[i][2 + len] == '=') {
+      return argv[i] + 3 + len;
+    }
+  }
+  return default_value;
+}
+
+// "a,b,c" to its items.
+inline std::vector<std::string> ParseNames(const char* list) {
+  std::vector<std::string> names;
+  std::string all = list;
+  size_t start = 0;
+  while (start < all.size()) {
+    size_t comma = all.find(',', start);
+    if (comma == std::string::npos) {
+      comma = all.size();
+    }
+    if (comma > start) {
+      names.push_back(all.substr(start, comma - start));
+    }
+    start = comma + 1;
+  }
+  return names;
+}
+
+// "64,1K,1M" to bytes.
+inline std::vector<uint32_t> ParseSizes(const char* list) {
+  std::vector<uint32_t> sizes;
+  const char* p = list;
+  while (*p != '\0') {
+    char* end = nullptr;
+    uint32_t size = (uint32_t)strtoul(p, &end, 10);
+    if (end == p) {
+      break;
+    }
+    if (*end == 'K' || *end == 'k') {
+      size *= 1024;
+      ++end;
+    } else if (*end == 'M' || *end == 'm') {
+      size *= 1024 * 1024;
+      ++end;
+    }
+    sizes.push_back(size);
+    p = *end == ',' ? end + 1 : end;
+  }
+  return sizes;
+}
+
+inline double ElapsedSeconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+inline double GetProcessCpuMs() {
+#if defined(_WIN32)
+  FILETIME creation, exit, kernel, user;
+  GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+  return (k.QuadPart + u.QuadPart) / 10000.0;
+#else
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec * 1000.0 + usage.ru_utime.tv_usec / 1000.0 +
+         usage.ru_stime.tv_sec * 1000.0 + usage.ru_stime.tv_usec / 1000.0;
+#endif
+}
+
+// Resident memory of the process, or 0 if unknown.
+inline uint64_t GetRssBytes() {
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters;
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                            sizeof(counters))) {
+    return 0;
+  }
+  return counters.WorkingSetSize;
+#elif defined(__linux__)
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == nullptr) {
+    return 0;
+  }
+  unsigned long long size = 0;
+  unsigned long long resident = 0;
+  int fields = fscanf(file, "%llu %llu", &size, &resident);
+  fclose(file);
+  return fields == 2 ? resident * (uint64_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+  // Peak rather than current, the best getrusage tells. Bytes on macOS,
+  // KB elsewhere.
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+  return (uint64_t)usage.ru_maxrss;
+#else
+  return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Lifts the open file limit to the hard limit, every connection holds a
+// socket. Returns the limit now in effect.
+inline uint64_t RaiseFileLimit() {
+#if defined(_WIN32)
+  return UINT64_MAX;
+#else
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) {
+    return 0;
+  }
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+  getrlimit(RLIMIT_NOFILE, &limit);
+  return limit.rlim_cur;
+#endif
+}
+
+// CPU time of the library IO thread, named "RawQuic", or -1 where it can
+// not be told apart from the other threads.
+inline double GetIoThreadCpuMs() {
+#if defined(__linux__)
+  DIR* dir = opendir("/proc/self/task");
+  if (dir == nullptr) {
+    return -1;
+  }
+
+  double cpu_ms = -1;
+  long ticks_per_second = sysconf(_SC_CLK_TCK);
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+
+    std::string task = std::string("/proc/self/task/") + entry->d_name;
+    char comm[64] = {0};
+    FILE* file = fopen((task + "/comm").c_str(), "r");
+    if (file == nullptr) {
+      continue;
+    }
+    bool is_io_thread = fgets(comm, sizeof(comm), file) != nullptr &&
+                        strcmp(comm, "RawQuic\n") == 0;
+    fclose(file);
+    if (!is_io_thread) {
+      continue;
+    }
+
+    // utime and stime are fields 14 and 15, after the parenthesized name.
+    char stat[1024] = {0};
+    file = fopen((task + "/stat").c_str(), "r");
+    if (file == nullptr) {
+      continue;
+    }
+    size_t len = fread(stat, 1, sizeof(stat) - 1, file);
+    fclose(file);
+    stat[len] = '\0';
+    const char* fields = strrchr(stat, ')');
+    unsigned long long utime = 0;
+    unsigned long long stime = 0;
+    if (fields != nullptr &&
+        sscanf(fields + 2,
+               "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime,
+               &stime) == 2) {
+      cpu_ms = (utime + stime) * 1000.0 / ticks_per_second;
+    }
+    break;
+  }
+  closedir(dir);
+  return cpu_ms;
+#else
+  return -1;
+#endif
+}
+
+// RawQuicGetStats calls of WaitSendBuffer in the process. Each one is a task
+// on the IO thread, benchmarks report the rate next to its CPU time.
+inline std::atomic<uint64_t>& StatsPolls() {
+  static std::atomic<uint64_t> polls(0);
+  return polls;
+}
+
+// Waits until the send buffer holds at most limit bytes, RawQuicSend drops
+// data beyond the buffer instead of blocking. Sleeps for the time the excess
+// takes at the pacing rate, so a wait costs the IO thread a poll or two
+// rather than one every few hundred us.
+inline bool WaitSendBuffer(RawQuicHandle handle,
+                           uint32_t limit,
+                           std::chrono::steady_clock::time_point deadline) {
+  const int64_t kMinSleepUs = 200;
+  const int64_t kMaxSleepUs = 10 * 1000;
+  int64_t backoff_us = kMinSleepUs;
+  RawQuicStats stats;
+  while (RawQuicGetStats(handle, &stats) == RAW_QUIC_ERROR_CODE_SUCCESS) {
+    StatsPolls().fetch_add(1, std::memory_order_relaxed);
+    if (stats.send_buffer_bytes <= limit) {
+      return true;
+    }
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+
+    // No rate before the first acks, back off instead.
+    int64_t sleep_us = backoff_us;
+    if (stats.pacing_rate_bps > 0) {
+      sleep_us = (int64_t)((stats.send_buffer_bytes - limit) * 8 * 1000000ull /
+                           stats.pacing_rate_bps);
+    } else {
+      backoff_us = std::min(backoff_us * 2, kMaxSleepUs);
+    }
+    sleep_us = std::max(kMinSleepUs, std::min(sleep_us, kMaxSleepUs));
+    std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+  }
+  return false;
+}
+
+// callbacks may be NULL for none.
+inline RawQuicHandle OpenConnected(const char* host,
+                                   uint16_t port,
+                                   const char* path,
+                                   uint32_t send_buffer_size,
+                                   uint32_t recv_buffer_size,
+                                   const RawQuicCallbacks* callbacks = NULL,
+                                   void* opaque = NULL) {
+  RawQuicCallbacks none;
+  memset(&none, 0, sizeof(none));
+  RawQuicHandle handle =
+      RawQuicOpen(callbacks != NULL ? *callbacks : none, opaque, false);
+  if (handle == 0) {
+    return 0;
+  }
+
+  if (send_buffer_size > 0) {
+    RawQuicSetSendBufferSize(handle, send_buffer_size);
+  }
+  if (recv_buffer_size > 0) {
+    RawQuicSetRecvBufferSize(handle, recv_buffer_size);
+  }
+
+  int32_t ret = RawQuicConnect(handle, host, port, path, 5000);
+  if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    fprintf(stderr, "RawQuicConnect %s:%u/%s failed %d.\n", host, port, path,
+            ret);
+    RawQuicClose(handle);
+    return 0;
+  }
+  return handle;
+}
+
+/////////////////////////////////////Report/////////////////////////////////////
+// Results as {"benchmark": name, "results": [{...}, ...]}, one object per
+// case, so runs of different releases can be diffed by tools.
+class Report {
+ public:
+  explicit Report(const char* name) : name_(name) {}
+
+  void BeginResult() { current_.clear(); }
+
+  void Add(const char* key, const std::string& value) {
+    Separate();
+    current_ += "\"" + std::string(key) + "\":\"" + value + "\"";
+  }
+
+  void Add(const char* key, double value) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.3f", value);
+    Separate();
+    current_ += "\"" + std::string(key) + "\":" + buffer;
+  }
+
+  void Add(const char* key, uint64_t value) {
+    Separate();
+    current_ += "\"" + std::string(key) + "\":" + std::to_string(value);
+  }
+
+  void EndResult() { results_.push_back("{" + current_ + "}"); }
+
+  // To path, or stdout if path is empty.
+  bool Write(const char* path) const {
+    std::string json = "{\"benchmark\":\"" + name_ + "\",\"results\":[\n";
+    for (size_t i = 0; i < results_.size(); ++i) {
+      json += "  " + results_[i] + (i + 1 < results_.size() ? ",\n" : "\n");
+    }
+    json += "]}\n";
+
+    if (path == nullptr || path[0] == '\0') {
+      fputs(json.c_str(), stdout);
+      return true;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+      fprintf(stderr, "Open %s failed.\n", path);
+      return false;
+    }
+    bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    fclose(file);
+    return written;
+  }
+
+ private:
+  void Separate() {
+    if (!current_.empty()) {
+      current_ += ",";
+    }
+  }
+
+  std::string name_;
+  std::string current_;
+  std::vector<std::string> results_;
+};
+
+}  // namespace bench
+
+#endif  // RAW_QUIC_BENCH_UTIL_H_
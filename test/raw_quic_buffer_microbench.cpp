@@ -0,0 +1,301 @@
+// Microbenchmarks of the receive buffer and the write queue of RawQuic, used
+// the way RawQuic uses them, to evaluate replacing either in seconds.
+// Only depends on streambuf/ and RawQuicBufferPool, which needs the header
+// only base/no_destructor.h, so with CHROMIUM_SRC the patched src directory
+// build with e.g. the one line
+//   g++ -std=c++14 -O2 -I../src/raw_quic -I$CHROMIUM_SRC
+//       raw_quic_buffer_microbench.cpp
+//       ../src/raw_quic/raw_quic_buffer_pool.cc -lpthread
+//
+//   raw_quic_buffer_microbench [--filter=substring] [--min-time-ms=500]
+//
+// Each benchmark doubles its iterations until it ran for --min-time-ms, then
+// prints time per iteration and throughput, like Google Benchmark does.
+//   StreamBufFillRead/N       FillReadBuffer fills the buffer to the receive
+//                             buffer size in kReadOnceSize chunks, Read
+//                             takes it out N bytes at a time.
+//   StreamBufPeekConsume      Same fill, RecvPeek/RecvConsume take it out.
+//   StreamBufProducerConsumer/N
+//                             Filling and reading on two threads under
+//                             read_mutex_, reader waits on read_cond_.
+//   WriteQueuePushPop/N       Send allocates random 1B-64KB writes from
+//                             RawQuicBufferPool and copies them, N are
+//                             queued, then FlushWriteBuffer pops them all
+//                             and frees the buffers back to the pool.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raw_quic_buffer_pool.h"
+#include "streambuf/streambuf.hpp"
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+// Same as raw_quic.cc.
+const uint32_t kReadOnceSize = 32 * 1024;
+const uint32_t kRecvBufferSize = 512 * 1024;
+
+const uint32_t kMaxWriteSize = 64 * 1024;
+const uint32_t kRandomSizeCount = 4096;
+
+// Results are stored here so the compiler can't drop the work.
+volatile uint64_t g_sink = 0;
+
+struct Counters {
+  uint64_t bytes = 0;
+  uint64_t items = 0;
+};
+
+typedef void (*BenchmarkFunction)(uint64_t iterations,
+                                  uint32_t arg,
+                                  Counters* counters);
+
+struct Benchmark {
+  const char* name;
+  BenchmarkFunction function;
+  uint32_t arg;
+};
+
+// Stands in for QuicTransportStream::Read, the data is copied once there too.
+class FakeStream {
+ public:
+  FakeStream() : data_(kReadOnceSize, 'r') {}
+
+  uint32_t Read(char* buffer, uint32_t size) {
+    uint32_t read_len = std::min<uint32_t>(size, (uint32_t)data_.size());
+    memcpy(buffer, data_.data(), read_len);
+    return read_len;
+  }
+
+ private:
+  std::string data_;
+};
+
+// Receive side state of one RawQuic.
+struct ReadBuffer {
+  ReadBuffer()
+      : temp_read_buffer(new uint8_t[kReadOnceSize]),
+        read_istream(&read_buffer),
+        read_ostream(&read_buffer) {}
+
+  // As RawQuic::FillReadBuffer.
+  void Fill(FakeStream* stream) {
+    while (read_buffer.size() < kRecvBufferSize) {
+      uint32_t read_len =
+          stream->Read((char*)temp_read_buffer.get(), kReadOnceSize);
+      read_ostream.write((const char*)temp_read_buffer.get(), read_len);
+    }
+  }
+
+  boost::asio::streambuf read_buffer;
+  std::unique_ptr<uint8_t[]> temp_read_buffer;
+  std::istream read_istream;
+  std::ostream read_ostream;
+  std::mutex read_mutex;
+  std::condition_variable read_cond;
+};
+
+void StreamBufFillRead(uint64_t iterations, uint32_t arg, Counters* counters) {
+  ReadBuffer buffer;
+  FakeStream stream;
+  std::vector<uint8_t> data(arg);
+  for (uint64_t i = 0; i < iterations; ++i) {
+    buffer.Fill(&stream);
+    while (buffer.read_buffer.size() > 0) {
+      uint32_t read_len =
+          std::min<uint32_t>(arg, (uint32_t)buffer.read_buffer.size());
+      buffer.read_istream.read((char*)data.data(), read_len);
+      counters->bytes += read_len;
+      ++counters->items;
+    }
+  }
+}
+
+void StreamBufPeekConsume(uint64_t iterations,
+                          uint32_t /* arg */,
+                          Counters* counters) {
+  ReadBuffer buffer;
+  FakeStream stream;
+  uint64_t checksum = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    buffer.Fill(&stream);
+    while (buffer.read_buffer.size() > 0) {
+      // As RawQuic::Peek.
+      boost::asio::streambuf::const_buffers_type buffers =
+          buffer.read_buffer.data();
+      uint32_t size = 0;
+      for (auto it = buffers.begin(); it != buffers.end(); ++it) {
+        boost::asio::const_buffer region(*it);
+        uint32_t len = (uint32_t)boost::asio::buffer_size(region);
+        if (len == 0) {
+          continue;
+        }
+        // Touch the data as a caller would.
+        checksum += boost::asio::buffer_cast<const uint8_t*>(region)[0];
+        size += len;
+      }
+      uint32_t consume_len = std::min<uint32_t>(kReadOnceSize, size);
+      buffer.read_buffer.consume(consume_len);
+      counters->bytes += consume_len;
+      ++counters->items;
+    }
+  }
+  g_sink = checksum;
+}
+
+void StreamBufProducerConsumer(uint64_t iterations,
+                               uint32_t arg,
+                               Counters* counters) {
+  ReadBuffer buffer;
+  uint64_t total = iterations * kRecvBufferSize;
+
+  // IO thread, fills as far as the buffer allows and wakes the reader.
+  std::thread producer([&buffer, total] {
+    FakeStream stream;
+    uint64_t produced = 0;
+    while (produced < total) {
+      std::unique_lock<std::mutex> lock(buffer.read_mutex);
+      buffer.read_cond.wait(lock, [&buffer] {
+        return buffer.read_buffer.size() < kRecvBufferSize;
+      });
+      while (buffer.read_buffer.size() < kRecvBufferSize && produced < total) {
+        uint32_t read_len =
+            stream.Read((char*)buffer.temp_read_buffer.get(), kReadOnceSize);
+        read_len = (uint32_t)std::min<uint64_t>(read_len, total - produced);
+        buffer.read_ostream.write((const char*)buffer.temp_read_buffer.get(),
+                                  read_len);
+        produced += read_len;
+      }
+      buffer.read_cond.notify_all();
+    }
+  });
+
+  // Caller of RawQuicRecv.
+  std::vector<uint8_t> data(arg);
+  uint64_t consumed = 0;
+  while (consumed < total) {
+    std::unique_lock<std::mutex> lock(buffer.read_mutex);
+    buffer.read_cond.wait(lock,
+                          [&buffer] { return buffer.read_buffer.size() > 0; });
+    uint32_t read_len =
+        std::min<uint32_t>(arg, (uint32_t)buffer.read_buffer.size());
+    buffer.read_istream.read((char*)data.data(), read_len);
+    consumed += read_len;
+    ++counters->items;
+    // RawQuic posts a READ command here, the producer is woken instead.
+    buffer.read_cond.notify_all();
+  }
+  producer.join();
+  counters->bytes += consumed;
+}
+
+void WriteQueuePushPop(uint64_t iterations, uint32_t arg, Counters* counters) {
+  // Sizes are drawn up front, fixed seed so every run sees the same ones.
+  std::mt19937 random(1);
+  std::uniform_int_distribution<uint32_t> distribution(1, kMaxWriteSize);
+  std::vector<uint32_t> sizes(kRandomSizeCount);
+  for (uint32_t& size : sizes) {
+    size = distribution(random);
+  }
+  std::vector<uint8_t> source(kMaxWriteSize, 'w');
+
+  // As RawQuic::write_queue_.
+  net::RawQuicBufferPool* pool = net::RawQuicBufferPool::GetInstance();
+  std::queue<net::RawQuicBuffer> write_queue;
+  uint64_t next = 0;
+  uint64_t written = 0;
+  for (uint64_t i = 0; i < iterations; ++i) {
+    for (uint32_t j = 0; j < arg; ++j) {
+      uint32_t size = sizes[next++ % kRandomSizeCount];
+      // As RawQuic::Write and DoWrite.
+      net::RawQuicBufferPtr buffer(pool->Allocate(size));
+      memcpy(buffer.get(), source.data(), size);
+      write_queue.emplace(std::move(buffer), size, (int64_t)next);
+    }
+
+    while (!write_queue.empty()) {
+      const net::RawQuicBuffer& data = write_queue.front();
+      written += data.length() + (data.data()[0] == 'w' ? 0 : 1);
+      write_queue.pop();
+      ++counters->items;
+    }
+  }
+  counters->bytes += written;
+}
+
+const Benchmark kBenchmarks[] = {
+    {"StreamBufFillRead", StreamBufFillRead, 1024},
+    {"StreamBufFillRead", StreamBufFillRead, 4096},
+    {"StreamBufFillRead", StreamBufFillRead, 32 * 1024},
+    {"StreamBufPeekConsume", StreamBufPeekConsume, 0},
+    {"StreamBufProducerConsumer", StreamBufProducerConsumer, 1024},
+    {"StreamBufProducerConsumer", StreamBufProducerConsumer, 32 * 1024},
+    {"WriteQueuePushPop", WriteQueuePushPop, 1},
+    {"WriteQueuePushPop", WriteQueuePushPop, 64},
+    {"WriteQueuePushPop", WriteQueuePushPop, 1024},
+};
+
+const char* GetFlag(int argc,
+                    char** argv,
+                    const char* name,
+                    const char* default_value) {
+  size_t len = strlen(name);
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--", 2) == 0 &&
+        strncmp(argv[i] + 2, name, len) == 0 && argv[i][2 + len] == '=') {
+      return argv[i] + 3 + len;
+    }
+  }
+  return default_value;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* filter = GetFlag(argc, argv, "filter", "");
+  double min_seconds = atoi(GetFlag(argc, argv, "min-time-ms", "500")) / 1000.0;
+
+  printf("%-36s %14s %12s %12s %14s\n", "Benchmark", "Time/iter", "Iterations",
+         "MB/s", "items/s");
+  for (const Benchmark& benchmark : kBenchmarks) {
+    std::string name = benchmark.name;
+    if (benchmark.arg > 0) {
+      name += "/" + std::to_string(benchmark.arg);
+    }
+    if (name.find(filter) == std::string::npos) {
+      continue;
+    }
+
+    uint64_t iterations = 1;
+    Counters counters;
+    double seconds = 0;
+    while (true) {
+      counters = Counters();
+      Clock::time_point start = Clock::now();
+      benchmark.function(iterations, benchmark.arg, &counters);
+      seconds = std::chrono::duration<double>(Clock::now() - start).count();
+      if (seconds >= min_seconds) {
+        break;
+      }
+      iterations *= 2;
+    }
+
+    printf("%-36s %11.0f ns %12llu %12.1f %14.0f\n", name.c_str(),
+           seconds * 1e9 / iterations, (unsigned long long)iterations,
+           counters.bytes / seconds / (1024 * 1024), counters.items / seconds);
+  }
+  return 0;
+}
@@ -0,0 +1,301 @@
+// Test of RawQuicCertCache and the cache lookups of RawQuicProofVerifier,
+// on a test clock and over a fake default verifier, without a network.
+//
+//   raw_quic_cert_cache_test
+// Covers the length prefixing of Key, expiry at the earlier of the leaf
+// expiry and kVerifiedChainLifetimeMinutes, eviction of the entry expiring
+// soonest at kMaxVerifiedChains, that a hit skips verification while a miss,
+// an expired entry or a failed chain goes to the default verifier, and that
+// per host verifiers are bounded without dropping one still verifying.
+
+#include <stdio.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/test/simple_test_clock.h"
+#include "crypto/rsa_private_key.h"
+#include "net/cert/x509_util.h"
+#include "net/quic/raw_quic/raw_quic_proof_verifier.h"
+
+namespace {
+
+bool Check(bool condition, const char* what) {
+  if (!condition) {
+    printf("%s failed.\n", what);
+  }
+  return condition;
+}
+
+// DER of a self-signed certificate valid until now + valid_for.
+bool CreateCertificate(base::TimeDelta valid_for, std::string* der_cert) {
+  std::unique_ptr<crypto::RSAPrivateKey> key;
+  base::Time now = base::Time::Now();
+  return net::x509_util::CreateKeyAndSelfSignedCert(
+      "CN=localhost", 1, now - base::TimeDelta::FromDays(1), now + valid_for,
+      &key, der_cert);
+}
+
+// Default verifier of one host, counts the chains it verifies.
+class FakeVerifier : public quic::ProofVerifier {
+ public:
+  explicit FakeVerifier(std::map<std::string, int>* verified)
+      : verified_(verified) {}
+
+  // Next chains fail, or are held until RunPending.
+  static bool fail;
+  static bool async;
+  static std::unique_ptr<quic::ProofVerifierCallback> pending;
+
+  static void RunPending() {
+    std::unique_ptr<quic::ProofVerifierCallback> callback = std::move(pending);
+    std::unique_ptr<quic::ProofVerifyDetails> details;
+    callback->Run(true, std::string(), &details);
+  }
+
+  quic::QuicAsyncStatus VerifyProof(
+      const std::string& hostname,
+      const uint16_t port,
+      const std::string& server_config,
+      quic::QuicTransportVersion transport_version,
+      quiche::QuicheStringPiece chlo_hash,
+      const std::vector<std::string>& certs,
+      const std::string& cert_sct,
+      const std::string& signature,
+      const quic::ProofVerifyContext* context,
+      std::string* error_details,
+      std::unique_ptr<quic::ProofVerifyDetails>* details,
+      std::unique_ptr<quic::ProofVerifierCallback> callback) override {
+    return quic::QUIC_FAILURE;
+  }
+
+  quic::QuicAsyncStatus VerifyCertChain(
+      const std::string& hostname,
+      const std::vector<std::string>& certs,
+      const std::string& ocsp_response,
+      const std::string& cert_sct,
+      const quic::ProofVerifyContext* context,
+      std::string* error_details,
+      std::unique_ptr<quic::ProofVerifyDetails>* details,
+      std::unique_ptr<quic::ProofVerifierCallback> callback) override {
+    ++(*verified_)[hostname];
+    if (async) {
+      pending = std::move(callback);
+      return quic::QUIC_PENDING;
+    }
+    return fail ? quic::QUIC_FAILURE : quic::QUIC_SUCCESS;
+  }
+
+  std::unique_ptr<quic::ProofVerifyContext> CreateDefaultContext() override {
+    return nullptr;
+  }
+
+ private:
+  std::map<std::string, int>* verified_;
+};
+
+bool FakeVerifier::fail = false;
+bool FakeVerifier::async = false;
+std::unique_ptr<quic::ProofVerifierCallback> FakeVerifier::pending;
+
+class IgnoreCallback : public quic::ProofVerifierCallback {
+ public:
+  void Run(bool ok,
+           const std::string& error_details,
+           std::unique_ptr<quic::ProofVerifyDetails>* details) override {}
+};
+
+class TestProofVerifier : public net::RawQuicProofVerifier {
+ public:
+  explicit TestProofVerifier(net::RawQuicCertCache* cache)
+      : net::RawQuicProofVerifier(cache) {}
+
+  quic::QuicAsyncStatus Verify(const std::string& hostname,
+                               const std::vector<std::string>& certs) {
+    std::string error_details;
+    std::unique_ptr<quic::ProofVerifyDetails> details;
+    return VerifyCertChain(hostname, certs, std::string(), std::string(),
+                           nullptr, &error_details, &details,
+                           std::make_unique<IgnoreCallback>());
+  }
+
+  // Chains each host's default verifier verified.
+  std::map<std::string, int> verified;
+  // Default verifiers created per host.
+  std::map<std::string, int> created;
+
+ protected:
+  std::unique_ptr<quic::ProofVerifier> CreateVerifier(
+      const std::string& hostname) override {
+    ++created[hostname];
+    return std::make_unique<FakeVerifier>(&verified);
+  }
+};
+
+bool TestKey() {
+  typedef net::RawQuicCertCache Cache;
+  bool passed = Check(Cache::Key("host", {"a", "b"}).size() == 32, "Key size");
+  passed = Check(Cache::Key("host", {"a", "b"}) ==
+                     Cache::Key("host", {"a", "b"}),
+                 "Key of equal chains") &&
+           passed;
+  // Same bytes, split differently.
+  passed = Check(Cache::Key("hosta", {"b"}) != Cache::Key("host", {"ab"}),
+                 "Key of hostname prefixing") &&
+           passed;
+  passed = Check(Cache::Key("host", {"ab", "c"}) !=
+                     Cache::Key("host", {"a", "bc"}),
+                 "Key of certificate prefixing") &&
+           passed;
+  passed = Check(Cache::Key("host", {"a", ""}) != Cache::Key("host", {"a"}),
+                 "Key of empty certificate") &&
+           passed;
+  return passed;
+}
+
+bool TestExpiry(const std::string& long_leaf, const std::string& short_leaf) {
+  base::SimpleTestClock clock;
+  clock.SetNow(base::Time::Now());
+  net::RawQuicCertCache cache;
+  cache.SetClockForTesting(&clock);
+
+  // Leaf outlives the entry.
+  bool passed = Check(!cache.Lookup("long"), "Lookup before Insert");
+  cache.Insert("long", long_leaf);
+  // Short leaf expires 10 minutes from now, before the entry would.
+  cache.Insert("short", short_leaf);
+  passed = Check(cache.Lookup("long"), "Lookup after Insert") && passed;
+  passed = Check(cache.Lookup("short"), "Lookup of short leaf") && passed;
+
+  clock.Advance(base::TimeDelta::FromMinutes(11));
+  passed = Check(!cache.Lookup("short"), "Lookup after leaf expiry") && passed;
+  passed = Check(cache.Lookup("long"), "Lookup within lifetime") && passed;
+
+  clock.Advance(
+      base::TimeDelta::FromMinutes(net::kVerifiedChainLifetimeMinutes - 11));
+  passed = Check(!cache.Lookup("long"), "Lookup after lifetime") && passed;
+
+  // Not a certificate, nothing to bound the entry with.
+  cache.Insert("garbage", "not a certificate");
+  passed = Check(!cache.Lookup("garbage"), "Lookup of bad leaf") && passed;
+  return passed;
+}
+
+bool TestEviction(const std::string& leaf) {
+  base::SimpleTestClock clock;
+  clock.SetNow(base::Time::Now());
+  net::RawQuicCertCache cache;
+  cache.SetClockForTesting(&clock);
+
+  // Each entry expires a second after the one before.
+  for (size_t i = 0; i < net::kMaxVerifiedChains; ++i) {
+    cache.Insert("key" + std::to_string(i), leaf);
+    clock.Advance(base::TimeDelta::FromSeconds(1));
+  }
+  bool passed = Check(cache.Lookup("key0"), "Lookup of first entry");
+
+  // Full, the one expiring soonest goes.
+  cache.Insert("new", leaf);
+  passed = Check(!cache.Lookup("key0"), "Lookup of evicted entry") && passed;
+  passed = Check(cache.Lookup("key1"), "Lookup of second entry") && passed;
+  passed = Check(cache.Lookup("new"), "Lookup of new entry") && passed;
+
+  // Reinserting a cached key evicts nothing.
+  cache.Insert("key1", leaf);
+  passed = Check(cache.Lookup("key2"), "Lookup after reinsert") && passed;
+  return passed;
+}
+
+bool TestVerifier(const std::string& leaf) {
+  base::SimpleTestClock clock;
+  clock.SetNow(base::Time::Now());
+  net::RawQuicCertCache cache;
+  cache.SetClockForTesting(&clock);
+  TestProofVerifier verifier(&cache);
+  std::vector<std::string> chain = {leaf};
+
+  // Miss is verified and cached, the hit after it isn't verified again.
+  bool passed = Check(verifier.Verify("a.test", chain) == quic::QUIC_SUCCESS,
+                      "Verify on miss");
+  passed = Check(verifier.Verify("a.test", chain) == quic::QUIC_SUCCESS,
+                 "Verify on hit") &&
+           passed;
+  passed = Check(verifier.verified["a.test"] == 1, "Hit skips verifying") &&
+           passed;
+
+  // Chains are cached per host.
+  verifier.Verify("b.test", chain);
+  passed =
+      Check(verifier.verified["b.test"] == 1, "Other host verifies") && passed;
+
+  // Expired entry is verified again.
+  clock.Advance(
+      base::TimeDelta::FromMinutes(net::kVerifiedChainLifetimeMinutes + 1));
+  verifier.Verify("a.test", chain);
+  passed = Check(verifier.verified["a.test"] == 2, "Expired entry verifies") &&
+           passed;
+
+  // Failed chains aren't cached.
+  FakeVerifier::fail = true;
+  passed = Check(verifier.Verify("c.test", chain) == quic::QUIC_FAILURE,
+                 "Verify of bad chain") &&
+           passed;
+  verifier.Verify("c.test", chain);
+  FakeVerifier::fail = false;
+  passed = Check(verifier.verified["c.test"] == 2, "Failure not cached") &&
+           passed;
+
+  // Async success is cached once its callback runs.
+  FakeVerifier::async = true;
+  passed = Check(verifier.Verify("pending.test", chain) == quic::QUIC_PENDING,
+                 "Verify async") &&
+           passed;
+  FakeVerifier::async = false;
+
+  // More hosts than kept, the least recent ones are dropped but not the one
+  // still verifying.
+  for (size_t i = 0; i < net::kMaxHostVerifiers; ++i) {
+    verifier.Verify("host" + std::to_string(i) + ".test", chain);
+  }
+  clock.Advance(
+      base::TimeDelta::FromMinutes(net::kVerifiedChainLifetimeMinutes + 1));
+  verifier.Verify("b.test", chain);
+  passed = Check(verifier.created["b.test"] == 2, "Verifier dropped") &&
+           passed;
+
+  FakeVerifier::RunPending();
+  passed = Check(verifier.Verify("pending.test", chain) == quic::QUIC_SUCCESS,
+                 "Verify after async success") &&
+           passed;
+  passed = Check(verifier.verified["pending.test"] == 1 &&
+                     verifier.created["pending.test"] == 1,
+                 "Verifier kept while verifying") &&
+           passed;
+  return passed;
+}
+
+}  // namespace
+
+int main() {
+  base::AtExitManager exit_manager;
+
+  std::string long_leaf;
+  std::string short_leaf;
+  if (!CreateCertificate(base::TimeDelta::FromDays(7), &long_leaf) ||
+      !CreateCertificate(base::TimeDelta::FromMinutes(10), &short_leaf)) {
+    printf("Create certificate failed.\n");
+    printf("FAILED\n");
+    return 1;
+  }
+
+  bool passed = TestKey();
+  passed = TestExpiry(long_leaf, short_leaf) && passed;
+  passed = TestEviction(long_leaf) && passed;
+  passed = TestVerifier(long_leaf) && passed;
+
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// Mass teardown time of RawQuicClose vs RawQuicCloseAsync.
+// Usage: raw_quic_close_bench [count] [host port path]
+// Without host, handles are closed without connecting, which measures the
+// round trips through the IO thread only.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "raw_quic_api.h"
+
+namespace {
+std::mutex g_mutex;
+std::condition_variable g_cond;
+int g_closed = 0;
+}  // namespace
+
+void BenchClosedCallback(RawQuicHandle handle, void* opaque) {
+  std::unique_lock<std::mutex> lock(g_mutex);
+  ++g_closed;
+  g_cond.notify_all();
+}
+
+std::vector<RawQuicHandle> OpenHandles(int count,
+                                       const char* host,
+                                       uint16_t port,
+                                       const char* path) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  std::vector<RawQuicHandle> handles;
+  for (int i = 0; i < count; ++i) {
+    RawQuicHandle handle = RawQuicOpen(callbacks, nullptr, false);
+    if (handle == 0) {
+      break;
+    }
+    RawQuicSetClosedCallback(handle, BenchClosedCallback);
+
+    if (host != nullptr) {
+      int32_t ret = RawQuicConnect(handle, host, port, path, 5000);
+      if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+        printf("RawQuicConnect failed %d.\n", ret);
+        RawQuicClose(handle);
+        break;
+      }
+    }
+    handles.push_back(handle);
+  }
+  return handles;
+}
+
+double ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+int main(int argc, char** argv) {
+  int count = argc > 1 ? atoi(argv[1]) : 2000;
+  const char* host = argc > 4 ? argv[2] : nullptr;
+  uint16_t port = argc > 4 ? (uint16_t)atoi(argv[3]) : 0;
+  const char* path = argc > 4 ? argv[4] : "";
+
+  std::vector<RawQuicHandle> handles = OpenHandles(count, host, port, path);
+  auto start = std::chrono::steady_clock::now();
+  for (RawQuicHandle handle : handles) {
+    RawQuicClose(handle);
+  }
+  printf("RawQuicClose      %zu handles: %.1f ms\n", handles.size(),
+         ElapsedMs(start));
+
+  handles = OpenHandles(count, host, port, path);
+  g_closed = 0;
+  start = std::chrono::steady_clock::now();
+  for (RawQuicHandle handle : handles) {
+    RawQuicCloseAsync(handle);
+  }
+  double return_ms = ElapsedMs(start);
+  {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    g_cond.wait(lock, [&handles] { return g_closed == (int)handles.size(); });
+  }
+  printf("RawQuicCloseAsync %zu handles: %.1f ms to return, %.1f ms to close\n",
+         handles.size(), return_ms, ElapsedMs(start));
+
+  return 0;
+}
@@ -0,0 +1,290 @@
+// Round trip latency benchmark of librawquic against a local echo server.
+//
+//   rawquic_latency_bench [--modes=blocking,timeout,callback] [--sizes=16,1K]
+//                         [--count=10000] [--warmup=200] [--background=0,2]
+//                         [--background-size=16K] [--timeout-ms=1]
+//                         [--host=127.0.0.1 --port=20557] [--json=result.json]
+//
+// Without --host, rawquic_test_server is started as a child process.
+// One message is in flight at a time, timed from RawQuicSend until the
+// whole echo is received. Receive modes:
+//   blocking  RawQuicRecv with a long timeout.
+//   timeout   RawQuicRecv with --timeout-ms, retried on TIMEOUT.
+//   callback  RawQuicRecv with timeout 0, woken by can_read_callback.
+// --background opens that many extra connections in the same process,
+// each uploading to /discard as fast as its send buffer drains, to expose
+// queueing on the shared IO thread. They pace on RawQuicGetStats, polls/s
+// are reported with each case.
+// Every case reports p50/p90/p99/p99.9/max round trip, and p99 of the
+// library send and receive queue stages, in us.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raw_quic_api.h"
+#include "raw_quic_bench_util.h"
+#include "raw_quic_test_server.h"
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t kSendBufferSize = 4 * 1024 * 1024;
+const uint32_t kRecvBufferSize = 4 * 1024 * 1024;
+const int32_t kBlockingTimeoutMs = 5000;
+
+struct Case {
+  std::string mode;
+  uint32_t message_size;
+  uint32_t count;
+  uint32_t warmup;
+  uint32_t background;
+  uint32_t background_size;
+  int32_t timeout_ms;
+};
+
+// Wakes the receiving thread from can_read_callback, which is edge
+// triggered: it fires once data arrives after a read returned EAGAIN.
+class ReadableEvent {
+ public:
+  static void RAW_QUIC_CALLBACK OnCanRead(RawQuicHandle handle,
+                                          uint32_t size,
+                                          void* opaque) {
+    ReadableEvent* event = (ReadableEvent*)opaque;
+    std::lock_guard<std::mutex> lock(event->mutex_);
+    event->readable_ = true;
+    event->cv_.notify_one();
+  }
+
+  bool Wait(Clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool readable =
+        cv_.wait_until(lock, deadline, [this] { return readable_; });
+    readable_ = false;
+    return readable;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool readable_ = false;
+};
+
+// Receives exactly size bytes in the way mode asks for.
+bool RecvMessage(RawQuicHandle handle,
+                 const Case& c,
+                 ReadableEvent* event,
+                 uint8_t* buffer,
+                 uint32_t size) {
+  Clock::time_point deadline =
+      Clock::now() + std::chrono::milliseconds(kBlockingTimeoutMs);
+  uint32_t received = 0;
+  while (received < size) {
+    int32_t ret = 0;
+    if (c.mode == "blocking") {
+      ret = RawQuicRecv(handle, buffer + received, size - received,
+                        kBlockingTimeoutMs);
+    } else if (c.mode == "timeout") {
+      ret = RawQuicRecv(handle, buffer + received, size - received,
+                        c.timeout_ms);
+      if (ret == RAW_QUIC_ERROR_CODE_TIMEOUT && Clock::now() < deadline) {
+        continue;
+      }
+    } else {
+      ret = RawQuicRecv(handle, buffer + received, size - received, 0);
+      if (ret == RAW_QUIC_ERROR_CODE_EAGAIN && event->Wait(deadline)) {
+        continue;
+      }
+    }
+
+    if (ret < 0) {
+      fprintf(stderr, "RawQuicRecv failed %d, %u of %u bytes received.\n",
+              ret, received, size);
+      return false;
+    }
+    received += ret;
+  }
+  return true;
+}
+
+void RunBackground(RawQuicHandle handle,
+                   uint32_t size,
+                   const std::atomic<bool>* stop) {
+  std::vector<uint8_t> message(size, 'b');
+  uint32_t limit = kSendBufferSize / 2;
+  while (!stop->load()) {
+    if (!bench::WaitSendBuffer(handle, limit - size,
+                               Clock::now() + std::chrono::seconds(10)) ||
+        RawQuicSend(handle, message.data(), size) < 0) {
+      return;
+    }
+  }
+}
+
+int64_t Percentile(const std::vector<int64_t>& sorted, double percent) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  size_t rank = (size_t)(percent / 100 * sorted.size());
+  return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+bool RunCase(const char* host,
+             uint16_t port,
+             const Case& c,
+             bench::Report* report) {
+  std::atomic<bool> stop(false);
+  std::vector<RawQuicHandle> background;
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < c.background; ++i) {
+    RawQuicHandle handle = bench::OpenConnected(host, port, "discard",
+                                                kSendBufferSize, 0);
+    if (handle == 0) {
+      break;
+    }
+    background.push_back(handle);
+    threads.emplace_back(RunBackground, handle, c.background_size, &stop);
+  }
+
+  ReadableEvent event;
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.can_read_callback = ReadableEvent::OnCanRead;
+  RawQuicHandle handle =
+      bench::OpenConnected(host, port, "echo", kSendBufferSize,
+                           kRecvBufferSize, &callbacks, &event);
+
+  bool failed = handle == 0 || background.size() != c.background;
+  uint64_t polls = bench::StatsPolls().load();
+  Clock::time_point case_start = Clock::now();
+  std::vector<int64_t> samples;
+  RawQuicLatencyStats stages;
+  memset(&stages, 0, sizeof(stages));
+  if (handle != 0) {
+    std::vector<uint8_t> message(c.message_size, 'p');
+    std::vector<uint8_t> echo(c.message_size);
+    samples.reserve(c.count);
+    for (uint32_t i = 0; i < c.warmup + c.count && !failed; ++i) {
+      if (i == c.warmup) {
+        RawQuicGetLatencyStats(handle, &stages, true);
+      }
+
+      Clock::time_point start = Clock::now();
+      failed = RawQuicSend(handle, message.data(), c.message_size) < 0 ||
+               !RecvMessage(handle, c, &event, echo.data(), c.message_size);
+      if (i >= c.warmup && !failed) {
+        samples.push_back(std::chrono::duration_cast<std::chrono::microseconds>(
+                              Clock::now() - start)
+                              .count());
+      }
+    }
+    RawQuicGetLatencyStats(handle, &stages, false);
+    RawQuicClose(handle);
+  }
+
+  stop.store(true);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (RawQuicHandle background_handle : background) {
+    RawQuicClose(background_handle);
+  }
+
+  double elapsed = bench::ElapsedSeconds(case_start);
+  polls = bench::StatsPolls().load() - polls;
+
+  std::sort(samples.begin(), samples.end());
+  int64_t p50 = Percentile(samples, 50);
+  int64_t p90 = Percentile(samples, 90);
+  int64_t p99 = Percentile(samples, 99);
+  int64_t p999 = Percentile(samples, 99.9);
+  int64_t max = samples.empty() ? 0 : samples.back();
+  fprintf(stderr,
+          "%-8s size %-8u background %-3u p50 %7lldus p99 %7lldus "
+          "p99.9 %7lldus max %7lldus %s\n",
+          c.mode.c_str(), c.message_size, c.background, (long long)p50,
+          (long long)p99, (long long)p999, (long long)max,
+          failed ? "FAILED" : "");
+
+  report->BeginResult();
+  report->Add("mode", c.mode);
+  report->Add("message_size", (uint64_t)c.message_size);
+  report->Add("background_connections", (uint64_t)c.background);
+  report->Add("background_message_size", (uint64_t)c.background_size);
+  report->Add("samples", (uint64_t)samples.size());
+  report->Add("p50_us", (uint64_t)p50);
+  report->Add("p90_us", (uint64_t)p90);
+  report->Add("p99_us", (uint64_t)p99);
+  report->Add("p999_us", (uint64_t)p999);
+  report->Add("max_us", (uint64_t)max);
+  report->Add("send_queue_p99_us", (uint64_t)stages.send_queue.p99_us);
+  report->Add("recv_queue_p99_us", (uint64_t)stages.recv_queue.p99_us);
+  report->Add("stats_polls_per_second", polls / elapsed);
+  report->Add("failed", (uint64_t)(failed ? 1 : 0));
+  report->EndResult();
+  return !failed;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> modes = bench::ParseNames(
+      bench::GetFlag(argc, argv, "modes", "blocking,timeout,callback"));
+  std::vector<uint32_t> sizes =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "sizes", "16,1K"));
+  std::vector<uint32_t> backgrounds =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "background", "0,2"));
+  uint32_t count = (uint32_t)atoi(bench::GetFlag(argc, argv, "count", "10000"));
+  uint32_t warmup = (uint32_t)atoi(bench::GetFlag(argc, argv, "warmup", "200"));
+  std::vector<uint32_t> background_size =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "background-size", "16K"));
+  int32_t timeout_ms = atoi(bench::GetFlag(argc, argv, "timeout-ms", "1"));
+  const char* host = bench::GetFlag(argc, argv, "host", nullptr);
+  uint16_t port = (uint16_t)atoi(bench::GetFlag(argc, argv, "port", "20557"));
+  const char* json = bench::GetFlag(argc, argv, "json", "");
+  if (background_size.empty() || background_size[0] == 0 ||
+      background_size[0] > kSendBufferSize / 4 || timeout_ms <= 0) {
+    fprintf(stderr, "Invalid --background-size or --timeout-ms.\n");
+    return 1;
+  }
+
+  for (const std::string& mode : modes) {
+    if (mode != "blocking" && mode != "timeout" && mode != "callback") {
+      fprintf(stderr, "Unknown mode %s.\n", mode.c_str());
+      return 1;
+    }
+  }
+
+  RawQuicTestServer server;
+  if (host == nullptr) {
+    if (!server.Start(argv[0], port)) {
+      return 1;
+    }
+    host = server.host();
+  }
+
+  bench::Report report("rawquic_latency_bench");
+  bool passed = true;
+  for (uint32_t background : backgrounds) {
+    for (const std::string& mode : modes) {
+      for (uint32_t size : sizes) {
+        Case c = {mode,       size,               count,     warmup,
+                  background, background_size[0], timeout_ms};
+        passed = RunCase(host, port, c, &report) && passed;
+      }
+    }
+  }
+
+  server.Stop();
+  if (!report.Write(json)) {
+    return 1;
+  }
+  return passed ? 0 : 1;
+}
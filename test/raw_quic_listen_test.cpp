@@ -0,0 +1,292 @@
+// Echo test of RawQuicListen, client and server handles in one process.
+//
+//   raw_quic_listen_test [port]
+// A certificate is generated into a temp dir, the listener echoes every
+// stream accepted on its own thread with blocking RawQuicRecv/RawQuicSend.
+// On Linux it runs again with several listener threads sharing the port,
+// connections must be served whichever thread the kernel picks, also with
+// 20 byte connection ids the server replaces by its own. Last, one
+// handshake at a time is let through, the next connections are sent a Retry
+// and must come back with its token and connect, each counted once.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/files/scoped_temp_dir.h"
+#include "net/quic/raw_quic/raw_quic_session_pool.h"
+#include "raw_quic_api.h"
+#include "raw_quic_test_certificate.h"
+
+namespace {
+const uint16_t kDefaultPort = 20558;
+const int kConnections = 8;
+
+struct Accepted {
+  RawQuicHandle handle;
+  std::string path;
+};
+
+// Filled on IO threads by AcceptCallback, drained by the echo thread.
+class AcceptQueue {
+ public:
+  void Push(RawQuicHandle handle, const char* path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_.push_back({handle, path});
+    cond_.notify_all();
+  }
+
+  // Returns false once stopped and empty.
+  bool Pop(Accepted* accepted) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return stopped_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      return false;
+    }
+    *accepted = queue_.front();
+    queue_.pop_front();
+    return true;
+  }
+
+  void Stop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopped_ = true;
+    cond_.notify_all();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::deque<Accepted> queue_;
+  bool stopped_ = false;
+};
+
+struct EchoServer {
+  AcceptQueue queue;
+  std::mutex mutex;
+  std::vector<std::string> paths;
+};
+
+void OnAccept(RawQuicListenerHandle listener,
+              RawQuicHandle handle,
+              const char* path,
+              void* opaque) {
+  // Handle can't be used here, it's only queued.
+  ((EchoServer*)opaque)->queue.Push(handle, path);
+}
+
+// Echoes until the client goes away, then frees the handle.
+void EchoLoop(EchoServer* server) {
+  Accepted accepted;
+  while (server->queue.Pop(&accepted)) {
+    {
+      std::unique_lock<std::mutex> lock(server->mutex);
+      server->paths.push_back(accepted.path);
+    }
+
+    std::vector<uint8_t> buffer(64 * 1024);
+    while (true) {
+      int32_t ret =
+          RawQuicRecv(accepted.handle, buffer.data(), buffer.size(), 5000);
+      if (ret <= 0) {
+        break;
+      }
+
+      uint32_t size = ret;
+      uint32_t sent = 0;
+      while (sent < size) {
+        ret = RawQuicSend(accepted.handle, buffer.data() + sent, size - sent);
+        if (ret < 0) {
+          break;
+        }
+        sent += ret;
+      }
+      if (sent < size) {
+        break;
+      }
+    }
+    RawQuicClose(accepted.handle);
+  }
+}
+
+// Echo of size bytes must come back intact.
+bool EchoOnce(RawQuicHandle handle, uint32_t size) {
+  std::vector<uint8_t> message(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    message[i] = (uint8_t)(i * 131 + size);
+  }
+
+  uint32_t sent = 0;
+  while (sent < size) {
+    int32_t ret = RawQuicSend(handle, message.data() + sent, size - sent);
+    if (ret < 0) {
+      printf("RawQuicSend failed %d.\n", ret);
+      return false;
+    }
+    sent += ret;
+  }
+
+  std::vector<uint8_t> echo(size);
+  uint32_t received = 0;
+  while (received < size) {
+    int32_t ret =
+        RawQuicRecv(handle, echo.data() + received, size - received, 5000);
+    if (ret < 0) {
+      printf("RawQuicRecv failed %d, %u of %u bytes received.\n", ret,
+             received, size);
+      return false;
+    }
+    received += ret;
+  }
+
+  if (memcmp(echo.data(), message.data(), size) != 0) {
+    printf("Echo of %u bytes mismatch.\n", size);
+    return false;
+  }
+  return true;
+}
+
+bool TestEcho(uint16_t port) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  RawQuicHandle handle = RawQuicOpen(callbacks, NULL, false);
+  if (handle == 0) {
+    printf("RawQuicOpen failed.\n");
+    return false;
+  }
+
+  bool passed = false;
+  do {
+    int32_t ret = RawQuicConnect(handle, "127.0.0.1", port, "echo", 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicConnect echo failed %d.\n", ret);
+      break;
+    }
+
+    const uint32_t sizes[] = {1, 100, 1350, 64 * 1024, 256 * 1024};
+    bool echoed = true;
+    for (uint32_t size : sizes) {
+      echoed = echoed && EchoOnce(handle, size);
+    }
+    passed = echoed;
+  } while (0);
+
+  RawQuicClose(handle);
+  return passed;
+}
+
+// All connections must be echoed and accepted with their path. limit NULL
+// keeps the default, far above what the test opens.
+bool TestListen(uint16_t port,
+                uint32_t threads,
+                const RawQuicHandshakeLimit* limit,
+                const base::FilePath& cert_path,
+                const base::FilePath& key_path) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  EchoServer server;
+  RawQuicListenerHandle listener = 0;
+  int32_t ret = RawQuicListen("127.0.0.1", port,
+                              cert_path.AsUTF8Unsafe().c_str(),
+                              key_path.AsUTF8Unsafe().c_str(), threads,
+                              OnAccept, callbacks, &server, &listener);
+  if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    printf("RawQuicListen with %u threads failed %d.\n", threads, ret);
+    return false;
+  }
+  if (limit != NULL) {
+    ret = RawQuicSetHandshakeLimit(listener, limit);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicSetHandshakeLimit failed %d.\n", ret);
+      RawQuicStopListen(listener);
+      return false;
+    }
+  }
+  std::thread echo_thread(EchoLoop, &server);
+
+  // Each connection's stream must be accepted as its own handle.
+  bool passed = true;
+  for (int i = 0; i < kConnections; ++i) {
+    passed = TestEcho(port) && passed;
+  }
+
+  RawQuicListenerStats stats;
+  RawQuicGetListenerStats(listener, &stats);
+  RawQuicStopListen(listener);
+  server.queue.Stop();
+  echo_thread.join();
+
+  bool paths_ok = (int)server.paths.size() == kConnections;
+  for (const std::string& path : server.paths) {
+    paths_ok = paths_ok && path == "echo";
+  }
+  // Retransmitted Initials go to the session admitted first, each
+  // connection counts once however often it was dropped before.
+  bool accepted = (int)stats.handshakes_accepted == kConnections;
+  // Validated tokens prove the QUIC_VERSION_99 client took the draft-25
+  // Retry, integrity tag included, rather than retransmitting its Initial.
+  bool retried = limit == NULL || !limit->retry ||
+                 (stats.handshakes_retried > 0 &&
+                  stats.handshakes_validated > 0 &&
+                  stats.handshakes_validated <= stats.handshakes_retried);
+  passed = passed && paths_ok && accepted && retried &&
+           stats.threads == std::max(threads, 1u);
+  printf("listen threads=%u: %s, %llu packets, %llu forwarded, "
+         "%llu handshakes, %llu retried, %llu validated, %llu dropped\n",
+         threads, passed ? "ok" : "failed",
+         (unsigned long long)stats.packets_received,
+         (unsigned long long)stats.packets_forwarded,
+         (unsigned long long)stats.handshakes_accepted,
+         (unsigned long long)stats.handshakes_retried,
+         (unsigned long long)stats.handshakes_validated,
+         (unsigned long long)stats.handshakes_dropped);
+  return passed;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager exit_manager;
+  uint16_t port = (uint16_t)(argc > 1 ? atoi(argv[1]) : kDefaultPort);
+
+  base::ScopedTempDir temp_dir;
+  base::FilePath cert_path;
+  base::FilePath key_path;
+  if (!temp_dir.CreateUniqueTempDir() ||
+      !GenerateCertificate(temp_dir.GetPath(), &cert_path, &key_path)) {
+    printf("Generate certificate failed.\n");
+    printf("FAILED\n");
+    return 1;
+  }
+
+  bool passed = TestListen(port, 1, NULL, cert_path, key_path);
+#if defined(__linux__)
+  passed = TestListen(port, 4, NULL, cert_path, key_path) && passed;
+
+  // Replacement must steer to the thread that took the Initial.
+  net::RawQuicSessionPool::SetConnectionIdLengthForTesting(20);
+  passed = TestListen(port, 4, NULL, cert_path, key_path) && passed;
+  net::RawQuicSessionPool::SetConnectionIdLengthForTesting(0);
+#endif
+
+  // Bucket is below half when the next connection comes, which is retried,
+  // then dropped until the bucket refills and the client retransmits.
+  RawQuicHandshakeLimit limit;
+  limit.handshakes_per_second = 2;
+  limit.burst = 1;
+  limit.retry = true;
+  passed = TestListen(port, 1, &limit, cert_path, key_path) && passed;
+
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,204 @@
+// Hermetic echo test against rawquic_test_server on 127.0.0.1.
+//
+//   raw_quic_loopback_test [port]
+// The server is started as a child process, see raw_quic_test_server.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <future>
+#include <vector>
+
+#include "raw_quic_api.h"
+#include "raw_quic_test_server.h"
+
+namespace {
+// Echo of size bytes must come back intact.
+bool EchoOnce(RawQuicHandle handle, uint32_t size) {
+  std::vector<uint8_t> message(size);
+  for (uint32_t i = 0; i < size; ++i) {
+    message[i] = (uint8_t)(i * 131 + size);
+  }
+
+  uint32_t sent = 0;
+  while (sent < size) {
+    int32_t ret = RawQuicSend(handle, message.data() + sent, size - sent);
+    if (ret < 0) {
+      printf("RawQuicSend failed %d.\n", ret);
+      return false;
+    }
+    sent += ret;
+  }
+
+  std::vector<uint8_t> echo(size);
+  uint32_t received = 0;
+  while (received < size) {
+    int32_t ret =
+        RawQuicRecv(handle, echo.data() + received, size - received, 5000);
+    if (ret < 0) {
+      printf("RawQuicRecv failed %d, %u of %u bytes received.\n", ret,
+             received, size);
+      return false;
+    }
+    received += ret;
+  }
+
+  if (memcmp(echo.data(), message.data(), size) != 0) {
+    printf("Echo of %u bytes mismatch.\n", size);
+    return false;
+  }
+  return true;
+}
+
+bool TestEcho(const RawQuicTestServer& server) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  RawQuicHandle handle = RawQuicOpen(callbacks, NULL, false);
+  if (handle == 0) {
+    printf("RawQuicOpen failed.\n");
+    return false;
+  }
+
+  bool passed = false;
+  do {
+    int32_t ret =
+        RawQuicConnect(handle, server.host(), server.port(), "echo", 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicConnect echo failed %d.\n", ret);
+      break;
+    }
+
+    const uint32_t sizes[] = {1, 100, 1350, 64 * 1024, 256 * 1024};
+    bool echoed = true;
+    for (uint32_t size : sizes) {
+      echoed = echoed && EchoOnce(handle, size);
+    }
+    passed = echoed;
+  } while (0);
+
+  RawQuicClose(handle);
+  printf("echo: %s\n", passed ? "ok" : "failed");
+  return passed;
+}
+
+// FIN without any data written, the echo must end with one too.
+bool TestShutdownWriteEmpty(const RawQuicTestServer& server) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  RawQuicHandle handle = RawQuicOpen(callbacks, NULL, false);
+  if (handle == 0) {
+    printf("RawQuicOpen failed.\n");
+    return false;
+  }
+
+  bool passed = false;
+  do {
+    int32_t ret =
+        RawQuicConnect(handle, server.host(), server.port(), "echo", 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicConnect echo failed %d.\n", ret);
+      break;
+    }
+
+    ret = RawQuicShutdownWrite(handle);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicShutdownWrite failed %d.\n", ret);
+      break;
+    }
+
+    uint8_t data[16];
+    ret = RawQuicRecv(handle, data, sizeof(data), 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_STREAM_FIN) {
+      printf("RawQuicRecv after empty upload returned %d.\n", ret);
+      break;
+    }
+    passed = true;
+  } while (0);
+
+  RawQuicClose(handle);
+  printf("shutdown write empty: %s\n", passed ? "ok" : "failed");
+  return passed;
+}
+
+void DiscardShutdownCallback(RawQuicHandle handle,
+                             RawQuicError* error,
+                             void* opaque) {
+  ((std::promise<int32_t>*)opaque)->set_value(error->error);
+}
+
+// chunks of 16KB are sent, none for a handle that never wrote, which must
+// still send its FIN and finish.
+bool TestDiscard(const RawQuicTestServer& server, int chunks) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  std::promise<int32_t> shutdown;
+  RawQuicHandle handle = RawQuicOpen(callbacks, &shutdown, false);
+  if (handle == 0) {
+    printf("RawQuicOpen failed.\n");
+    return false;
+  }
+  RawQuicSetShutdownCallback(handle, DiscardShutdownCallback);
+
+  bool passed = false;
+  do {
+    int32_t ret =
+        RawQuicConnect(handle, server.host(), server.port(), "discard", 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicConnect discard failed %d.\n", ret);
+      break;
+    }
+
+    uint8_t chunk[16 * 1024];
+    memset(chunk, 'd', sizeof(chunk));
+    for (int i = 0; i < chunks; ++i) {
+      ret = RawQuicSend(handle, chunk, sizeof(chunk));
+      if (ret < 0) {
+        printf("RawQuicSend failed %d.\n", ret);
+        break;
+      }
+    }
+
+    // Everything sent must be acked by the sink before linger expires.
+    ret = RawQuicShutdown(handle, 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicShutdown failed %d.\n", ret);
+      break;
+    }
+
+    ret = shutdown.get_future().get();
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("Shutdown finished with %d.\n", ret);
+      break;
+    }
+    passed = true;
+  } while (0);
+
+  RawQuicClose(handle);
+  printf("discard %d chunks: %s\n", chunks, passed ? "ok" : "failed");
+  return passed;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  uint16_t port = (uint16_t)(argc > 1 ? atoi(argv[1])
+                                      : RawQuicTestServer::kDefaultPort);
+
+  RawQuicTestServer server;
+  if (!server.Start(argv[0], port)) {
+    printf("FAILED\n");
+    return 1;
+  }
+
+  bool passed = TestEcho(server);
+  passed = TestShutdownWriteEmpty(server) && passed;
+  passed = TestDiscard(server, 16) && passed;
+  passed = TestDiscard(server, 0) && passed;
+  server.Stop();
+
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 1;
+}
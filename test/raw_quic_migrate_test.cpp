@@ -0,0 +1,301 @@
+// Connection migration test between two loopback addresses.
+//
+//   raw_quic_migrate_test [port] [path] [ip_a] [ip_b]
+// Starts rawquic_test_server on port, see raw_quic_test_server.h.
+// Linux routes the whole 127.0.0.0/8 to lo, so 127.0.0.1 and 127.0.0.2 can
+// be used without configuring the interface. Last, a connection through a
+// relay that drops packets of any new client address must time out probing
+// and stay on its path.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "raw_quic_api.h"
+#include "raw_quic_test_server.h"
+
+#if defined(_WIN32)
+typedef SOCKET SocketFd;
+static const SocketFd kInvalidSocket = INVALID_SOCKET;
+static void CloseSocket(SocketFd fd) {
+  closesocket(fd);
+}
+#else
+typedef int SocketFd;
+static const SocketFd kInvalidSocket = -1;
+static void CloseSocket(SocketFd fd) {
+  close(fd);
+}
+#endif
+
+// UDP relay on 127.0.0.1 to the server. Only the first client address is
+// relayed, packets of any other are dropped, so probes of a migration get
+// no answer while the connection keeps working on its path.
+class BlackholeRelay {
+ public:
+  BlackholeRelay() : stopped_(false), dropped_(0) {}
+  ~BlackholeRelay() { Stop(); }
+
+  bool Start(const char* server_host, uint16_t server_port) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    char port[8];
+    snprintf(port, sizeof(port), "%u", server_port);
+    struct addrinfo* server = NULL;
+    if (getaddrinfo(server_host, port, &hints, &server) != 0) {
+      return false;
+    }
+    back_ = socket(AF_INET, SOCK_DGRAM, 0);
+    bool connected = back_ != kInvalidSocket &&
+                     connect(back_, server->ai_addr,
+                             (int)server->ai_addrlen) == 0;
+    freeaddrinfo(server);
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(local);
+    front_ = socket(AF_INET, SOCK_DGRAM, 0);
+    if (!connected || front_ == kInvalidSocket ||
+        bind(front_, (struct sockaddr*)&local, sizeof(local)) != 0 ||
+        getsockname(front_, (struct sockaddr*)&local, &len) != 0) {
+      return false;
+    }
+    port_ = ntohs(local.sin_port);
+    thread_ = std::thread(&BlackholeRelay::Run, this);
+    return true;
+  }
+
+  void Stop() {
+    stopped_.store(true);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    if (front_ != kInvalidSocket) {
+      CloseSocket(front_);
+      front_ = kInvalidSocket;
+    }
+    if (back_ != kInvalidSocket) {
+      CloseSocket(back_);
+      back_ = kInvalidSocket;
+    }
+  }
+
+  uint16_t port() const { return port_; }
+
+  uint64_t dropped() const { return dropped_.load(); }
+
+ private:
+  void Run() {
+    char buffer[2048];
+    bool has_client = false;
+    struct sockaddr_in client;
+    memset(&client, 0, sizeof(client));
+    while (!stopped_.load()) {
+      fd_set fds;
+      FD_ZERO(&fds);
+      FD_SET(front_, &fds);
+      FD_SET(back_, &fds);
+      struct timeval timeout = {0, 100 * 1000};
+      if (select((int)std::max(front_, back_) + 1, &fds, NULL, NULL,
+                 &timeout) <= 0) {
+        continue;
+      }
+
+      if (FD_ISSET(front_, &fds)) {
+        struct sockaddr_in from;
+        socklen_t len = sizeof(from);
+        int size = recvfrom(front_, buffer, sizeof(buffer), 0,
+                            (struct sockaddr*)&from, &len);
+        if (size > 0 && !has_client) {
+          client = from;
+          has_client = true;
+        }
+        if (size > 0 && from.sin_port == client.sin_port &&
+            from.sin_addr.s_addr == client.sin_addr.s_addr) {
+          send(back_, buffer, size, 0);
+        } else if (size > 0) {
+          dropped_.fetch_add(1);
+        }
+      }
+
+      if (FD_ISSET(back_, &fds)) {
+        int size = recv(back_, buffer, sizeof(buffer), 0);
+        if (size > 0 && has_client) {
+          sendto(front_, buffer, size, 0, (struct sockaddr*)&client,
+                 sizeof(client));
+        }
+      }
+    }
+  }
+
+  SocketFd front_ = kInvalidSocket;
+  SocketFd back_ = kInvalidSocket;
+  uint16_t port_ = 0;
+  std::atomic<bool> stopped_;
+  std::atomic<uint64_t> dropped_;
+  std::thread thread_;
+};
+
+static bool EchoOnce(RawQuicHandle handle, const char* message) {
+  uint32_t len = (uint32_t)strlen(message);
+  int32_t ret = RawQuicSend(handle, (uint8_t*)message, len);
+  if (ret != (int32_t)len) {
+    printf("RawQuicSend failed %d.\n", ret);
+    return false;
+  }
+
+  char buffer[1024] = {0};
+  uint32_t received = 0;
+  while (received < len) {
+    ret = RawQuicRecv(handle, (uint8_t*)buffer + received,
+                      sizeof(buffer) - 1 - received, 5000);
+    if (ret < 0) {
+      printf("RawQuicRecv failed %d.\n", ret);
+      return false;
+    }
+    received += ret;
+  }
+
+  if (memcmp(buffer, message, len) != 0) {
+    printf("Echo mismatch, sent %s, received %s.\n", message, buffer);
+    return false;
+  }
+  return true;
+}
+
+static bool MigrateAndEcho(RawQuicHandle handle,
+                           const char* local_ip,
+                           const char* message) {
+  int32_t ret = RawQuicMigrate(handle, local_ip, 3000);
+  if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    printf("RawQuicMigrate to %s failed %d.\n",
+           local_ip != NULL ? local_ip : "(rebind)", ret);
+    return false;
+  }
+  printf("Migrated to %s.\n", local_ip != NULL ? local_ip : "(rebind)");
+  return EchoOnce(handle, message);
+}
+
+// Probe path bound fine but never answered, RawQuicMigrate must wait out
+// the probe retries and report TIMEOUT with the connection still usable.
+static bool TestUnansweredProbe(const char* host, uint16_t port,
+                                const char* path) {
+  BlackholeRelay relay;
+  if (!relay.Start(host, port)) {
+    printf("Start relay to %s:%u failed.\n", host, port);
+    return false;
+  }
+
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+  RawQuicHandle handle = RawQuicOpen(callbacks, NULL, false);
+  if (handle == 0) {
+    printf("RawQuicOpen failed.\n");
+    return false;
+  }
+
+  bool passed = false;
+  do {
+    int32_t ret = RawQuicConnect(handle, "127.0.0.1", relay.port(), path, 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicConnect through relay failed %d.\n", ret);
+      break;
+    }
+
+    if (!EchoOnce(handle, "through relay")) {
+      break;
+    }
+
+    // Waits for the probe result rather than a timeout of its own.
+    ret = RawQuicMigrate(handle, NULL, -1);
+    printf("RawQuicMigrate to unanswered path return %d, %llu dropped.\n",
+           ret, (unsigned long long)relay.dropped());
+    if (ret != RAW_QUIC_ERROR_CODE_TIMEOUT || relay.dropped() == 0 ||
+        !EchoOnce(handle, "after failed migration")) {
+      break;
+    }
+
+    passed = true;
+  } while (0);
+
+  RawQuicClose(handle);
+  relay.Stop();
+  return passed;
+}
+
+int main(int argc, char** argv) {
+#if defined(_WIN32)
+  WSADATA wsa_data;
+  WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+  uint16_t port = (uint16_t)(argc > 1 ? atoi(argv[1])
+                                      : RawQuicTestServer::kDefaultPort);
+  const char* path = argc > 2 ? argv[2] : "echo";
+  const char* ip_a = argc > 3 ? argv[3] : "127.0.0.1";
+  const char* ip_b = argc > 4 ? argv[4] : "127.0.0.2";
+
+  RawQuicTestServer server;
+  if (!server.Start(argv[0], port)) {
+    printf("FAILED\n");
+    return 1;
+  }
+
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  bool passed = false;
+  RawQuicHandle handle = RawQuicOpen(callbacks, NULL, false);
+  do {
+    if (handle == 0) {
+      printf("RawQuicOpen failed.\n");
+      break;
+    }
+
+    int32_t ret = RawQuicConnect(handle, server.host(), server.port(), path,
+                                 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicConnect failed %d.\n", ret);
+      break;
+    }
+
+    // Stream state must survive every hop.
+    if (!EchoOnce(handle, "before migration") ||
+        !MigrateAndEcho(handle, ip_b, "after migration to b") ||
+        !MigrateAndEcho(handle, ip_a, "after migration back to a") ||
+        !MigrateAndEcho(handle, NULL, "after port rebinding")) {
+      break;
+    }
+
+    passed = true;
+  } while (0);
+
+  if (handle != 0) {
+    RawQuicClose(handle);
+  }
+
+  passed = passed && TestUnansweredProbe(server.host(), server.port(), path);
+  server.Stop();
+
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 1;
+}
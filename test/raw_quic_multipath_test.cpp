@@ -0,0 +1,142 @@
+// Experimental multipath test on one host.
+//
+//   raw_quic_multipath_test [scheduler] [delay_a_ms] [delay_b_ms] [seconds]
+//                           [port] [path] [ip_b]
+// Starts rawquic_test_server on port, see raw_quic_test_server.h.
+// scheduler is min_rtt or redundant. Echo goodput is measured on the
+// primary path alone, then with a second path bound to ip_b. Path delays
+// are simulated by the client writer once multipath is on, so no netem is
+// needed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "raw_quic_api.h"
+#include "raw_quic_test_server.h"
+
+namespace {
+const uint32_t kChunkSize = 4 * 1024;
+const uint32_t kWindowSize = 256 * 1024;
+
+// Echo goodput in Mbps, or negative on error.
+double MeasureEcho(RawQuicHandle handle, int seconds) {
+  uint8_t chunk[kChunkSize];
+  memset(chunk, 'm', sizeof(chunk));
+  uint8_t buffer[64 * 1024];
+
+  uint64_t sent = 0;
+  uint64_t received = 0;
+  auto start = std::chrono::steady_clock::now();
+  auto end = start + std::chrono::seconds(seconds);
+  while (std::chrono::steady_clock::now() < end) {
+    if (sent - received < kWindowSize) {
+      int32_t ret = RawQuicSend(handle, chunk, kChunkSize);
+      if (ret < 0) {
+        printf("RawQuicSend failed %d.\n", ret);
+        return -1;
+      }
+      sent += ret;
+      continue;
+    }
+
+    int32_t ret = RawQuicRecv(handle, buffer, sizeof(buffer), 100);
+    if (ret < 0 && ret != RAW_QUIC_ERROR_CODE_TIMEOUT) {
+      printf("RawQuicRecv failed %d.\n", ret);
+      return -1;
+    }
+    received += ret > 0 ? ret : 0;
+  }
+
+  // Drain what is still in flight so the next phase starts clean.
+  while (received < sent) {
+    int32_t ret = RawQuicRecv(handle, buffer, sizeof(buffer), 5000);
+    if (ret < 0) {
+      printf("RawQuicRecv failed %d, %llu bytes missing.\n", ret,
+             (unsigned long long)(sent - received));
+      return -1;
+    }
+    received += ret;
+  }
+
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  return received * 8 / elapsed / 1e6;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  const char* scheduler_name = argc > 1 ? argv[1] : "min_rtt";
+  uint32_t delay_a = (uint32_t)(argc > 2 ? atoi(argv[2]) : 0);
+  uint32_t delay_b = (uint32_t)(argc > 3 ? atoi(argv[3]) : 0);
+  int seconds = argc > 4 ? atoi(argv[4]) : 5;
+  uint16_t port = (uint16_t)(argc > 5 ? atoi(argv[5])
+                                      : RawQuicTestServer::kDefaultPort);
+  const char* path = argc > 6 ? argv[6] : "echo";
+  const char* ip_b = argc > 7 ? argv[7] : "127.0.0.2";
+
+  RawQuicTestServer server;
+  if (!server.Start(argv[0], port)) {
+    printf("FAILED\n");
+    return 1;
+  }
+
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  bool passed = false;
+  RawQuicHandle handle = RawQuicOpen(callbacks, NULL, false);
+  do {
+    if (handle == 0) {
+      printf("RawQuicOpen failed.\n");
+      break;
+    }
+
+    int32_t ret = RawQuicConnect(handle, server.host(), server.port(), path,
+                                 5000);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicConnect failed %d.\n", ret);
+      break;
+    }
+
+    double single = MeasureEcho(handle, seconds);
+    if (single < 0) {
+      break;
+    }
+    printf("single path: %.2f Mbps\n", single);
+
+    RawQuicMultipathConfig config;
+    memset(&config, 0, sizeof(config));
+    config.local_ip = ip_b;
+    config.scheduler = strcmp(scheduler_name, "redundant") == 0
+                           ? RAW_QUIC_MULTIPATH_SCHEDULER_REDUNDANT
+                           : RAW_QUIC_MULTIPATH_SCHEDULER_MIN_RTT;
+    config.primary_delay_ms = delay_a;
+    config.secondary_delay_ms = delay_b;
+    ret = RawQuicEnableMultipath(handle, &config);
+    if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+      printf("RawQuicEnableMultipath failed %d.\n", ret);
+      break;
+    }
+
+    double multi = MeasureEcho(handle, seconds);
+    if (multi < 0) {
+      break;
+    }
+    printf("multipath %s (delay %u/%u ms): %.2f Mbps\n", scheduler_name,
+           delay_a, delay_b, multi);
+
+    passed = true;
+  } while (0);
+
+  if (handle != 0) {
+    RawQuicClose(handle);
+  }
+  server.Stop();
+
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 1;
+}
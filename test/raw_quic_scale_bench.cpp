@@ -0,0 +1,424 @@
+// Many-connection scalability and soak benchmark of librawquic against a
+// local server.
+//
+//   rawquic_scale_bench [--counts=1,100,1000,10000] [--connect-window=256]
+//                       [--idle-seconds=5] [--active-seconds=5]
+//                       [--active-interval-ms=1000] [--message-size=64]
+//                       [--soak-seconds=0] [--soak-threads=8]
+//                       [--host=127.0.0.1 --port=20557] [--json=result.json]
+//
+// Without --host, rawquic_test_server is started as a child process. For
+// each count N, with pooling off so every handle has its own connection:
+//   connect  N handles connect asynchronously, at most --connect-window
+//            handshakes in flight, reported as handshakes/s.
+//   idle     Nothing is sent for --idle-seconds, the CPU spent is the cost
+//            of timers and keep-alives, reported in ms/s.
+//   active   Every handle echoes --message-size bytes once per
+//            --active-interval-ms, from a few driver threads.
+//   close    All handles are closed.
+// RSS is sampled around each phase, RSS per connection is the growth over
+// the connect phase divided by N. Up to 50000 connections need the open
+// file limit, which is raised to the hard limit at start.
+//
+// --soak-seconds runs open/connect/echo/close cycles on --soak-threads
+// threads afterwards, printing RSS every 10 seconds. RSS should settle
+// after warm-up, steady growth per cycle points at a leak in
+// RawQuicOpen/RawQuicClose.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "raw_quic_api.h"
+#include "raw_quic_bench_util.h"
+#include "raw_quic_test_server.h"
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const int kConnectTimeoutSeconds = 30;
+const int kMaxDriverThreads = 4;
+const int kSoakSampleSeconds = 10;
+const uint32_t kRecvChunkSize = 16 * 1024;
+
+struct Options {
+  const char* host;
+  uint16_t port;
+  uint32_t connect_window;
+  int idle_seconds;
+  int active_seconds;
+  int active_interval_ms;
+  uint32_t message_size;
+};
+
+// Counts results of asynchronous connects.
+class ConnectTracker {
+ public:
+  static void RAW_QUIC_CALLBACK OnConnect(RawQuicHandle handle,
+                                          RawQuicError* error,
+                                          void* opaque) {
+    ConnectTracker* tracker = (ConnectTracker*)opaque;
+    std::lock_guard<std::mutex> lock(tracker->mutex_);
+    ++tracker->done_;
+    if (error->error == RAW_QUIC_ERROR_CODE_SUCCESS) {
+      ++tracker->succeeded_;
+    }
+    tracker->cv_.notify_all();
+  }
+
+  // Waits until at most pending connects are unfinished out of started.
+  bool Wait(uint32_t started, uint32_t pending, Clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return cv_.wait_until(lock, deadline, [this, started, pending] {
+      return done_ + pending >= started;
+    });
+  }
+
+  uint32_t succeeded() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return succeeded_;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  uint32_t done_ = 0;
+  uint32_t succeeded_ = 0;
+};
+
+struct CpuSample {
+  double process_ms;
+  double io_thread_ms;
+};
+
+CpuSample SampleCpu() {
+  CpuSample sample = {bench::GetProcessCpuMs(), bench::GetIoThreadCpuMs()};
+  return sample;
+}
+
+// CPU ms per second since start, io thread -1 if unknown.
+CpuSample CpuRate(const CpuSample& start, double seconds) {
+  CpuSample end = SampleCpu();
+  CpuSample rate;
+  rate.process_ms = (end.process_ms - start.process_ms) / seconds;
+  rate.io_thread_ms = start.io_thread_ms < 0 || end.io_thread_ms < 0
+                          ? -1
+                          : (end.io_thread_ms - start.io_thread_ms) / seconds;
+  return rate;
+}
+
+// Reads whatever is buffered without waiting, returns false on error.
+bool Drain(RawQuicHandle handle, uint8_t* buffer, uint64_t* received) {
+  while (true) {
+    int32_t ret = RawQuicRecv(handle, buffer, kRecvChunkSize, 0);
+    if (ret == RAW_QUIC_ERROR_CODE_EAGAIN) {
+      return true;
+    }
+    if (ret < 0) {
+      return false;
+    }
+    *received += ret;
+  }
+}
+
+// Every handle of [begin, end) echoes one message per interval.
+void DriveActive(const Options& options,
+                 const RawQuicHandle* begin,
+                 const RawQuicHandle* end,
+                 Clock::time_point stop,
+                 std::atomic<uint64_t>* echoed,
+                 std::atomic<uint64_t>* errors) {
+  std::vector<uint8_t> message(options.message_size, 'a');
+  std::vector<uint8_t> buffer(kRecvChunkSize);
+  uint64_t received = 0;
+  uint64_t failed = 0;
+  Clock::time_point tick = Clock::now();
+  while (tick < stop) {
+    for (const RawQuicHandle* handle = begin; handle != end; ++handle) {
+      if (!Drain(*handle, buffer.data(), &received) ||
+          RawQuicSend(*handle, message.data(), options.message_size) < 0) {
+        ++failed;
+      }
+    }
+    tick += std::chrono::milliseconds(options.active_interval_ms);
+    std::this_thread::sleep_until(tick);
+  }
+
+  // Echoes of the last round.
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  for (const RawQuicHandle* handle = begin; handle != end; ++handle) {
+    Drain(*handle, buffer.data(), &received);
+  }
+  *echoed += received;
+  *errors += failed;
+}
+
+bool RunCount(const Options& options, uint32_t count, bench::Report* report) {
+  uint64_t rss_start = bench::GetRssBytes();
+
+  // Connect.
+  ConnectTracker tracker;
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+  callbacks.connect_callback = ConnectTracker::OnConnect;
+
+  std::vector<RawQuicHandle> handles;
+  handles.reserve(count);
+  Clock::time_point start = Clock::now();
+  Clock::time_point deadline =
+      start + std::chrono::seconds(kConnectTimeoutSeconds);
+  for (uint32_t i = 0; i < count; ++i) {
+    if (!tracker.Wait((uint32_t)handles.size(), options.connect_window - 1,
+                      deadline)) {
+      break;
+    }
+
+    RawQuicHandle handle = RawQuicOpen(callbacks, &tracker, false);
+    if (handle == 0) {
+      break;
+    }
+    if (RawQuicConnect(handle, options.host, options.port, "echo", 0) !=
+        RAW_QUIC_ERROR_CODE_SUCCESS) {
+      RawQuicClose(handle);
+      break;
+    }
+    handles.push_back(handle);
+  }
+  tracker.Wait((uint32_t)handles.size(), 0, deadline);
+  double connect_seconds = bench::ElapsedSeconds(start);
+  uint32_t connected = tracker.succeeded();
+  uint64_t rss_connected = bench::GetRssBytes();
+
+  // Idle.
+  CpuSample cpu = SampleCpu();
+  std::this_thread::sleep_for(std::chrono::seconds(options.idle_seconds));
+  CpuSample idle = CpuRate(cpu, options.idle_seconds);
+  uint64_t rss_idle = bench::GetRssBytes();
+
+  // Active.
+  std::atomic<uint64_t> echoed(0);
+  std::atomic<uint64_t> errors(0);
+  size_t thread_count =
+      std::min<size_t>(kMaxDriverThreads, std::max<size_t>(handles.size(), 1));
+  size_t slice = (handles.size() + thread_count - 1) / thread_count;
+  Clock::time_point stop =
+      Clock::now() + std::chrono::seconds(options.active_seconds);
+  cpu = SampleCpu();
+  start = Clock::now();
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i * slice < handles.size(); ++i) {
+    const RawQuicHandle* begin = handles.data() + i * slice;
+    const RawQuicHandle* end =
+        handles.data() + std::min(handles.size(), (i + 1) * slice);
+    threads.emplace_back(DriveActive, std::cref(options), begin, end, stop,
+                         &echoed, &errors);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  CpuSample active = CpuRate(cpu, bench::ElapsedSeconds(start));
+  uint64_t rss_active = bench::GetRssBytes();
+
+  // Close.
+  start = Clock::now();
+  for (RawQuicHandle handle : handles) {
+    RawQuicClose(handle);
+  }
+  double close_seconds = bench::ElapsedSeconds(start);
+  uint64_t rss_closed = bench::GetRssBytes();
+
+  bool failed = connected != count || errors.load() > 0;
+  double rss_per_connection =
+      connected > 0 ? ((double)rss_connected - rss_start) / connected : 0;
+  fprintf(stderr,
+          "conns %-6u connected %-6u %8.0f handshakes/s %8.0f B/conn "
+          "idle io %6.2f ms/s active io %6.2f ms/s %s\n",
+          count, connected, connected / connect_seconds, rss_per_connection,
+          idle.io_thread_ms, active.io_thread_ms, failed ? "FAILED" : "");
+
+  report->BeginResult();
+  report->Add("phase", std::string("scale"));
+  report->Add("connections", (uint64_t)count);
+  report->Add("connected", (uint64_t)connected);
+  report->Add("connect_seconds", connect_seconds);
+  report->Add("handshakes_per_second", connected / connect_seconds);
+  report->Add("rss_start_bytes", rss_start);
+  report->Add("rss_connected_bytes", rss_connected);
+  report->Add("rss_idle_bytes", rss_idle);
+  report->Add("rss_active_bytes", rss_active);
+  report->Add("rss_closed_bytes", rss_closed);
+  report->Add("rss_per_connection_bytes", rss_per_connection);
+  report->Add("idle_process_cpu_ms_per_second", idle.process_ms);
+  report->Add("idle_io_thread_cpu_ms_per_second", idle.io_thread_ms);
+  report->Add("active_process_cpu_ms_per_second", active.process_ms);
+  report->Add("active_io_thread_cpu_ms_per_second", active.io_thread_ms);
+  report->Add("active_echoed_bytes", echoed.load());
+  report->Add("active_errors", errors.load());
+  report->Add("close_seconds", close_seconds);
+  report->Add("failed", (uint64_t)(failed ? 1 : 0));
+  report->EndResult();
+  return !failed;
+}
+
+// One open/connect/echo/close cycle.
+bool SoakCycle(const Options& options, uint8_t* message, uint8_t* buffer) {
+  RawQuicHandle handle =
+      bench::OpenConnected(options.host, options.port, "echo", 0, 0);
+  if (handle == 0) {
+    return false;
+  }
+
+  bool echoed = RawQuicSend(handle, message, options.message_size) >= 0;
+  uint32_t received = 0;
+  while (echoed && received < options.message_size) {
+    int32_t ret = RawQuicRecv(handle, buffer, kRecvChunkSize, 5000);
+    echoed = ret > 0;
+    received += echoed ? ret : 0;
+  }
+  RawQuicClose(handle);
+  return echoed;
+}
+
+bool RunSoak(const Options& options,
+             int seconds,
+             uint32_t thread_count,
+             bench::Report* report) {
+  std::atomic<uint64_t> cycles(0);
+  std::atomic<uint64_t> failures(0);
+  std::atomic<bool> stop(false);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads.emplace_back([&options, &cycles, &failures, &stop] {
+      std::vector<uint8_t> message(options.message_size, 's');
+      std::vector<uint8_t> buffer(kRecvChunkSize);
+      while (!stop.load()) {
+        if (!SoakCycle(options, message.data(), buffer.data())) {
+          ++failures;
+        }
+        ++cycles;
+      }
+    });
+  }
+
+  // The first sample is taken after warm-up, growth is measured from it.
+  Clock::time_point start = Clock::now();
+  uint64_t rss_first = 0;
+  uint64_t cycles_first = 0;
+  uint64_t rss_last = 0;
+  for (int elapsed = kSoakSampleSeconds; elapsed <= seconds;
+       elapsed += kSoakSampleSeconds) {
+    std::this_thread::sleep_until(start + std::chrono::seconds(elapsed));
+    rss_last = bench::GetRssBytes();
+    if (rss_first == 0) {
+      rss_first = rss_last;
+      cycles_first = cycles.load();
+    }
+    fprintf(stderr, "soak %5ds cycles %-9llu failures %-6llu rss %llu\n",
+            elapsed, (unsigned long long)cycles.load(),
+            (unsigned long long)failures.load(),
+            (unsigned long long)rss_last);
+  }
+  stop.store(true);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  double elapsed = bench::ElapsedSeconds(start);
+  uint64_t measured_cycles = cycles.load() - cycles_first;
+  double growth_per_1000_cycles =
+      measured_cycles > 0
+          ? ((double)rss_last - rss_first) * 1000 / measured_cycles
+          : 0;
+  fprintf(stderr,
+          "soak %llu cycles, %.0f cycles/s, rss growth %.0f B per 1000 "
+          "cycles\n",
+          (unsigned long long)cycles.load(), cycles.load() / elapsed,
+          growth_per_1000_cycles);
+
+  report->BeginResult();
+  report->Add("phase", std::string("soak"));
+  report->Add("seconds", elapsed);
+  report->Add("threads", (uint64_t)thread_count);
+  report->Add("cycles", cycles.load());
+  report->Add("cycles_per_second", cycles.load() / elapsed);
+  report->Add("failures", failures.load());
+  report->Add("rss_first_sample_bytes", rss_first);
+  report->Add("rss_last_sample_bytes", rss_last);
+  report->Add("rss_growth_per_1000_cycles_bytes", growth_per_1000_cycles);
+  report->EndResult();
+  return failures.load() == 0;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::vector<uint32_t> counts = bench::ParseSizes(
+      bench::GetFlag(argc, argv, "counts", "1,100,1000,10000"));
+  Options options;
+  options.host = bench::GetFlag(argc, argv, "host", nullptr);
+  options.port =
+      (uint16_t)atoi(bench::GetFlag(argc, argv, "port", "20557"));
+  options.connect_window =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "connect-window", "256"));
+  options.idle_seconds = atoi(bench::GetFlag(argc, argv, "idle-seconds", "5"));
+  options.active_seconds =
+      atoi(bench::GetFlag(argc, argv, "active-seconds", "5"));
+  options.active_interval_ms =
+      atoi(bench::GetFlag(argc, argv, "active-interval-ms", "1000"));
+  options.message_size =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "message-size", "64"));
+  int soak_seconds = atoi(bench::GetFlag(argc, argv, "soak-seconds", "0"));
+  uint32_t soak_threads =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "soak-threads", "8"));
+  const char* json = bench::GetFlag(argc, argv, "json", "");
+  if (options.connect_window == 0 || options.idle_seconds <= 0 ||
+      options.active_seconds <= 0 || options.active_interval_ms <= 0 ||
+      options.message_size == 0 || soak_threads == 0) {
+    fprintf(stderr,
+            "Invalid flags, see the header of raw_quic_scale_bench.cpp.\n");
+    return 1;
+  }
+
+  uint64_t file_limit = bench::RaiseFileLimit();
+  uint32_t max_count = counts.empty()
+                           ? 0
+                           : *std::max_element(counts.begin(), counts.end());
+  if (file_limit < (uint64_t)max_count + 64) {
+    fprintf(stderr, "Open file limit %llu is below %u connections.\n",
+            (unsigned long long)file_limit, max_count);
+  }
+
+  RawQuicTestServer server;
+  if (options.host == nullptr) {
+    if (!server.Start(argv[0], options.port)) {
+      return 1;
+    }
+    options.host = server.host();
+  }
+
+  // Pooling would share connections between handles.
+  RawQuicSetPoolIdleTimeout(0);
+
+  bench::Report report("rawquic_scale_bench");
+  bool passed = true;
+  for (uint32_t count : counts) {
+    passed = RunCount(options, count, &report) && passed;
+  }
+  if (soak_seconds > 0) {
+    passed = RunSoak(options, soak_seconds, soak_threads, &report) && passed;
+  }
+
+  server.Stop();
+  if (!report.Write(json)) {
+    return 1;
+  }
+  return passed ? 0 : 1;
+}
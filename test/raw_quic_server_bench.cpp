@@ -0,0 +1,475 @@
+// Multi-core packet rate benchmark of RawQuicListen against local load
+// generators.
+//
+//   rawquic_server_bench [--threads=1,2,4,8] [--generators=4]
+//                        [--connections=16] [--message-size=1000]
+//                        [--seconds=10] [--port=20559] [--json=result.json]
+//                        [--storm=0] [--storm-connections=16]
+//                        [--handshake-rate=1000] [--handshake-burst=1000]
+//                        [--retry=1]
+//
+// For each listener thread count, a listener is started in this process
+// and --generators load generator processes, this binary again with
+// --generate, upload --message-size messages on --connections connections
+// each as fast as their send buffers drain. Accepted handles discard the
+// data. After a second of warm-up, over --seconds:
+//   packets_per_second   Packets read by the listener, from
+//                        RawQuicGetListenerStats.
+//   forwarded_percent    Packets the kernel delivered to a thread other
+//                        than the connection's, 0 with the steering program.
+//   payload_mbps         Data read from the accepted handles.
+//   cpu_cores            CPU time of this process over wall time.
+// The generators need at least as many cores as the listener threads, else
+// they are the bottleneck, see their packets/s next to the listener's.
+// With --storm=N, each thread count runs again while N more processes
+// connect and close --storm-connections connections each in a loop, as
+// clients reconnecting after a network blip, against the listener limited
+// with RawQuicSetHandshakeLimit by --handshake-rate, --handshake-burst and
+// --retry. payload_mbps then shows what is left for established connections,
+// and per second:
+//   handshakes_per_second  New connections admitted.
+//   retried_per_second     New connections sent a Retry.
+//   dropped_per_second     Initial packets dropped over the limit.
+// Linux only, listener threads share the port with SO_REUSEPORT.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "base/at_exit.h"
+#include "base/files/scoped_temp_dir.h"
+#include "raw_quic_api.h"
+#include "raw_quic_bench_util.h"
+#include "raw_quic_test_certificate.h"
+
+namespace {
+typedef std::chrono::steady_clock Clock;
+
+const int kWarmupSeconds = 1;
+const int kAcceptTimeoutSeconds = 30;
+const int kDrainTimeoutSeconds = 10;
+const uint32_t kSendBufferSize = 1024 * 1024;
+const uint32_t kRecvChunkSize = 64 * 1024;
+const uint32_t kStormConnectTimeoutMs = 2000;
+
+// Values of --generate.
+const int kGenerateUpload = 1;
+const int kGenerateStorm = 2;
+
+struct Options {
+  uint16_t port;
+  uint32_t generators;
+  uint32_t connections;
+  uint32_t message_size;
+  int seconds;
+  uint32_t storm;
+  uint32_t storm_connections;
+  RawQuicHandshakeLimit limit;
+};
+
+/////////////////////////////////////Generator/////////////////////////////////////
+void RunUpload(RawQuicHandle handle,
+               const Options& options,
+               std::atomic<bool>* failed) {
+  std::vector<uint8_t> message(options.message_size, 'u');
+  Clock::time_point end = Clock::now() + std::chrono::seconds(options.seconds);
+  uint32_t pacing_limit = kSendBufferSize / 2;
+  uint32_t sent_since_check = 0;
+  while (Clock::now() < end) {
+    if (sent_since_check + options.message_size > pacing_limit / 2) {
+      if (!bench::WaitSendBuffer(
+              handle, pacing_limit - options.message_size,
+              end + std::chrono::seconds(kDrainTimeoutSeconds))) {
+        failed->store(true);
+        return;
+      }
+      sent_since_check = 0;
+    }
+
+    if (RawQuicSend(handle, message.data(), options.message_size) < 0) {
+      failed->store(true);
+      return;
+    }
+    sent_since_check += options.message_size;
+  }
+}
+
+// Entry of a --generate child, uploads until --seconds passed.
+int RunGenerator(const Options& options) {
+  std::vector<RawQuicHandle> handles;
+  for (uint32_t i = 0; i < options.connections; ++i) {
+    RawQuicHandle handle = bench::OpenConnected(
+        "127.0.0.1", options.port, "discard", kSendBufferSize, 0);
+    if (handle == 0) {
+      break;
+    }
+    handles.push_back(handle);
+  }
+
+  std::atomic<bool> failed(handles.size() != options.connections);
+  std::vector<std::thread> threads;
+  if (!failed.load()) {
+    for (RawQuicHandle handle : handles) {
+      threads.emplace_back(RunUpload, handle, options, &failed);
+    }
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (RawQuicHandle handle : handles) {
+    RawQuicClose(handle);
+  }
+  return failed.load() ? 1 : 0;
+}
+
+void RunReconnect(const Options& options, Clock::time_point end) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+  while (Clock::now() < end) {
+    RawQuicHandle handle = RawQuicOpen(callbacks, NULL, false);
+    if (handle == 0) {
+      return;
+    }
+    // Timeouts are expected once the listener limits handshakes.
+    RawQuicConnect(handle, "127.0.0.1", options.port, "storm",
+                   kStormConnectTimeoutMs);
+    RawQuicClose(handle);
+  }
+}
+
+// Entry of a --generate=2 child, reconnects until --seconds passed.
+int RunStorm(const Options& options) {
+  Clock::time_point end = Clock::now() + std::chrono::seconds(options.seconds);
+  std::vector<std::thread> threads;
+  for (uint32_t i = 0; i < options.storm_connections; ++i) {
+    threads.emplace_back(RunReconnect, options, end);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  return 0;
+}
+
+pid_t SpawnGenerator(const Options& options, int mode, int seconds) {
+  // Built before fork, only exec runs in the child.
+  std::vector<std::string> args = {
+      "rawquic_server_bench",
+      "--generate=" + std::to_string(mode),
+      "--port=" + std::to_string(options.port),
+      "--connections=" + std::to_string(options.connections),
+      "--storm-connections=" + std::to_string(options.storm_connections),
+      "--message-size=" + std::to_string(options.message_size),
+      "--seconds=" + std::to_string(seconds)};
+  std::vector<char*> argv;
+  for (std::string& arg : args) {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(NULL);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    execv("/proc/self/exe", argv.data());
+    _exit(127);
+  }
+  return pid;
+}
+
+//////////////////////////////////////Listener//////////////////////////////////////
+// Accepted handles, each read to the end on a thread of its own. Those of
+// the storm are only closed, on one thread for all.
+class Sink {
+ public:
+  Sink() : closer_(&Sink::CloseDiscarded, this) {}
+
+  ~Sink() {
+    Join();
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopped_ = true;
+      discard_cond_.notify_all();
+    }
+    closer_.join();
+  }
+
+  void Add(RawQuicHandle handle, const std::string& path) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (path == "storm") {
+      discarded_.push_back(handle);
+      discard_cond_.notify_all();
+      return;
+    }
+
+    ++accepted_;
+    threads_.emplace_back(&Sink::Drain, this, handle);
+  }
+
+  uint32_t accepted() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return accepted_;
+  }
+
+  uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+  void Join() {
+    std::vector<std::thread> threads;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      threads.swap(threads_);
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+
+ private:
+  void Drain(RawQuicHandle handle) {
+    std::vector<uint8_t> buffer(kRecvChunkSize);
+    while (true) {
+      int32_t ret = RawQuicRecv(handle, buffer.data(), kRecvChunkSize, 1000);
+      if (ret == RAW_QUIC_ERROR_CODE_TIMEOUT) {
+        continue;
+      }
+      if (ret <= 0) {
+        break;
+      }
+      bytes_.fetch_add(ret, std::memory_order_relaxed);
+    }
+    RawQuicClose(handle);
+  }
+
+  // Handles can't be closed in the accept callback.
+  void CloseDiscarded() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      discard_cond_.wait(lock,
+                         [this] { return stopped_ || !discarded_.empty(); });
+      if (discarded_.empty()) {
+        return;
+      }
+
+      RawQuicHandle handle = discarded_.front();
+      discarded_.pop_front();
+      lock.unlock();
+      RawQuicClose(handle);
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::vector<std::thread> threads_;
+  uint32_t accepted_ = 0;
+  std::atomic<uint64_t> bytes_{0};
+
+  std::condition_variable discard_cond_;
+  std::deque<RawQuicHandle> discarded_;
+  bool stopped_ = false;
+  std::thread closer_;
+};
+
+void OnAccept(RawQuicListenerHandle listener,
+              RawQuicHandle handle,
+              const char* path,
+              void* opaque) {
+  ((Sink*)opaque)->Add(handle, path);
+}
+
+bool RunCase(const Options& options,
+             uint32_t threads,
+             uint32_t storm,
+             const base::FilePath& cert_path,
+             const base::FilePath& key_path,
+             bench::Report* report) {
+  RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
+
+  Sink sink;
+  RawQuicListenerHandle listener = 0;
+  int32_t ret = RawQuicListen(NULL, options.port,
+                              cert_path.AsUTF8Unsafe().c_str(),
+                              key_path.AsUTF8Unsafe().c_str(), threads,
+                              OnAccept, callbacks, &sink, &listener);
+  if (ret != RAW_QUIC_ERROR_CODE_SUCCESS) {
+    fprintf(stderr, "RawQuicListen with %u threads failed %d.\n", threads,
+            ret);
+    return false;
+  }
+  RawQuicSetHandshakeLimit(listener, &options.limit);
+
+  // Generators upload through warm-up and measurement.
+  std::vector<pid_t> generators;
+  for (uint32_t i = 0; i < options.generators; ++i) {
+    pid_t pid = SpawnGenerator(options, kGenerateUpload,
+                               kWarmupSeconds + options.seconds);
+    if (pid > 0) {
+      generators.push_back(pid);
+    }
+  }
+
+  uint32_t expected = options.generators * options.connections;
+  Clock::time_point accept_deadline =
+      Clock::now() + std::chrono::seconds(kAcceptTimeoutSeconds);
+  while (sink.accepted() < expected && Clock::now() < accept_deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  // Storm hits connections already established, and lasts until they end.
+  std::vector<pid_t> storms;
+  for (uint32_t i = 0; i < storm; ++i) {
+    pid_t pid = SpawnGenerator(options, kGenerateStorm,
+                               kWarmupSeconds + options.seconds);
+    if (pid > 0) {
+      storms.push_back(pid);
+    }
+  }
+  std::this_thread::sleep_for(std::chrono::seconds(kWarmupSeconds));
+
+  RawQuicListenerStats begin;
+  RawQuicGetListenerStats(listener, &begin);
+  uint64_t begin_bytes = sink.bytes();
+  double begin_cpu_ms = bench::GetProcessCpuMs();
+  Clock::time_point start = Clock::now();
+
+  std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+
+  RawQuicListenerStats end;
+  RawQuicGetListenerStats(listener, &end);
+  uint64_t end_bytes = sink.bytes();
+  double cpu_ms = bench::GetProcessCpuMs() - begin_cpu_ms;
+  double seconds = bench::ElapsedSeconds(start);
+
+  bool passed =
+      sink.accepted() == expected && generators.size() == options.generators;
+  for (pid_t pid : generators) {
+    int status = 0;
+    waitpid(pid, &status, 0);
+    passed = passed && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  for (pid_t pid : storms) {
+    waitpid(pid, NULL, 0);
+  }
+
+  // Accepted handles read an error once their connections close.
+  RawQuicStopListen(listener);
+  sink.Join();
+
+  uint64_t packets = end.packets_received - begin.packets_received;
+  uint64_t forwarded = end.packets_forwarded - begin.packets_forwarded;
+  double packets_per_second = packets / seconds;
+  double forwarded_percent = packets > 0 ? forwarded * 100.0 / packets : 0;
+  double payload_mbps = (end_bytes - begin_bytes) * 8 / seconds / 1e6;
+  double cpu_cores = cpu_ms / 1000 / seconds;
+  double handshakes_per_second =
+      (end.handshakes_accepted - begin.handshakes_accepted) / seconds;
+  double retried_per_second =
+      (end.handshakes_retried - begin.handshakes_retried) / seconds;
+  double dropped_per_second =
+      (end.handshakes_dropped - begin.handshakes_dropped) / seconds;
+  fprintf(stderr,
+          "threads=%u storm=%u packets/s=%.0f forwarded=%.2f%% "
+          "payload=%.1fMbps cpu=%.2f cores handshakes/s=%.0f retried/s=%.0f "
+          "dropped/s=%.0f %s\n",
+          threads, storm, packets_per_second, forwarded_percent, payload_mbps,
+          cpu_cores, handshakes_per_second, retried_per_second,
+          dropped_per_second, passed ? "" : "FAILED");
+
+  report->BeginResult();
+  report->Add("threads", (uint64_t)threads);
+  report->Add("storm", (uint64_t)storm);
+  report->Add("generators", (uint64_t)options.generators);
+  report->Add("connections", (uint64_t)expected);
+  report->Add("message_size", (uint64_t)options.message_size);
+  report->Add("packets_per_second", packets_per_second);
+  report->Add("forwarded_percent", forwarded_percent);
+  report->Add("payload_mbps", payload_mbps);
+  report->Add("cpu_cores", cpu_cores);
+  report->Add("handshakes_per_second", handshakes_per_second);
+  report->Add("retried_per_second", retried_per_second);
+  report->Add("dropped_per_second", dropped_per_second);
+  report->Add("passed", std::string(passed ? "true" : "false"));
+  report->EndResult();
+  return passed;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager exit_manager;
+
+  Options options;
+  options.port = (uint16_t)atoi(bench::GetFlag(argc, argv, "port", "20559"));
+  options.generators =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "generators", "4"));
+  options.connections =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "connections", "16"));
+  std::vector<uint32_t> message_size =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "message-size", "1000"));
+  options.message_size = message_size.empty() ? 0 : message_size[0];
+  options.seconds = atoi(bench::GetFlag(argc, argv, "seconds", "10"));
+  options.storm = (uint32_t)atoi(bench::GetFlag(argc, argv, "storm", "0"));
+  options.storm_connections =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "storm-connections", "16"));
+  options.limit.handshakes_per_second =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "handshake-rate", "1000"));
+  options.limit.burst =
+      (uint32_t)atoi(bench::GetFlag(argc, argv, "handshake-burst", "1000"));
+  options.limit.retry = atoi(bench::GetFlag(argc, argv, "retry", "1")) != 0;
+  if (options.connections == 0 || options.message_size == 0 ||
+      options.message_size > kSendBufferSize / 4 || options.seconds <= 0 ||
+      options.storm_connections == 0) {
+    fprintf(stderr,
+            "Invalid flags, see the header of raw_quic_server_bench.cpp.\n");
+    return 1;
+  }
+
+  int mode = atoi(bench::GetFlag(argc, argv, "generate", "0"));
+  if (mode == kGenerateUpload) {
+    return RunGenerator(options);
+  }
+  if (mode == kGenerateStorm) {
+    return RunStorm(options);
+  }
+
+  std::vector<uint32_t> threads =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "threads", "1,2,4,8"));
+  const char* json = bench::GetFlag(argc, argv, "json", "");
+
+  base::ScopedTempDir temp_dir;
+  base::FilePath cert_path;
+  base::FilePath key_path;
+  if (!temp_dir.CreateUniqueTempDir() ||
+      !GenerateCertificate(temp_dir.GetPath(), &cert_path, &key_path)) {
+    fprintf(stderr, "Generate certificate failed.\n");
+    return 1;
+  }
+
+  bench::Report report("rawquic_server_bench");
+  bool passed = true;
+  // With a storm, each thread count runs without first, to compare against.
+  for (uint32_t count : threads) {
+    passed =
+        RunCase(options, count, 0, cert_path, key_path, &report) && passed;
+    if (options.storm > 0) {
+      passed = RunCase(options, count, options.storm, cert_path, key_path,
+                       &report) &&
+               passed;
+    }
+  }
+
+  if (!report.Write(json)) {
+    return 1;
+  }
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,609 @@
+// Benchmark of the RawQuic client session over quiche's discrete-event
+// network simulator: reproducible, faster than real time, no sockets.
+//
+//   rawquic_simulator_bench [--workload=upload|echo] [--cc=cubic,bbr]
+//       [--bandwidth-mbps=10] [--rtt-ms=50] [--loss=0,1] [--reorder=0]
+//       [--reorder-delay-ms=5] [--queues=0] [--send-buffer=4M]
+//       [--message-size=16K] [--seconds=30] [--seed=1] [--json=result.json]
+//
+// Topology, the switch port towards the server is the bottleneck:
+//   client --(10 x bandwidth, rtt/4)-- switch --(bandwidth, rtt/4)-- server
+// --queues lists switch port queue sizes in bytes, 0 for one BDP. --loss and
+// --reorder are percents applied to packets of both directions on arrival,
+// a reordered packet is held for --reorder-delay-ms. Both draw from a
+// generator seeded with --seed, so a case gives the same result every run.
+//
+// The client is RawQuicSession, configured as RawQuicSessionPool does, with
+// the simulator feeding it packets instead of a socket. The server is the
+// QuicTransport simple server session, "/discard" for upload and "/echo"
+// for echo. The application keeps at most --send-buffer bytes unacked
+// (upload) or not yet echoed (echo), in --message-size writes.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/files/scoped_temp_dir.h"
+#include "net/quic/raw_quic/raw_quic_session.h"
+#include "net/quic/raw_quic/raw_quic_session_pool.h"
+#include "net/third_party/quiche/src/quic/core/crypto/quic_compressed_certs_cache.h"
+#include "net/third_party/quiche/src/quic/core/crypto/quic_crypto_server_config.h"
+#include "net/third_party/quiche/src/quic/test_tools/quic_connection_peer.h"
+#include "net/third_party/quiche/src/quic/test_tools/quic_test_utils.h"
+#include "net/third_party/quiche/src/quic/test_tools/simulator/link.h"
+#include "net/third_party/quiche/src/quic/test_tools/simulator/queue.h"
+#include "net/third_party/quiche/src/quic/test_tools/simulator/simulator.h"
+#include "net/third_party/quiche/src/quic/test_tools/simulator/switch.h"
+#include "net/third_party/quiche/src/quic/tools/fake_proof_verifier.h"
+#include "net/third_party/quiche/src/quic/tools/quic_transport_simple_server_session.h"
+#include "raw_quic_bench_util.h"
+#include "raw_quic_test_certificate.h"
+#include "url/gurl.h"
+#include "url/origin.h"
+
+namespace {
+namespace simulator = quic::simulator;
+
+typedef std::chrono::steady_clock Clock;
+
+const char kClientName[] = "Client";
+const char kServerName[] = "Server";
+const uint64_t kConnectionId = 0x10;
+const quic::QuicByteCount kTxQueueCapacity =
+    64 * quic::kMaxOutgoingPacketSize;
+const int kAccessLinkSpeedup = 10;
+const int kHandshakeTimeoutSeconds = 10;
+
+struct Case {
+  std::string workload;
+  std::string cc;
+  quic::CongestionControlType cc_type;
+  double bandwidth_mbps;
+  int64_t rtt_ms;
+  double loss_percent;
+  double reorder_percent;
+  int64_t reorder_delay_ms;
+  uint32_t queue_bytes;
+  uint32_t send_buffer_size;
+  uint32_t message_size;
+  int seconds;
+  uint32_t seed;
+};
+
+quic::QuicSocketAddress GetAddress(const char* ip, uint16_t port) {
+  quic::QuicIpAddress address;
+  address.FromString(ip);
+  return quic::QuicSocketAddress(address, port);
+}
+
+/////////////////////////////////////SimulatedEndpoint/////////////////////////////////////
+// Host side of one connection: packets written by the connection go out
+// through a NIC queue, which blocks the writer rather than dropping when
+// full, as a socket buffer does.
+class SimulatedEndpoint : public simulator::Endpoint,
+                          public simulator::UnconstrainedPortInterface,
+                          public simulator::Queue::ListenerInterface,
+                          public quic::QuicPacketWriter {
+ public:
+  SimulatedEndpoint(simulator::Simulator* simulator,
+                    const std::string& name,
+                    const std::string& peer_name)
+      : Endpoint(simulator, name),
+        peer_name_(peer_name),
+        tx_queue_(simulator, name + " TX queue", kTxQueueCapacity) {
+    tx_queue_.set_listener_interface(this);
+  }
+
+  // Received packets go to session if not null, else to connection.
+  void Attach(quic::QuicConnection* connection, net::RawQuicSession* session) {
+    connection_ = connection;
+    session_ = session;
+  }
+
+  // simulator::Endpoint
+  simulator::UnconstrainedPortInterface* GetRxPort() override { return this; }
+
+  void SetTxPort(simulator::ConstrainedPortInterface* port) override {
+    tx_queue_.set_tx_port(port);
+  }
+
+  void Act() override {}
+
+  // simulator::UnconstrainedPortInterface
+  void AcceptPacket(std::unique_ptr<simulator::Packet> packet) override {
+    if (packet->destination != name_ || connection_ == nullptr) {
+      return;
+    }
+
+    quic::QuicReceivedPacket received(packet->contents.data(),
+                                      packet->contents.size(), clock_->Now());
+    if (session_ != nullptr) {
+      session_->OnPacket(received, connection_->self_address(),
+                         connection_->peer_address());
+    } else {
+      connection_->ProcessUdpPacket(connection_->self_address(),
+                                    connection_->peer_address(), received);
+    }
+  }
+
+  // simulator::Queue::ListenerInterface
+  void OnPacketDequeued() override {
+    if (write_blocked_ && connection_ != nullptr &&
+        tx_queue_.capacity() - tx_queue_.bytes_queued() >=
+            quic::kMaxOutgoingPacketSize) {
+      write_blocked_ = false;
+      connection_->OnCanWrite();
+    }
+  }
+
+  // quic::QuicPacketWriter
+  quic::WriteResult WritePacket(const char* buffer,
+                                size_t buf_len,
+                                const quic::QuicIpAddress& self_address,
+                                const quic::QuicSocketAddress& peer_address,
+                                quic::PerPacketOptions* options) override {
+    if (tx_queue_.capacity() - tx_queue_.bytes_queued() < buf_len) {
+      write_blocked_ = true;
+      return quic::WriteResult(quic::WRITE_STATUS_BLOCKED, 0);
+    }
+
+    auto packet = std::make_unique<simulator::Packet>();
+    packet->source = name_;
+    packet->destination = peer_name_;
+    packet->tx_timestamp = clock_->Now();
+    packet->contents = std::string(buffer, buf_len);
+    packet->size = buf_len;
+    tx_queue_.AcceptPacket(std::move(packet));
+    return quic::WriteResult(quic::WRITE_STATUS_OK, buf_len);
+  }
+
+  bool IsWriteBlocked() const override { return write_blocked_; }
+
+  void SetWritable() override { write_blocked_ = false; }
+
+  quic::QuicByteCount GetMaxPacketSize(
+      const quic::QuicSocketAddress& peer_address) const override {
+    return quic::kMaxOutgoingPacketSize;
+  }
+
+  bool SupportsReleaseTime() const override { return false; }
+
+  bool IsBatchMode() const override { return false; }
+
+  char* GetNextWriteLocation(
+      const quic::QuicIpAddress& self_address,
+      const quic::QuicSocketAddress& peer_address) override {
+    return nullptr;
+  }
+
+  quic::WriteResult Flush() override {
+    return quic::WriteResult(quic::WRITE_STATUS_OK, 0);
+  }
+
+ private:
+  std::string peer_name_;
+  simulator::Queue tx_queue_;
+  quic::QuicConnection* connection_ = nullptr;
+  net::RawQuicSession* session_ = nullptr;
+  bool write_blocked_ = false;
+};
+
+/////////////////////////////////////Impairment/////////////////////////////////////
+// Sits in front of an endpoint's receive port, drops or holds back packets
+// arriving for it.
+class Impairment : public simulator::Endpoint,
+                   public simulator::UnconstrainedPortInterface {
+ public:
+  Impairment(simulator::Simulator* simulator,
+             const std::string& name,
+             simulator::Endpoint* endpoint,
+             const Case& c,
+             std::mt19937* random)
+      : Endpoint(simulator, name),
+        endpoint_(endpoint),
+        loss_(c.loss_percent / 100),
+        reorder_(c.reorder_percent / 100),
+        reorder_delay_(
+            quic::QuicTime::Delta::FromMilliseconds(c.reorder_delay_ms)),
+        random_(random) {}
+
+  uint64_t dropped() const { return dropped_; }
+
+  uint64_t reordered() const { return reordered_; }
+
+  // simulator::Endpoint
+  simulator::UnconstrainedPortInterface* GetRxPort() override { return this; }
+
+  void SetTxPort(simulator::ConstrainedPortInterface* port) override {
+    endpoint_->SetTxPort(port);
+  }
+
+  // Delivers held packets which are due.
+  void Act() override {
+    while (!held_.empty() && held_.front().first <= clock_->Now()) {
+      endpoint_->GetRxPort()->AcceptPacket(std::move(held_.front().second));
+      held_.pop_front();
+    }
+    if (!held_.empty()) {
+      Schedule(held_.front().first);
+    }
+  }
+
+  // simulator::UnconstrainedPortInterface
+  void AcceptPacket(std::unique_ptr<simulator::Packet> packet) override {
+    double draw = distribution_(*random_);
+    if (draw < loss_) {
+      ++dropped_;
+      return;
+    }
+
+    if (draw < loss_ + reorder_) {
+      ++reordered_;
+      held_.emplace_back(clock_->Now() + reorder_delay_, std::move(packet));
+      if (held_.size() == 1) {
+        Schedule(held_.front().first);
+      }
+      return;
+    }
+    endpoint_->GetRxPort()->AcceptPacket(std::move(packet));
+  }
+
+ private:
+  simulator::Endpoint* endpoint_ = nullptr;
+  double loss_ = 0;
+  double reorder_ = 0;
+  quic::QuicTime::Delta reorder_delay_ = quic::QuicTime::Delta::Zero();
+  std::mt19937* random_ = nullptr;
+  std::uniform_real_distribution<double> distribution_;
+  // Due time, in arrival order as the delay is fixed.
+  std::deque<std::pair<quic::QuicTime, std::unique_ptr<simulator::Packet>>>
+      held_;
+  uint64_t dropped_ = 0;
+  uint64_t reordered_ = 0;
+};
+
+/////////////////////////////////////BenchClient/////////////////////////////////////
+// Application on top of the client session, writes messages on its stream
+// as long as the send window allows.
+class BenchClient : public quic::QuicTransportClientSession::ClientVisitor,
+                    public net::RawQuicSession::TransportObserver {
+ public:
+  BenchClient(const Case& c, simulator::Simulator* simulator)
+      : echo_(c.workload == "echo"),
+        window_(c.send_buffer_size),
+        message_(c.message_size, 'm') {
+    // Acks are processed inside the connection, write after they are done.
+    fill_alarm_.reset(simulator->GetAlarmFactory()->CreateAlarm(
+        new AlarmDelegate(this)));
+  }
+
+  ~BenchClient() override { fill_alarm_->Cancel(); }
+
+  void set_session(net::RawQuicSession* session) { session_ = session; }
+
+  // Bytes acked by the server for upload, echoed back for echo.
+  uint64_t delivered() const { return echo_ ? received_ : acked_; }
+
+  // quic::QuicTransportClientSession::ClientVisitor
+  void OnSessionReady() override {
+    stream_ = session_->OpenOutgoingBidirectionalStream();
+    if (stream_ == nullptr) {
+      return;
+    }
+    stream_->set_visitor(std::make_unique<StreamVisitor>(this));
+    Fill();
+  }
+
+  void OnIncomingBidirectionalStreamAvailable() override {}
+
+  void OnIncomingUnidirectionalStreamAvailable() override {}
+
+  // net::RawQuicSession::TransportObserver
+  void OnCongestionChange(quic::QuicTime now) override {}
+
+  void OnStreamFrameAcked(const quic::QuicStreamFrame& frame,
+                          quic::QuicTime now) override {
+    acked_ = std::max<uint64_t>(acked_, frame.offset + frame.data_length);
+    if (!fill_alarm_->IsSet()) {
+      fill_alarm_->Set(now);
+    }
+  }
+
+ private:
+  class StreamVisitor : public quic::QuicTransportStream::Visitor {
+   public:
+    explicit StreamVisitor(BenchClient* client) : client_(client) {}
+    void OnCanRead() override { client_->OnCanRead(); }
+    void OnFinRead() override {}
+    void OnCanWrite() override { client_->Fill(); }
+
+   private:
+    BenchClient* client_ = nullptr;
+  };
+
+  class AlarmDelegate : public quic::QuicAlarm::Delegate {
+   public:
+    explicit AlarmDelegate(BenchClient* client) : client_(client) {}
+    void OnAlarm() override { client_->Fill(); }
+
+   private:
+    BenchClient* client_ = nullptr;
+  };
+
+  void OnCanRead() {
+    char buffer[32 * 1024];
+    while (size_t read_len = stream_->Read(buffer, sizeof(buffer))) {
+      received_ += read_len;
+    }
+    Fill();
+  }
+
+  void Fill() {
+    if (stream_ == nullptr) {
+      return;
+    }
+
+    quic::QuicConnection::ScopedPacketFlusher flusher(session_->connection());
+    while (written_ - delivered() + message_.size() <= window_ &&
+           stream_->Write(message_)) {
+      written_ += message_.size();
+    }
+  }
+
+  bool echo_ = false;
+  uint64_t window_ = 0;
+  std::string message_;
+  net::RawQuicSession* session_ = nullptr;
+  quic::QuicTransportStream* stream_ = nullptr;
+  std::unique_ptr<quic::QuicAlarm> fill_alarm_;
+  uint64_t written_ = 0;
+  // Highest stream offset acked, holes of lost packets are not deducted.
+  uint64_t acked_ = 0;
+  uint64_t received_ = 0;
+};
+
+bool RunCase(const Case& c,
+             const base::FilePath& cert_path,
+             const base::FilePath& key_path,
+             bench::Report* report) {
+  simulator::Simulator simulator;
+  std::mt19937 random(c.seed);
+  quic::QuicBandwidth bandwidth =
+      quic::QuicBandwidth::FromBitsPerSecond((int64_t)(c.bandwidth_mbps * 1e6));
+  quic::QuicTime::Delta rtt = quic::QuicTime::Delta::FromMilliseconds(c.rtt_ms);
+  quic::QuicTime::Delta link_delay =
+      quic::QuicTime::Delta::FromMicroseconds(rtt.ToMicroseconds() / 4);
+  quic::QuicByteCount queue_bytes =
+      c.queue_bytes > 0 ? c.queue_bytes : bandwidth.ToBytesPerPeriod(rtt);
+
+  SimulatedEndpoint client_endpoint(&simulator, kClientName, kServerName);
+  SimulatedEndpoint server_endpoint(&simulator, kServerName, kClientName);
+  Impairment client_impairment(&simulator, "Client impairment",
+                               &client_endpoint, c, &random);
+  Impairment server_impairment(&simulator, "Server impairment",
+                               &server_endpoint, c, &random);
+  simulator::Switch network_switch(&simulator, "Switch", 8, queue_bytes);
+  simulator::SymmetricLink client_link(&client_impairment,
+                                       network_switch.port(1),
+                                       bandwidth * kAccessLinkSpeedup,
+                                       link_delay);
+  simulator::SymmetricLink server_link(&server_impairment,
+                                       network_switch.port(2), bandwidth,
+                                       link_delay);
+
+  quic::QuicSocketAddress client_address = GetAddress("10.0.0.1", 40000);
+  quic::QuicSocketAddress server_address = GetAddress("10.0.0.2", 443);
+  quic::ParsedQuicVersionVector versions =
+      net::RawQuicSessionPool::GetVersions();
+
+  // Server.
+  auto server_connection = std::make_unique<quic::QuicConnection>(
+      quic::test::TestConnectionId(kConnectionId), client_address, &simulator,
+      simulator.GetAlarmFactory(), &server_endpoint, false /* owns_writer */,
+      quic::Perspective::IS_SERVER, versions);
+  server_connection->SetSelfAddress(server_address);
+  quic::test::QuicConnectionPeer::GetSentPacketManager(server_connection.get())
+      ->SetSendAlgorithm(c.cc_type);
+  server_endpoint.Attach(server_connection.get(), nullptr);
+
+  auto proof_source = std::make_unique<net::ProofSourceChromium>();
+  if (!proof_source->Initialize(cert_path, key_path, base::FilePath())) {
+    fprintf(stderr, "Load certificate failed.\n");
+    return false;
+  }
+  quic::QuicCryptoServerConfig crypto_server_config(
+      quic::QuicCryptoServerConfig::TESTING, quic::QuicRandom::GetInstance(),
+      std::move(proof_source), quic::KeyExchangeSource::Default());
+  quic::QuicCompressedCertsCache compressed_certs_cache(
+      quic::QuicCompressedCertsCache::kQuicCompressedCertsCacheSize);
+  quic::QuicTransportSimpleServerSession server_session(
+      server_connection.get(), false /* owns_connection */, nullptr,
+      net::RawQuicSessionPool::DefaultQuicConfig(), versions,
+      &crypto_server_config, &compressed_certs_cache,
+      {url::Origin::Create(GURL("https://localhost"))});
+  server_session.Initialize();
+
+  // Client.
+  auto client_connection = std::make_unique<quic::QuicConnection>(
+      quic::test::TestConnectionId(kConnectionId), server_address, &simulator,
+      simulator.GetAlarmFactory(), &client_endpoint, false /* owns_writer */,
+      quic::Perspective::IS_CLIENT, versions);
+  client_connection->SetSelfAddress(client_address);
+  quic::QuicConnection* connection = client_connection.get();
+  quic::test::QuicConnectionPeer::GetSentPacketManager(connection)
+      ->SetSendAlgorithm(c.cc_type);
+
+  BenchClient client(c, &simulator);
+  const char* path = c.workload == "echo" ? "echo" : "discard";
+  quic::QuicCryptoClientConfig crypto_config(
+      std::make_unique<quic::FakeProofVerifier>());
+  // The simulator clock is only read through const methods.
+  net::RawQuicSession session(
+      std::move(client_connection), nullptr,
+      const_cast<quic::QuicClock*>(simulator.GetClock()), nullptr,
+      net::RawQuicSessionPool::DefaultQuicConfig(), versions,
+      GURL(std::string("quic-transport://localhost:443/") + path),
+      &crypto_config, url::Origin::Create(GURL("https://localhost")),
+      &client);
+  client.set_session(&session);
+  session.set_transport_observer(&client);
+  client_endpoint.Attach(connection, &session);
+
+  Clock::time_point wall_start = Clock::now();
+  session.Initialize();
+  session.CryptoConnect();
+  bool failed = !simulator.RunUntilOrTimeout(
+      [&session] { return session.IsSessionReady(); },
+      quic::QuicTime::Delta::FromSeconds(kHandshakeTimeoutSeconds));
+
+  uint64_t delivered = client.delivered();
+  quic::QuicTime start = simulator.GetClock()->Now();
+  if (!failed) {
+    simulator.RunFor(quic::QuicTime::Delta::FromSeconds(c.seconds));
+  }
+  double simulated_seconds =
+      (simulator.GetClock()->Now() - start).ToMicroseconds() / 1e6;
+  double wall_seconds = bench::ElapsedSeconds(wall_start);
+  delivered = client.delivered() - delivered;
+  failed = failed || !connection->connected();
+
+  const quic::QuicConnectionStats& stats = connection->GetStats();
+  double goodput_mbps =
+      simulated_seconds > 0 ? delivered * 8 / simulated_seconds / 1e6 : 0;
+  fprintf(stderr,
+          "%-7s cc %-6s %6.1fMbps rtt %4lldms loss %5.2f%% reorder %5.2f%% "
+          "queue %-8u %8.2f Mbps goodput %7.1fx realtime %s\n",
+          c.workload.c_str(), c.cc.c_str(), c.bandwidth_mbps,
+          (long long)c.rtt_ms, c.loss_percent, c.reorder_percent,
+          (uint32_t)queue_bytes, goodput_mbps,
+          wall_seconds > 0 ? simulated_seconds / wall_seconds : 0,
+          failed ? "FAILED" : "");
+
+  report->BeginResult();
+  report->Add("workload", c.workload);
+  report->Add("cc", c.cc);
+  report->Add("bandwidth_mbps", c.bandwidth_mbps);
+  report->Add("rtt_ms", (uint64_t)c.rtt_ms);
+  report->Add("loss_percent", c.loss_percent);
+  report->Add("reorder_percent", c.reorder_percent);
+  report->Add("reorder_delay_ms", (uint64_t)c.reorder_delay_ms);
+  report->Add("queue_bytes", (uint64_t)queue_bytes);
+  report->Add("send_buffer_size", (uint64_t)c.send_buffer_size);
+  report->Add("message_size", (uint64_t)c.message_size);
+  report->Add("seed", (uint64_t)c.seed);
+  report->Add("simulated_seconds", simulated_seconds);
+  report->Add("wall_seconds", wall_seconds);
+  report->Add("bytes", delivered);
+  report->Add("goodput_mbps", goodput_mbps);
+  report->Add("packets_sent", (uint64_t)stats.packets_sent);
+  report->Add("packets_lost", (uint64_t)stats.packets_lost);
+  report->Add("packets_retransmitted", (uint64_t)stats.packets_retransmitted);
+  report->Add("packets_dropped_by_network",
+              client_impairment.dropped() + server_impairment.dropped());
+  report->Add("packets_reordered_by_network",
+              client_impairment.reordered() + server_impairment.reordered());
+  report->Add("srtt_us", (uint64_t)stats.srtt_us);
+  report->Add("min_rtt_us", (uint64_t)stats.min_rtt_us);
+  report->Add("failed", (uint64_t)(failed ? 1 : 0));
+  report->EndResult();
+
+  connection->CloseConnection(quic::QUIC_NO_ERROR, "Done.",
+                              quic::ConnectionCloseBehavior::SILENT_CLOSE);
+  return !failed;
+}
+
+bool ParseCongestionControl(const std::string& name,
+                            quic::CongestionControlType* type) {
+  if (name == "cubic") {
+    *type = quic::kCubicBytes;
+  } else if (name == "reno") {
+    *type = quic::kRenoBytes;
+  } else if (name == "bbr") {
+    *type = quic::kBBR;
+  } else if (name == "bbrv2") {
+    *type = quic::kBBRv2;
+  } else {
+    return false;
+  }
+  return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager exit_manager;
+
+  std::string workload = bench::GetFlag(argc, argv, "workload", "upload");
+  std::vector<std::string> ccs =
+      bench::ParseNames(bench::GetFlag(argc, argv, "cc", "cubic,bbr"));
+  std::vector<std::string> losses =
+      bench::ParseNames(bench::GetFlag(argc, argv, "loss", "0,1"));
+  std::vector<uint32_t> queues =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "queues", "0"));
+  const char* json = bench::GetFlag(argc, argv, "json", "");
+
+  Case base_case;
+  base_case.workload = workload;
+  base_case.bandwidth_mbps =
+      atof(bench::GetFlag(argc, argv, "bandwidth-mbps", "10"));
+  base_case.rtt_ms = atoi(bench::GetFlag(argc, argv, "rtt-ms", "50"));
+  base_case.reorder_percent = atof(bench::GetFlag(argc, argv, "reorder", "0"));
+  base_case.reorder_delay_ms =
+      atoi(bench::GetFlag(argc, argv, "reorder-delay-ms", "5"));
+  std::vector<uint32_t> send_buffer =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "send-buffer", "4M"));
+  std::vector<uint32_t> message_size =
+      bench::ParseSizes(bench::GetFlag(argc, argv, "message-size", "16K"));
+  base_case.send_buffer_size = send_buffer.empty() ? 0 : send_buffer[0];
+  base_case.message_size = message_size.empty() ? 0 : message_size[0];
+  base_case.seconds = atoi(bench::GetFlag(argc, argv, "seconds", "30"));
+  base_case.seed = (uint32_t)atoi(bench::GetFlag(argc, argv, "seed", "1"));
+  if ((workload != "upload" && workload != "echo") ||
+      base_case.bandwidth_mbps <= 0 || base_case.rtt_ms < 4 ||
+      base_case.message_size == 0 ||
+      base_case.message_size > base_case.send_buffer_size) {
+    fprintf(stderr,
+            "Invalid flags, see the header of raw_quic_simulator_bench.cpp.\n");
+    return 1;
+  }
+
+  // Generated once, every case loads it into its own server config.
+  base::ScopedTempDir temp_dir;
+  base::FilePath cert_path;
+  base::FilePath key_path;
+  if (!temp_dir.CreateUniqueTempDir() ||
+      !GenerateCertificate(temp_dir.GetPath(), &cert_path, &key_path)) {
+    fprintf(stderr, "Generate certificate failed.\n");
+    return 1;
+  }
+
+  bench::Report report("rawquic_simulator_bench");
+  bool passed = true;
+  for (const std::string& cc : ccs) {
+    for (const std::string& loss : losses) {
+      for (uint32_t queue : queues) {
+        Case c = base_case;
+        c.cc = cc;
+        if (!ParseCongestionControl(cc, &c.cc_type)) {
+          fprintf(stderr, "Unknown congestion control %s.\n", cc.c_str());
+          return 1;
+        }
+        c.loss_percent = atof(loss.c_str());
+        c.queue_bytes = queue;
+        passed = RunCase(c, cert_path, key_path, &report) && passed;
+      }
+    }
+  }
+
+  if (!report.Write(json)) {
+    return 1;
+  }
+  return passed ? 0 : 1;
+}
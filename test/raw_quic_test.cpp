@@ -33,6 +33,7 @@ void TestCanReadCallback(RawQuicHandle handle, uint32_t size, void* opaque) {
 
 int main(int argc, char** argv) {
   RawQuicCallbacks callbacks;
+  memset(&callbacks, 0, sizeof(callbacks));
   callbacks.connect_callback = TestConnectCallback;
   callbacks.error_callback = TestErrorCallback;
   callbacks.can_read_callback = TestCanReadCallback;
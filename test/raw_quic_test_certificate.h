@@ -0,0 +1,72 @@
+// Self-signed certificate generated at run time for the test server and the
+// simulator benchmark, so neither needs certificate files. Clients must not
+// verify it.
+
+#ifndef RAW_QUIC_TEST_CERTIFICATE_H_
+#define RAW_QUIC_TEST_CERTIFICATE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/files/file_path.h"
+#include "base/files/file_util.h"
+#include "base/time/time.h"
+#include "crypto/rsa_private_key.h"
+#include "net/cert/x509_certificate.h"
+#include "net/cert/x509_util.h"
+#include "net/quic/crypto/proof_source_chromium.h"
+
+// Writes a new key and certificate into dir, in the formats
+// ProofSourceChromium reads: PEM certificate and PKCS#8 DER key.
+inline bool GenerateCertificate(const base::FilePath& dir,
+                                base::FilePath* cert_path,
+                                base::FilePath* key_path) {
+  // Short lived, only this process uses it.
+  const int kCertificateValidDays = 7;
+
+  std::unique_ptr<crypto::RSAPrivateKey> key;
+  std::string der_cert;
+  base::Time now = base::Time::Now();
+  if (!net::x509_util::CreateKeyAndSelfSignedCert(
+          "CN=localhost", 1, now - base::TimeDelta::FromDays(1),
+          now + base::TimeDelta::FromDays(kCertificateValidDays), &key,
+          &der_cert)) {
+    return false;
+  }
+
+  std::string pem_cert;
+  if (!net::X509Certificate::GetPEMEncodedFromDER(der_cert, &pem_cert)) {
+    return false;
+  }
+
+  std::vector<uint8_t> key_info;
+  if (!key->ExportPrivateKey(&key_info)) {
+    return false;
+  }
+
+  *cert_path = dir.AppendASCII("cert.pem");
+  *key_path = dir.AppendASCII("key.pkcs8");
+  return base::WriteFile(*cert_path, pem_cert.data(), pem_cert.size()) ==
+             (int)pem_cert.size() &&
+         base::WriteFile(*key_path, (const char*)key_info.data(),
+                         key_info.size()) == (int)key_info.size();
+}
+
+// Proof source over a certificate generated into dir, or nullptr.
+inline std::unique_ptr<net::ProofSourceChromium> CreateTestProofSource(
+    const base::FilePath& dir) {
+  base::FilePath cert_path;
+  base::FilePath key_path;
+  if (!GenerateCertificate(dir, &cert_path, &key_path)) {
+    return nullptr;
+  }
+
+  auto proof_source = std::make_unique<net::ProofSourceChromium>();
+  if (!proof_source->Initialize(cert_path, key_path, base::FilePath())) {
+    return nullptr;
+  }
+  return proof_source;
+}
+
+#endif  // RAW_QUIC_TEST_CERTIFICATE_H_
@@ -0,0 +1,190 @@
+// Runs rawquic_test_server as a child process for hermetic tests and
+// benchmarks, no network or certificate files needed. Clients must open
+// handles with verify false, the certificate is self-signed.
+//
+// The server binary is taken from RAW_QUIC_TEST_SERVER, or looked up next
+// to the current program.
+
+#ifndef RAW_QUIC_TEST_SERVER_H_
+#define RAW_QUIC_TEST_SERVER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+class RawQuicTestServer {
+ public:
+  static const uint16_t kDefaultPort = 20557;
+
+  RawQuicTestServer() {}
+  ~RawQuicTestServer() { Stop(); }
+
+  RawQuicTestServer(const RawQuicTestServer&) = delete;
+  RawQuicTestServer& operator=(const RawQuicTestServer&) = delete;
+
+  // argv0 locates the server binary, waits until it is listening.
+  bool Start(const char* argv0, uint16_t port = kDefaultPort) {
+    std::string binary = GetBinaryPath(argv0);
+    std::string port_arg = "--port=" + std::to_string(port);
+    if (!Spawn(binary, port_arg)) {
+      fprintf(stderr, "Start %s failed.\n", binary.c_str());
+      return false;
+    }
+
+    std::string line = ReadLine();
+    if (line.compare(0, 6, "READY ") != 0) {
+      fprintf(stderr, "%s not ready: %s\n", binary.c_str(), line.c_str());
+      Stop();
+      return false;
+    }
+    port_ = port;
+    return true;
+  }
+
+  void Stop() {
+#if defined(_WIN32)
+    if (process_ != NULL) {
+      TerminateProcess(process_, 0);
+      WaitForSingleObject(process_, INFINITE);
+      CloseHandle(process_);
+      process_ = NULL;
+    }
+    if (stdout_read_ != NULL) {
+      CloseHandle(stdout_read_);
+      stdout_read_ = NULL;
+    }
+#else
+    if (pid_ > 0) {
+      kill(pid_, SIGTERM);
+      waitpid(pid_, NULL, 0);
+      pid_ = -1;
+    }
+    if (stdout_read_ >= 0) {
+      close(stdout_read_);
+      stdout_read_ = -1;
+    }
+#endif
+    port_ = 0;
+  }
+
+  const char* host() const { return "127.0.0.1"; }
+
+  uint16_t port() const { return port_; }
+
+ private:
+  static std::string GetBinaryPath(const char* argv0) {
+    const char* env = getenv("RAW_QUIC_TEST_SERVER");
+    if (env != NULL && env[0] != '\0') {
+      return env;
+    }
+
+#if defined(_WIN32)
+    const char* name = "rawquic_test_server.exe";
+#else
+    const char* name = "rawquic_test_server";
+#endif
+    std::string dir = argv0 != NULL ? argv0 : "";
+    size_t slash = dir.find_last_of("/\\");
+    dir = slash == std::string::npos ? "." : dir.substr(0, slash);
+    return dir + "/" + name;
+  }
+
+#if defined(_WIN32)
+  bool Spawn(const std::string& binary, const std::string& port_arg) {
+    SECURITY_ATTRIBUTES attributes = {sizeof(attributes), NULL, TRUE};
+    HANDLE stdout_write = NULL;
+    if (!CreatePipe(&stdout_read_, &stdout_write, &attributes, 0)) {
+      return false;
+    }
+    SetHandleInformation(stdout_read_, HANDLE_FLAG_INHERIT, 0);
+
+    STARTUPINFOA startup_info;
+    memset(&startup_info, 0, sizeof(startup_info));
+    startup_info.cb = sizeof(startup_info);
+    startup_info.dwFlags = STARTF_USESTDHANDLES;
+    startup_info.hStdOutput = stdout_write;
+    startup_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    PROCESS_INFORMATION process_info;
+    std::string command = "\"" + binary + "\" " + port_arg;
+    BOOL created = CreateProcessA(NULL, &command[0], NULL, NULL, TRUE, 0, NULL,
+                                  NULL, &startup_info, &process_info);
+    CloseHandle(stdout_write);
+    if (!created) {
+      return false;
+    }
+    CloseHandle(process_info.hThread);
+    process_ = process_info.hProcess;
+    return true;
+  }
+
+  std::string ReadLine() {
+    std::string line;
+    char c = 0;
+    DWORD read = 0;
+    while (ReadFile(stdout_read_, &c, 1, &read, NULL) && read == 1 &&
+           c != '\n') {
+      line += c;
+    }
+    return line;
+  }
+
+  HANDLE process_ = NULL;
+  HANDLE stdout_read_ = NULL;
+#else
+  bool Spawn(const std::string& binary, const std::string& port_arg) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+      return false;
+    }
+
+    pid_ = fork();
+    if (pid_ < 0) {
+      close(fds[0]);
+      close(fds[1]);
+      return false;
+    }
+
+    if (pid_ == 0) {
+      dup2(fds[1], STDOUT_FILENO);
+      close(fds[0]);
+      close(fds[1]);
+      execl(binary.c_str(), binary.c_str(), port_arg.c_str(), (char*)NULL);
+      _exit(127);
+    }
+
+    close(fds[1]);
+    stdout_read_ = fds[0];
+    return true;
+  }
+
+  // Empty if the server exited before getting ready.
+  std::string ReadLine() {
+    std::string line;
+    char c = 0;
+    while (read(stdout_read_, &c, 1) == 1 && c != '\n') {
+      line += c;
+    }
+    return line;
+  }
+
+  pid_t pid_ = -1;
+  int stdout_read_ = -1;
+#endif
+
+  uint16_t port_ = 0;
+};
+
+#endif  // RAW_QUIC_TEST_SERVER_H_
@@ -0,0 +1,69 @@
+// Loopback QuicTransport server for hermetic tests and benchmarks.
+//
+// Same server as quic_transport_simple_server, paths "/echo" and
+// "/discard", but with a self-signed certificate generated at start, so it
+// needs no files. Prints "READY <port>" once listening, which
+// raw_quic_test_server.h waits for.
+//   rawquic_test_server [--port=20557]
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "base/at_exit.h"
+#include "base/command_line.h"
+#include "base/files/scoped_temp_dir.h"
+#include "base/run_loop.h"
+#include "base/strings/string_number_conversions.h"
+#include "base/task/single_thread_task_executor.h"
+#include "net/tools/quic/quic_transport_simple_server.h"
+#include "raw_quic_test_certificate.h"
+#include "url/gurl.h"
+#include "url/origin.h"
+
+namespace {
+const int kDefaultPort = 20557;
+}  // namespace
+
+int main(int argc, char** argv) {
+  base::AtExitManager exit_manager;
+  base::CommandLine::Init(argc, argv);
+  base::SingleThreadTaskExecutor io_task_executor(base::MessagePumpType::IO);
+
+  int port = kDefaultPort;
+  const base::CommandLine* command_line =
+      base::CommandLine::ForCurrentProcess();
+  if (command_line->HasSwitch("port") &&
+      !base::StringToInt(command_line->GetSwitchValueASCII("port"), &port)) {
+    fprintf(stderr, "Invalid port.\n");
+    return 1;
+  }
+
+  base::ScopedTempDir temp_dir;
+  std::unique_ptr<net::ProofSourceChromium> proof_source;
+  if (temp_dir.CreateUniqueTempDir()) {
+    proof_source = CreateTestProofSource(temp_dir.GetPath());
+  }
+  if (proof_source == nullptr) {
+    fprintf(stderr, "Generate certificate failed.\n");
+    return 1;
+  }
+
+  // RawQuic sends https://<host> as origin.
+  std::vector<url::Origin> accepted_origins = {
+      url::Origin::Create(GURL("https://localhost")),
+      url::Origin::Create(GURL("https://127.0.0.1"))};
+
+  net::QuicTransportSimpleServer server(port, accepted_origins,
+                                        std::move(proof_source));
+  if (server.Start() != EXIT_SUCCESS) {
+    fprintf(stderr, "Listen on port %d failed.\n", port);
+    return 1;
+  }
+
+  printf("READY %d\n", port);
+  fflush(stdout);
+
+  base::RunLoop().Run();
+  return 0;
+}